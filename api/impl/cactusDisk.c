@@ -15,6 +15,7 @@
 #define CACTUS_DISK_NAME_INCREMENT 16384
 #define CACTUS_DISK_BUCKET_NUMBER 65536
 #define CACTUS_DISK_PARAMETER_KEY -100000
+#define CACTUS_DISK_SEQUENCE_CATALOG_KEY -100001
 #define CACTUS_DISK_SEQUENCE_CHUNK_SIZE 500
 
 /*
@@ -22,13 +23,23 @@
  */
 
 void cactusDisk_addMetaSequence(CactusDisk *cactusDisk, MetaSequence *metaSequence) {
-    assert(stSortedSet_search(cactusDisk->metaSequences, metaSequence) == NULL);
-    stSortedSet_insert(cactusDisk->metaSequences, metaSequence);
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_metaSequences)
+#endif
+    {
+        assert(stSortedSet_search(cactusDisk->metaSequences, metaSequence) == NULL);
+        stSortedSet_insert(cactusDisk->metaSequences, metaSequence);
+    }
 }
 
 void cactusDisk_removeMetaSequence(CactusDisk *cactusDisk, MetaSequence *metaSequence) {
-    assert(stSortedSet_search(cactusDisk->metaSequences, metaSequence) != NULL);
-    stSortedSet_remove(cactusDisk->metaSequences, metaSequence);
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_metaSequences)
+#endif
+    {
+        assert(stSortedSet_search(cactusDisk->metaSequences, metaSequence) != NULL);
+        stSortedSet_remove(cactusDisk->metaSequences, metaSequence);
+    }
 }
 
 /*
@@ -347,14 +358,22 @@ char *cactusDisk_getString(CactusDisk *cactusDisk, Name name, int64_t start, int
     if (length == 0) {
         return stString_copy("");
     }
-    //First try getting it from the cache
-    char *string = cactusDisk_getStringFromCache(cactusDisk, name, start, length, strand);
-    if (string == NULL) { //If not in the cache, add it to the cache and then get it from the cache.
-        stList *list = stList_construct3(0, (void (*)(void *)) substring_destruct);
-        stList_append(list, substring_construct(name, start, length));
-        cacheSubstringsFromDB(cactusDisk, list);
-        stList_destruct(list);
+    char *string;
+    //Strings are read by concurrently running aligners (see cactus_bar), so the cache and the
+    //database are only touched by one thread at a time.
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_database)
+#endif
+    {
+        //First try getting it from the cache
         string = cactusDisk_getStringFromCache(cactusDisk, name, start, length, strand);
+        if (string == NULL) { //If not in the cache, add it to the cache and then get it from the cache.
+            stList *list = stList_construct3(0, (void (*)(void *)) substring_destruct);
+            stList_append(list, substring_construct(name, start, length));
+            cacheSubstringsFromDB(cactusDisk, list);
+            stList_destruct(list);
+            string = cactusDisk_getStringFromCache(cactusDisk, name, start, length, strand);
+        }
     }
     assert(string != NULL);
     return string;
@@ -502,6 +521,112 @@ static bool containsRecord(CactusDisk *cactusDisk, Name objectName) {
         || stKVDatabase_containsRecord(cactusDisk->database, objectName);
 }
 
+/*
+ * Functions on the sequence catalog.
+ */
+
+static void loadSequenceCatalog(CactusDisk *cactusDisk) {
+    if (cactusDisk->sequenceCatalog != NULL) {
+        return;
+    }
+    cactusDisk->sequenceCatalog = stSortedSet_construct3(sequenceCatalogEntry_compare,
+            (void (*)(void *)) sequenceCatalogEntry_destruct);
+    void *record = getRecord(cactusDisk, CACTUS_DISK_SEQUENCE_CATALOG_KEY, "sequence catalog", NULL);
+    if (record != NULL) {
+        void *cA = record;
+        int64_t entryNumber = binaryRepresentation_getInteger(&cA);
+        for (int64_t i = 0; i < entryNumber; i++) {
+            SequenceCatalogEntry *entry = sequenceCatalogEntry_loadFromBinaryRepresentation(&cA);
+            assert(entry != NULL);
+            stSortedSet_insert(cactusDisk->sequenceCatalog, entry);
+        }
+        free(record);
+    }
+}
+
+static void writeSequenceCatalog(CactusDisk *cactusDisk,
+        void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+    binaryRepresentation_writeInteger(stSortedSet_size(cactusDisk->sequenceCatalog), writeFn);
+    stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->sequenceCatalog);
+    SequenceCatalogEntry *entry;
+    while ((entry = stSortedSet_getNext(it)) != NULL) {
+        sequenceCatalogEntry_writeBinaryRepresentation(entry, writeFn);
+    }
+    stSortedSet_destructIterator(it);
+}
+
+static SequenceCatalogEntry *getSequenceCatalogEntry(CactusDisk *cactusDisk, Name metaSequenceName) {
+    SequenceCatalogEntry entry;
+    entry.name = metaSequenceName;
+    return stSortedSet_search(cactusDisk->sequenceCatalog, &entry);
+}
+
+static void sequenceCatalogModified(CactusDisk *cactusDisk) {
+    cactusDisk->sequenceCatalogModified = 1;
+    if (cactusDisk->sequenceCatalogHeaders != NULL) {
+        stHash_destruct(cactusDisk->sequenceCatalogHeaders);
+        cactusDisk->sequenceCatalogHeaders = NULL;
+    }
+}
+
+void cactusDisk_updateSequenceCatalog(CactusDisk *cactusDisk, MetaSequence *metaSequence) {
+    loadSequenceCatalog(cactusDisk);
+    SequenceCatalogEntry *entry = getSequenceCatalogEntry(cactusDisk, metaSequence_getName(metaSequence));
+    if (entry == NULL) {
+        stSortedSet_insert(cactusDisk->sequenceCatalog, sequenceCatalogEntry_construct(metaSequence));
+    } else if (strcmp(sequenceCatalogEntry_getHeader(entry), metaSequence_getHeader(metaSequence)) != 0) {
+        sequenceCatalogEntry_setHeader(entry, metaSequence_getHeader(metaSequence));
+    } else {
+        return;
+    }
+    sequenceCatalogModified(cactusDisk);
+}
+
+void cactusDisk_setSequenceCatalogThreadName(CactusDisk *cactusDisk, MetaSequence *metaSequence, Name threadName) {
+    cactusDisk_updateSequenceCatalog(cactusDisk, metaSequence);
+    SequenceCatalogEntry *entry = getSequenceCatalogEntry(cactusDisk, metaSequence_getName(metaSequence));
+    if (sequenceCatalogEntry_getThreadName(entry) != threadName) {
+        sequenceCatalogEntry_setThreadName(entry, threadName);
+        sequenceCatalogModified(cactusDisk);
+    }
+}
+
+stList *cactusDisk_getSequenceCatalog(CactusDisk *cactusDisk) {
+    loadSequenceCatalog(cactusDisk);
+    return stSortedSet_getList(cactusDisk->sequenceCatalog);
+}
+
+stList *cactusDisk_getSequenceCatalogEntriesByName(CactusDisk *cactusDisk, stList *metaSequenceNames) {
+    loadSequenceCatalog(cactusDisk);
+    stList *entries = stList_construct();
+    for (int64_t i = 0; i < stList_length(metaSequenceNames); i++) {
+        stList_append(entries, getSequenceCatalogEntry(cactusDisk, *((int64_t *) stList_get(metaSequenceNames, i))));
+    }
+    return entries;
+}
+
+stList *cactusDisk_getSequenceCatalogEntriesByHeader(CactusDisk *cactusDisk, stList *headers) {
+    loadSequenceCatalog(cactusDisk);
+    if (cactusDisk->sequenceCatalogHeaders == NULL) {
+        //Entries are visited in order of name, so where headers are shared the entry with the least name is kept.
+        cactusDisk->sequenceCatalogHeaders = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, NULL, NULL);
+        stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->sequenceCatalog);
+        SequenceCatalogEntry *entry;
+        while ((entry = stSortedSet_getNext(it)) != NULL) {
+            char *header = (char *) sequenceCatalogEntry_getHeader(entry);
+            if (stHash_search(cactusDisk->sequenceCatalogHeaders, header) == NULL) {
+                stHash_insert(cactusDisk->sequenceCatalogHeaders, header, entry);
+            }
+        }
+        stSortedSet_destructIterator(it);
+    }
+    stList *entries = stList_construct();
+    for (int64_t i = 0; i < stList_length(headers); i++) {
+        stList_append(entries, stHash_search(cactusDisk->sequenceCatalogHeaders, stList_get(headers, i)));
+    }
+    return entries;
+}
+
 static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool create, bool cache) {
     CactusDisk *cactusDisk = st_calloc(1, sizeof(CactusDisk));
 
@@ -566,6 +691,13 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
     }
     stSortedSet_destruct(cactusDisk->metaSequences);
 
+    if (cactusDisk->sequenceCatalogHeaders != NULL) {
+        stHash_destruct(cactusDisk->sequenceCatalogHeaders);
+    }
+    if (cactusDisk->sequenceCatalog != NULL) {
+        stSortedSet_destruct(cactusDisk->sequenceCatalog);
+    }
+
     //close DB
     stKVDatabase_destruct(cactusDisk->database);
 
@@ -589,18 +721,25 @@ void cactusDisk_addUpdateRequest(CactusDisk *cactusDisk, Flower *flower) {
     //Compression
     int64_t compressedSize;
     void *compressed = stCompression_compress(vA, recordSize, &compressedSize, -1);
-    if (containsRecord(cactusDisk, flower_getName(flower))) {
-        // Check if this is a redundant update.
-        int64_t recordSize2;
-        void *vA2 = getRecord(cactusDisk, flower_getName(flower), "flower", &recordSize2);
-        if (!stCache_recordsIdentical(vA, recordSize, vA2, recordSize2)) { //Only rewrite if we actually did something
+    //Flowers may be serialised by concurrently running threads (see cactus_reference), so only the comparison with
+    //the stored record and the queueing of the request are done one thread at a time.
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_database)
+#endif
+    {
+        if (containsRecord(cactusDisk, flower_getName(flower))) {
+            // Check if this is a redundant update.
+            int64_t recordSize2;
+            void *vA2 = getRecord(cactusDisk, flower_getName(flower), "flower", &recordSize2);
+            if (!stCache_recordsIdentical(vA, recordSize, vA2, recordSize2)) { //Only rewrite if we actually did something
+                stList_append(cactusDisk->updateRequests,
+                        stKVDatabaseBulkRequest_constructUpdateRequest(flower_getName(flower), compressed, compressedSize));
+            }
+            free(vA2);
+        } else {
             stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructUpdateRequest(flower_getName(flower), compressed, compressedSize));
+                    stKVDatabaseBulkRequest_constructInsertRequest(flower_getName(flower), compressed, compressedSize));
         }
-        free(vA2);
-    } else {
-        stList_append(cactusDisk->updateRequests,
-                stKVDatabaseBulkRequest_constructInsertRequest(flower_getName(flower), compressed, compressedSize));
     }
     free(vA);
     free(compressed);
@@ -670,6 +809,7 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
         if (!containsRecord(cactusDisk, metaSequence_getName(metaSequence))) {
             stList_append(cactusDisk->updateRequests,
                     stKVDatabaseBulkRequest_constructInsertRequest(metaSequence_getName(metaSequence), vA, recordSize));
+            cactusDisk_updateSequenceCatalog(cactusDisk, metaSequence);
         } else {
             stList_append(cactusDisk->updateRequests,
                     stKVDatabaseBulkRequest_constructUpdateRequest(metaSequence_getName(metaSequence), vA, recordSize));
@@ -680,6 +820,26 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
 
     st_logDebug("Got the sequences we are going to add to the database.\n");
 
+    // The catalog is only rewritten if sequences were added or their headers changed, which happens in one process at
+    // a time (cactus_setup, the reference and cactus_stripUniqueIDs), so it is not merged with the stored record.
+    if (cactusDisk->sequenceCatalogModified) {
+        void *vA = binaryRepresentation_makeBinaryRepresentation(cactusDisk,
+                (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) writeSequenceCatalog,
+                &recordSize);
+        vA = compress(vA, &recordSize);
+        if (!containsRecord(cactusDisk, CACTUS_DISK_SEQUENCE_CATALOG_KEY)) {
+            stList_append(cactusDisk->updateRequests,
+                    stKVDatabaseBulkRequest_constructInsertRequest(CACTUS_DISK_SEQUENCE_CATALOG_KEY, vA, recordSize));
+        } else {
+            stList_append(cactusDisk->updateRequests,
+                    stKVDatabaseBulkRequest_constructUpdateRequest(CACTUS_DISK_SEQUENCE_CATALOG_KEY, vA, recordSize));
+        }
+        free(vA);
+        cactusDisk->sequenceCatalogModified = 0;
+    }
+
+    st_logDebug("Got the sequence catalog updates\n");
+
     if (!containsRecord(cactusDisk, CACTUS_DISK_PARAMETER_KEY)) { //We only write the parameters once.
         cactusDisk_forceParameterUpdate(cactusDisk, false);
     }
@@ -732,7 +892,7 @@ stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
     stList *flowers = stList_construct();
     for (int64_t i = 0; i < stList_length(flowerNames); i++) {
         Name flowerName = *((int64_t *) stList_get(flowerNames, i));
-        static Flower flower;
+        Flower flower;
         flower.name = flowerName;
         Flower *flower2;
         if ((flower2 = stSortedSet_search(cactusDisk->flowers, &flower)) == NULL) {
@@ -748,31 +908,54 @@ stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
     return flowers;
 }
 
-Flower *cactusDisk_getFlower(CactusDisk *cactusDisk, Name flowerName) {
-    static Flower flower;
+static Flower *getLoadedFlower(CactusDisk *cactusDisk, Name flowerName) {
+    Flower flower;
     flower.name = flowerName;
     Flower *flower2;
-    if ((flower2 = stSortedSet_search(cactusDisk->flowers, &flower)) != NULL) {
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_flowers)
+#endif
+    flower2 = stSortedSet_search(cactusDisk->flowers, &flower);
+    return flower2;
+}
+
+Flower *cactusDisk_getFlower(CactusDisk *cactusDisk, Name flowerName) {
+    Flower *flower2 = getLoadedFlower(cactusDisk, flowerName);
+    if (flower2 != NULL) {
         return flower2;
     }
-    void *cA = getRecord(cactusDisk, flowerName, "flower", NULL);
-
-    if (cA == NULL) {
-        return NULL;
+    //Flowers may be loaded by concurrently running threads (see cactus_reference). Loading reads the database,
+    //so is done one thread at a time, checking again in case another thread loaded the flower first.
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_database)
+#endif
+    {
+        flower2 = getLoadedFlower(cactusDisk, flowerName);
+        if (flower2 == NULL) {
+            void *cA = getRecord(cactusDisk, flowerName, "flower", NULL);
+            if (cA != NULL) {
+                void *cA2 = cA;
+                flower2 = flower_loadFromBinaryRepresentation(&cA2, cactusDisk);
+                free(cA);
+            }
+        }
     }
-    void *cA2 = cA;
-    flower2 = flower_loadFromBinaryRepresentation(&cA2, cactusDisk);
-    free(cA);
     return flower2;
 }
 
 MetaSequence *cactusDisk_getMetaSequence(CactusDisk *cactusDisk, Name metaSequenceName) {
-    static MetaSequence metaSequence;
+    MetaSequence metaSequence;
     metaSequence.name = metaSequenceName;
     MetaSequence *metaSequence2;
-    if ((metaSequence2 = stSortedSet_search(cactusDisk->metaSequences, &metaSequence)) != NULL) {
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_metaSequences)
+#endif
+    metaSequence2 = stSortedSet_search(cactusDisk->metaSequences, &metaSequence);
+    if (metaSequence2 != NULL) {
         return metaSequence2;
     }
+    //Meta sequences are only loaded while loading the flowers that contain them, which cactusDisk_getFlower does
+    //one thread at a time, so threads working on loaded flowers always find them above.
     void *cA = getRecord(cactusDisk, metaSequenceName, "metaSequence", NULL);
     if (cA == NULL) {
         return NULL;
@@ -783,23 +966,60 @@ MetaSequence *cactusDisk_getMetaSequence(CactusDisk *cactusDisk, Name metaSequen
     return metaSequence2;
 }
 
+stList *cactusDisk_getMetaSequences(CactusDisk *cactusDisk, stList *metaSequenceNames) {
+    //Only the meta sequences not already in memory are loaded, as those constructed since the last write are not yet
+    //in the database.
+    MetaSequence metaSequence;
+    stList *namesToLoad = stList_construct();
+    for (int64_t i = 0; i < stList_length(metaSequenceNames); i++) {
+        metaSequence.name = *((int64_t *) stList_get(metaSequenceNames, i));
+        if (stSortedSet_search(cactusDisk->metaSequences, &metaSequence) == NULL) {
+            stList_append(namesToLoad, stList_get(metaSequenceNames, i));
+        }
+    }
+    stList *records = getRecords(cactusDisk, namesToLoad, "metaSequences");
+    assert(stList_length(namesToLoad) == stList_length(records));
+    for (int64_t i = 0; i < stList_length(records); i++) {
+        void *cA = stList_get(records, i);
+        MetaSequence *metaSequence2 = metaSequence_loadFromBinaryRepresentation(&cA, cactusDisk);
+        (void) metaSequence2;
+        assert(metaSequence2 != NULL);
+    }
+    stList_destruct(records);
+    stList_destruct(namesToLoad);
+    stList *metaSequences = stList_construct();
+    for (int64_t i = 0; i < stList_length(metaSequenceNames); i++) {
+        metaSequence.name = *((int64_t *) stList_get(metaSequenceNames, i));
+        MetaSequence *metaSequence2 = stSortedSet_search(cactusDisk->metaSequences, &metaSequence);
+        assert(metaSequence2 != NULL);
+        stList_append(metaSequences, metaSequence2);
+    }
+    return metaSequences;
+}
+
 /*
  * Private functions.
  */
 
 bool cactusDisk_flowerIsLoaded(CactusDisk *cactusDisk, Name flowerName) {
-    static Flower flower;
-    flower.name = flowerName;
-    return stSortedSet_search(cactusDisk->flowers, &flower) != NULL;
+    return getLoadedFlower(cactusDisk, flowerName) != NULL;
 }
 
 void cactusDisk_addFlower(CactusDisk *cactusDisk, Flower *flower) {
-    assert(stSortedSet_search(cactusDisk->flowers, flower) == NULL);
-    stSortedSet_insert(cactusDisk->flowers, flower);
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_flowers)
+#endif
+    {
+        assert(stSortedSet_search(cactusDisk->flowers, flower) == NULL);
+        stSortedSet_insert(cactusDisk->flowers, flower);
+    }
 }
 
 void cactusDisk_removeFlower(CactusDisk *cactusDisk, Flower *flower) {
     assert(cactusDisk_flowerIsLoaded(cactusDisk, flower_getName(flower)));
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_flowers)
+#endif
     stSortedSet_remove(cactusDisk->flowers, flower);
 }
 
@@ -889,12 +1109,23 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
 }
 
 int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize) {
-    assert(cactusDisk->uniqueNumber <= cactusDisk->maxUniqueNumber);
-    if (cactusDisk->uniqueNumber + intervalSize > cactusDisk->maxUniqueNumber) {
-        cactusDisk_getBlockOfUniqueIDs(cactusDisk, intervalSize);
+    Name uniqueNumber;
+    //Objects may be constructed by concurrently running threads (see cactus_reference).
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_uniqueID)
+#endif
+    {
+        assert(cactusDisk->uniqueNumber <= cactusDisk->maxUniqueNumber);
+        if (cactusDisk->uniqueNumber + intervalSize > cactusDisk->maxUniqueNumber) {
+            //Shares the database connection with cactusDisk_getString.
+#if defined(_OPENMP)
+#pragma omp critical(cactusDisk_database)
+#endif
+            cactusDisk_getBlockOfUniqueIDs(cactusDisk, intervalSize);
+        }
+        uniqueNumber = cactusDisk->uniqueNumber;
+        cactusDisk->uniqueNumber += intervalSize;
     }
-    Name uniqueNumber = cactusDisk->uniqueNumber;
-    cactusDisk->uniqueNumber += intervalSize;
     return uniqueNumber;
 }
 
@@ -20,6 +20,9 @@ struct _cactusDisk {
     EventTree *eventTree;
     Name uniqueNumber;
     Name maxUniqueNumber;
+    stSortedSet *sequenceCatalog; //Loaded on first use.
+    stHash *sequenceCatalogHeaders; //Built on first lookup by header, discarded when the catalog changes.
+    bool sequenceCatalogModified;
 };
 
 ////////////////////////////////////////////////
@@ -68,6 +71,11 @@ void cactusDisk_removeMetaSequence(CactusDisk *cactusDisk,
 
 bool cactusDisk_storedInFile(CactusDisk *cactusDisk);
 
+/*
+ * Records the meta sequence in the sequence catalog, or updates its header if it is already there.
+ */
+void cactusDisk_updateSequenceCatalog(CactusDisk *cactusDisk, MetaSequence *metaSequence);
+
 
 
 /*
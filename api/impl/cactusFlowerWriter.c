@@ -179,6 +179,7 @@ static FlowerStream *flowerStream_construct(stList *flowerNames, CactusDisk *cac
     ret->flowerNames = flowerNames;
     ret->flowerBatch = stList_construct();
     ret->curFlower = NULL;
+    ret->curBatch = NULL;
     ret->nextIdx = 0;
     ret->cactusDisk = cactusDisk;
     return ret;
@@ -189,48 +190,77 @@ FlowerStream *flowerWriter_getFlowerStream(CactusDisk *cactusDisk, FILE *file) {
     return flowerStream_construct(flowerNamesList, cactusDisk);
 }
 
-void flowerStream_destruct(FlowerStream *flowerStream) {
+// Unload the flowers previously returned by the stream.
+static void flowerStream_unloadCurrent(FlowerStream *flowerStream) {
     if (flowerStream->curFlower != NULL) {
         flower_destruct(flowerStream->curFlower, false);
+        flowerStream->curFlower = NULL;
+    }
+    if (flowerStream->curBatch != NULL) {
+        while (stList_length(flowerStream->curBatch) > 0) {
+            flower_destruct(stList_pop(flowerStream->curBatch), false);
+        }
+        stList_destruct(flowerStream->curBatch);
+        flowerStream->curBatch = NULL;
     }
+}
+
+// Load the next batch of flowers from the DB, if the last batch has
+// been used up.
+static void flowerStream_loadBatch(FlowerStream *flowerStream) {
+    if (stList_length(flowerStream->flowerBatch) > 0) {
+        return;
+    }
+    // Get the next batch of names.
+    int64_t batchStart = flowerStream->nextIdx;
+    int64_t batchEnd = flowerStream->nextIdx + FLOWER_STREAM_BATCH_SIZE;
+    if (batchEnd > stList_length(flowerStream->flowerNames)) {
+        batchEnd = stList_length(flowerStream->flowerNames);
+    }
+    stList *namesBatch = stList_construct2(batchEnd - batchStart);
+    for (int64_t i = batchStart; i < batchEnd; i++) {
+        stList_set(namesBatch, i - batchStart, stList_get(flowerStream->flowerNames, i));
+    }
+    // We want to be able to treat the batch like a stack and get
+    // the same order, so we reverse it.
+    stList_reverse(namesBatch);
+    stList_destruct(flowerStream->flowerBatch);
+    flowerStream->flowerBatch = cactusDisk_getFlowers(flowerStream->cactusDisk, namesBatch);
+    stList_destruct(namesBatch);
+}
+
+void flowerStream_destruct(FlowerStream *flowerStream) {
+    flowerStream_unloadCurrent(flowerStream);
     stList_destruct(flowerStream->flowerBatch);
     stList_destruct(flowerStream->flowerNames);
     free(flowerStream);
 }
 
 Flower *flowerStream_getNext(FlowerStream *flowerStream) {
-    if (flowerStream->curFlower != NULL) {
-        // Unload the previously loaded flower.
-        flower_destruct(flowerStream->curFlower, false);
-    }
+    flowerStream_unloadCurrent(flowerStream);
     if (flowerStream->nextIdx >= stList_length(flowerStream->flowerNames)) {
-        flowerStream->curFlower = NULL;
         return NULL;
     }
-    if (stList_length(flowerStream->flowerBatch) == 0) {
-        // Time to load the next batch of flowers from the DB.
-        // Get the next batch of names.
-        int64_t batchStart = flowerStream->nextIdx;
-        int64_t batchEnd = flowerStream->nextIdx + FLOWER_STREAM_BATCH_SIZE;
-        if (batchEnd > stList_length(flowerStream->flowerNames)) {
-            batchEnd = stList_length(flowerStream->flowerNames);
-        }
-        stList *namesBatch = stList_construct2(batchEnd - batchStart);
-        for (int64_t i = batchStart; i < batchEnd; i++) {
-            stList_set(namesBatch, i - batchStart, stList_get(flowerStream->flowerNames, i));
-        }
-        // We want to be able to treat the batch like a stack and get
-        // the same order, so we reverse it.
-        stList_reverse(namesBatch);
-        stList_destruct(flowerStream->flowerBatch);
-        flowerStream->flowerBatch = cactusDisk_getFlowers(flowerStream->cactusDisk, namesBatch);
-        stList_destruct(namesBatch);
-    }
+    flowerStream_loadBatch(flowerStream);
     flowerStream->curFlower = stList_pop(flowerStream->flowerBatch);
     flowerStream->nextIdx++;
     return flowerStream->curFlower;
 }
 
+stList *flowerStream_getNextBatch(FlowerStream *flowerStream) {
+    flowerStream_unloadCurrent(flowerStream);
+    if (flowerStream->nextIdx >= stList_length(flowerStream->flowerNames)) {
+        return NULL;
+    }
+    flowerStream_loadBatch(flowerStream);
+    // Hand out whatever is left of the batch, back in stream order.
+    flowerStream->curBatch = flowerStream->flowerBatch;
+    stList_reverse(flowerStream->curBatch);
+    flowerStream->flowerBatch = stList_construct();
+    flowerStream->nextIdx += stList_length(flowerStream->curBatch);
+    return flowerStream->curBatch;
+}
+
 int64_t flowerStream_size(const FlowerStream *flowerStream) {
     return stList_length(flowerStream->flowerNames);
 }
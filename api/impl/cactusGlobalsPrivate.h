@@ -46,6 +46,8 @@
 #include "cactusLinkPrivate.h"
 #include "cactusMetaSequence.h"
 #include "cactusMetaSequencePrivate.h"
+#include "cactusSequenceCatalog.h"
+#include "cactusSequenceCatalogPrivate.h"
 #include "cactusFlower.h"
 #include "cactusDisk.h"
 #include "cactusDiskPrivate.h"
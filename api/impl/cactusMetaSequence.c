@@ -91,6 +91,7 @@ void metaSequence_setHeader(MetaSequence *metaSequence,
                             char *newHeader) {
 	free(metaSequence->header);
 	metaSequence->header = newHeader;
+	cactusDisk_updateSequenceCatalog(metaSequence->cactusDisk, metaSequence);
 }
 
 /*
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Sequence catalog entry functions.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static SequenceCatalogEntry *sequenceCatalogEntry_construct2(Name name, int64_t length, Name stringName,
+        const char *header, Name eventName, Name threadName) {
+    SequenceCatalogEntry *entry = st_malloc(sizeof(SequenceCatalogEntry));
+    entry->name = name;
+    entry->length = length;
+    entry->stringName = stringName;
+    entry->header = stString_copy(header);
+    entry->eventName = eventName;
+    entry->threadName = threadName;
+    return entry;
+}
+
+SequenceCatalogEntry *sequenceCatalogEntry_construct(MetaSequence *metaSequence) {
+    return sequenceCatalogEntry_construct2(metaSequence->name, metaSequence->length, metaSequence->stringName,
+            metaSequence->header, metaSequence->eventName, NULL_NAME);
+}
+
+void sequenceCatalogEntry_destruct(SequenceCatalogEntry *entry) {
+    free(entry->header);
+    free(entry);
+}
+
+Name sequenceCatalogEntry_getName(SequenceCatalogEntry *entry) {
+    return entry->name;
+}
+
+const char *sequenceCatalogEntry_getHeader(SequenceCatalogEntry *entry) {
+    return entry->header;
+}
+
+Name sequenceCatalogEntry_getEventName(SequenceCatalogEntry *entry) {
+    return entry->eventName;
+}
+
+int64_t sequenceCatalogEntry_getLength(SequenceCatalogEntry *entry) {
+    return entry->length;
+}
+
+Name sequenceCatalogEntry_getStringName(SequenceCatalogEntry *entry) {
+    return entry->stringName;
+}
+
+Name sequenceCatalogEntry_getThreadName(SequenceCatalogEntry *entry) {
+    return entry->threadName;
+}
+
+void sequenceCatalogEntry_setHeader(SequenceCatalogEntry *entry, const char *header) {
+    free(entry->header);
+    entry->header = stString_copy(header);
+}
+
+void sequenceCatalogEntry_setThreadName(SequenceCatalogEntry *entry, Name threadName) {
+    entry->threadName = threadName;
+}
+
+int sequenceCatalogEntry_compare(const void *o1, const void *o2) {
+    return cactusMisc_nameCompare(((SequenceCatalogEntry *) o1)->name, ((SequenceCatalogEntry *) o2)->name);
+}
+
+/*
+ * Serialisation functions.
+ */
+
+void sequenceCatalogEntry_writeBinaryRepresentation(SequenceCatalogEntry *entry,
+        void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+    binaryRepresentation_writeElementType(CODE_SEQUENCE_CATALOG_ENTRY, writeFn);
+    binaryRepresentation_writeName(entry->name, writeFn);
+    binaryRepresentation_writeInteger(entry->length, writeFn);
+    binaryRepresentation_writeName(entry->eventName, writeFn);
+    binaryRepresentation_writeName(entry->stringName, writeFn);
+    binaryRepresentation_writeName(entry->threadName, writeFn);
+    binaryRepresentation_writeString(entry->header, writeFn);
+}
+
+SequenceCatalogEntry *sequenceCatalogEntry_loadFromBinaryRepresentation(void **binaryString) {
+    SequenceCatalogEntry *entry = NULL;
+    if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_SEQUENCE_CATALOG_ENTRY) {
+        binaryRepresentation_popNextElementType(binaryString);
+        Name name = binaryRepresentation_getName(binaryString);
+        int64_t length = binaryRepresentation_getInteger(binaryString);
+        Name eventName = binaryRepresentation_getName(binaryString);
+        Name stringName = binaryRepresentation_getName(binaryString);
+        Name threadName = binaryRepresentation_getName(binaryString);
+        char *header = binaryRepresentation_getString(binaryString);
+        entry = sequenceCatalogEntry_construct2(name, length, stringName, header, eventName, threadName);
+        free(header);
+    }
+    return entry;
+}
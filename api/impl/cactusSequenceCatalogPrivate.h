@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_SEQUENCE_CATALOG_PRIVATE_H_
+#define CACTUS_SEQUENCE_CATALOG_PRIVATE_H_
+
+#include "cactusGlobals.h"
+
+struct _sequenceCatalogEntry {
+    Name name;
+    Name stringName;
+    int64_t length;
+    Name eventName;
+    Name threadName;
+    char *header;
+};
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Private sequence catalog entry functions.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * Constructs an entry recording the meta sequence, without a thread name.
+ */
+SequenceCatalogEntry *sequenceCatalogEntry_construct(MetaSequence *metaSequence);
+
+void sequenceCatalogEntry_destruct(SequenceCatalogEntry *entry);
+
+/*
+ * Sets the header of the entry.
+ */
+void sequenceCatalogEntry_setHeader(SequenceCatalogEntry *entry, const char *header);
+
+void sequenceCatalogEntry_setThreadName(SequenceCatalogEntry *entry, Name threadName);
+
+/*
+ * Compares entries by name.
+ */
+int sequenceCatalogEntry_compare(const void *o1, const void *o2);
+
+/*
+ * Creates a binary representation of the entry.
+ */
+void sequenceCatalogEntry_writeBinaryRepresentation(SequenceCatalogEntry *entry,
+        void (*writeFn)(const void * ptr, size_t size, size_t count));
+
+/*
+ * Loads an entry from its binary representation, returning NULL if the next element is not an entry.
+ */
+SequenceCatalogEntry *sequenceCatalogEntry_loadFromBinaryRepresentation(void **binaryString);
+
+#endif
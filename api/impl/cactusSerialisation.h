@@ -46,6 +46,7 @@
 #define CODE_PSEUDO_CHROMOSOME 23
 #define CODE_PSEUDO_ADJACENCY 24
 #define CODE_CACTUS_DISK 25
+#define CODE_SEQUENCE_CATALOG_ENTRY 26
 
 /*
  * Writes a code for the element type.
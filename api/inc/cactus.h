@@ -18,6 +18,7 @@
 #include "cactusGlobals.h"
 #include "cactusLink.h"
 #include "cactusMetaSequence.h"
+#include "cactusSequenceCatalog.h"
 #include "cactusFlower.h"
 #include "cactusDisk.h"
 #include "cactusMisc.h"
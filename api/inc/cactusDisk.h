@@ -54,11 +54,13 @@ void cactusDisk_write(CactusDisk *cactusDisk);
 
 /*
  * This is used to serialise a flower before a call to a cactusDisk_write, it is exposed for use in the cactus_caf code.
+ * Different flowers may be serialised by concurrent threads.
  */
 void cactusDisk_addUpdateRequest(CactusDisk *cactusDisk, Flower *flower);
 
 /*
  * Gets a flower the cactusDisk contains. If the flower is not in memory it will be loaded. If not in memory or on disk, returns NULL.
+ * May be called by concurrent threads, which load flowers one at a time.
  */
 Flower *cactusDisk_getFlower(CactusDisk *cactusDisk, Name flowerName);
 
@@ -76,6 +78,41 @@ stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames);
  */
 MetaSequence *cactusDisk_getMetaSequence(CactusDisk *cactusDisk, Name metaSequenceName);
 
+/*
+ * Gets a list of meta sequences for the given list of meta sequence names, loading those not in memory in one
+ * request.
+ */
+stList *cactusDisk_getMetaSequences(CactusDisk *cactusDisk, stList *metaSequenceNames);
+
+/*
+ * Functions on the sequence catalog, a record of the header, name, event, length and string of every meta sequence,
+ * kept in a single record of its own so that sequences can be looked up without loading any flower. Meta sequences
+ * are added to the catalog when they are first written, and their entries are updated when their headers are set
+ * (see cactusSequenceCatalog.h).
+ */
+
+/*
+ * Gets the entries of the catalog, in order of name. The list should be destructed, not the entries.
+ */
+stList *cactusDisk_getSequenceCatalog(CactusDisk *cactusDisk);
+
+/*
+ * Gets a list of the entries of the meta sequences with the given list of names, NULL for a name not in the catalog.
+ */
+stList *cactusDisk_getSequenceCatalogEntriesByName(CactusDisk *cactusDisk, stList *metaSequenceNames);
+
+/*
+ * Gets a list of the entries of the meta sequences with the given list of headers, NULL for a header not in the
+ * catalog. If meta sequences share a header the entry with the least name is returned.
+ */
+stList *cactusDisk_getSequenceCatalogEntriesByHeader(CactusDisk *cactusDisk, stList *headers);
+
+/*
+ * Records the name of the cap that starts the thread of the meta sequence in the top level flower, so that alignments
+ * can be converted to cap names from the catalog.
+ */
+void cactusDisk_setSequenceCatalogThreadName(CactusDisk *cactusDisk, MetaSequence *metaSequence, Name threadName);
+
 /*
  * Precaches all the sequences in a given set of flowers into the cache.
  */
@@ -35,6 +35,7 @@ typedef struct {
     stList *flowerBatch;
     CactusDisk *cactusDisk;
     Flower *curFlower;
+    stList *curBatch;
     size_t nextIdx;
 } FlowerStream;
 
@@ -60,6 +61,15 @@ void flowerStream_destruct(FlowerStream *flowerStream);
  */
 Flower *flowerStream_getNext(FlowerStream *flowerStream);
 
+/*
+ * Get the next batch of flowers, in stream order, or NULL if there
+ * aren't any more in the stream. The flowers of a batch are loaded
+ * together, so can be worked on in parallel. The list belongs to the
+ * stream. NB: every call (or call to flowerStream_getNext) unloads the
+ * flowers previously returned.
+ */
+stList *flowerStream_getNextBatch(FlowerStream *flowerStream);
+
 /*
  * Get the total number of flowers in this flower stream. NB: not
  * affected by your current position within the stream.
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_SEQUENCE_CATALOG_H_
+#define CACTUS_SEQUENCE_CATALOG_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Sequence catalog entry functions.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * An entry of the sequence catalog of the cactus disk, which records the details of a meta sequence, so that it can
+ * be looked up by header or name without loading any flower (see cactusDisk_getSequenceCatalogEntriesByHeader).
+ * Entries belong to the cactus disk.
+ */
+
+/*
+ * Gets the name of the meta sequence.
+ */
+Name sequenceCatalogEntry_getName(SequenceCatalogEntry *entry);
+
+/*
+ * Gets the header line of the meta sequence.
+ */
+const char *sequenceCatalogEntry_getHeader(SequenceCatalogEntry *entry);
+
+/*
+ * Gets the name of the event of the meta sequence.
+ */
+Name sequenceCatalogEntry_getEventName(SequenceCatalogEntry *entry);
+
+/*
+ * Gets the length of the meta sequence.
+ */
+int64_t sequenceCatalogEntry_getLength(SequenceCatalogEntry *entry);
+
+/*
+ * Gets the name of the string of the meta sequence.
+ */
+Name sequenceCatalogEntry_getStringName(SequenceCatalogEntry *entry);
+
+/*
+ * Gets the name of the cap starting the thread of the sequence in the top level flower, or NULL_NAME if it
+ * has not been set (see cactusDisk_setSequenceCatalogThreadName).
+ */
+Name sequenceCatalogEntry_getThreadName(SequenceCatalogEntry *entry);
+
+#endif
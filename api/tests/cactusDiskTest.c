@@ -81,6 +81,73 @@ void testCactusDisk_getMetaSequence(CuTest* testCase) {
     cactusDiskTestTeardown(testCase);
 }
 
+static void checkCatalogEntry(CuTest *testCase, SequenceCatalogEntry *entry, MetaSequence *metaSequence,
+        const char *header, Name threadName) {
+    CuAssertTrue(testCase, entry != NULL);
+    CuAssertTrue(testCase, sequenceCatalogEntry_getName(entry) == metaSequence_getName(metaSequence));
+    CuAssertStrEquals(testCase, header, sequenceCatalogEntry_getHeader(entry));
+    CuAssertTrue(testCase, sequenceCatalogEntry_getEventName(entry) == metaSequence_getEventName(metaSequence));
+    CuAssertTrue(testCase, sequenceCatalogEntry_getLength(entry) == metaSequence_getLength(metaSequence));
+    CuAssertTrue(testCase, sequenceCatalogEntry_getStringName(entry) == metaSequence->stringName);
+    CuAssertTrue(testCase, sequenceCatalogEntry_getThreadName(entry) == threadName);
+}
+
+void testCactusDisk_sequenceCatalog(CuTest* testCase) {
+    cactusDiskTestSetup(testCase);
+    MetaSequence *metaSequence = metaSequence_construct(1, 10, "ACTGACTGAG",
+            "FOO", 10, cactusDisk);
+    MetaSequence *metaSequence2 = metaSequence_construct(2, 5, "CCCCC",
+            "BAR", 11, cactusDisk);
+    cactusDisk_setSequenceCatalogThreadName(cactusDisk, metaSequence, 5);
+    Name name1 = metaSequence_getName(metaSequence);
+    Name name2 = metaSequence_getName(metaSequence2);
+    //the catalog is written with the meta sequences, so is there after reloading the disk.
+    cactusDisk_write(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    stList *entries = cactusDisk_getSequenceCatalog(cactusDisk);
+    CuAssertIntEquals(testCase, 2, stList_length(entries));
+    stList_destruct(entries);
+    stList *headers = stList_construct();
+    stList_append(headers, "BAR");
+    stList_append(headers, "FOO");
+    stList_append(headers, "BAZ");
+    entries = cactusDisk_getSequenceCatalogEntriesByHeader(cactusDisk, headers);
+    CuAssertIntEquals(testCase, 3, stList_length(entries));
+    CuAssertTrue(testCase, stList_get(entries, 2) == NULL);
+    metaSequence = cactusDisk_getMetaSequence(cactusDisk, name1);
+    metaSequence2 = cactusDisk_getMetaSequence(cactusDisk, name2);
+    checkCatalogEntry(testCase, stList_get(entries, 0), metaSequence2, "BAR", NULL_NAME);
+    checkCatalogEntry(testCase, stList_get(entries, 1), metaSequence, "FOO", 5);
+    stList_destruct(entries);
+    stList *names = stList_construct();
+    stList_append(names, &name2);
+    stList_append(names, &name1);
+    entries = cactusDisk_getSequenceCatalogEntriesByName(cactusDisk, names);
+    checkCatalogEntry(testCase, stList_get(entries, 0), metaSequence2, "BAR", NULL_NAME);
+    checkCatalogEntry(testCase, stList_get(entries, 1), metaSequence, "FOO", 5);
+    stList_destruct(entries);
+    //setting a header updates the catalog.
+    metaSequence_setHeader(metaSequence, stString_copy("FOO2"));
+    cactusDisk_write(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    stList_set(headers, 0, "FOO2");
+    entries = cactusDisk_getSequenceCatalogEntriesByHeader(cactusDisk, headers);
+    CuAssertTrue(testCase, stList_get(entries, 1) == NULL);
+    stList *metaSequences = cactusDisk_getMetaSequences(cactusDisk, names);
+    CuAssertIntEquals(testCase, 2, stList_length(metaSequences));
+    metaSequence = stList_get(metaSequences, 1);
+    CuAssertTrue(testCase, metaSequence_getName(metaSequence) == name1);
+    CuAssertStrEquals(testCase, "FOO2", metaSequence_getHeader(metaSequence));
+    checkCatalogEntry(testCase, stList_get(entries, 0), metaSequence, "FOO2", 5);
+    stList_destruct(metaSequences);
+    stList_destruct(entries);
+    stList_destruct(names);
+    stList_destruct(headers);
+    cactusDiskTestTeardown(testCase);
+}
+
 void testCactusDisk_getUniqueID(CuTest* testCase) {
     cactusDiskTestSetup(testCase);
     for (int64_t i = 0; i < 1000000; i++) { //Gets a billion ids, checks we are good.
@@ -139,6 +206,7 @@ CuSuite* cactusDiskTestSuite(void) {
     SUITE_ADD_TEST(suite, testCactusDisk_write);
     SUITE_ADD_TEST(suite, testCactusDisk_getFlower);
     SUITE_ADD_TEST(suite, testCactusDisk_getMetaSequence);
+    SUITE_ADD_TEST(suite, testCactusDisk_sequenceCatalog);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_Unique);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_UniqueIntervals);
@@ -6,11 +6,10 @@
 
 #include "cactusGlobalsPrivate.h"
 
-static void testFlowerStream(CuTest *testCase) {
-    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk(testCase->name);
+// Make three flowers on disk and a file listing them, returning its path.
+static char *writeTestFlowers(CactusDisk *cactusDisk, Name *flowerNames) {
     char *tempPath = getTempFile();
     FILE *f = fopen(tempPath, "w");
-    Name flowerNames[3];
     // First test flower
     Flower *flower1 = flower_construct(cactusDisk);
     flowerNames[0] = flower_getName(flower1);
@@ -32,9 +31,16 @@ static void testFlowerStream(CuTest *testCase) {
     flower_destruct(flower1, false);
     flower_destruct(flower2, false);
     flower_destruct(flower3, false);
+    return tempPath;
+}
+
+static void testFlowerStream(CuTest *testCase) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk(testCase->name);
+    Name flowerNames[3];
+    char *tempPath = writeTestFlowers(cactusDisk, flowerNames);
 
     // Now read them back in.
-    f = fopen(tempPath, "r");
+    FILE *f = fopen(tempPath, "r");
     FlowerStream *flowerStream = flowerWriter_getFlowerStream(cactusDisk, f);
     CuAssertIntEquals(testCase, 3, flowerStream_size(flowerStream));
     int64_t i = 0;
@@ -53,6 +59,32 @@ static void testFlowerStream(CuTest *testCase) {
     testCommon_deleteTemporaryCactusDisk(testCase->name, cactusDisk);
 }
 
+static void testFlowerStreamBatches(CuTest *testCase) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk(testCase->name);
+    Name flowerNames[3];
+    char *tempPath = writeTestFlowers(cactusDisk, flowerNames);
+
+    FILE *f = fopen(tempPath, "r");
+    FlowerStream *flowerStream = flowerWriter_getFlowerStream(cactusDisk, f);
+    // Take the first flower alone, then the rest of its batch.
+    Flower *flower = flowerStream_getNext(flowerStream);
+    CuAssertIntEquals(testCase, flowerNames[0], flower_getName(flower));
+    stList *flowers = flowerStream_getNextBatch(flowerStream);
+    CuAssertIntEquals(testCase, 2, stList_length(flowers));
+    CuAssertIntEquals(testCase, 2, stSortedSet_size(cactusDisk->flowers));
+    for (int64_t i = 0; i < stList_length(flowers); i++) {
+        CuAssertIntEquals(testCase, flowerNames[i + 1], flower_getName(stList_get(flowers, i)));
+    }
+    CuAssertPtrEquals(testCase, NULL, flowerStream_getNextBatch(flowerStream));
+
+    // Check that no flowers are loaded.
+    CuAssertIntEquals(testCase, 0, stSortedSet_size(cactusDisk->flowers));
+    flowerStream_destruct(flowerStream);
+    fclose(f);
+    removeTempFile(tempPath);
+    testCommon_deleteTemporaryCactusDisk(testCase->name, cactusDisk);
+}
+
 static void testFlowerWriter(CuTest *testCase) {
     char *tempFile = "./flowerWriterTest.txt";
     FILE *fileHandle = fopen(tempFile, "w");
@@ -101,6 +133,7 @@ static void testFlowerWriter(CuTest *testCase) {
 CuSuite* cactusFlowerWriterTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testFlowerStream);
+    SUITE_ADD_TEST(suite, testFlowerStreamBatches);
     SUITE_ADD_TEST(suite, testFlowerWriter);
     return suite;
 }
@@ -7,8 +7,10 @@
 
 #include <assert.h>
 #include <getopt.h>
-#include <sys/mman.h>
 #include <stdio.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 #include "cactus.h"
 #include "sonLib.h"
@@ -79,18 +81,45 @@ void usage() {
 
     fprintf(stderr, "-R --partialOrderAlignmentBandFraction (float F) : abpoa \"f\" parameter where band is b+F*<length> (default=0.01)\n");
 
+    fprintf(stderr, "-T --threads (int > 0) : Number of threads used to align flowers, or the ends of a single flower, in parallel (default=1). The output does not depend on this.\n");
+
     fprintf(stderr, "-h --help : Print this help screen\n");
 }
 
-stPinch *getNextAlignedPairAlignment(stSortedSetIterator *it) {
-    AlignedPair *alignedPair = stSortedSet_getNext(it);
-    if (alignedPair == NULL) {
+/*
+ * Iterates over the pairs of a flower alignment, in order, as pinches. Each pair is held in both orientations, so is
+ * pinched twice, as it was when the alignment was a sorted set.
+ */
+typedef struct _alignedPairIterator {
+    EndAlignment *alignment;
+    int64_t index;
+    stPinch pinch;
+} AlignedPairIterator;
+
+static stPinch *alignedPairIterator_getNext(AlignedPairIterator *it) {
+    if (it->index == it->alignment->length) {
         return NULL;
     }
-    static stPinch pinch;
-    stPinch_fillOut(&pinch, alignedPair->subsequenceIdentifier, alignedPair->reverse->subsequenceIdentifier, alignedPair->position,
+    AlignedPair *alignedPair = &it->alignment->alignedPairs[it->index++];
+    stPinch_fillOut(&it->pinch, alignedPair->subsequenceIdentifier, alignedPair->reverse->subsequenceIdentifier, alignedPair->position,
             alignedPair->reverse->position, 1, alignedPair->strand == alignedPair->reverse->strand);
-    return &pinch;
+    return &it->pinch;
+}
+
+static AlignedPairIterator *alignedPairIterator_reset(AlignedPairIterator *it) {
+    it->index = 0;
+    return it;
+}
+
+static stPinchIterator *constructPinchIteratorFromAlignedPairs(EndAlignment *alignment) {
+    AlignedPairIterator *it = st_calloc(1, sizeof(AlignedPairIterator));
+    it->alignment = alignment;
+    stPinchIterator *pinchIterator = st_calloc(1, sizeof(stPinchIterator));
+    pinchIterator->alignmentArg = it;
+    pinchIterator->getNextAlignment = (stPinch *(*)(void *)) alignedPairIterator_getNext;
+    pinchIterator->destructAlignmentArg = free;
+    pinchIterator->startAlignmentStack = (void *(*)(void *)) alignedPairIterator_reset;
+    return pinchIterator;
 }
 
 static int64_t minimumIngroupDegree = 0, minimumOutgroupDegree = 0, minimumDegree = 0, minimumNumberOfSpecies = 0;
@@ -104,7 +133,7 @@ int main(int argc, char *argv[]) {
 
     char * logLevelString = NULL;
     char * cactusDiskDatabaseString = NULL;
-    int64_t i, j;
+    int64_t i;
     int64_t spanningTrees = 10;
     int64_t maximumLength = 1500;
     bool useProgressiveMerging = 0;
@@ -126,6 +155,7 @@ int main(int argc, char *argv[]) {
     int64_t maskFilter = -1;
     int64_t poaBandConstant = 10; //defaults from abpoa
     double poaBandFraction = 0.01;
+    int64_t numThreads = 1;
 
     PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters = pairwiseAlignmentBandingParameters_construct();
 
@@ -159,11 +189,12 @@ int main(int argc, char *argv[]) {
                         {"maskFilter", required_argument, 0, 'm'},
                         {"partialOrderAlignmentBandConstant", required_argument, 0, 'C'},
                         {"partialOrderAlignmentBandFraction", required_argument, 0, 'R'},
+                        {"threads", required_argument, 0, 'T'},
                         { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:P:m:C:R:", long_options, &option_index);
+        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:P:m:C:R:T:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -308,6 +339,12 @@ int main(int argc, char *argv[]) {
                     st_errAbort("Error parsing partialOrderAlignmentBandFraction parameter");
                 }
                 break;
+            case 'T':
+                i = sscanf(optarg, "%" PRIi64 "", &numThreads);
+                if (i != 1 || numThreads <= 0) {
+                    st_errAbort("Error parsing threads parameter");
+                }
+                break;
             default:
                 usage();
                 return 1;
@@ -315,6 +352,9 @@ int main(int argc, char *argv[]) {
     }
 
     st_setLogLevelFromString(logLevelString);
+#if defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
 
     /*
      * Load the flowerdisk
@@ -357,21 +397,28 @@ int main(int argc, char *argv[]) {
          */
         stList *names = flowerWriter_parseNames(stdin);
         Flower *flower = cactusDisk_getFlower(cactusDisk, *((Name *)stList_get(names, 0)));
-        FILE *fileHandle = fopen(endAlignmentsToPrecomputeOutputFile, "w");
+        FILE *fileHandle = fopen(endAlignmentsToPrecomputeOutputFile, "wb");
         if (fileHandle == NULL) {
             st_errnoAbort("Opening end alignment file %s failed", endAlignmentsToPrecomputeOutputFile);
         }
+        stList *ends = stList_construct();
         for(int64_t i=1; i<stList_length(names); i++) {
             End *end = flower_getEnd(flower, *((Name *)stList_get(names, i)));
             if (end == NULL) {
                 st_errAbort("The end %" PRIi64 " was not found in the flower\n", *((Name *)stList_get(names, i)));
             }
-            assert(poaWindow == 0);
-            stSortedSet *endAlignment = makeEndAlignment(sM, end, spanningTrees, maximumLength, useProgressiveMerging,
-                                                         matchGamma, pairwiseAlignmentBandingParameters);
-            writeEndAlignmentToDisk(end, endAlignment, fileHandle);
-            stSortedSet_destruct(endAlignment);
+            stList_append(ends, end);
         }
+        assert(poaWindow == 0);
+        stList *endAlignments = makeEndAlignments(sM, ends, spanningTrees, maximumLength, useProgressiveMerging,
+                                                  matchGamma, pairwiseAlignmentBandingParameters);
+        for(int64_t i=0; i<stList_length(ends); i++) {
+            EndAlignment *endAlignment = stList_get(endAlignments, i);
+            writeEndAlignmentToDisk(stList_get(ends, i), endAlignment, fileHandle);
+            endAlignment_destruct(endAlignment);
+        }
+        stList_destruct(endAlignments);
+        stList_destruct(ends);
         fclose(fileHandle);
         return 0; //avoid cleanup costs
         stList_destruct(names);
@@ -380,35 +427,10 @@ int main(int argc, char *argv[]) {
         /*
          * Compute complete flower alignments, possibly loading some precomputed alignments.
          */
-        bedRegion *bedRegions = NULL;
-        size_t numBeds = 0;
+        CoverageIndex *coverageIndex = NULL;
         if (ingroupCoverageFilePath != NULL) {
             // Pre-load the mmap for the coverage file.
-            FILE *coverageFile = fopen(ingroupCoverageFilePath, "rb");
-            if (coverageFile == NULL) {
-                st_errnoAbort("Opening coverage file %s failed",
-                              ingroupCoverageFilePath);
-            }
-            fseek(coverageFile, 0, SEEK_END);
-            int64_t coverageFileLen = ftell(coverageFile);
-            assert(coverageFileLen >= 0);
-            assert(coverageFileLen % sizeof(bedRegion) == 0);
-            if (coverageFileLen == 0) {
-                // mmap doesn't like length-0 mappings, for obvious
-                // reasons. Pretend that the coverage file doesn't
-                // exist in this case, since it contains no data.
-                ingroupCoverageFilePath = NULL;
-            } else {
-                // Establish a memory mapping for the file.
-                bedRegions = mmap(NULL, coverageFileLen, PROT_READ, MAP_SHARED,
-                                  fileno(coverageFile), 0);
-                if (bedRegions == MAP_FAILED) {
-                    st_errnoAbort("Failure mapping coverage file");
-                }
-
-                numBeds = coverageFileLen / sizeof(bedRegion);
-            }
-            fclose(coverageFile);
+            coverageIndex = coverageIndex_load(ingroupCoverageFilePath);
         }
 
         stList *flowers = flowerWriter_parseFlowersFromStdin(cactusDisk);
@@ -416,12 +438,22 @@ int main(int argc, char *argv[]) {
             st_errAbort("We have precomputed alignments but %" PRIi64 " flowers to align.\n", stList_length(flowers));
         }
         cactusDisk_preCacheStrings(cactusDisk, flowers);
-        for (j = 0; j < stList_length(flowers); j++) {
-            flower = stList_get(flowers, j);
+        int64_t flowerNumber = stList_length(flowers);
+        /*
+         * The alignments of the flowers are independent, so are computed in parallel. Building the cactus from
+         * an alignment creates new objects in the cactus disk, so this is done one flower at a time, in the order
+         * of the flowers. The names of the new objects, and hence the output, are therefore the same whatever
+         * the number of threads. With a single flower the threads are left for aligning its ends in parallel.
+         */
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 1) ordered if(flowerNumber > 1)
+#endif
+        for (int64_t j = 0; j < flowerNumber; j++) {
+            Flower *flowerToAlign = stList_get(flowers, j);
             st_logInfo("Processing a flower\n");
 
             stPinchIterator *pinchIterator = NULL;
-            stSortedSet *alignedPairs = NULL;
+            EndAlignment *alignedPairs = NULL;
             stList *alignment_blocks = NULL;
 
             if(poaWindow != 0) {
@@ -430,63 +462,85 @@ int main(int argc, char *argv[]) {
                  *
                  * It does not use any precomputed alignments, if they are provided they will be ignored
                  */
-                alignment_blocks = make_flower_alignment_poa(flower, maximumLength, poaWindow, maskFilter, poaBandConstant, poaBandFraction);
+                alignment_blocks = make_flower_alignment_poa(flowerToAlign, maximumLength, poaWindow, maskFilter, poaBandConstant, poaBandFraction);
                 st_logInfo("Created the poa alignments: %" PRIi64 " poa alignment blocks\n", stList_length(alignment_blocks));
                 pinchIterator = stPinchIterator_constructFromAlignedBlocks(alignment_blocks);
             }
             else {
-                alignedPairs = makeFlowerAlignment3(sM, flower, listOfEndAlignmentFiles, spanningTrees, maximumLength,
+                alignedPairs = makeFlowerAlignment3(sM, flowerToAlign, listOfEndAlignmentFiles, spanningTrees, maximumLength,
                                                     useProgressiveMerging, matchGamma,
                                                     pairwiseAlignmentBandingParameters,
                                                     pruneOutStubAlignments);
-                st_logInfo("Created the alignment: %" PRIi64 " pairs\n", stSortedSet_size(alignedPairs));
-                pinchIterator = stPinchIterator_constructFromAlignedPairs(alignedPairs, getNextAlignedPairAlignment);
-            }
-            /*
-             * Run the cactus caf functions to build cactus.
-             */
-            stPinchThreadSet *threadSet = stCaf_setup(flower);
-            stCaf_anneal(threadSet, pinchIterator, NULL);
-            if (minimumDegree < 2) {
-                stCaf_makeDegreeOneBlocks(threadSet);
-            }
-            if (minimumIngroupDegree > 0 || minimumOutgroupDegree > 0 || minimumDegree > 1) {
-                stCaf_melt(flower, threadSet, blockFilterFn, 0, 0, 0, INT64_MAX);
+                st_logInfo("Created the alignment: %" PRIi64 " pairs\n", alignedPairs->length);
+                pinchIterator = constructPinchIteratorFromAlignedPairs(alignedPairs);
             }
 
-            if (ingroupCoverageFilePath != NULL) {
-                // Rescue any sequence that is covered by outgroups
-                // but currently unaligned into single-degree blocks.
-                stPinchThreadSetIt pinchIt = stPinchThreadSet_getIt(threadSet);
-                stPinchThread *thread;
-                while ((thread = stPinchThreadSetIt_getNext(&pinchIt)) != NULL) {
-                    Cap *cap = flower_getCap(flower,
-                                             stPinchThread_getName(thread));
-                    assert(cap != NULL);
-                    Sequence *sequence = cap_getSequence(cap);
-                    assert(sequence != NULL);
-                    rescueCoveredRegions(thread, bedRegions, numBeds,
-                                         sequence_getName(sequence),
-                                         minimumSizeToRescue,
-                                         minimumCoverageToRescue);
+#if defined(_OPENMP)
+#pragma omp ordered
+#endif
+            {
+                flower = flowerToAlign; // Used by blockFilterFn
+                /*
+                 * Run the cactus caf functions to build cactus.
+                 */
+                stPinchThreadSet *threadSet = stCaf_setup(flower);
+                stCaf_anneal(threadSet, pinchIterator, NULL);
+                if (minimumDegree < 2) {
+                    stCaf_makeDegreeOneBlocks(threadSet);
+                }
+                if (minimumIngroupDegree > 0 || minimumOutgroupDegree > 0 || minimumDegree > 1) {
+                    stCaf_melt(flower, threadSet, blockFilterFn, 0, 0, 0, INT64_MAX);
                 }
-                stCaf_joinTrivialBoundaries(threadSet);
-            }
 
-            stCaf_finish(flower, threadSet, chainLengthForBigFlower, longChain, INT64_MAX, INT64_MAX); //Flower now destroyed.
-            stPinchThreadSet_destruct(threadSet);
-            st_logInfo("Ran the cactus core script.\n");
+                if (coverageIndex != NULL) {
+                    // Rescue any sequence that is covered by outgroups
+                    // but currently unaligned into single-degree blocks.
+                    // The threads are independent, so are rescued in parallel.
+                    int64_t threadNumber = stPinchThreadSet_getSize(threadSet);
+                    stPinchThread **threads = st_malloc(sizeof(stPinchThread *) * threadNumber);
+                    Name *sequenceNames = st_malloc(sizeof(Name) * threadNumber);
+                    stPinchThreadSetIt pinchIt = stPinchThreadSet_getIt(threadSet);
+                    stPinchThread *thread;
+                    int64_t k = 0;
+                    while ((thread = stPinchThreadSetIt_getNext(&pinchIt)) != NULL) {
+                        Cap *cap = flower_getCap(flower,
+                                                 stPinchThread_getName(thread));
+                        assert(cap != NULL);
+                        Sequence *sequence = cap_getSequence(cap);
+                        assert(sequence != NULL);
+                        threads[k] = thread;
+                        sequenceNames[k++] = sequence_getName(sequence);
+                    }
+                    assert(k == threadNumber);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+                    for (k = 0; k < threadNumber; k++) {
+                        rescueCoveredRegions(threads[k], coverageIndex,
+                                             sequenceNames[k],
+                                             minimumSizeToRescue,
+                                             minimumCoverageToRescue);
+                    }
+                    free(threads);
+                    free(sequenceNames);
+                    stCaf_joinTrivialBoundaries(threadSet);
+                }
+
+                stCaf_finish(flower, threadSet, chainLengthForBigFlower, longChain, INT64_MAX, INT64_MAX); //Flower now destroyed.
+                stPinchThreadSet_destruct(threadSet);
+                st_logInfo("Ran the cactus core script.\n");
+            }
 
             /*
              * Cleanup
              */
-            //Clean up the sorted set after cleaning up the iterator
+            //Clean up the aligned pairs after cleaning up the iterator
             stPinchIterator_destruct(pinchIterator);
             if(poaWindow != 0) {
                 stList_destruct(alignment_blocks);
             }
             else {
-                stSortedSet_destruct(alignedPairs);
+                endAlignment_destruct(alignedPairs);
             }
 
             st_logInfo("Finished filling in the alignments for the flower\n");
@@ -498,9 +552,9 @@ int main(int argc, char *argv[]) {
          */
         cactusDisk_write(cactusDisk);
         return 0; //Exit without clean up is quicker, enable cleanup when doing memory leak detection.
-        if (bedRegions != NULL) {
+        if (coverageIndex != NULL) {
             // Clean up our mapping.
-            munmap(bedRegions, numBeds * sizeof(bedRegion));
+            coverageIndex_destruct(coverageIndex);
         }
     }
 
@@ -0,0 +1,231 @@
+// Index of the outgroup coverage of each ingroup sequence, see
+// coverageIndex.h for the file layout.
+
+#include <sys/mman.h>
+#include "cactus.h"
+#include "sonLib.h"
+#include "coverageIndex.h"
+
+#define COVERAGE_INDEX_MAGIC_NUMBER 0x4547415245564f43 // "COVERAGE"
+#define COVERAGE_INDEX_VERSION 1
+
+#define COVERAGE_INDEX_HEADER_FIELDS 4
+#define COVERAGE_INDEX_SEQUENCE_FIELDS 3
+#define COVERAGE_INDEX_REGION_FIELDS 3
+
+struct _coverageIndex {
+    int64_t sequenceNumber;
+    int64_t regionNumber;
+    int64_t *data; // The whole of the file, including the header
+    int64_t *sequences; // Points into data
+    int64_t *regions; // Points into data
+    size_t mappedLength; // Non-zero if data is memory mapped
+};
+
+static inline int64_t getField(int64_t *fields, int64_t i, int64_t fieldNumber, int64_t field) {
+    return st_nativeInt64FromLittleEndian(fields[i * fieldNumber + field]);
+}
+
+static inline void setField(int64_t *fields, int64_t i, int64_t fieldNumber, int64_t field, int64_t value) {
+    fields[i * fieldNumber + field] = st_nativeInt64ToLittleEndian(value);
+}
+
+static inline Name sequence_name(CoverageIndex *index, int64_t i) {
+    return getField(index->sequences, i, COVERAGE_INDEX_SEQUENCE_FIELDS, 0);
+}
+
+static inline int64_t sequence_firstRegion(CoverageIndex *index, int64_t i) {
+    return getField(index->sequences, i, COVERAGE_INDEX_SEQUENCE_FIELDS, 1);
+}
+
+static inline int64_t sequence_regionNumber(CoverageIndex *index, int64_t i) {
+    return getField(index->sequences, i, COVERAGE_INDEX_SEQUENCE_FIELDS, 2);
+}
+
+static inline int64_t region_start(CoverageIndex *index, int64_t i) {
+    return getField(index->regions, i, COVERAGE_INDEX_REGION_FIELDS, 0);
+}
+
+static inline int64_t region_stop(CoverageIndex *index, int64_t i) {
+    return getField(index->regions, i, COVERAGE_INDEX_REGION_FIELDS, 1);
+}
+
+static inline int64_t region_coveredBefore(CoverageIndex *index, int64_t i) {
+    return getField(index->regions, i, COVERAGE_INDEX_REGION_FIELDS, 2);
+}
+
+static int64_t getDataLength(int64_t sequenceNumber, int64_t regionNumber) {
+    return COVERAGE_INDEX_HEADER_FIELDS + sequenceNumber * COVERAGE_INDEX_SEQUENCE_FIELDS
+            + regionNumber * COVERAGE_INDEX_REGION_FIELDS;
+}
+
+// Point the sequences and regions at their parts of the data.
+static void setSections(CoverageIndex *index) {
+    index->sequences = index->data + COVERAGE_INDEX_HEADER_FIELDS;
+    index->regions = index->sequences + index->sequenceNumber * COVERAGE_INDEX_SEQUENCE_FIELDS;
+}
+
+CoverageIndex *coverageIndex_construct(Name *names, int64_t *starts, int64_t *stops, int64_t regionNumber) {
+    // Count the sequences and merged regions, so the data can be
+    // allocated in one go.
+    int64_t sequenceNumber = 0, mergedRegionNumber = 0;
+    for (int64_t i = 0; i < regionNumber; i++) {
+        if (starts[i] > stops[i]) {
+            st_errAbort("Covered region %" PRIi64 ":%" PRIi64 "-%" PRIi64 " has a negative length",
+                        names[i], starts[i], stops[i]);
+        }
+        if (i == 0 || names[i] != names[i - 1]) {
+            if (i > 0 && names[i] < names[i - 1]) {
+                st_errAbort("Covered regions are not sorted by name");
+            }
+            sequenceNumber++;
+            mergedRegionNumber++;
+        } else {
+            if (starts[i] < starts[i - 1]) {
+                st_errAbort("Covered regions of sequence %" PRIi64 " are not sorted by start", names[i]);
+            }
+            mergedRegionNumber++;
+        }
+    }
+
+    CoverageIndex *index = st_malloc(sizeof(CoverageIndex));
+    index->sequenceNumber = sequenceNumber;
+    index->regionNumber = 0;
+    index->mappedLength = 0;
+    index->data = st_calloc(getDataLength(sequenceNumber, mergedRegionNumber), sizeof(int64_t));
+    setSections(index);
+
+    // Fill in the sequences and regions, merging any regions that
+    // overlap or abut.
+    int64_t j = -1; // The index of the current sequence
+    int64_t coveredBefore = 0;
+    for (int64_t i = 0; i < regionNumber; i++) {
+        if (starts[i] == stops[i]) {
+            continue;
+        }
+        if (j == -1 || names[i] != sequence_name(index, j)) {
+            j++;
+            setField(index->sequences, j, COVERAGE_INDEX_SEQUENCE_FIELDS, 0, names[i]);
+            setField(index->sequences, j, COVERAGE_INDEX_SEQUENCE_FIELDS, 1, index->regionNumber);
+            coveredBefore = 0;
+        } else if (starts[i] <= region_stop(index, index->regionNumber - 1)) {
+            // Extend the previous region
+            int64_t k = index->regionNumber - 1;
+            if (stops[i] > region_stop(index, k)) {
+                coveredBefore += stops[i] - region_stop(index, k);
+                setField(index->regions, k, COVERAGE_INDEX_REGION_FIELDS, 1, stops[i]);
+            }
+            continue;
+        }
+        int64_t k = index->regionNumber++;
+        setField(index->regions, k, COVERAGE_INDEX_REGION_FIELDS, 0, starts[i]);
+        setField(index->regions, k, COVERAGE_INDEX_REGION_FIELDS, 1, stops[i]);
+        setField(index->regions, k, COVERAGE_INDEX_REGION_FIELDS, 2, coveredBefore);
+        coveredBefore += stops[i] - starts[i];
+        setField(index->sequences, j, COVERAGE_INDEX_SEQUENCE_FIELDS, 2, index->regionNumber
+                 - sequence_firstRegion(index, j));
+    }
+    // Sequences all of whose regions were empty are dropped.
+    index->sequenceNumber = j + 1;
+    assert(index->regionNumber <= mergedRegionNumber);
+
+    // The regions were laid out assuming every sequence was kept, so
+    // move them up behind the sequences that were.
+    int64_t *regions = index->regions;
+    setSections(index);
+    memmove(index->regions, regions, index->regionNumber * COVERAGE_INDEX_REGION_FIELDS * sizeof(int64_t));
+
+    setField(index->data, 0, 1, 0, COVERAGE_INDEX_MAGIC_NUMBER);
+    setField(index->data, 1, 1, 0, COVERAGE_INDEX_VERSION);
+    setField(index->data, 2, 1, 0, index->sequenceNumber);
+    setField(index->data, 3, 1, 0, index->regionNumber);
+    return index;
+}
+
+CoverageIndex *coverageIndex_load(const char *path) {
+    FILE *fileHandle = fopen(path, "rb");
+    if (fileHandle == NULL) {
+        st_errnoAbort("Opening coverage file %s failed", path);
+    }
+    int64_t header[COVERAGE_INDEX_HEADER_FIELDS];
+    if (fread(header, sizeof(int64_t), COVERAGE_INDEX_HEADER_FIELDS, fileHandle) != COVERAGE_INDEX_HEADER_FIELDS
+        || getField(header, 0, 1, 0) != COVERAGE_INDEX_MAGIC_NUMBER) {
+        st_errAbort("Coverage file %s is not a coverage index", path);
+    }
+    if (getField(header, 1, 1, 0) != COVERAGE_INDEX_VERSION) {
+        st_errAbort("Coverage file %s has version %" PRIi64 ", expected %i", path, getField(header, 1, 1, 0),
+                    COVERAGE_INDEX_VERSION);
+    }
+
+    CoverageIndex *index = st_malloc(sizeof(CoverageIndex));
+    index->sequenceNumber = getField(header, 2, 1, 0);
+    index->regionNumber = getField(header, 3, 1, 0);
+    index->mappedLength = getDataLength(index->sequenceNumber, index->regionNumber) * sizeof(int64_t);
+    fseeko(fileHandle, 0, SEEK_END);
+    if (ftello(fileHandle) != (off_t)index->mappedLength) {
+        st_errAbort("Coverage file %s is truncated", path);
+    }
+    index->data = mmap(NULL, index->mappedLength, PROT_READ, MAP_SHARED, fileno(fileHandle), 0);
+    if (index->data == MAP_FAILED) {
+        st_errnoAbort("Failure mapping coverage file %s", path);
+    }
+    fclose(fileHandle);
+    setSections(index);
+    return index;
+}
+
+void coverageIndex_destruct(CoverageIndex *index) {
+    if (index->mappedLength > 0) {
+        munmap(index->data, index->mappedLength);
+    } else {
+        free(index->data);
+    }
+    free(index);
+}
+
+void coverageIndex_write(CoverageIndex *index, FILE *fileHandle) {
+    int64_t length = getDataLength(index->sequenceNumber, index->regionNumber);
+    if (fwrite(index->data, sizeof(int64_t), length, fileHandle) != (size_t)length) {
+        st_errnoAbort("Writing the coverage index failed");
+    }
+}
+
+// The number of covered bases of the sequence's regions before x.
+static int64_t getCoveredBasesBefore(CoverageIndex *index, int64_t firstRegion, int64_t regionNumber, int64_t x) {
+    // Find the number of regions starting before x
+    int64_t low = 0, high = regionNumber;
+    while (low < high) {
+        int64_t mid = low + (high - low) / 2;
+        if (region_start(index, firstRegion + mid) < x) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) {
+        return 0;
+    }
+    int64_t i = firstRegion + low - 1;
+    int64_t stop = region_stop(index, i);
+    return region_coveredBefore(index, i) + (x < stop ? x : stop) - region_start(index, i);
+}
+
+int64_t coverageIndex_getCoveredBases(CoverageIndex *index, Name name, int64_t start, int64_t stop) {
+    // Find the sequence in the offset table
+    int64_t low = 0, high = index->sequenceNumber;
+    while (low < high) {
+        int64_t mid = low + (high - low) / 2;
+        if (sequence_name(index, mid) < name) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == index->sequenceNumber || sequence_name(index, low) != name || start >= stop) {
+        return 0;
+    }
+    int64_t firstRegion = sequence_firstRegion(index, low);
+    int64_t regionNumber = sequence_regionNumber(index, low);
+    return getCoveredBasesBefore(index, firstRegion, regionNumber, stop)
+            - getCoveredBasesBefore(index, firstRegion, regionNumber, start);
+}
@@ -4,6 +4,10 @@
  * Released under the MIT license, see LICENSE.txt
  */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "endAligner.h"
 #include "multipleAligner.h"
 #include "adjacencySequences.h"
@@ -26,6 +30,9 @@ AlignedPair *alignedPair_construct(int64_t subsequenceIdentifier1, int64_t posit
     alignedPair->score = score;
     alignedPair->reverse->score = rScore;
 
+    alignedPair->deleted = 0;
+    alignedPair->reverse->deleted = 0;
+
     return alignedPair;
 }
 
@@ -52,7 +59,224 @@ int alignedPair_cmpFn(const AlignedPair *alignedPair1, const AlignedPair *aligne
     return i;
 }
 
-stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
+EndAlignment *endAlignment_construct(void) {
+    EndAlignment *endAlignment = st_calloc(1, sizeof(EndAlignment));
+    endAlignment->sorted = 1;
+    return endAlignment;
+}
+
+void endAlignment_destruct(EndAlignment *endAlignment) {
+    if (endAlignment->mappedMemory != NULL) {
+        munmap(endAlignment->mappedMemory, endAlignment->mappedLength);
+    } else {
+        free(endAlignment->alignedPairs);
+    }
+    free(endAlignment);
+}
+
+static AlignedPair *endAlignment_addP(EndAlignment *endAlignment, int64_t subsequenceIdentifier, int64_t position,
+        bool strand, int64_t score) {
+    if (endAlignment->length == endAlignment->maxLength) {
+        endAlignment->maxLength = endAlignment->maxLength * 2 + 16;
+        endAlignment->alignedPairs = st_realloc(endAlignment->alignedPairs, sizeof(AlignedPair) * endAlignment->maxLength);
+    }
+    AlignedPair *alignedPair = &endAlignment->alignedPairs[endAlignment->length++];
+    alignedPair->subsequenceIdentifier = subsequenceIdentifier;
+    alignedPair->position = position;
+    alignedPair->strand = strand;
+    alignedPair->score = score;
+    alignedPair->reverse = NULL; // Set when the alignment is sorted
+    alignedPair->deleted = 0;
+    return alignedPair;
+}
+
+void endAlignment_add(EndAlignment *endAlignment, int64_t subsequenceIdentifier1, int64_t position1, bool strand1,
+        int64_t subsequenceIdentifier2, int64_t position2, bool strand2, int64_t score1, int64_t score2) {
+    //Until the alignment is sorted the two sides of each pair sit next to each other in the array,
+    //the reverse of the pair at index i being at index i^1.
+    assert(endAlignment->length % 2 == 0);
+    assert(endAlignment->length == 0 || !endAlignment->sorted);
+    endAlignment->sorted = 0;
+    endAlignment_addP(endAlignment, subsequenceIdentifier1, position1, strand1, score1);
+    endAlignment_addP(endAlignment, subsequenceIdentifier2, position2, strand2, score2);
+}
+
+/*
+ * Keys used to radix sort the aligned pairs. Names are compared as signed integers, so the sign bit is flipped.
+ */
+static uint64_t alignedPair_nameKey(AlignedPair *alignedPair) {
+    return ((uint64_t) alignedPair->subsequenceIdentifier) ^ (((uint64_t) 1) << 63);
+}
+
+static uint64_t alignedPair_positionKey(AlignedPair *alignedPair) {
+    assert(alignedPair->position >= 0 && alignedPair->position < INT64_MAX / 2);
+    return (((uint64_t) alignedPair->position) << 1) | (alignedPair->strand ? 1 : 0);
+}
+
+#define RADIX_BITS 16
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/*
+ * Stable sort of the indexes in "order" by the given keys, one RADIX_BITS digit at a time, least significant first.
+ * Digits shared by all the keys are skipped.
+ */
+static void radixSortIndexes(uint64_t *keys, int64_t **order, int64_t **order2, int64_t length, int64_t *counts) {
+    if (length == 0) {
+        return;
+    }
+    for (int64_t shift = 0; shift < 64; shift += RADIX_BITS) {
+        memset(counts, 0, sizeof(int64_t) * RADIX_BUCKETS);
+        for (int64_t i = 0; i < length; i++) {
+            counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+        if (counts[(keys[0] >> shift) & (RADIX_BUCKETS - 1)] == length) {
+            continue;
+        }
+        int64_t total = 0;
+        for (int64_t j = 0; j < RADIX_BUCKETS; j++) {
+            int64_t k = counts[j];
+            counts[j] = total;
+            total += k;
+        }
+        for (int64_t i = 0; i < length; i++) {
+            int64_t k = (*order)[i];
+            (*order2)[counts[(keys[k] >> shift) & (RADIX_BUCKETS - 1)]++] = k;
+        }
+        int64_t *swap = *order;
+        *order = *order2;
+        *order2 = swap;
+    }
+}
+
+/*
+ * Below this number of aligned pairs the pairs are sorted with qsort, as clearing the radix counts for each digit
+ * would cost more than the sort.
+ */
+#define RADIX_SORT_MIN_LENGTH 4096
+
+static int alignedPairPointer_cmpFn(const void *a, const void *b) {
+    return alignedPair_cmpFn(*(AlignedPair * const *) a, *(AlignedPair * const *) b);
+}
+
+/*
+ * Sorts the indexes in "order" of the pairs, whose reverses are at index i^1, with qsort.
+ */
+static void qsortIndexes(AlignedPair *alignedPairs, int64_t *order, int64_t length) {
+    AlignedPair **sortedAlignedPairs = st_malloc(sizeof(AlignedPair *) * (length > 0 ? length : 1));
+    for (int64_t i = 0; i < length; i++) {
+        alignedPairs[i].reverse = &alignedPairs[i ^ 1];
+        sortedAlignedPairs[i] = &alignedPairs[i];
+    }
+    qsort(sortedAlignedPairs, length, sizeof(AlignedPair *), alignedPairPointer_cmpFn);
+    for (int64_t i = 0; i < length; i++) {
+        order[i] = sortedAlignedPairs[i] - alignedPairs;
+    }
+    free(sortedAlignedPairs);
+}
+
+void endAlignment_sort(EndAlignment *endAlignment) {
+    if (endAlignment->sorted) {
+        return;
+    }
+    int64_t length = endAlignment->length;
+    AlignedPair *alignedPairs = endAlignment->alignedPairs;
+    assert(length % 2 == 0);
+
+    int64_t *order = st_malloc(sizeof(int64_t) * (length > 0 ? length : 1));
+    int64_t *order2 = st_malloc(sizeof(int64_t) * (length > 0 ? length : 1));
+    if (length < RADIX_SORT_MIN_LENGTH) {
+        qsortIndexes(alignedPairs, order, length);
+    } else {
+        uint64_t *keys = st_malloc(sizeof(uint64_t) * length);
+        int64_t *counts = st_malloc(sizeof(int64_t) * RADIX_BUCKETS);
+        for (int64_t i = 0; i < length; i++) {
+            order[i] = i;
+        }
+        //Sort by the keys in order of increasing significance, so the final order is as given by alignedPair_cmpFn:
+        //the position and strand of the reverse, the name of the reverse, the position and strand, then the name.
+        for (int64_t k = 0; k < 4; k++) {
+            for (int64_t i = 0; i < length; i++) {
+                AlignedPair *alignedPair = &alignedPairs[k < 2 ? i ^ 1 : i];
+                keys[i] = k % 2 == 0 ? alignedPair_positionKey(alignedPair) : alignedPair_nameKey(alignedPair);
+            }
+            radixSortIndexes(keys, &order, &order2, length, counts);
+        }
+        free(keys);
+        free(counts);
+    }
+
+    //Now permute the pairs into sorted order, linking each pair to its reverse.
+    int64_t *ranks = order2; //The sorted index of each pair, by its index before sorting
+    for (int64_t i = 0; i < length; i++) {
+        ranks[order[i]] = i;
+    }
+    AlignedPair *sortedAlignedPairs = st_malloc(sizeof(AlignedPair) * (length > 0 ? length : 1));
+    for (int64_t i = 0; i < length; i++) {
+        sortedAlignedPairs[i] = alignedPairs[order[i]];
+        sortedAlignedPairs[i].reverse = &sortedAlignedPairs[ranks[order[i] ^ 1]];
+    }
+    for (int64_t i = 1; i < length; i++) {
+        assert(alignedPair_cmpFn(&sortedAlignedPairs[i - 1], &sortedAlignedPairs[i]) < 0);
+    }
+
+    free(alignedPairs);
+    free(order);
+    free(order2);
+    endAlignment->alignedPairs = sortedAlignedPairs;
+    endAlignment->maxLength = length;
+    endAlignment->sorted = 1;
+}
+
+int64_t endAlignment_size(EndAlignment *endAlignment) {
+    return endAlignment->length - endAlignment->deletedNumber;
+}
+
+int64_t endAlignment_lowerBound(EndAlignment *endAlignment, int64_t subsequenceIdentifier, int64_t position) {
+    assert(endAlignment->sorted);
+    int64_t min = 0, max = endAlignment->length;
+    while (min < max) {
+        int64_t mid = min + (max - min) / 2;
+        AlignedPair *alignedPair = &endAlignment->alignedPairs[mid];
+        if (alignedPair->subsequenceIdentifier < subsequenceIdentifier ||
+            (alignedPair->subsequenceIdentifier == subsequenceIdentifier && alignedPair->position < position)) {
+            min = mid + 1;
+        } else {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+void endAlignment_delete(EndAlignment *endAlignment, AlignedPair *alignedPair) {
+    assert(!alignedPair->deleted);
+    assert(!alignedPair->reverse->deleted);
+    alignedPair->deleted = 1;
+    alignedPair->reverse->deleted = 1;
+    endAlignment->deletedNumber += 2;
+}
+
+bool endAlignment_equals(EndAlignment *endAlignment1, EndAlignment *endAlignment2) {
+    int64_t i = 0, j = 0;
+    while (1) {
+        while (i < endAlignment1->length && endAlignment1->alignedPairs[i].deleted) {
+            i++;
+        }
+        while (j < endAlignment2->length && endAlignment2->alignedPairs[j].deleted) {
+            j++;
+        }
+        if (i == endAlignment1->length || j == endAlignment2->length) {
+            return i == endAlignment1->length && j == endAlignment2->length;
+        }
+        AlignedPair *alignedPair1 = &endAlignment1->alignedPairs[i++];
+        AlignedPair *alignedPair2 = &endAlignment2->alignedPairs[j++];
+        if (alignedPair_cmpFn(alignedPair1, alignedPair2) != 0 || alignedPair1->score != alignedPair2->score
+                || alignedPair1->reverse->score != alignedPair2->reverse->score) {
+            return 0;
+        }
+    }
+}
+
+EndAlignment *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
         bool useProgressiveMerging, float gapGamma,
         PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
     //Make an alignment of the sequences in the ends
@@ -141,9 +365,9 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     }
 
     //Convert the alignment pairs to an alignment of the caps..
-    stSortedSet *sortedAlignment =
-                stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
-                (void (*)(void *))alignedPair_destruct);
+    EndAlignment *endAlignment = endAlignment_construct();
+    endAlignment->maxLength = 2 * stList_length(mA->alignedPairs);
+    endAlignment->alignedPairs = st_malloc(sizeof(AlignedPair) * (endAlignment->maxLength > 0 ? endAlignment->maxLength : 1));
     while(stList_length(mA->alignedPairs) > 0) {
         stIntTuple *alignedPair = stList_pop(mA->alignedPairs);
         assert(stIntTuple_length(alignedPair) == 5);
@@ -165,16 +389,13 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
         double *scoreAdjustments = seqFrag1->rightEndId == seqFrag2->rightEndId ? scoreAdjustmentsCommonEnds : scoreAdjustmentsNonCommonEnds;
         assert(scoreAdjustments[seqIndex1] != INT64_MIN);
         assert(scoreAdjustments[seqIndex2] != INT64_MIN);
-        AlignedPair *alignedPair2 = alignedPair_construct(
+        endAlignment_add(endAlignment,
                 i->subsequenceIdentifier, i->start + (i->strand ? offset1 : -offset1), i->strand,
                 j->subsequenceIdentifier, j->start + (j->strand ? offset2 : -offset2), j->strand,
                 score*scoreAdjustments[seqIndex1], score*scoreAdjustments[seqIndex2]); //Do the reweighting here.
-        assert(stSortedSet_search(sortedAlignment, alignedPair2) == NULL);
-        assert(stSortedSet_search(sortedAlignment, alignedPair2->reverse) == NULL);
-        stSortedSet_insert(sortedAlignment, alignedPair2);
-        stSortedSet_insert(sortedAlignment, alignedPair2->reverse);
         stIntTuple_destruct(alignedPair);
     }
+    endAlignment_sort(endAlignment); //This also checks there are no duplicate pairs
     //Cleanup
     stList_destruct(seqFrags);
     stList_destruct(sequences);
@@ -185,56 +406,135 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     multipleAlignment_destruct(mA);
     stHash_destruct(endInstanceNumbers);
 
-    return sortedAlignment;
+    return endAlignment;
 }
 
-void writeEndAlignmentToDisk(End *end, stSortedSet *endAlignment, FILE *fileHandle) {
-    fprintf(fileHandle, "%s %" PRIi64 "\n", cactusMisc_nameToStringStatic(end_getName(end)), stSortedSet_size(endAlignment));
-    stSortedSetIterator *it = stSortedSet_getIterator(endAlignment);
-    AlignedPair *aP;
-    while((aP = stSortedSet_getNext(it)) != NULL) {
-        fprintf(fileHandle, "%" PRIi64 " %" PRIi64 " %i %" PRIi64 " ", aP->subsequenceIdentifier, aP->position, aP->strand, aP->score);
-        aP = aP->reverse;
-        fprintf(fileHandle, "%" PRIi64 " %" PRIi64 " %i %" PRIi64 "\n", aP->subsequenceIdentifier, aP->position, aP->strand, aP->score);
+/*
+ * The header of each end alignment in an end alignment file. It is followed by "pairNumber" aligned pairs,
+ * in sorted order, each written as an AlignedPair whose reverse pointer holds the index of its reverse instead.
+ * The size of the header is a multiple of 8 so that the aligned pairs can be mapped in place.
+ */
+typedef struct _endAlignmentFileHeader {
+    uint64_t magicNumber;
+    int64_t version;
+    int64_t recordSize; // The size of an aligned pair, so that files are not read by an incompatible build
+    int64_t endName;
+    int64_t pairNumber;
+} EndAlignmentFileHeader;
+
+#define END_ALIGNMENT_FILE_MAGIC_NUMBER 0x4e47494c41444e45 // "ENDALIGN"
+#define END_ALIGNMENT_FILE_VERSION 1
+
+void writeEndAlignmentToDisk(End *end, EndAlignment *endAlignment, FILE *fileHandle) {
+    assert(endAlignment->sorted);
+    //Get the indices the pairs will have once the deleted pairs are removed
+    int64_t *indices = st_malloc(sizeof(int64_t) * (endAlignment->length > 0 ? endAlignment->length : 1));
+    int64_t pairNumber = 0;
+    for (int64_t i = 0; i < endAlignment->length; i++) {
+        indices[i] = endAlignment->alignedPairs[i].deleted ? -1 : pairNumber++;
+    }
+    assert(pairNumber == endAlignment_size(endAlignment));
+
+    EndAlignmentFileHeader header;
+    memset(&header, 0, sizeof(EndAlignmentFileHeader));
+    header.magicNumber = END_ALIGNMENT_FILE_MAGIC_NUMBER;
+    header.version = END_ALIGNMENT_FILE_VERSION;
+    header.recordSize = sizeof(AlignedPair);
+    header.endName = end_getName(end);
+    header.pairNumber = pairNumber;
+    if (fwrite(&header, sizeof(EndAlignmentFileHeader), 1, fileHandle) != 1) {
+        st_errnoAbort("Failed to write an end alignment header");
+    }
+    for (int64_t i = 0; i < endAlignment->length; i++) {
+        AlignedPair *aP = &endAlignment->alignedPairs[i];
+        if (aP->deleted) {
+            continue;
+        }
+        AlignedPair record;
+        memset(&record, 0, sizeof(AlignedPair)); //Don't write uninitialised padding
+        record.subsequenceIdentifier = aP->subsequenceIdentifier;
+        record.position = aP->position;
+        record.score = aP->score;
+        record.strand = aP->strand;
+        assert(indices[aP->reverse - endAlignment->alignedPairs] >= 0);
+        record.reverse = (AlignedPair *) (intptr_t) indices[aP->reverse - endAlignment->alignedPairs];
+        if (fwrite(&record, sizeof(AlignedPair), 1, fileHandle) != 1) {
+            st_errnoAbort("Failed to write an end alignment");
+        }
     }
-    stSortedSet_destructIterator(it);
+    free(indices);
 }
 
-stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end) {
-    stSortedSet *endAlignment =
-                stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
-                (void (*)(void *))alignedPair_destruct);
-    char *line = stFile_getLineFromFile(fileHandle);
-    if(line == NULL) {
+EndAlignment *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end) {
+    EndAlignmentFileHeader header;
+    size_t i = fread(&header, sizeof(EndAlignmentFileHeader), 1, fileHandle);
+    if (i != 1) {
+        if (ferror(fileHandle)) {
+            st_errnoAbort("Failed to read an end alignment header");
+        }
         *end = NULL;
         return NULL;
     }
-    Name flowerName;
-    int64_t lineNumber;
-    int64_t i = sscanf(line, "%" PRIi64 " %" PRIi64 "", &flowerName, &lineNumber);
-    if(i != 2 || lineNumber < 0) {
-        st_errAbort("We encountered a mis-specified name in loading the first line of an end alignment from the disk: '%s'\n", line);
+    if (header.magicNumber != END_ALIGNMENT_FILE_MAGIC_NUMBER) {
+        st_errAbort("The file does not contain an end alignment\n");
     }
-    free(line);
-    *end = flower_getEnd(flower, flowerName);
+    if (header.version != END_ALIGNMENT_FILE_VERSION || header.recordSize != sizeof(AlignedPair)) {
+        st_errAbort("The end alignment file has version %" PRIi64 " and record size %" PRIi64
+                    ", but we expect version %i and record size %" PRIi64 "\n", header.version, header.recordSize,
+                    END_ALIGNMENT_FILE_VERSION, (int64_t) sizeof(AlignedPair));
+    }
+    if (header.pairNumber < 0 || header.pairNumber % 2 != 0) {
+        st_errAbort("We encountered a mis-specified number of pairs in an end alignment: %" PRIi64 "\n", header.pairNumber);
+    }
+    *end = flower_getEnd(flower, header.endName);
     if(*end == NULL) {
-        st_errAbort("We encountered an end name that is not in the database: '%s'\n", line);
+        st_errAbort("We encountered an end name that is not in the database: %" PRIi64 "\n", header.endName);
     }
-    for(int64_t i=0; i<lineNumber; i++) {
-        line = stFile_getLineFromFile(fileHandle);
-        if(line == NULL) {
-            st_errAbort("Got a null line when parsing an end alignment\n");
-        }
-        int64_t sI1, sI2;
-        int64_t p1, st1, p2, st2, score1, score2;
-        int64_t i = sscanf(line, "%" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 "", &sI1, &p1, &st1, &score1, &sI2, &p2, &st2, &score2);
-        (void)i;
-        if(i != 8) {
-            st_errAbort("We encountered a mis-specified name in loading an end alignment from the disk: '%s'\n", line);
+
+    EndAlignment *endAlignment = endAlignment_construct();
+    if (header.pairNumber == 0) {
+        return endAlignment;
+    }
+
+    //Check the file holds all the pairs, so a truncated or corrupt file can't be read past the end of the mapping.
+    off_t offset = ftello(fileHandle);
+    struct stat fileStat;
+    if (offset < 0 || fstat(fileno(fileHandle), &fileStat) != 0) {
+        st_errnoAbort("Failed to get the size of an end alignment file");
+    }
+    if (header.pairNumber > (INT64_MAX - offset) / (int64_t) sizeof(AlignedPair)
+            || fileStat.st_size < offset + header.pairNumber * (int64_t) sizeof(AlignedPair)) {
+        st_errAbort("The end alignment file is too short to hold %" PRIi64 " pairs\n", header.pairNumber);
+    }
+
+    //Map the pairs from the file. The mapping is private, so the reverse pointers can be fixed up in place.
+    size_t length = header.pairNumber * sizeof(AlignedPair);
+    off_t pageSize = sysconf(_SC_PAGESIZE);
+    off_t mapOffset = offset - offset % pageSize;
+    endAlignment->mappedLength = length + (offset - mapOffset);
+    endAlignment->mappedMemory = mmap(NULL, endAlignment->mappedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                                      fileno(fileHandle), mapOffset);
+    if (endAlignment->mappedMemory == MAP_FAILED) {
+        st_errnoAbort("Failure mapping an end alignment");
+    }
+    if (fseeko(fileHandle, offset + length, SEEK_SET) != 0) {
+        st_errnoAbort("Failed to seek past an end alignment");
+    }
+    endAlignment->alignedPairs = (AlignedPair *) ((char *) endAlignment->mappedMemory + (offset - mapOffset));
+    endAlignment->length = header.pairNumber;
+    endAlignment->maxLength = header.pairNumber;
+
+    for (int64_t j = 0; j < endAlignment->length; j++) {
+        AlignedPair *aP = &endAlignment->alignedPairs[j];
+        int64_t k = (int64_t) (intptr_t) aP->reverse;
+        if (k < 0 || k >= endAlignment->length) {
+            st_errAbort("We encountered a mis-specified pair in an end alignment: %" PRIi64 "\n", k);
         }
-        stSortedSet_insert(endAlignment, alignedPair_construct(sI1, p1, st1, sI2, p2, st2, score1, score2));
-        free(line);
+        aP->reverse = &endAlignment->alignedPairs[k];
+        aP->deleted = 0;
+    }
+    for (int64_t j = 1; j < endAlignment->length; j++) {
+        assert(alignedPair_cmpFn(&endAlignment->alignedPairs[j - 1], &endAlignment->alignedPairs[j]) < 0);
     }
     return endAlignment;
 }
-
@@ -5,64 +5,43 @@
  */
 
 #include "endAligner.h"
+#include "flowerAligner.h"
 #include "cactus.h"
 #include "sonLib.h"
 #include "adjacencySequences.h"
 #include "pairwiseAligner.h"
 
-stList *getInducedAlignment(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence) {
+stList *getInducedAlignment(EndAlignment *endAlignment, AdjacencySequence *adjacencySequence) {
     /*
      * Gets an ordered list of pairs from the end alignment for the given adjacency sequence.
      */
     stList *inducedAlignment = stList_construct();
     if (adjacencySequence->strand) {
-        AlignedPair *alignedPair = alignedPair_construct(adjacencySequence->subsequenceIdentifier,
-                adjacencySequence->start - 1, adjacencySequence->strand, 0, 0, 0, 0, 0);
-        AlignedPair *alignedPair2 = stSortedSet_searchGreaterThan(endAlignment, alignedPair);
-        if (alignedPair2 != NULL) {
-            stSortedSetIterator *it = stSortedSet_getIteratorFrom(endAlignment, alignedPair2);
-            while ((alignedPair2 = stSortedSet_getNext(it)) != NULL) {
-                if (alignedPair2->subsequenceIdentifier == adjacencySequence->subsequenceIdentifier) {
-                    if (alignedPair2->position >= adjacencySequence->start + adjacencySequence->length) {
-                        break;
-                    }
-                    assert(alignedPair2->position >= adjacencySequence->start);
-                    if (alignedPair2->strand == adjacencySequence->strand) {
-                        stList_append(inducedAlignment, alignedPair2);
-                    }
-                } else {
-                    break;
-                }
+        for (int64_t i = endAlignment_lowerBound(endAlignment, adjacencySequence->subsequenceIdentifier,
+                adjacencySequence->start); i < endAlignment->length; i++) {
+            AlignedPair *alignedPair = &endAlignment->alignedPairs[i];
+            if (alignedPair->subsequenceIdentifier != adjacencySequence->subsequenceIdentifier
+                    || alignedPair->position >= adjacencySequence->start + adjacencySequence->length) {
+                break;
+            }
+            assert(alignedPair->position >= adjacencySequence->start);
+            if (alignedPair->strand == adjacencySequence->strand && !alignedPair->deleted) {
+                stList_append(inducedAlignment, alignedPair);
             }
-            stSortedSet_destructIterator(it);
         }
-        alignedPair_destruct(alignedPair->reverse);
-        alignedPair_destruct(alignedPair);
     } else {
-        AlignedPair *alignedPair = alignedPair_construct(adjacencySequence->subsequenceIdentifier,
-                adjacencySequence->start + 1, adjacencySequence->strand, 0, 0, 0, 0, 0);
-        AlignedPair *alignedPair2 = stSortedSet_searchLessThan(endAlignment, alignedPair);
-        if (alignedPair2 != NULL) {
-            stSortedSetIterator *it = stSortedSet_getIteratorFrom(endAlignment, alignedPair2);
-            stSortedSet_getNext(it);
-            stSortedSet_getNext(it); //shift it up..
-            while ((alignedPair2 = stSortedSet_getPrevious(it)) != NULL) {
-                if (alignedPair2->subsequenceIdentifier == adjacencySequence->subsequenceIdentifier) {
-                    if (alignedPair2->position <= adjacencySequence->start - adjacencySequence->length) {
-                        break;
-                    }
-                    assert(alignedPair2->position <= adjacencySequence->start);
-                    if (alignedPair2->strand == adjacencySequence->strand) {
-                        stList_append(inducedAlignment, alignedPair2);
-                    }
-                } else {
-                    break;
-                }
+        for (int64_t i = endAlignment_lowerBound(endAlignment, adjacencySequence->subsequenceIdentifier,
+                adjacencySequence->start + 1) - 1; i >= 0; i--) {
+            AlignedPair *alignedPair = &endAlignment->alignedPairs[i];
+            if (alignedPair->subsequenceIdentifier != adjacencySequence->subsequenceIdentifier
+                    || alignedPair->position <= adjacencySequence->start - adjacencySequence->length) {
+                break;
+            }
+            assert(alignedPair->position <= adjacencySequence->start);
+            if (alignedPair->strand == adjacencySequence->strand && !alignedPair->deleted) {
+                stList_append(inducedAlignment, alignedPair);
             }
-            stSortedSet_destructIterator(it);
         }
-        alignedPair_destruct(alignedPair->reverse);
-        alignedPair_destruct(alignedPair);
     }
     /*
      * Check the induced alignment
@@ -190,44 +169,33 @@ void updateDeletedPairs(int64_t subsequenceIdentifier, stHash *deletedAlignedPai
     (*j)++;
 }
 
-static void pruneAlignmentsP(stList *inducedAlignment, stSortedSet *endAlignment, int64_t start, int64_t end,
-        stSortedSet *pairsToDelete, stHash *deletedAlignedPairCounts) {
+static void pruneAlignmentsP(stList *inducedAlignment, EndAlignment *endAlignment, int64_t start, int64_t end,
+        stHash *deletedAlignedPairCounts) {
     for (int64_t i = start; i < end; i++) {
         AlignedPair *alignedPair = stList_get(inducedAlignment, i);
-        if (stSortedSet_search(endAlignment, alignedPair) != NULL) { //can be missing if we are pruning the reverse strand alignment at the same time
-            assert(stSortedSet_search(endAlignment, alignedPair->reverse) != NULL);
+        if (!alignedPair->deleted) { //can be deleted if we are pruning the reverse strand alignment at the same time
             updateDeletedPairs(alignedPair->subsequenceIdentifier, deletedAlignedPairCounts);
             updateDeletedPairs(alignedPair->reverse->subsequenceIdentifier, deletedAlignedPairCounts);
-            stSortedSet_remove(endAlignment, alignedPair);
-            stSortedSet_remove(endAlignment, alignedPair->reverse);
-            if (stSortedSet_search(pairsToDelete, alignedPair) == NULL) { // &&
-                assert(stSortedSet_search(pairsToDelete, alignedPair->reverse) == NULL);
-                stSortedSet_insert(pairsToDelete, alignedPair);
-                stSortedSet_insert(pairsToDelete, alignedPair->reverse);
-            } else {
-                assert(stSortedSet_search(pairsToDelete, alignedPair->reverse) != NULL);
-            }
+            endAlignment_delete(endAlignment, alignedPair);
         }
     }
 }
 
-static void pruneAlignments(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, stSortedSet *endAlignment1,
-        stSortedSet *endAlignment2, void *deletedAlignedPairCounts) {
+static void pruneAlignments(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, EndAlignment *endAlignment1,
+        EndAlignment *endAlignment2, void *deletedAlignedPairCounts) {
     /*
      * Chooses a point along the adjacency sequence at which to filter the two alignments,
      * then filters the aligned pairs by this point.
      */
     int64_t cutOff1 = 0, cutOff2 = 0;
     getCutOff(inducedAlignment1, inducedAlignment2, &cutOff1, &cutOff2);
-    stSortedSet *pairsToDelete = stSortedSet_construct2((void(*)(void *)) alignedPair_destruct);
     //Now do the actual filtering of the alignments.
-    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1, stList_length(inducedAlignment1), pairsToDelete, deletedAlignedPairCounts);
-    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, deletedAlignedPairCounts);
-    stSortedSet_destruct(pairsToDelete);
+    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1, stList_length(inducedAlignment1), deletedAlignedPairCounts);
+    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, deletedAlignedPairCounts);
 }
 
-void getScore(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, stSortedSet *endAlignment1,
-        stSortedSet *endAlignment2, void *capScoresFnHash) {
+void getScore(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, EndAlignment *endAlignment1,
+        EndAlignment *endAlignment2, void *capScoresFnHash) {
 
     int64_t i, j;
     int64_t *maxScore = st_malloc(sizeof(int64_t));
@@ -237,12 +205,39 @@ void getScore(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2, st
     stHash_insert(capScoresFnHash, cap, maxScore);
 }
 
-static int sortCapsFn(const void *cap1, const void *cap2, void *capScoresFnHash) {
-    assert(stHash_search((stHash *)capScoresFnHash, (void *) cap1) != NULL);
-    assert(stHash_search((stHash *)capScoresFnHash, (void *) cap2) != NULL);
-    int64_t i = ((int64_t *) stHash_search((stHash *)capScoresFnHash, (void *) cap1))[0] - ((int64_t *) stHash_search(
-            (stHash *)capScoresFnHash, (void *) cap2))[0];
-    return (i > 0) ? 1 : ((i < 0) ? -1 : 0); 
+typedef struct _capScore {
+    Cap *cap;
+    int64_t score;
+    int64_t index; // Position before sorting, so ties keep their order
+} CapScore;
+
+static int sortCapsFn(const void *a, const void *b) {
+    const CapScore *capScore1 = a, *capScore2 = b;
+    if (capScore1->score != capScore2->score) {
+        return capScore1->score > capScore2->score ? 1 : -1;
+    }
+    return capScore1->index > capScore2->index ? 1 : (capScore1->index < capScore2->index ? -1 : 0);
+}
+
+/*
+ * Sorts the caps in ascending order of their cut off score. The scores are copied into a local array and sorted with
+ * qsort, as stList_sort2 keeps its comparator and argument in statics and flowers are aligned in parallel.
+ */
+static void sortCapsByScore(stList *caps, stHash *capScoresFnHash) {
+    int64_t capNumber = stList_length(caps);
+    CapScore *capScores = st_malloc(sizeof(CapScore) * (capNumber > 0 ? capNumber : 1));
+    for (int64_t i = 0; i < capNumber; i++) {
+        capScores[i].cap = stList_get(caps, i);
+        int64_t *score = stHash_search(capScoresFnHash, capScores[i].cap);
+        assert(score != NULL);
+        capScores[i].score = score[0];
+        capScores[i].index = i;
+    }
+    qsort(capScores, capNumber, sizeof(CapScore), sortCapsFn);
+    for (int64_t i = 0; i < capNumber; i++) {
+        stList_set(caps, i, capScores[i].cap);
+    }
+    free(capScores);
 }
 
 bool isAlignedToStubSequence(AlignedPair *alignedPair, Flower *flower) {
@@ -274,7 +269,7 @@ static int64_t findFirstNonStubAlignment(Flower *flower, stList *inducedAlignmen
 }
 
 static void pruneStubAlignments(Cap *cap, stList *inducedAlignment1, stList *inducedAlignment2,
-        stSortedSet *endAlignment1, stSortedSet *endAlignment2, void *deletedAlignedPairCounts) {
+        EndAlignment *endAlignment1, EndAlignment *endAlignment2, void *deletedAlignedPairCounts) {
     assert(cap != NULL);
     End *end = cap_getEnd(cap);
     assert(cap_getAdjacency(cap) != NULL);
@@ -293,11 +288,9 @@ static void pruneStubAlignments(Cap *cap, stList *inducedAlignment1, stList *ind
         cutOff1 = -1;
         cutOff2 = findFirstNonStubAlignment(end_getFlower(end), inducedAlignment2, 0);
     }
-    stSortedSet *pairsToDelete = stSortedSet_construct2((void(*)(void *)) alignedPair_destruct);
     //Now do the actual filtering of the alignments.
-    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1 + 1, stList_length(inducedAlignment1), pairsToDelete, deletedAlignedPairCounts);
-    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, pairsToDelete, deletedAlignedPairCounts);
-    stSortedSet_destruct(pairsToDelete);
+    pruneAlignmentsP(inducedAlignment1, endAlignment1, cutOff1 + 1, stList_length(inducedAlignment1), deletedAlignedPairCounts);
+    pruneAlignmentsP(inducedAlignment2, endAlignment2, 0, cutOff2, deletedAlignedPairCounts);
 }
 
 /*
@@ -305,8 +298,8 @@ static void pruneStubAlignments(Cap *cap, stList *inducedAlignment1, stList *ind
  */
 
 static int makeFlowerAlignmentP(Cap *cap, stHash *endAlignments,
-        void(*fn)(Cap *, stList *, stList *, stSortedSet *, stSortedSet *, void *), void *extraArg) {
-    stSortedSet *endAlignment1 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(cap)));
+        void(*fn)(Cap *, stList *, stList *, EndAlignment *, EndAlignment *, void *), void *extraArg) {
+    EndAlignment *endAlignment1 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(cap)));
     assert(endAlignment1 != NULL);
 
     Cap *adjacentCap = cap_getAdjacency(cap);
@@ -314,7 +307,7 @@ static int makeFlowerAlignmentP(Cap *cap, stHash *endAlignments,
     assert(cap_getSide(adjacentCap));
     assert(cap_getStrand(adjacentCap));
     adjacentCap = cap_getReverse(adjacentCap);
-    stSortedSet *endAlignment2 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(adjacentCap)));
+    EndAlignment *endAlignment2 = stHash_search(endAlignments, end_getPositiveOrientation(cap_getEnd(adjacentCap)));
     assert(endAlignment2 != NULL);
 
     AdjacencySequence *adjacencySequence1 = adjacencySequence_construct(cap, INT64_MAX);
@@ -338,7 +331,110 @@ static int makeFlowerAlignmentP(Cap *cap, stHash *endAlignments,
     return 1;
 }
 
-static stSortedSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments, bool pruneOutStubAlignments) {
+/*
+ * A position in one of the sorted end alignments being merged, and the index in the merged alignment of each of its
+ * remaining pairs.
+ */
+typedef struct _mergeCursor {
+    EndAlignment *endAlignment;
+    int64_t index;
+    int64_t *mergedIndexes;
+} MergeCursor;
+
+static void mergeCursor_skipDeleted(MergeCursor *cursor) {
+    while (cursor->index < cursor->endAlignment->length && cursor->endAlignment->alignedPairs[cursor->index].deleted) {
+        cursor->index++;
+    }
+}
+
+static bool mergeCursor_lessThan(MergeCursor *cursor1, MergeCursor *cursor2) {
+    return alignedPair_cmpFn(&cursor1->endAlignment->alignedPairs[cursor1->index],
+                             &cursor2->endAlignment->alignedPairs[cursor2->index]) < 0;
+}
+
+static void mergeCursors_siftDown(MergeCursor **heap, int64_t heapLength, int64_t i) {
+    MergeCursor *cursor = heap[i];
+    while (2 * i + 1 < heapLength) {
+        int64_t j = 2 * i + 1;
+        if (j + 1 < heapLength && mergeCursor_lessThan(heap[j + 1], heap[j])) {
+            j++;
+        }
+        if (!mergeCursor_lessThan(heap[j], cursor)) {
+            break;
+        }
+        heap[i] = heap[j];
+        i = j;
+    }
+    heap[i] = cursor;
+}
+
+static EndAlignment *mergeEndAlignments(stHash *endAlignments) {
+    /*
+     * Merges the remaining pairs of the sorted end alignments into a single sorted alignment, each pair held in both
+     * orientations. The end alignments are merged with a min-heap of cursors, so the pairs are not sorted again.
+     */
+    stList *endAlignmentsList = stHash_getValues(endAlignments);
+    int64_t cursorNumber = stList_length(endAlignmentsList);
+    MergeCursor *cursors = st_malloc(sizeof(MergeCursor) * (cursorNumber > 0 ? cursorNumber : 1));
+    MergeCursor **heap = st_malloc(sizeof(MergeCursor *) * (cursorNumber > 0 ? cursorNumber : 1));
+    int64_t heapLength = 0, length = 0;
+    for (int64_t i = 0; i < cursorNumber; i++) {
+        EndAlignment *endAlignment = stList_get(endAlignmentsList, i);
+        assert(endAlignment->sorted);
+        cursors[i].endAlignment = endAlignment;
+        cursors[i].index = 0;
+        cursors[i].mergedIndexes = st_malloc(sizeof(int64_t) * (endAlignment->length > 0 ? endAlignment->length : 1));
+        length += endAlignment_size(endAlignment);
+        mergeCursor_skipDeleted(&cursors[i]);
+        if (cursors[i].index < endAlignment->length) {
+            heap[heapLength++] = &cursors[i];
+        }
+    }
+    for (int64_t i = heapLength / 2 - 1; i >= 0; i--) {
+        mergeCursors_siftDown(heap, heapLength, i);
+    }
+
+    EndAlignment *flowerAlignment = endAlignment_construct();
+    flowerAlignment->alignedPairs = st_malloc(sizeof(AlignedPair) * (length > 0 ? length : 1));
+    flowerAlignment->length = length;
+    flowerAlignment->maxLength = length;
+    int64_t k = 0;
+    while (heapLength > 0) {
+        MergeCursor *cursor = heap[0];
+        AlignedPair *alignedPair = &cursor->endAlignment->alignedPairs[cursor->index];
+        assert(alignedPair->deleted == alignedPair->reverse->deleted);
+        assert(k == 0 || alignedPair_cmpFn(&flowerAlignment->alignedPairs[k - 1], alignedPair) < 0);
+        flowerAlignment->alignedPairs[k] = *alignedPair;
+        cursor->mergedIndexes[cursor->index++] = k++;
+        mergeCursor_skipDeleted(cursor);
+        if (cursor->index == cursor->endAlignment->length) {
+            heap[0] = heap[--heapLength];
+        }
+        if (heapLength > 0) {
+            mergeCursors_siftDown(heap, heapLength, 0);
+        }
+    }
+    assert(k == length);
+
+    //Link each pair to its reverse, which is in the same end alignment.
+    for (int64_t i = 0; i < cursorNumber; i++) {
+        EndAlignment *endAlignment = cursors[i].endAlignment;
+        for (int64_t j = 0; j < endAlignment->length; j++) {
+            AlignedPair *alignedPair = &endAlignment->alignedPairs[j];
+            if (!alignedPair->deleted) {
+                flowerAlignment->alignedPairs[cursors[i].mergedIndexes[j]].reverse =
+                        &flowerAlignment->alignedPairs[cursors[i].mergedIndexes[alignedPair->reverse - endAlignment->alignedPairs]];
+            }
+        }
+        free(cursors[i].mergedIndexes);
+    }
+    free(cursors);
+    free(heap);
+    stList_destruct(endAlignmentsList);
+    return flowerAlignment;
+}
+
+static EndAlignment *makeFlowerAlignment2(Flower *flower, stHash *endAlignments, bool pruneOutStubAlignments) {
     /*
      * Makes the alignments of the ends, in "endAlignments", consistent with one another using the bar algorithm.
      */
@@ -365,7 +461,7 @@ static stSortedSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments,
     }
     flower_destructEndIterator(endIterator);
     assert(stHash_size(capScoresFnHash) == stList_length(caps));
-    stList_sort2(caps, sortCapsFn, capScoresFnHash); //sorts the caps in ascending order according to their cut off score.
+    sortCapsByScore(caps, capScoresFnHash); //sorts the caps in ascending order according to their cut off score.
 
     //Now do the actual pruning
     stHash *deletedAlignedPairCounts = stHash_construct3((uint64_t (*)(const void *))stIntTuple_hashKey,
@@ -413,28 +509,12 @@ static stSortedSet *makeFlowerAlignment2(Flower *flower, stHash *endAlignments,
     }
     stList_destruct(freeStubCaps);
 
-    //Now convert to set of final aligned pairs to return.
-    stSortedSet *sortedAlignment = stSortedSet_construct3((int(*)(const void *, const void *)) alignedPair_cmpFn,
-            (void(*)(void *)) alignedPair_destruct);
-    stList *endAlignmentsList = stHash_getValues(endAlignments);
-    while (stList_length(endAlignmentsList) > 0) {
-        stSortedSet *endAlignment = stList_pop(endAlignmentsList);
-        while (stSortedSet_size(endAlignment) > 0) {
-            AlignedPair *alignedPair = stSortedSet_getFirst(endAlignment);
-            stSortedSet_remove(endAlignment, alignedPair);
-            assert(stSortedSet_search(endAlignment, alignedPair->reverse) != NULL);
-            stSortedSet_remove(endAlignment, alignedPair->reverse);
-            assert(stSortedSet_search(sortedAlignment, alignedPair) == NULL);
-            assert(stSortedSet_search(sortedAlignment, alignedPair->reverse) == NULL);
-            stSortedSet_insert(sortedAlignment, alignedPair);
-            stSortedSet_insert(sortedAlignment, alignedPair->reverse);
-        }
-    }
-    stList_destruct(endAlignmentsList);
+    //Now merge the remaining pairs of the end alignments into the flower alignment.
+    EndAlignment *flowerAlignment = mergeEndAlignments(endAlignments);
     stHash_destruct(endAlignments);
     stHash_destruct(deletedAlignedPairCounts);
 
-    return sortedAlignment;
+    return flowerAlignment;
 }
 
 /*
@@ -531,30 +611,34 @@ static void computeMissingEndAlignments(StateMachine *sM, Flower *flower, stHash
      */
     //Make the end alignments, representing each as an adjacency alignment.
     stSortedSet *endsToAlign = getEndsToAlign(flower, maxSequenceLength);
+    stList *missingEnds = stList_construct();
     End *end;
     Flower_EndIterator *endIterator = flower_getEndIterator(flower);
     while ((end = flower_getNextEnd(endIterator)) != NULL) {
         if (stHash_search(endAlignments, end) == NULL) {
             if (stSortedSet_search(endsToAlign, end) != NULL) {
-                stHash_insert(
-                        endAlignments,
-                        end,
-                        makeEndAlignment(sM, end, spanningTrees, maxSequenceLength,
-                                useProgressiveMerging, gapGamma,
-                                pairwiseAlignmentBandingParameters));
+                stList_append(missingEnds, end);
             } else {
-                stHash_insert(endAlignments, end, stSortedSet_construct());
+                stHash_insert(endAlignments, end, endAlignment_construct());
             }
         }
     }
     flower_destructEndIterator(endIterator);
     stSortedSet_destruct(endsToAlign);
+
+    stList *missingEndAlignments = makeEndAlignments(sM, missingEnds, spanningTrees, maxSequenceLength,
+            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
+    for (int64_t i = 0; i < stList_length(missingEnds); i++) {
+        stHash_insert(endAlignments, stList_get(missingEnds, i), stList_get(missingEndAlignments, i));
+    }
+    stList_destruct(missingEndAlignments);
+    stList_destruct(missingEnds);
 }
 
-stSortedSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees, int64_t maxSequenceLength,
+EndAlignment *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees, int64_t maxSequenceLength,
         bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments, int64_t poaWindow) {
-    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) stSortedSet_destruct);
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments) {
+    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) endAlignment_destruct);
     computeMissingEndAlignments(sM, flower, endAlignments, spanningTrees, maxSequenceLength,
             useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
     return makeFlowerAlignment2(flower, endAlignments, pruneOutStubAlignments);
@@ -566,8 +650,11 @@ static void loadEndAlignments(Flower *flower, stHash *endAlignments, stList *lis
      */
     for (int64_t i = 0; i < stList_length(listOfEndAlignments); i++) {
         End *end;
-        FILE *fileHandle = fopen(stList_get(listOfEndAlignments, i), "r");
-        stSortedSet *alignment;
+        FILE *fileHandle = fopen(stList_get(listOfEndAlignments, i), "rb");
+        if (fileHandle == NULL) {
+            st_errnoAbort("Opening end alignment file %s failed", (char *)stList_get(listOfEndAlignments, i));
+        }
+        EndAlignment *alignment;
         while((alignment = loadEndAlignmentFromDisk(flower, fileHandle, &end)) != NULL) {
             assert(stHash_search(endAlignments, end) == NULL);
             stHash_insert(endAlignments, end, alignment);
@@ -576,10 +663,10 @@ static void loadEndAlignments(Flower *flower, stHash *endAlignments, stList *lis
     }
 }
 
-stSortedSet *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
+EndAlignment *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
         PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments) {
-    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) stSortedSet_destruct);
+    stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) endAlignment_destruct);
     if(listOfEndAlignmentFiles != NULL) {
         loadEndAlignments(flower, endAlignments, listOfEndAlignmentFiles);
     }
@@ -630,3 +717,52 @@ stSortedSet *getEndsToAlignSeparately(Flower *flower, int64_t maxSequenceLength,
     }
     return largeEndsToAlign;
 }
+
+/*
+ * Functions for computing end alignments in parallel.
+ */
+
+typedef struct _endToAlign {
+    End *end;
+    int64_t index; // Index of the end in the input list
+    int64_t totalAdjacencyLength;
+} EndToAlign;
+
+static int endToAlign_cmpByDecreasingSize(const void *a, const void *b) {
+    const EndToAlign *e1 = a, *e2 = b;
+    if (e1->totalAdjacencyLength != e2->totalAdjacencyLength) {
+        return e1->totalAdjacencyLength > e2->totalAdjacencyLength ? -1 : 1;
+    }
+    return e1->index < e2->index ? -1 : (e1->index > e2->index ? 1 : 0);
+}
+
+stList *makeEndAlignments(StateMachine *sM, stList *ends, int64_t spanningTrees, int64_t maxSequenceLength,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
+    int64_t endNumber = stList_length(ends);
+    EndToAlign *endsToAlign = st_malloc(sizeof(EndToAlign) * (endNumber > 0 ? endNumber : 1));
+    for (int64_t i = 0; i < endNumber; i++) {
+        endsToAlign[i].end = stList_get(ends, i);
+        endsToAlign[i].index = i;
+        endsToAlign[i].totalAdjacencyLength = getTotalAdjacencyLength(endsToAlign[i].end);
+    }
+    //Start the biggest alignments first, to shorten the tail.
+    qsort(endsToAlign, endNumber, sizeof(EndToAlign), endToAlign_cmpByDecreasingSize);
+
+    EndAlignment **endAlignments = st_calloc(endNumber > 0 ? endNumber : 1, sizeof(EndAlignment *));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int64_t i = 0; i < endNumber; i++) {
+        endAlignments[endsToAlign[i].index] = makeEndAlignment(sM, endsToAlign[i].end, spanningTrees,
+                maxSequenceLength, useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
+    }
+
+    stList *endAlignmentsList = stList_construct();
+    for (int64_t i = 0; i < endNumber; i++) {
+        stList_append(endAlignmentsList, endAlignments[i]);
+    }
+    free(endAlignments);
+    free(endsToAlign);
+    return endAlignmentsList;
+}
@@ -91,60 +91,87 @@ static void flip_msa_seq(Msa* msa) {
     }
 }
 
+/**
+ * The POA alphabet value of a gap, msa_to_byte('-').
+ */
+#define MSA_GAP 5
+
+static inline bool msa_is_gap(uint8_t n) {
+    return n == MSA_GAP;
+}
+
 /**
  * Returns an array of floats, one for each corresponding column in the MSA. Each float
  * is the score of the column in the alignment.
  */
 static float *make_column_scores(Msa *msa) {
-    float *column_scores = st_calloc(msa->column_no, sizeof(float));
+    // Count the bases in each column, streaming along the rows of the msa rather than down its columns,
+    // which keeps the memory access contiguous and lets the compiler vectorise the inner loop
+    int32_t *base_counts = st_calloc(msa->column_no, sizeof(int32_t));
+    for(int64_t j=0; j<msa->seq_no; j++) {
+        uint8_t *row = msa->msa_seq[j];
+        for(int64_t i=0; i<msa->column_no; i++) {
+            base_counts[i] += row[i] != MSA_GAP;
+        }
+    }
+    float *column_scores = st_malloc(msa->column_no * sizeof(float));
     for(int64_t i=0; i<msa->column_no; i++) {
         // Score is simply max(number of aligned bases in the column - 1, 0)
-        for(int64_t j=0; j<msa->seq_no; j++) {
-            if(msa_to_base(msa->msa_seq[j][i]) != '-') {
-                column_scores[i]++;
-            }
-        }
-        if(column_scores[i] >= 1.0) {
-            column_scores[i]--;
-        }
-        assert(column_scores[i] >= 0.0);
+        column_scores[i] = base_counts[i] > 1 ? base_counts[i] - 1 : 0;
     }
+    free(base_counts);
     return column_scores;
 }
 
 /**
- * Fills in cu_column_scores with the cumulative sum of column scores, from left-to-right, of columns
- * containing a non-gap character in the given "row".
+ * Reverses the column scores, to match an msa that has been flipped with flip_msa_seq.
  */
-static void sum_column_scores(int64_t row, Msa *msa, float *column_scores, float *cu_column_scores) {
-    float cu_score = 0.0; // The cumulative sum of column scores containing bases for the given row
-    int64_t j=0; // The index in the DNA string for the given row
-    for(int64_t i=0; i<msa->column_no; i++) {
-        if(msa_to_base(msa->msa_seq[row][i]) != '-') {
-            cu_score += column_scores[i];
-            cu_column_scores[j++] = cu_score;
-        }
+static void flip_column_scores(float *column_scores, int64_t column_no) {
+    for(int64_t i=0, j=column_no-1; i<j; i++, j--) {
+        float f = column_scores[i];
+        column_scores[i] = column_scores[j];
+        column_scores[j] = f;
     }
-    assert(msa->seq_lens[row] == j); // We should cover all the bases in the DNA sequence
 }
 
 /**
- * Removes the suffix of the given row from the MSA and updates the column scores. suffix_start is the beginning
- * suffix to remove.
+ * Fills in suffix_columns with the columns of the last suffix_length bases of the given row, in left-to-right
+ * order, by scanning back from the end of the row.
  */
-static void trim_msa_suffix(Msa *msa, float *column_scores, int64_t row, int64_t suffix_start) {
-    int64_t seq_index = 0;
-    for(int64_t i=0; i<msa->column_no; i++) {
-        if(msa_to_base(msa->msa_seq[row][i]) != '-') {
-            if(seq_index++ >= suffix_start) {
-                msa->msa_seq[row][i] = msa_to_byte('-');
-                column_scores[i] = column_scores[i]-1 > 0 ? column_scores[i]-1 : 0;
-                assert(column_scores[i] >= 0.0);
-            }
+static void get_suffix_columns(Msa *msa, int64_t row, int64_t suffix_length, int64_t *suffix_columns) {
+    int64_t j = suffix_length;
+    for(int64_t i=msa->column_no-1; j>0; i--) {
+        assert(i >= 0); // The row must contain at least suffix_length bases
+        if(!msa_is_gap(msa->msa_seq[row][i])) {
+            suffix_columns[--j] = i;
         }
     }
 }
 
+/**
+ * Fills in cu_column_scores with the cumulative sum, from left-to-right, of the column scores of the given columns.
+ */
+static void sum_column_scores(int64_t *columns, int64_t column_no, float *column_scores, float *cu_column_scores) {
+    float cu_score = 0.0; // The cumulative sum of column scores containing bases for the given row
+    for(int64_t i=0; i<column_no; i++) {
+        cu_score += column_scores[columns[i]];
+        cu_column_scores[i] = cu_score;
+    }
+}
+
+/**
+ * Removes the bases in the given columns of the row from the MSA and updates the column scores.
+ */
+static void trim_msa_suffix(Msa *msa, float *column_scores, int64_t row, int64_t *columns, int64_t column_no) {
+    for(int64_t i=0; i<column_no; i++) {
+        int64_t j = columns[i];
+        assert(!msa_is_gap(msa->msa_seq[row][j]));
+        msa->msa_seq[row][j] = MSA_GAP;
+        column_scores[j] = column_scores[j]-1 > 0 ? column_scores[j]-1 : 0;
+        assert(column_scores[j] >= 0.0);
+    }
+}
+
 /**
  * Used to make two MSAs consistent with each other for a shared sequence
  */
@@ -161,26 +188,26 @@ static void trim(int64_t row1, Msa *msa1, float *column_scores1,
     assert(overlap <= seq_len1); // The overlap must be less than the length of the prefixes
     assert(overlap <= seq_len2);
 
-    // Get the cumulative cut scores for the columns containing the shared sequence
-    float *cu_column_scores1 = st_malloc(msa1->column_no * sizeof(float));
-    float *cu_column_scores2 = st_malloc(msa2->column_no * sizeof(float));
-    sum_column_scores(row1, msa1, column_scores1, cu_column_scores1);
-    sum_column_scores(row2, msa2, column_scores2, cu_column_scores2);
+    // Only the overlapping suffix of each row can be cut, and the scores of the bases before the overlap
+    // are common to every cut point, so we only need the cumulative scores of the columns in the overlaps.
+    // Position i in these arrays corresponds to base seq_len-overlap+i of the row.
+    int64_t *columns1 = st_malloc(overlap * sizeof(int64_t));
+    int64_t *columns2 = st_malloc(overlap * sizeof(int64_t));
+    float *cu_column_scores1 = st_malloc(overlap * sizeof(float));
+    float *cu_column_scores2 = st_malloc(overlap * sizeof(float));
+    get_suffix_columns(msa1, row1, overlap, columns1);
+    get_suffix_columns(msa2, row2, overlap, columns2);
+    sum_column_scores(columns1, overlap, column_scores1, cu_column_scores1);
+    sum_column_scores(columns2, overlap, column_scores2, cu_column_scores2);
 
     // The score if we cut all of the overlap in msa1 and keep all of the overlap in msa2
-    assert(seq_len2 <= msa2->column_no);
-    float max_cut_score = cu_column_scores2[seq_len2-1];
-    if(overlap < seq_len1) { // The overlap is less than the length of the first sequence
-        assert(seq_len1-overlap-1 >= 0);
-        max_cut_score += cu_column_scores1[seq_len1-overlap-1]; // We will keep everything before the overlap
-    }
+    float max_cut_score = cu_column_scores2[overlap-1];
     int64_t max_overlap_cut_point = 0; // the length of the prefix of the overlap of msa1 to keep
 
     // Not walk through each possible cut point within the overlap
     for(int64_t i=0; i<overlap-1; i++) {
-        assert(seq_len2-i-2 >= 0); // Sanity check
-        float cut_score = cu_column_scores1[seq_len1-overlap+i] + cu_column_scores2[seq_len2-i-2]; // The score if we keep prefix up to
-        // and including column i of MSA1's overlap, and the prefix of msa2 up to and including column seq_len-i-2
+        float cut_score = cu_column_scores1[i] + cu_column_scores2[overlap-i-2]; // The score if we keep prefix up to
+        // and including column i of MSA1's overlap, and the prefix of msa2 up to and including column overlap-i-2
         if(cut_score > max_cut_score) {
             max_overlap_cut_point = i + 1;
             max_cut_score = cut_score;
@@ -188,12 +215,7 @@ static void trim(int64_t row1, Msa *msa1, float *column_scores1,
     }
 
     // The score if we cut all of msa2's overlap and keep all of msa1's
-    float f = cu_column_scores1[seq_len1-1];
-    if(overlap < seq_len2) {
-        assert(seq_len2-overlap-1 >= 0);
-        f += cu_column_scores2[seq_len2-overlap-1];
-    }
-
+    float f = cu_column_scores1[overlap-1];
     if(f > max_cut_score) {
         max_cut_score = f;
         max_overlap_cut_point = overlap;
@@ -201,9 +223,11 @@ static void trim(int64_t row1, Msa *msa1, float *column_scores1,
 
     // Now trim back the two MSAs
     assert(max_overlap_cut_point <= overlap);
-    trim_msa_suffix(msa1, column_scores1, row1, seq_len1 - overlap + max_overlap_cut_point);
-    trim_msa_suffix(msa2, column_scores2, row2, seq_len2 - max_overlap_cut_point);
+    trim_msa_suffix(msa1, column_scores1, row1, columns1 + max_overlap_cut_point, overlap - max_overlap_cut_point);
+    trim_msa_suffix(msa2, column_scores2, row2, columns2 + (overlap - max_overlap_cut_point), max_overlap_cut_point);
 
+    free(columns1);
+    free(columns2);
     free(cu_column_scores1);
     free(cu_column_scores2);
 }
@@ -217,7 +241,7 @@ static void msa_fix_trimmed(Msa* msa) {
         // recompute the seq_len
         msa->seq_lens[i] = 0;
         for (int64_t j = 0; j < msa->column_no; ++j) {
-            if (msa_to_base(msa->msa_seq[i][j]) != '-') {
+            if (!msa_is_gap(msa->msa_seq[i][j])) {
                 ++msa->seq_lens[i];
             }
         }
@@ -226,7 +250,7 @@ static void msa_fix_trimmed(Msa* msa) {
     int64_t empty_columns = 0;
     for (bool still_empty = true; empty_columns < msa->column_no; ++empty_columns) {
         for (int64_t i = 0; i < msa->seq_no && still_empty; ++i) {
-            still_empty = msa_to_base(msa->msa_seq[i][msa->column_no - 1 - empty_columns]) == '-';
+            still_empty = msa_is_gap(msa->msa_seq[i][msa->column_no - 1 - empty_columns]);
         }
         if (!still_empty) {
             break;
@@ -235,8 +259,69 @@ static void msa_fix_trimmed(Msa* msa) {
     msa->column_no -= empty_columns;
 }
 
-Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
-                                      int64_t poa_band_constant, double poa_band_fraction) {
+/**
+ * Make the abpoa parameters used for building the msas.
+ */
+static abpoa_para_t *msa_make_abpoa_parameters(int64_t poa_band_constant, double poa_band_fraction) {
+    abpoa_para_t *abpt = abpoa_init_para();
+
+    // todo: support including modifying abpoa params
+    // alignment parameters
+    // abpt->align_mode = 0; // 0:global alignment, 1:extension
+    // abpt->match = 2;      // match score
+    // abpt->mismatch = 4;   // mismatch penalty
+    // abpt->gap_mode = ABPOA_CONVEX_GAP; // gap penalty mode
+    // abpt->gap_open1 = 4;  // gap open penalty #1
+    // abpt->gap_ext1 = 2;   // gap extension penalty #1
+    // abpt->gap_open2 = 24; // gap open penalty #2
+    // abpt->gap_ext2 = 1;   // gap extension penalty #2
+                             // gap_penalty = min{gap_open1 + gap_len * gap_ext1, gap_open2 + gap_len * gap_ext2}
+    abpt->wb = poa_band_constant;        // extra band used in adaptive banded DP
+    abpt->wf = poa_band_fraction;        // adaptive band is wb + wf * length 
+     
+    // output options
+    abpt->out_msa = 1; // generate Row-Column multiple sequence alignment(RC-MSA), set 0 to disable
+    abpt->out_cons = 0; // generate consensus sequence, set 0 to disable
+
+    abpoa_post_set_para(abpt);
+
+    return abpt;
+}
+
+/**
+ * Encodes the strings in the POA alphabet. The encoded strings are laid out in a single buffer,
+ * which is freed with msa_destruct_encoded_seqs.
+ */
+static uint8_t **msa_encode_seqs(char **seqs, int *seq_lens, int64_t seq_no) {
+    int64_t total_length = 0;
+    for (int64_t i = 0; i < seq_no; ++i) {
+        total_length += seq_lens[i];
+    }
+    uint8_t **bseqs = st_malloc(sizeof(uint8_t *) * (seq_no + 1));
+    bseqs[0] = st_malloc(sizeof(uint8_t) * (total_length + 1));
+    for (int64_t i = 0; i < seq_no; ++i) {
+        // todo: support iupac characters?
+        for (int64_t j = 0; j < seq_lens[i]; ++j) {
+            bseqs[i][j] = msa_to_byte(seqs[i][j]);
+        }
+        bseqs[i+1] = bseqs[i] + seq_lens[i];
+    }
+    return bseqs;
+}
+
+static void msa_destruct_encoded_seqs(uint8_t **bseqs) {
+    free(bseqs[0]);
+    free(bseqs);
+}
+
+/**
+ * As msa_make_partial_order_alignment, but using the given abpoa context, so that it can be reused
+ * between calls, and taking the sequences already encoded in the POA alphabet. The windows passed to abpoa
+ * point straight into bseqs, which is not modified. The returned msa takes ownership of seq_lens, but not of
+ * bseqs, and its seqs are NULL. The graph of ab must be empty.
+ */
+static Msa *msa_make_partial_order_alignment2(abpoa_t *ab, abpoa_para_t *abpt, uint8_t **bseqs, int *seq_lens,
+                                              int64_t seq_no, int64_t window_size) {
 
     assert(seq_no > 0);
     
@@ -256,43 +341,19 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
     // keep track of overlaps
     int64_t* row_overlaps = (int64_t*)st_calloc(seq_no, sizeof(int64_t));
 
-    // allocate the poa input buffer
-    uint8_t **bseqs = (uint8_t**)st_malloc(sizeof(uint8_t*) * seq_no);
+    // the poa input for each window, pointing into bseqs
+    uint8_t **window_bseqs = (uint8_t**)st_malloc(sizeof(uint8_t*) * seq_no);
+    uint8_t empty_seq = msa_to_byte('N');
     for (int64_t i = 0; i < seq_no; ++i) {
-        int64_t row_size = seq_lens[i] < window_size ? seq_lens[i] : window_size;
-        bseqs[i] = (uint8_t*)st_malloc(sizeof(uint8_t) * row_size);
         bases_remaining += seq_lens[i];
     }
 
-    // initialize variables
-    abpoa_t *ab = abpoa_init();
-    abpoa_para_t *abpt = abpoa_init_para();
-
-    // todo: support including modifying abpoa params
-    // alignment parameters
-    // abpt->align_mode = 0; // 0:global alignment, 1:extension
-    // abpt->match = 2;      // match score
-    // abpt->mismatch = 4;   // mismatch penalty
-    // abpt->gap_mode = ABPOA_CONVEX_GAP; // gap penalty mode
-    // abpt->gap_open1 = 4;  // gap open penalty #1
-    // abpt->gap_ext1 = 2;   // gap extension penalty #1
-    // abpt->gap_open2 = 24; // gap open penalty #2
-    // abpt->gap_ext2 = 1;   // gap extension penalty #2
-                             // gap_penalty = min{gap_open1 + gap_len * gap_ext1, gap_open2 + gap_len * gap_ext2}
-    abpt->wb = poa_band_constant;        // extra band used in adaptive banded DP
-    abpt->wf = poa_band_fraction;        // adaptive band is wb + wf * length 
-     
-    // output options
-    abpt->out_msa = 1; // generate Row-Column multiple sequence alignment(RC-MSA), set 0 to disable
-    abpt->out_cons = 0; // generate consensus sequence, set 0 to disable
-
-    abpoa_post_set_para(abpt);
-
     // collect our windowed outputs here, to be stiched at the end. 
     stList* msa_windows = stList_construct3(0, (void(*)(void *)) msa_destruct);
     
-    // remember the previous window
+    // remember the previous window, and its column scores
     Msa* prev_msa = NULL;
+    float* prev_column_scores = NULL;
     
     int64_t prev_bases_remaining = bases_remaining;
     for (int64_t iteration = 0; bases_remaining > 0; ++iteration) {
@@ -304,7 +365,7 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
                 assert(prev_msa->column_no > window_overlap_size);
                 row_overlaps[i] = 0;
                 for (int64_t j = prev_msa->column_no - window_overlap_size; j < prev_msa->column_no; ++j) {
-                    if (msa_to_base(prev_msa->msa_seq[i][j]) != '-') {
+                    if (!msa_is_gap(prev_msa->msa_seq[i][j])) {
                         ++row_overlaps[i];
                     }
                 }
@@ -321,13 +382,11 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         msa->seqs = NULL;
         msa->seq_lens = st_malloc(sizeof(int) * msa->seq_no);
         
-        // load up to window_size of each sequence into the input matrix for poa
+        // point the input matrix for poa at up to window_size of each sequence
         for (int64_t i = 0; i < msa->seq_no; ++i) {
-            msa->seq_lens[i] = 0;
-            for (int64_t j = seq_offsets[i]; j < seq_lens[i] && msa->seq_lens[i] < window_size; ++j, ++msa->seq_lens[i]) {
-                // todo: support iupac characters?
-                bseqs[i][msa->seq_lens[i]] = msa_to_byte(seqs[i][j]);
-            }
+            int64_t remaining = seq_lens[i] - seq_offsets[i];
+            msa->seq_lens[i] = remaining < window_size ? remaining : window_size;
+            window_bseqs[i] = bseqs[i] + seq_offsets[i];
         }
 
         // poa can't handle empty sequences.  this is a hack to get around that
@@ -336,7 +395,7 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
             if (msa->seq_lens[i] == 0) {
                 empty_seqs[i] = true;
                 msa->seq_lens[i] = 1;
-                bseqs[i][0] = msa_to_byte('N');
+                window_bseqs[i] = &empty_seq;
                 ++emptyCount;
             } else {
                 empty_seqs[i] = false;
@@ -344,7 +403,7 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         }
 
         // perform abpoa-msa
-        abpoa_msa(ab, abpt, msa->seq_no, NULL, msa->seq_lens, bseqs, NULL, NULL, NULL, NULL, NULL,
+        abpoa_msa(ab, abpt, msa->seq_no, NULL, msa->seq_lens, window_bseqs, NULL, NULL, NULL, NULL, NULL,
                   &(msa->msa_seq), &(msa->column_no));
 
         // mask out empty sequences that were phonied in as Ns above
@@ -377,13 +436,11 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
             seq_offsets[i] += msa->seq_lens[i];
         }
 
-        // todo: there is obviously room for optimization here, as we compute full scores twice for each msa
-        //       in addition to flipping the prev_msa back and forth
-        //       (not sure if this is at all noticeable on top of abpoa running time though)
+        // the column scores of each msa are computed once, and kept up to date by trim() so they can be
+        // reused when the msa is trimmed against the next window
         if (prev_msa) {
             // trim() presently assumes we're looking at reverse-complement sequence:
             flip_msa_seq(msa);
-            float* prev_column_scores = make_column_scores(prev_msa);
             float* column_scores = make_column_scores(msa);
 
             // trim with the previous alignment
@@ -396,8 +453,14 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
             // todo: can this be done as part of trim?
             msa_fix_trimmed(msa);
             msa_fix_trimmed(prev_msa);            
-            // flip our msa back to its original strand
+            // flip our msa back to its original strand, along with its scores (the empty columns clipped
+            // by msa_fix_trimmed are dropped from the end of the flipped scores)
             flip_msa_seq(msa);
+            flip_column_scores(column_scores, msa->column_no);
+            free(prev_column_scores);
+            prev_column_scores = column_scores;
+        } else {
+            prev_column_scores = make_column_scores(msa);
         }
 
         // add the msa to our list
@@ -422,14 +485,14 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
     if (num_windows == 1) {
         // if we have only one window, return it
         output_msa = stList_removeFirst(msa_windows);
-        output_msa->seqs = seqs;
+        free(output_msa->seq_lens);
         output_msa->seq_lens = seq_lens;
     } else {
         // otherwise, we stitch all the window msas into a new output msa
         output_msa = st_malloc(sizeof(Msa));
         assert(seq_no > 0);
         output_msa->seq_no = seq_no;
-        output_msa->seqs = seqs;
+        output_msa->seqs = NULL;
         output_msa->seq_lens = seq_lens;
         output_msa->column_no = 0;
         for (int64_t i = 0; i < num_windows; ++i) {
@@ -452,37 +515,76 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
     } 
 
     // Clean up
-    for (int64_t i = 0; i < seq_no; ++i) {
-        free(bseqs[i]);
-    }
-    free(bseqs);
+    free(window_bseqs);
     free(seq_offsets);
     free(empty_seqs);
     free(row_overlaps);
+    free(prev_column_scores);
     stList_destruct(msa_windows);
 
+    return output_msa;
+}
+
+Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
+                                      int64_t poa_band_constant, double poa_band_fraction) {
+    // initialize variables
+    abpoa_t *ab = abpoa_init();
+    abpoa_para_t *abpt = msa_make_abpoa_parameters(poa_band_constant, poa_band_fraction);
+
+    uint8_t **bseqs = msa_encode_seqs(seqs, seq_lens, seq_no);
+    Msa *msa = msa_make_partial_order_alignment2(ab, abpt, bseqs, seq_lens, seq_no, window_size);
+    msa->seqs = seqs;
+
+    msa_destruct_encoded_seqs(bseqs);
     abpoa_free(ab, abpt);
     abpoa_free_para(abpt);
 
     // in debug mode, cactus uses the dreaded -Wall -Werror combo.  This line is a hack to allow compilation with these flags
     if (false) SIMDMalloc(0, 0);
 
-    return output_msa;
+    return msa;
 }
 
-Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_lengths, char ***end_strings,
+/**
+ * As make_consistent_partial_order_alignments, but taking the strings of each end already encoded
+ * in the POA alphabet. The seqs of the returned msas are NULL.
+ */
+static Msa **make_consistent_partial_order_alignments2(int64_t end_no, int64_t *end_lengths, uint8_t ***end_bseqs,
         int **end_string_lengths, int64_t **right_end_indexes, int64_t **right_end_row_indexes, int64_t **overlaps,
         int64_t window_size, int64_t poa_band_constant, double poa_band_fraction) {
-    // Calculate the initial, potentially inconsistent msas and column scores for each msa
+    // Calculate the initial, potentially inconsistent msas and column scores for each msa.
+    // The msas are independent, so are computed in parallel, each thread reusing its own abpoa context
+    // from one end to the next.
     float *column_scores[end_no];
     Msa **msas = st_malloc(sizeof(Msa *) * end_no);
-    for(int64_t i=0; i<end_no; i++) {
-        msas[i] = msa_make_partial_order_alignment(end_strings[i], end_string_lengths[i], end_lengths[i], window_size,
-                                                   poa_band_constant, poa_band_fraction);
-        column_scores[i] = make_column_scores(msas[i]);
+#if defined(_OPENMP)
+    #pragma omp parallel if(end_no > 1)
+#endif
+    {
+        abpoa_t *ab = abpoa_init();
+        abpoa_para_t *abpt = msa_make_abpoa_parameters(poa_band_constant, poa_band_fraction);
+        bool ab_used = false;
+
+#if defined(_OPENMP)
+        #pragma omp for schedule(dynamic, 1)
+#endif
+        for(int64_t i=0; i<end_no; i++) {
+            if(ab_used) {
+                // reset graph before re-use
+                int64_t qlen = end_string_lengths[i][0] < window_size ? end_string_lengths[i][0] : window_size;
+                abpoa_reset_graph(ab, abpt, qlen > 0 ? qlen : 1);
+            }
+            msas[i] = msa_make_partial_order_alignment2(ab, abpt, end_bseqs[i], end_string_lengths[i], end_lengths[i],
+                                                        window_size);
+            column_scores[i] = make_column_scores(msas[i]);
+            ab_used = true;
+        }
+
+        abpoa_free(ab, abpt);
+        abpoa_free_para(abpt);
     }
 
-    // Make the msas consistent with one another
+    // Make the msas consistent with one another, this is done serially once all the msas are built
     for(int64_t i=0; i<end_no; i++) { // For each end
         Msa *msa = msas[i];
         for(int64_t j=0; j<msa->seq_no; j++) { //  For each string incident to the ith end
@@ -505,6 +607,26 @@ Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_leng
     return msas;
 }
 
+Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_lengths, char ***end_strings,
+        int **end_string_lengths, int64_t **right_end_indexes, int64_t **right_end_row_indexes, int64_t **overlaps,
+        int64_t window_size, int64_t poa_band_constant, double poa_band_fraction) {
+    uint8_t **end_bseqs[end_no];
+    for(int64_t i=0; i<end_no; i++) {
+        end_bseqs[i] = msa_encode_seqs(end_strings[i], end_string_lengths[i], end_lengths[i]);
+    }
+
+    Msa **msas = make_consistent_partial_order_alignments2(end_no, end_lengths, end_bseqs, end_string_lengths,
+                                                           right_end_indexes, right_end_row_indexes, overlaps,
+                                                           window_size, poa_band_constant, poa_band_fraction);
+
+    for(int64_t i=0; i<end_no; i++) {
+        msas[i]->seqs = end_strings[i];
+        msa_destruct_encoded_seqs(end_bseqs[i]);
+    }
+
+    return msas;
+}
+
 /**
  * The follow code is for dealing with the cactus API
  */
@@ -612,6 +734,80 @@ char *get_adjacency_string_and_overlap(Cap *cap, int *length, int64_t *overlap,
     return adjacency_string;
 }
 
+/**
+ * Gets the length of the adjacency string of the given cap, and the start of its interval on the
+ * positive strand of the sequence.
+ */
+static int64_t get_adjacency_length(Cap *cap, int64_t *start) {
+    assert(!cap_getSide(cap));
+    Cap *cap2 = cap_getAdjacency(cap);
+    assert(cap2 != NULL);
+    assert(cap_getSide(cap2));
+    int64_t seq_length;
+    if (cap_getStrand(cap)) {
+        assert(cap_getCoordinate(cap2) > cap_getCoordinate(cap));
+        *start = cap_getCoordinate(cap) + 1;
+        seq_length = cap_getCoordinate(cap2) - cap_getCoordinate(cap) - 1;
+    } else {
+        assert(cap_getCoordinate(cap) > cap_getCoordinate(cap2));
+        *start = cap_getCoordinate(cap2) + 1;
+        seq_length = cap_getCoordinate(cap) - cap_getCoordinate(cap2) - 1;
+    }
+    assert(seq_length >= 0);
+    return seq_length;
+}
+
+void get_adjacency_bytes_and_overlap(Cap *cap, uint8_t *bytes, int *length, int64_t *overlap,
+                                     int64_t max_seq_length, int64_t mask_filter) {
+    int64_t start;
+    int64_t seq_length = get_adjacency_length(cap, &start);
+    bool strand = cap_getStrand(cap);
+    Sequence *sequence = cap_getSequence(cap);
+    assert(sequence != NULL);
+
+    // Calculate the length of the prefix up to max_seq_length
+    int64_t prefix_length = seq_length > max_seq_length ? max_seq_length : seq_length;
+    *length = prefix_length;
+    int length_backward = *length;
+
+    // Get the positive strand bases of the prefix. For a negative strand cap the prefix is the reverse complement
+    // of the end of the adjacency's positive strand interval, so is read backwards.
+    char *prefix = sequence_getString(sequence, strand ? start : start + seq_length - prefix_length, prefix_length, 1);
+
+    if (mask_filter >= 0) {
+        // apply the mask filter on the forward strand
+        *length = get_unmasked_length(prefix, prefix_length, *length, !strand, mask_filter);
+        // and from the other end of the adjacency, which needs the bases of the opposite end of the interval
+        if (prefix_length == seq_length) {
+            length_backward = get_unmasked_length(prefix, prefix_length, *length, strand, mask_filter);
+        } else {
+            char *suffix = sequence_getString(sequence, strand ? start + seq_length - *length : start, *length, 1);
+            length_backward = get_unmasked_length(suffix, *length, *length, strand, mask_filter);
+            free(suffix);
+        }
+    }
+
+    // Encode the prefix, taking the reverse complement as we go for negative strand caps
+    if (strand) {
+        for (int64_t i = 0; i < *length; ++i) {
+            bytes[i] = msa_to_byte(prefix[i]);
+        }
+    } else {
+        for (int64_t i = 0; i < *length; ++i) {
+            bytes[i] = msa_to_rc(msa_to_byte(prefix[prefix_length - 1 - i]));
+        }
+    }
+    free(prefix);
+
+    // Calculate the overlap with the reverse complement
+    if (*length + length_backward > seq_length) { // There is overlap
+        *overlap = *length + length_backward - seq_length;
+        assert(*overlap >= 0);
+    } else { // There is no overlap
+        *overlap = 0;
+    }
+}
+
 /**
  * Gets the length and sequences present in the next maximal gapless alignment block.
  * @param msa The msa to scan
@@ -626,7 +822,7 @@ int64_t get_next_maximal_block_dimensions(Msa *msa, int64_t start, bool *rows_in
     // Calculate which sequences are in the block
     *sequences_in_block = 0;
     for(int64_t i=0; i<msa->seq_no; i++) {
-        rows_in_block[i] = msa_to_base(msa->msa_seq[i][start]) != '-';
+        rows_in_block[i] = !msa_is_gap(msa->msa_seq[i][start]);
         if(rows_in_block[i]) {
             *sequences_in_block += 1;
         }
@@ -637,7 +833,7 @@ int64_t get_next_maximal_block_dimensions(Msa *msa, int64_t start, bool *rows_in
     int64_t end = start;
     while(++end < msa->column_no) {
         for(int64_t i=0; i<msa->seq_no; i++) {
-            bool p = msa_to_base(msa->msa_seq[i][end]) != '-'; // Is not a gap
+            bool p = !msa_is_gap(msa->msa_seq[i][end]); // Is not a gap
             if(p != rows_in_block[i]) {
                 return end;
             }
@@ -760,7 +956,7 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
     // Arrays of ends and connecting the strings necessary to build the POA alignment
     int64_t end_no = flower_getEndNumber(flower); // The number of ends
     int64_t end_lengths[end_no]; // The number of strings incident with each end
-    char **end_strings[end_no]; // The actual strings connecting the ends
+    uint8_t **end_bseqs[end_no]; // The strings connecting the ends, encoded in the POA alphabet
     int *end_string_lengths[end_no]; // Length of the strings connecting the ends
     int64_t *right_end_indexes[end_no];  // For each string the index of the right end that it is connecting
     int64_t *right_end_row_indexes[end_no]; // For each string the index of the row of its reverse complement
@@ -777,26 +973,25 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
     while ((end = flower_getNextEnd(endIterator)) != NULL) {
         // Initialize the various arrays for the end
         end_lengths[i] = end_getInstanceNumber(end); // The number of strings incident with the end
-        end_strings[i] = st_malloc(sizeof(char *)*end_lengths[i]);
         end_string_lengths[i] = st_malloc(sizeof(int)*end_lengths[i]);
         right_end_indexes[i] = st_malloc(sizeof(int64_t)*end_lengths[i]);
         right_end_row_indexes[i] = st_malloc(sizeof(int64_t)*end_lengths[i]);
         indices_to_caps[i] = st_malloc(sizeof(Cap *)*end_lengths[i]);
         overlaps[i] = st_malloc(sizeof(int64_t)*end_lengths[i]);
 
-        // Now get each string incident with the end
+        // Now get each cap incident with the end
         Cap *cap;
         End_InstanceIterator *capIterator = end_getInstanceIterator(end);
         int64_t j=0; // Index of the cap in the end's arrays
+        int64_t total_length = 0; // The total length of the prefixes of the strings incident with the end
         while ((cap = end_getNext(capIterator)) != NULL) {
             assert(j < end_lengths[i]);
             // Ensure we have the cap in the correct orientation
             if (cap_getSide(cap)) {
                 cap = cap_getReverse(cap);
             }
-            // Get the prefix of the adjacency string and its length and overlap with its reverse complement
-            end_strings[i][j] = get_adjacency_string_and_overlap(cap, &(end_string_lengths[i][j]),
-                                                                 &(overlaps[i][j]), max_seq_length, mask_filter);
+            int64_t start, seq_length = get_adjacency_length(cap, &start);
+            total_length += seq_length > max_seq_length ? max_seq_length : seq_length;
 
             // Populate the caps to end/row indices, and vice versa, data structures
             indices_to_caps[i][j] = cap;
@@ -806,6 +1001,16 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
         }
         end_destructInstanceIterator(capIterator);
         assert(end_lengths[i] == j);
+
+        // Get the prefix of each adjacency string, encoded straight into a single buffer for the end,
+        // and its length and overlap with its reverse complement
+        end_bseqs[i] = st_malloc(sizeof(uint8_t *)*(end_lengths[i]+1));
+        end_bseqs[i][0] = st_malloc(sizeof(uint8_t)*(total_length+1));
+        for(j=0; j<end_lengths[i]; j++) {
+            get_adjacency_bytes_and_overlap(indices_to_caps[i][j], end_bseqs[i][j], &(end_string_lengths[i][j]),
+                                            &(overlaps[i][j]), max_seq_length, mask_filter);
+            end_bseqs[i][j+1] = end_bseqs[i][j] + end_string_lengths[i][j];
+        }
         i++;
     }
     flower_destructEndIterator(endIterator);
@@ -841,9 +1046,9 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
     flower_destructEndIterator(endIterator);
 
     // Now make the consistent MSAs
-    Msa **msas = make_consistent_partial_order_alignments(end_no, end_lengths, end_strings, end_string_lengths,
-                                                          right_end_indexes, right_end_row_indexes, overlaps, window_size,
-                                                          poa_band_constant, poa_band_fraction);
+    Msa **msas = make_consistent_partial_order_alignments2(end_no, end_lengths, end_bseqs, end_string_lengths,
+                                                           right_end_indexes, right_end_row_indexes, overlaps, window_size,
+                                                           poa_band_constant, poa_band_fraction);
 
     // Temp debug output
     //for(int64_t i=0; i<end_no; i++) {
@@ -859,6 +1064,7 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
     // Cleanup
     for(int64_t i=0; i<end_no; i++) {
         msa_destruct(msas[i]);
+        msa_destruct_encoded_seqs(end_bseqs[i]);
         free(right_end_indexes[i]);
         free(right_end_row_indexes[i]);
         free(indices_to_caps[i]);
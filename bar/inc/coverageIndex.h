@@ -0,0 +1,43 @@
+#ifndef COVERAGE_INDEX_H_
+#define COVERAGE_INDEX_H_
+
+#include "cactus.h"
+#include "sonLib.h"
+
+// An index of the bases of each sequence that are covered by an
+// outgroup, used by the bar rescue. It is written by
+// cactus_convertAlignmentsToInternalNames and memory mapped by
+// cactus_bar.
+//
+// The file is a sequence of little-endian 64-bit integers:
+//   - a header: magic number, version, number of sequences, number of
+//     regions.
+//   - an offset table, with for each sequence, in ascending order of
+//     name: the sequence Name, the index of its first region and its
+//     number of regions.
+//   - the regions, with for each sequence in turn its disjoint covered
+//     intervals in ascending order: the 0-based start (inclusive), the
+//     stop (exclusive) and the number of covered bases of the sequence
+//     before the start.
+// The last field is a prefix sum, so the number of covered bases in any
+// interval is found with a binary search for each end of the interval.
+typedef struct _coverageIndex CoverageIndex;
+
+// Construct an index from a list of covered regions, given as parallel
+// arrays, sorted by name and then by start. Overlapping and abutting
+// regions are merged.
+CoverageIndex *coverageIndex_construct(Name *names, int64_t *starts, int64_t *stops, int64_t regionNumber);
+
+// Load an index written by coverageIndex_write, by memory mapping the
+// file.
+CoverageIndex *coverageIndex_load(const char *path);
+
+void coverageIndex_destruct(CoverageIndex *index);
+
+void coverageIndex_write(CoverageIndex *index, FILE *fileHandle);
+
+// The number of bases in [start, stop) of the given sequence that are
+// covered.
+int64_t coverageIndex_getCoveredBases(CoverageIndex *index, Name name, int64_t start, int64_t stop);
+
+#endif // COVERAGE_INDEX_H_
@@ -21,11 +21,27 @@
 typedef struct _AlignedPair {
     int64_t subsequenceIdentifier;
     int64_t position;
-    bool strand;
     int64_t score;
     struct _AlignedPair *reverse;
+    bool strand;
+    bool deleted; // Set when the pair has been pruned from an end alignment
 } AlignedPair;
 
+/*
+ * An end alignment. The aligned pairs are held in a single array, sorted according to the
+ * alignedPair comparison function. Each pair is held twice, once for each side, with the reverse pointers
+ * linking the two sides. Pairs pruned from the alignment are marked as deleted, rather than removed.
+ */
+typedef struct _EndAlignment {
+    AlignedPair *alignedPairs;
+    int64_t length; // The number of aligned pairs in the array, including deleted pairs
+    int64_t maxLength;
+    int64_t deletedNumber; // The number of deleted aligned pairs
+    bool sorted;
+    void *mappedMemory; // If the aligned pairs were mapped from an end alignment file, the mapping
+    size_t mappedLength;
+} EndAlignment;
+
 /*
  * Constructs the an aligned pair.
  */
@@ -42,24 +58,71 @@ void alignedPair_destruct(AlignedPair *alignedPair);
  */
 int alignedPair_cmpFn(const AlignedPair *alignedPair1, const AlignedPair *alignedPair2);
 
+/*
+ * Constructs an empty end alignment.
+ */
+EndAlignment *endAlignment_construct(void);
+
+/*
+ * Destructs the end alignment and its aligned pairs.
+ */
+void endAlignment_destruct(EndAlignment *endAlignment);
+
+/*
+ * Adds an aligned pair, and its reverse, to the end alignment. The end alignment must be sorted
+ * with endAlignment_sort before it is queried.
+ */
+void endAlignment_add(EndAlignment *endAlignment, int64_t subsequenceIdentifier1, int64_t position1, bool strand1,
+        int64_t subsequenceIdentifier2, int64_t position2, bool strand2, int64_t score1, int64_t score2);
+
+/*
+ * Sorts the aligned pairs of the end alignment, using a radix sort (or qsort for few pairs), and links each pair to its reverse.
+ */
+void endAlignment_sort(EndAlignment *endAlignment);
+
+/*
+ * Returns the number of aligned pairs in the end alignment, excluding deleted pairs. Each pair
+ * is counted twice, once for each side.
+ */
+int64_t endAlignment_size(EndAlignment *endAlignment);
+
+/*
+ * Returns the index of the first aligned pair in the sorted end alignment whose sequence and position are
+ * greater than or equal to the given sequence and position. Returns endAlignment->length if there is none.
+ */
+int64_t endAlignment_lowerBound(EndAlignment *endAlignment, int64_t subsequenceIdentifier, int64_t position);
+
+/*
+ * Marks the aligned pair, and its reverse, as deleted from the end alignment.
+ */
+void endAlignment_delete(EndAlignment *endAlignment, AlignedPair *alignedPair);
+
+/*
+ * Returns non-zero if the two end alignments contain the same pairs, with the same scores.
+ */
+bool endAlignment_equals(EndAlignment *endAlignment1, EndAlignment *endAlignment2);
+
 /*
  * Creates a global alignment (as a set of aligned pairs) of the sequences from the end,
  * the pairs returned are ordered according
  * to the alignerPair comparison function.
  */
-stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
-                              bool useProgressiveMerging, float gapGamma,
-                              PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters);
+EndAlignment *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
+                               bool useProgressiveMerging, float gapGamma,
+                               PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters);
 
 /*
- * Writes an end alignment to the given file.
+ * Writes an end alignment, excluding deleted pairs, to the given file. The file is binary: a header giving the
+ * format version, the end's name and the number of aligned pairs, followed by the sorted aligned pairs.
+ * Multiple end alignments can be written to the same file.
  */
-void writeEndAlignmentToDisk(End *end, stSortedSet *endAlignment, FILE *fileHandle);
+void writeEndAlignmentToDisk(End *end, EndAlignment *endAlignment, FILE *fileHandle);
 
 /*
- * Loads an end alignment from the given file.
+ * Loads the next end alignment from the given file, returning NULL and setting end to NULL at the end of the file.
+ * The aligned pairs are memory mapped from the file rather than parsed.
  */
-stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end);
+EndAlignment *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end);
 
 
 #endif /* ENDALIGNER_H_ */
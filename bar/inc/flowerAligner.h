@@ -15,6 +15,7 @@
 #define FLOWER_ALIGNER_H_
 
 #include "pairwiseAligner.h"
+#include "endAligner.h"
 
 /*
  * Constructs an alignment for the flower by constructing an alignment for each end
@@ -22,15 +23,16 @@
  * end alignment. Spanning trees controls the number of pairwise alignments used
  * to construct the alignment, maxSequenceLength is the maximum length of a sequence to consider in the end alignment.
  * Model parameters is the parameters of the pairwise alignment model.
+ * The aligned pairs are returned in a single sorted array, each pair held in both orientations.
  */
-stSortedSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees,
+EndAlignment *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
         PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments);
 
 /*
  * As above, but including alignments from disk.
  */
-stSortedSet *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
+EndAlignment *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
         PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments);
 
@@ -44,4 +46,13 @@ stSortedSet *getEndsToAlignSeparately(Flower *flower, int64_t maxSequenceLength,
  */
 int64_t getTotalAdjacencyLength(End *end);
 
+/*
+ * Makes an end alignment (see makeEndAlignment) for each of the given ends. The alignments are independent,
+ * so they are computed in parallel, largest ends (by total adjacency length) first so that a big end
+ * does not start last. Returns a list of the alignments, in the same order as the ends.
+ */
+stList *makeEndAlignments(StateMachine *sM, stList *ends, int64_t spanningTrees, int64_t maxSequenceLength,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters);
+
 #endif /* NETALIGNER_H_ */
@@ -111,6 +111,22 @@ void alignmentBlock_print(AlignmentBlock *ab, FILE *f);
  */
 char *get_adjacency_string(Cap *cap, int *length);
 
+/**
+ * Get the prefix of the string connecting two ends for the given cap, of at most max_seq_length bases
+ * and cut before any run of more than mask_filter masked bases (mask_filter < 0 = disabled), along with the
+ * length of its overlap with the equivalent prefix of the reverse complement adjacency.
+ */
+char *get_adjacency_string_and_overlap(Cap *cap, int *length, int64_t *overlap, int64_t max_seq_length,
+                                       int64_t mask_filter);
+
+/**
+ * As get_adjacency_string_and_overlap, but writes the prefix into bytes encoded in the POA alphabet (see msa_to_byte),
+ * rather than returning a string. Only the bases of the sequence needed are fetched, and the reverse complement is
+ * taken as the bases are encoded. bytes must have room for min(adjacency length, max_seq_length) bases.
+ */
+void get_adjacency_bytes_and_overlap(Cap *cap, uint8_t *bytes, int *length, int64_t *overlap,
+                                     int64_t max_seq_length, int64_t mask_filter);
+
 /**
  * Makes alignments of the the unaligned sequence using the bar algorithm.
  *
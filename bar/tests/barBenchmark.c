@@ -0,0 +1,468 @@
+/*
+ * Benchmarks the bar aligners, POA (make_flower_alignment_poa) and cPecan (makeFlowerAlignment3), on
+ * seeded synthetic flowers over a grid of parameters. Each run is made in a child process, so that its
+ * peak resident set size can be measured, and reported as a line of CSV (or a JSON object).
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "cactus.h"
+#include "sonLib.h"
+#include "flowerAligner.h"
+#include "poaBarAligner.h"
+#include "stateMachine.h"
+#include "pairwiseAligner.h"
+
+void usage() {
+    fprintf(stderr, "cactus_barBenchmark, version 0.1\n");
+    fprintf(stderr, "Lists are comma separated, every combination of their values is run.\n");
+    fprintf(stderr, "-a --logLevel : Set the log level\n");
+    fprintf(stderr, "-s --seed : (int) The random seed used to generate the flowers (default 0)\n");
+    fprintf(stderr, "-r --repeats : (int > 0) The number of flowers generated for each combination of parameters (default 1)\n");
+    fprintf(stderr, "-d --endDegrees : (list of int > 0) The number of sequences threaded through each flower (default 2,8,32)\n");
+    fprintf(stderr, "-l --adjacencyLengths : (list of int >= 0) The length of the ancestral adjacency (default 100,1000)\n");
+    fprintf(stderr, "-v --divergences : (list of float [0, 1]) The per base mutation rate of each sequence from the ancestor (default 0.01,0.1)\n");
+    fprintf(stderr, "-w --poaWindows : (list of int > 0) The POA window sizes (default 10000)\n");
+    fprintf(stderr, "-b --poaBandConstants : (list of int) The abpoa band constants, < 0 disables banding (default 10)\n");
+    fprintf(stderr, "-f --poaBandFractions : (list of float) The abpoa band fractions (default 0.01)\n");
+    fprintf(stderr, "-j --maximumLength : (int >= 0) The maximum length of the prefix of an adjacency to align (default 1500)\n");
+    fprintf(stderr, "-i --spanningTrees : (int >= 0) The number of spanning trees used by cPecan (default 10)\n");
+    fprintf(stderr, "-n --noPecan : Don't run cPecan\n");
+    fprintf(stderr, "-p --noPoa : Don't run POA\n");
+    fprintf(stderr, "-J --json : Report the results as a JSON array, rather than CSV\n");
+    fprintf(stderr, "-h --help : Print this help screen\n");
+}
+
+/*
+ * Parsing of the parameter lists.
+ */
+
+static int64_t *parseIntegerList(const char *string, int64_t *length) {
+    int64_t *values = st_malloc(sizeof(int64_t) * (strlen(string) + 1));
+    *length = 0;
+    const char *c = string;
+    while (*c != '\0') {
+        char *end;
+        values[(*length)++] = strtoll(c, &end, 10);
+        if (end == c || (*end != ',' && *end != '\0')) {
+            st_errAbort("Couldn't parse the list of integers: %s", string);
+        }
+        c = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+static double *parseFloatList(const char *string, int64_t *length) {
+    double *values = st_malloc(sizeof(double) * (strlen(string) + 1));
+    *length = 0;
+    const char *c = string;
+    while (*c != '\0') {
+        char *end;
+        values[(*length)++] = strtod(c, &end);
+        if (end == c || (*end != ',' && *end != '\0')) {
+            st_errAbort("Couldn't parse the list of floats: %s", string);
+        }
+        c = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+/*
+ * Generation of the synthetic flowers.
+ */
+
+static char randomBase() {
+    return "ACGT"[st_randomInt(0, 4)];
+}
+
+/*
+ * Returns a copy of the ancestral string in which each base has been mutated with probability divergence.
+ * Mutations are substitutions, single base deletions and single base insertions, in the ratio 8:1:1.
+ */
+static char *mutateString(const char *ancestor, double divergence) {
+    int64_t length = strlen(ancestor);
+    char *string = st_malloc(sizeof(char) * (2 * length + 1));
+    int64_t j = 0;
+    for (int64_t i = 0; i < length; i++) {
+        if (st_random() >= divergence) {
+            string[j++] = ancestor[i];
+            continue;
+        }
+        double f = st_random();
+        if (f < 0.8) { // Substitution
+            char b;
+            while ((b = randomBase()) == ancestor[i]);
+            string[j++] = b;
+        } else if (f < 0.9) { // Insertion
+            string[j++] = ancestor[i];
+            string[j++] = randomBase();
+        } // Else deletion
+    }
+    string[j] = '\0';
+    return string;
+}
+
+/*
+ * Makes a flower with two ends, connected by endDegree sequences, each mutated from a common ancestral
+ * adjacency of the given length.
+ */
+static Flower *makeSyntheticFlower(CactusDisk *cactusDisk, int64_t endDegree, int64_t adjacencyLength,
+        double divergence) {
+    Flower *flower = flower_construct(cactusDisk);
+    EventTree *eventTree = eventTree_construct2(cactusDisk);
+    Event *leafEvent = event_construct3("LEAF", 0.1, eventTree_getRootEvent(eventTree), eventTree);
+
+    End *end1 = end_construct2(0, 1, flower);
+    End *end2 = end_construct2(1, 1, flower);
+
+    char *ancestor = st_malloc(sizeof(char) * (adjacencyLength + 1));
+    for (int64_t i = 0; i < adjacencyLength; i++) {
+        ancestor[i] = randomBase();
+    }
+    ancestor[adjacencyLength] = '\0';
+
+    for (int64_t i = 0; i < endDegree; i++) {
+        char *string = mutateString(ancestor, divergence);
+        int64_t length = strlen(string);
+        char *header = stString_print(">seq%" PRIi64 "", i);
+        MetaSequence *metaSequence = metaSequence_construct(1, length, string, header, event_getName(leafEvent),
+                                                            cactusDisk);
+        Sequence *sequence = sequence_construct(metaSequence, flower);
+        Cap *cap1 = cap_construct2(end1, 0, 1, sequence);
+        Cap *cap2 = cap_construct2(end2, length + 1, 1, sequence);
+        cap_makeAdjacent(cap1, cap2);
+        free(header);
+        free(string);
+    }
+    free(ancestor);
+
+    return flower;
+}
+
+/*
+ * Running the aligners.
+ */
+
+typedef struct _benchmarkParameters {
+    int64_t seed;
+    int64_t repeat;
+    int64_t endDegree;
+    int64_t adjacencyLength;
+    double divergence;
+    int64_t maximumLength;
+    int64_t spanningTrees;
+    int64_t poaWindow;
+    int64_t poaBandConstant;
+    double poaBandFraction;
+} BenchmarkParameters;
+
+static double getWallTime() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1.0e9;
+}
+
+/*
+ * Gets the number of pairs of aligned bases in a list of alignment blocks.
+ */
+static int64_t countAlignedPairsInBlocks(stList *alignmentBlocks) {
+    int64_t alignedPairs = 0;
+    for (int64_t i = 0; i < stList_length(alignmentBlocks); i++) {
+        AlignmentBlock *block = stList_get(alignmentBlocks, i);
+        int64_t rows = 0;
+        for (AlignmentBlock *b = block; b != NULL; b = b->next) {
+            rows++;
+        }
+        alignedPairs += block->length * rows * (rows - 1) / 2;
+    }
+    return alignedPairs;
+}
+
+/*
+ * Builds the flower and runs the given aligner over it, returning the aligned pairs and the time taken to align.
+ */
+static void runAligner(bool usePoa, BenchmarkParameters *p, double *wallTime, int64_t *alignedPairs) {
+    char *diskName = stString_print("cactus_barBenchmark_%i", (int)getpid());
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk(diskName);
+    st_randomSeed(p->seed + p->repeat);
+    Flower *flower = makeSyntheticFlower(cactusDisk, p->endDegree, p->adjacencyLength, p->divergence);
+
+    if (usePoa) {
+        double t = getWallTime();
+        stList *alignmentBlocks = make_flower_alignment_poa(flower, p->maximumLength, p->poaWindow, -1,
+                                                            p->poaBandConstant, p->poaBandFraction);
+        *wallTime = getWallTime() - t;
+        *alignedPairs = countAlignedPairsInBlocks(alignmentBlocks);
+        stList_destruct(alignmentBlocks);
+    } else {
+        StateMachine *sM = stateMachine5_construct(fiveState);
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters = pairwiseAlignmentBandingParameters_construct();
+        double t = getWallTime();
+        EndAlignment *flowerAlignment = makeFlowerAlignment3(sM, flower, NULL, p->spanningTrees, p->maximumLength, 0,
+                                                             pairwiseAlignmentBandingParameters->gapGamma,
+                                                             pairwiseAlignmentBandingParameters, 0);
+        *wallTime = getWallTime() - t;
+        *alignedPairs = flowerAlignment->length / 2; // Each pair is present in both orientations
+        endAlignment_destruct(flowerAlignment);
+        pairwiseAlignmentBandingParameters_destruct(pairwiseAlignmentBandingParameters);
+        stateMachine_destruct(sM);
+    }
+
+    testCommon_deleteTemporaryCactusDisk(diskName, cactusDisk);
+    free(diskName);
+}
+
+/*
+ * Runs the aligner in a child process and reports the result, including the child's peak RSS.
+ */
+static void benchmark(bool usePoa, BenchmarkParameters *p, bool json, bool *first) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        st_errnoAbort("Couldn't create a pipe");
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        st_errnoAbort("Couldn't fork");
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        double wallTime;
+        int64_t alignedPairs;
+        runAligner(usePoa, p, &wallTime, &alignedPairs);
+        FILE *fileHandle = fdopen(fds[1], "w");
+        fprintf(fileHandle, "%f %" PRIi64 "\n", wallTime, alignedPairs);
+        fclose(fileHandle);
+        _exit(0);
+    }
+    close(fds[1]);
+    double wallTime = -1.0;
+    int64_t alignedPairs = -1;
+    FILE *fileHandle = fdopen(fds[0], "r");
+    int64_t i = fscanf(fileHandle, "%lf %" SCNi64 "", &wallTime, &alignedPairs);
+    fclose(fileHandle);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        st_errnoAbort("Waiting for the benchmark process failed");
+    }
+    if (i != 2 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        st_errAbort("The %s run failed for end degree %" PRIi64 ", adjacency length %" PRIi64 ", divergence %f",
+                    usePoa ? "poa" : "pecan", p->endDegree, p->adjacencyLength, p->divergence);
+    }
+
+    // ru_maxrss is in kilobytes on Linux
+    if (json) {
+        printf("%s\n  {\"aligner\": \"%s\", \"seed\": %" PRIi64 ", \"repeat\": %" PRIi64 ", \"endDegree\": %" PRIi64
+               ", \"adjacencyLength\": %" PRIi64 ", \"divergence\": %f, \"maximumLength\": %" PRIi64,
+               *first ? "" : ",", usePoa ? "poa" : "pecan", p->seed, p->repeat, p->endDegree, p->adjacencyLength,
+               p->divergence, p->maximumLength);
+        if (usePoa) {
+            printf(", \"poaWindow\": %" PRIi64 ", \"poaBandConstant\": %" PRIi64 ", \"poaBandFraction\": %f",
+                   p->poaWindow, p->poaBandConstant, p->poaBandFraction);
+        } else {
+            printf(", \"spanningTrees\": %" PRIi64 "", p->spanningTrees);
+        }
+        printf(", \"wallSeconds\": %f, \"peakRssKb\": %ld, \"alignedPairs\": %" PRIi64 "}", wallTime,
+               usage.ru_maxrss, alignedPairs);
+    } else {
+        printf("%s,%" PRIi64 ",%" PRIi64 ",%" PRIi64 ",%" PRIi64 ",%f,%" PRIi64 ",", usePoa ? "poa" : "pecan",
+               p->seed, p->repeat, p->endDegree, p->adjacencyLength, p->divergence, p->maximumLength);
+        if (usePoa) {
+            printf(",%" PRIi64 ",%" PRIi64 ",%f,", p->poaWindow, p->poaBandConstant, p->poaBandFraction);
+        } else {
+            printf("%" PRIi64 ",,,,", p->spanningTrees);
+        }
+        printf("%f,%ld,%" PRIi64 "\n", wallTime, usage.ru_maxrss, alignedPairs);
+    }
+    *first = false;
+}
+
+int main(int argc, char *argv[]) {
+    char *logLevelString = NULL;
+    int64_t seed = 0, repeats = 1, maximumLength = 1500, spanningTrees = 10;
+    char *endDegreesString = stString_copy("2,8,32");
+    char *adjacencyLengthsString = stString_copy("100,1000");
+    char *divergencesString = stString_copy("0.01,0.1");
+    char *poaWindowsString = stString_copy("10000");
+    char *poaBandConstantsString = stString_copy("10");
+    char *poaBandFractionsString = stString_copy("0.01");
+    bool doPecan = true, doPoa = true, json = false;
+    int64_t i;
+
+    /*
+     * Parse the options.
+     */
+    while (1) {
+        static struct option long_options[] = { { "logLevel", required_argument, 0, 'a' }, { "seed", required_argument, 0, 's' },
+                                                { "repeats", required_argument, 0, 'r' },
+                                                { "endDegrees", required_argument, 0, 'd' },
+                                                { "adjacencyLengths", required_argument, 0, 'l' },
+                                                { "divergences", required_argument, 0, 'v' },
+                                                { "poaWindows", required_argument, 0, 'w' },
+                                                { "poaBandConstants", required_argument, 0, 'b' },
+                                                { "poaBandFractions", required_argument, 0, 'f' },
+                                                { "maximumLength", required_argument, 0, 'j' },
+                                                { "spanningTrees", required_argument, 0, 'i' },
+                                                { "noPecan", no_argument, 0, 'n' }, { "noPoa", no_argument, 0, 'p' },
+                                                { "json", no_argument, 0, 'J' }, { "help", no_argument, 0, 'h' },
+                                                { 0, 0, 0, 0 } };
+
+        int option_index = 0;
+
+        int key = getopt_long(argc, argv, "a:s:r:d:l:v:w:b:f:j:i:npJh", long_options, &option_index);
+
+        if (key == -1) {
+            break;
+        }
+
+        switch (key) {
+            case 'a':
+                logLevelString = stString_copy(optarg);
+                st_setLogLevelFromString(logLevelString);
+                break;
+            case 's':
+                i = sscanf(optarg, "%" PRIi64 "", &seed);
+                assert(i == 1);
+                break;
+            case 'r':
+                i = sscanf(optarg, "%" PRIi64 "", &repeats);
+                assert(i == 1);
+                assert(repeats > 0);
+                break;
+            case 'd':
+                free(endDegreesString);
+                endDegreesString = stString_copy(optarg);
+                break;
+            case 'l':
+                free(adjacencyLengthsString);
+                adjacencyLengthsString = stString_copy(optarg);
+                break;
+            case 'v':
+                free(divergencesString);
+                divergencesString = stString_copy(optarg);
+                break;
+            case 'w':
+                free(poaWindowsString);
+                poaWindowsString = stString_copy(optarg);
+                break;
+            case 'b':
+                free(poaBandConstantsString);
+                poaBandConstantsString = stString_copy(optarg);
+                break;
+            case 'f':
+                free(poaBandFractionsString);
+                poaBandFractionsString = stString_copy(optarg);
+                break;
+            case 'j':
+                i = sscanf(optarg, "%" PRIi64 "", &maximumLength);
+                assert(i == 1);
+                assert(maximumLength >= 0);
+                break;
+            case 'i':
+                i = sscanf(optarg, "%" PRIi64 "", &spanningTrees);
+                assert(i == 1);
+                assert(spanningTrees >= 0);
+                break;
+            case 'n':
+                doPecan = false;
+                break;
+            case 'p':
+                doPoa = false;
+                break;
+            case 'J':
+                json = true;
+                break;
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    (void) i;
+
+    int64_t endDegreeNo, adjacencyLengthNo, divergenceNo, poaWindowNo, poaBandConstantNo, poaBandFractionNo;
+    int64_t *endDegrees = parseIntegerList(endDegreesString, &endDegreeNo);
+    int64_t *adjacencyLengths = parseIntegerList(adjacencyLengthsString, &adjacencyLengthNo);
+    double *divergences = parseFloatList(divergencesString, &divergenceNo);
+    int64_t *poaWindows = parseIntegerList(poaWindowsString, &poaWindowNo);
+    int64_t *poaBandConstants = parseIntegerList(poaBandConstantsString, &poaBandConstantNo);
+    double *poaBandFractions = parseFloatList(poaBandFractionsString, &poaBandFractionNo);
+
+    /*
+     * Run the grid.
+     */
+    bool first = true;
+    if (json) {
+        printf("[");
+    } else {
+        printf("aligner,seed,repeat,endDegree,adjacencyLength,divergence,maximumLength,spanningTrees,poaWindow,"
+               "poaBandConstant,poaBandFraction,wallSeconds,peakRssKb,alignedPairs\n");
+    }
+    BenchmarkParameters p;
+    p.seed = seed;
+    p.maximumLength = maximumLength;
+    p.spanningTrees = spanningTrees;
+    for (int64_t d = 0; d < endDegreeNo; d++) {
+        p.endDegree = endDegrees[d];
+        for (int64_t l = 0; l < adjacencyLengthNo; l++) {
+            p.adjacencyLength = adjacencyLengths[l];
+            for (int64_t v = 0; v < divergenceNo; v++) {
+                p.divergence = divergences[v];
+                for (p.repeat = 0; p.repeat < repeats; p.repeat++) {
+                    if (doPecan) {
+                        benchmark(0, &p, json, &first);
+                    }
+                    if (!doPoa) {
+                        continue;
+                    }
+                    for (int64_t w = 0; w < poaWindowNo; w++) {
+                        p.poaWindow = poaWindows[w];
+                        for (int64_t b = 0; b < poaBandConstantNo; b++) {
+                            p.poaBandConstant = poaBandConstants[b];
+                            for (int64_t f = 0; f < poaBandFractionNo; f++) {
+                                p.poaBandFraction = poaBandFractions[f];
+                                benchmark(1, &p, json, &first);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (json) {
+        printf("\n]\n");
+    }
+
+    /*
+     * Cleanup
+     */
+    free(endDegrees);
+    free(adjacencyLengths);
+    free(divergences);
+    free(poaWindows);
+    free(poaBandConstants);
+    free(poaBandFractions);
+    free(endDegreesString);
+    free(adjacencyLengthsString);
+    free(divergencesString);
+    free(poaWindowsString);
+    free(poaBandConstantsString);
+    free(poaBandFractionsString);
+    free(logLevelString);
+
+    return 0;
+}
@@ -99,21 +99,23 @@ static void testMakeEndAlignments(CuTest *testCase) {
     int64_t maxLength = 4;
     for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
         End *end = ends[endIndex];
-        stSortedSet *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
+        EndAlignment *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
 
-        stSortedSetIterator *iterator = stSortedSet_getIterator(endAlignment);
-        AlignedPair *alignedPair;
         //Check pairs are part of valid sequences from end
-
-        while ((alignedPair = stSortedSet_getNext(iterator)) != NULL) {
+        for (int64_t i = 0; i < endAlignment->length; i++) {
+            AlignedPair *alignedPair = &endAlignment->alignedPairs[i];
             CuAssertTrue(testCase, alignedPair->score > 0); //Check score is valid.
             CuAssertTrue(testCase, alignedPair->score <= PAIR_ALIGNMENT_PROB_1);
-            CuAssertTrue(testCase, stSortedSet_search(endAlignment, alignedPair->reverse) != NULL); //Check other end is in.
+            CuAssertTrue(testCase, !alignedPair->deleted);
+            CuAssertTrue(testCase, alignedPair->reverse->reverse == alignedPair); //Check other end is in.
+            CuAssertTrue(testCase, alignedPair->reverse >= endAlignment->alignedPairs && alignedPair->reverse < endAlignment->alignedPairs + endAlignment->length);
+            if (i > 0) { //Check the pairs are sorted
+                CuAssertTrue(testCase, alignedPair_cmpFn(&endAlignment->alignedPairs[i-1], alignedPair) < 0);
+            }
             //Check coordinates are in sequence..
             CuAssertTrue(testCase, isInAdjacency(alignedPair, end, maxLength));
         }
-        stSortedSet_destructIterator(iterator);
-        stSortedSet_destruct(endAlignment);
+        endAlignment_destruct(endAlignment);
     }
     teardown(testCase);
 }
@@ -124,26 +126,43 @@ static void testReadAndWriteEndAlignments(CuTest *testCase) {
     int64_t maxLength = 4;
     for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
         End *end = ends[endIndex];
-        stSortedSet *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
+        EndAlignment *endAlignment = makeEndAlignment(stateMachine, end, 5, maxLength, end_getInstanceNumber(end) > 50, 0.5, pairwiseParameters);
         char *temporaryEndAlignmentFile = "temporaryEndAlignmentFile.end";
-        FILE *fileHandle = fopen(temporaryEndAlignmentFile, "w");
+        FILE *fileHandle = fopen(temporaryEndAlignmentFile, "wb");
         writeEndAlignmentToDisk(end, endAlignment, fileHandle);
         writeEndAlignmentToDisk(end, endAlignment, fileHandle); //Write twice to show we can serialise.
+        //Deleted pairs are not written
+        if (endAlignment->length > 0) {
+            endAlignment_delete(endAlignment, &endAlignment->alignedPairs[0]);
+        }
+        writeEndAlignmentToDisk(end, endAlignment, fileHandle);
+        EndAlignment *emptyEndAlignment = endAlignment_construct();
+        writeEndAlignmentToDisk(end, emptyEndAlignment, fileHandle);
         fclose(fileHandle);
-        fileHandle = fopen(temporaryEndAlignmentFile, "r");
+        fileHandle = fopen(temporaryEndAlignmentFile, "rb");
         End *end2;
-        stSortedSet *endAlignment2 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
+        EndAlignment *endAlignment2 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
+        CuAssertPtrEquals(testCase, end, end2);
+        EndAlignment *endAlignment3 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
+        CuAssertPtrEquals(testCase, end, end2);
+        EndAlignment *endAlignment4 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
         CuAssertPtrEquals(testCase, end, end2);
-        stSortedSet *endAlignment3 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
+        EndAlignment *endAlignment5 = loadEndAlignmentFromDisk(flower, fileHandle, &end2);
         CuAssertPtrEquals(testCase, end, end2);
+        CuAssertIntEquals(testCase, 0, endAlignment_size(endAlignment5));
         CuAssertTrue(testCase, loadEndAlignmentFromDisk(flower, fileHandle, &end2) == NULL);
         CuAssertTrue(testCase, end2 == NULL);
         fclose(fileHandle);
-        CuAssertTrue(testCase, stSortedSet_equals(endAlignment, endAlignment2));
-        CuAssertTrue(testCase, stSortedSet_equals(endAlignment, endAlignment3));
-        stSortedSet_destruct(endAlignment);
-        stSortedSet_destruct(endAlignment2);
-        stSortedSet_destruct(endAlignment3);
+        CuAssertTrue(testCase, endAlignment_equals(endAlignment2, endAlignment3));
+        CuAssertTrue(testCase, endAlignment_equals(endAlignment, endAlignment4));
+        CuAssertIntEquals(testCase, endAlignment_size(endAlignment), endAlignment_size(endAlignment4));
+        CuAssertIntEquals(testCase, endAlignment_size(endAlignment) + (endAlignment->length > 0 ? 2 : 0), endAlignment_size(endAlignment2));
+        endAlignment_destruct(endAlignment);
+        endAlignment_destruct(endAlignment2);
+        endAlignment_destruct(endAlignment3);
+        endAlignment_destruct(endAlignment4);
+        endAlignment_destruct(endAlignment5);
+        endAlignment_destruct(emptyEndAlignment);
         stFile_rmtree(temporaryEndAlignmentFile);
     }
     teardown(testCase);
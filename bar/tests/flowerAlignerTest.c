@@ -10,7 +10,7 @@
 #include "adjacencySequences.h"
 #include "pairwiseAligner.h"
 
-stList *getInducedAlignment(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence);
+stList *getInducedAlignment(EndAlignment *endAlignment, AdjacencySequence *adjacencySequence);
 
 static int getRandomPosition(AdjacencySequence *adjacencySequence) {
     if(adjacencySequence->strand) {
@@ -23,16 +23,14 @@ static int getRandomPosition(AdjacencySequence *adjacencySequence) {
 
 int64_t isInAdjacencySequence(AlignedPair *alignedPair, AdjacencySequence *adjacencySequence);
 
-stList *getinducedAlignment2(stSortedSet *endAlignment, AdjacencySequence *adjacencySequence) {
+stList *getinducedAlignment2(EndAlignment *endAlignment, AdjacencySequence *adjacencySequence) {
     stList *inducedAlignment = stList_construct();
-    stSortedSetIterator *it = stSortedSet_getIterator(endAlignment);
-    AlignedPair *alignedPair;
-    while((alignedPair = stSortedSet_getNext(it)) != NULL) {
-        if(isInAdjacencySequence(alignedPair, adjacencySequence)) {
+    for(int64_t i=0; i<endAlignment->length; i++) {
+        AlignedPair *alignedPair = &endAlignment->alignedPairs[i];
+        if(!alignedPair->deleted && isInAdjacencySequence(alignedPair, adjacencySequence)) {
             stList_append(inducedAlignment, alignedPair);
         }
     }
-    stSortedSet_destructIterator(it);
     stList_sort(inducedAlignment, (int (*)(const void *, const void *))alignedPair_cmpFn);
     if(!adjacencySequence->strand) {
         stList_reverse(inducedAlignment);
@@ -46,6 +44,7 @@ void test_getInducedAlignment(CuTest *testCase) {
 
         stSortedSet *sortedAlignment = stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
                        (void (*)(void *))alignedPair_destruct);
+        EndAlignment *endAlignment = endAlignment_construct();
 
 
         stList *adjacencySequences = stList_construct3(0, (void (*)(void *))adjacencySequence_destruct);
@@ -65,15 +64,33 @@ void test_getInducedAlignment(CuTest *testCase) {
                         alignedPair_construct(aS1->subsequenceIdentifier, getRandomPosition(aS1), aS1->strand,
                                               aS2->subsequenceIdentifier, getRandomPosition(aS2), aS2->strand,
                                               st_randomInt(0, PAIR_ALIGNMENT_PROB_1), st_randomInt(0, PAIR_ALIGNMENT_PROB_1));
-                stSortedSet_insert(sortedAlignment, alignedPair);
-                stSortedSet_insert(sortedAlignment, alignedPair->reverse);
+                if(stSortedSet_search(sortedAlignment, alignedPair) == NULL) { //Skip duplicate pairs
+                    stSortedSet_insert(sortedAlignment, alignedPair);
+                    stSortedSet_insert(sortedAlignment, alignedPair->reverse);
+                    endAlignment_add(endAlignment, aS1->subsequenceIdentifier, alignedPair->position, aS1->strand,
+                                     aS2->subsequenceIdentifier, alignedPair->reverse->position, aS2->strand,
+                                     alignedPair->score, alignedPair->reverse->score);
+                }
+                else {
+                    alignedPair_destruct(alignedPair->reverse);
+                    alignedPair_destruct(alignedPair);
+                }
+            }
+        }
+        endAlignment_sort(endAlignment);
+
+        //Delete some of the pairs, which should then be missing from the induced alignments
+        for(int64_t i=0; i<endAlignment->length; i++) {
+            AlignedPair *alignedPair = &endAlignment->alignedPairs[i];
+            if(!alignedPair->deleted && st_random() > 0.8) {
+                endAlignment_delete(endAlignment, alignedPair);
             }
         }
 
         for(int64_t i=0; i<stList_length(adjacencySequences); i++) {
             AdjacencySequence *adjacencySequence = stList_get(adjacencySequences, i);
-            stList *inducedAlignment = getInducedAlignment(sortedAlignment, adjacencySequence);
-            stList *inducedAlignment2 = getinducedAlignment2(sortedAlignment, adjacencySequence);
+            stList *inducedAlignment = getInducedAlignment(endAlignment, adjacencySequence);
+            stList *inducedAlignment2 = getinducedAlignment2(endAlignment, adjacencySequence);
 
             /*st_logInfo("The lengths are %" PRIi64 " %" PRIi64 "\n", stList_length(inducedAlignment), stList_length(inducedAlignment2));
             st_logInfo("Adj %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 "\n", adjacencySequence->sequenceName, adjacencySequence->start, adjacencySequence->length, adjacencySequence->strand);
@@ -99,6 +116,7 @@ void test_getInducedAlignment(CuTest *testCase) {
 
         //cleanup
         stSortedSet_destruct(sortedAlignment);
+        endAlignment_destruct(endAlignment);
         teardown(testCase);
     }
 }
@@ -110,19 +128,53 @@ void test_flowerAlignerRandom(CuTest *testCase) {
     setup(testCase);
     int64_t maxLength = 5;
     StateMachine *sM = stateMachine5_construct(fiveState);
-    stSortedSet *flowerAlignment = makeFlowerAlignment(sM, flower, 5, maxLength, 1, 0.5, pairwiseParameters, st_random() > 0.5);
+    EndAlignment *flowerAlignment = makeFlowerAlignment(sM, flower, 5, maxLength, 1, 0.5, pairwiseParameters, st_random() > 0.5);
     stateMachine_destruct(sM);
     //Check the aligned pairs are all good..
-    stSortedSetIterator *iterator = stSortedSet_getIterator(flowerAlignment);
-    AlignedPair *alignedPair;
-    while((alignedPair = stSortedSet_getNext(iterator)) != NULL) {
+    for (int64_t i = 0; i < flowerAlignment->length; i++) {
+        AlignedPair *alignedPair = &flowerAlignment->alignedPairs[i];
         CuAssertTrue(testCase, alignedPair->score > 0); //Check score is valid
         CuAssertTrue(testCase, alignedPair->score <= PAIR_ALIGNMENT_PROB_1);
-        CuAssertTrue(testCase, stSortedSet_search(flowerAlignment, alignedPair->reverse) != NULL); //Check other end is in.
+        CuAssertTrue(testCase, !alignedPair->deleted);
+        CuAssertTrue(testCase, alignedPair->reverse->reverse == alignedPair); //Check other end is in.
+        CuAssertTrue(testCase, alignedPair->reverse >= flowerAlignment->alignedPairs);
+        CuAssertTrue(testCase, alignedPair->reverse < flowerAlignment->alignedPairs + flowerAlignment->length);
+        if (i > 0) { //Check the pairs are sorted
+            CuAssertTrue(testCase, alignedPair_cmpFn(&flowerAlignment->alignedPairs[i - 1], alignedPair) < 0);
+        }
     }
-    stSortedSet_destructIterator(iterator);
-    stSortedSet_destruct(flowerAlignment);
+    endAlignment_destruct(flowerAlignment);
+
+    teardown(testCase);
+}
 
+int64_t isInAdjacency(AlignedPair *alignedPair, End *end, int64_t maxLength);
+
+/*
+ * Checks the end alignments made in parallel are valid and returned in the order of the ends.
+ */
+void test_makeEndAlignmentsInParallel(CuTest *testCase) {
+    setup(testCase);
+    int64_t maxLength = 4;
+    stList *ends = stList_construct();
+    stList_append(ends, end1);
+    stList_append(ends, end2);
+    stList_append(ends, end3);
+    stList *endAlignments = makeEndAlignments(stateMachine, ends, 5, maxLength, 0, 0.5, pairwiseParameters);
+    CuAssertIntEquals(testCase, stList_length(ends), stList_length(endAlignments));
+    for (int64_t i = 0; i < stList_length(ends); i++) {
+        EndAlignment *endAlignment = stList_get(endAlignments, i);
+        for (int64_t j = 0; j < endAlignment->length; j++) {
+            AlignedPair *alignedPair = &endAlignment->alignedPairs[j];
+            CuAssertTrue(testCase, alignedPair->score > 0);
+            CuAssertTrue(testCase, alignedPair->score <= PAIR_ALIGNMENT_PROB_1);
+            CuAssertTrue(testCase, alignedPair->reverse->reverse == alignedPair);
+            CuAssertTrue(testCase, isInAdjacency(alignedPair, stList_get(ends, i), maxLength));
+        }
+        endAlignment_destruct(endAlignment);
+    }
+    stList_destruct(endAlignments);
+    stList_destruct(ends);
     teardown(testCase);
 }
 
@@ -130,5 +182,6 @@ CuSuite* flowerAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_getInducedAlignment);
     SUITE_ADD_TEST(suite, test_flowerAlignerRandom);
+    SUITE_ADD_TEST(suite, test_makeEndAlignmentsInParallel);
     return suite;
 }
@@ -154,6 +154,84 @@ void test_make_consistent_partial_order_alignments_two_ends(CuTest *testCase) {
     }
 }
 
+/**
+ * As test_make_consistent_partial_order_alignments_two_ends, but with many pairs of ends and a small window,
+ * so the msas are built in parallel and each thread's abpoa context is reused between ends and windows.
+ */
+void test_make_consistent_partial_order_alignments_many_ends(CuTest *testCase) {
+    for(int64_t test=0; test<20; test++) {
+        fprintf(stderr, "Running test_make_consistent_partial_order_alignments_many_ends, test %i\n", (int)test);
+
+        // build the pairs of ends, each pair is connected by strings evolved from its own parent string
+        int64_t pair_no = st_randomInt(1, 10);
+        int64_t end_no = 2 * pair_no;
+        int64_t end_lengths[end_no];
+        char **end_strings[end_no];
+        int *end_string_lengths[end_no];
+        int64_t *right_end_indexes[end_no];
+        int64_t *right_end_row_indexes[end_no];
+        int64_t *overlaps[end_no];
+        int64_t offsets[pair_no];
+
+        for(int64_t p=0; p<pair_no; p++) {
+            char *parent_string = getRandomACGTSequence(st_randomInt(1, 50));
+            int64_t seq_no = st_randomInt(1, 20);
+            int64_t end1 = 2 * p, end2 = 2 * p + 1;
+            for(int64_t i=end1; i<=end2; i++) {
+                end_lengths[i] = seq_no;
+                end_strings[i] = st_malloc(sizeof(char *) * seq_no);
+                end_string_lengths[i] = st_malloc(sizeof(int) * seq_no);
+                right_end_indexes[i] = st_malloc(sizeof(int64_t) * seq_no);
+                right_end_row_indexes[i] = st_malloc(sizeof(int64_t) * seq_no);
+                overlaps[i] = st_malloc(sizeof(int64_t) * seq_no);
+            }
+
+            int64_t j = offsets[p] = st_randomInt(0, 1000);
+            for(int64_t i=0; i<seq_no; i++) {
+                char *c = evolveSequence(parent_string);
+                int64_t k = (i + j)%seq_no; // The row index of the corresponding sequence for the second end
+
+                end_strings[end1][i] = c;
+                end_string_lengths[end1][i] = strlen(c);
+                right_end_indexes[end1][i] = end2;
+                right_end_row_indexes[end1][i] = k;
+                overlaps[end1][i] = strlen(c);
+
+                end_strings[end2][k] = stString_reverseComplementString(c);
+                end_string_lengths[end2][k] = strlen(c);
+                right_end_indexes[end2][k] = end1;
+                right_end_row_indexes[end2][k] = i;
+                overlaps[end2][k] = strlen(c);
+            }
+            free(parent_string);
+        }
+
+        // generate the alignments
+        Msa **msas = make_consistent_partial_order_alignments(end_no, end_lengths, end_strings, end_string_lengths,
+                                                              right_end_indexes, right_end_row_indexes, overlaps, 20, 10, 0.01);
+
+        // Validate the combination of each pair of MSAs covers the complete sequences
+        for(int64_t p=0; p<pair_no; p++) {
+            int64_t seq_no = end_lengths[2 * p];
+            int64_t lengths1[seq_no], lengths2[seq_no];
+            validate_msa(testCase, msas[2 * p], lengths1);
+            validate_msa(testCase, msas[2 * p + 1], lengths2);
+            for(int64_t i=0; i<seq_no; i++) {
+                CuAssertTrue(testCase, lengths1[i] + lengths2[(i + offsets[p])%seq_no] == end_string_lengths[2 * p][i]);
+            }
+        }
+
+        // clean up
+        for(int64_t i=0; i<end_no; i++) {
+            msa_destruct(msas[i]);
+            free(right_end_indexes[i]);
+            free(right_end_row_indexes[i]);
+            free(overlaps[i]);
+        }
+        free(msas);
+    }
+}
+
 void test_make_flower_alignment_poa(CuTest *testCase) {
     setup(testCase);
 
@@ -191,6 +269,49 @@ void test_make_flower_alignment_poa(CuTest *testCase) {
     teardown(testCase);
 }
 
+/**
+ * Check that the encoded adjacency prefixes match the adjacency prefix strings.
+ */
+void test_get_adjacency_bytes_and_overlap(CuTest *testCase) {
+    setup(testCase);
+
+    int64_t max_seq_lengths[] = { 0, 1, 2, 5, 10000 };
+    int64_t mask_filters[] = { -1, 0, 1, 5 };
+    End *end;
+    Flower_EndIterator *endIterator = flower_getEndIterator(flower);
+    while ((end = flower_getNextEnd(endIterator)) != NULL) {
+        Cap *cap;
+        End_InstanceIterator *capIterator = end_getInstanceIterator(end);
+        while ((cap = end_getNext(capIterator)) != NULL) {
+            if (cap_getSide(cap)) {
+                cap = cap_getReverse(cap);
+            }
+            for(int64_t i=0; i<5; i++) {
+                for(int64_t j=0; j<4; j++) {
+                    int length, length2;
+                    int64_t overlap, overlap2;
+                    char *s = get_adjacency_string_and_overlap(cap, &length, &overlap, max_seq_lengths[i],
+                                                               mask_filters[j]);
+                    uint8_t *bytes = st_malloc(sizeof(uint8_t) * (max_seq_lengths[i] + 1));
+                    get_adjacency_bytes_and_overlap(cap, bytes, &length2, &overlap2, max_seq_lengths[i],
+                                                    mask_filters[j]);
+                    CuAssertIntEquals(testCase, length, length2);
+                    CuAssertIntEquals(testCase, overlap, overlap2);
+                    for(int64_t k=0; k<length; k++) {
+                        CuAssertIntEquals(testCase, msa_to_byte(s[k]), bytes[k]);
+                    }
+                    free(s);
+                    free(bytes);
+                }
+            }
+        }
+        end_destructInstanceIterator(capIterator);
+    }
+    flower_destructEndIterator(endIterator);
+
+    teardown(testCase);
+}
+
 void test_alignment_block_iterator(CuTest *testCase) {
     setup(testCase);
 
@@ -223,7 +344,9 @@ CuSuite* poaBarAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_make_partial_order_alignment);
     SUITE_ADD_TEST(suite, test_make_consistent_partial_order_alignments_two_ends);
+    SUITE_ADD_TEST(suite, test_make_consistent_partial_order_alignments_many_ends);
     SUITE_ADD_TEST(suite, test_make_flower_alignment_poa);
+    SUITE_ADD_TEST(suite, test_get_adjacency_bytes_and_overlap);
     SUITE_ADD_TEST(suite, test_alignment_block_iterator);
     return suite;
 }
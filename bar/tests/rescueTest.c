@@ -4,8 +4,20 @@
 #include "stPinchGraphs.h"
 #include "rescue.h"
 
-// Get a little-endian bed region array as an mmaped coverage array
-// would appear.
+typedef struct {
+    Name name;
+    int64_t start;
+    int64_t stop;
+} bedRegion;
+
+static int bedRegion_cmp(const bedRegion *region1, const bedRegion *region2) {
+    if (region1->name != region2->name) {
+        return region1->name < region2->name ? -1 : 1;
+    }
+    return region1->start < region2->start ? -1 : (region1->start > region2->start ? 1 : 0);
+}
+
+// Get a bed region array of the covered runs of a coverage array.
 static bedRegion *getBedRegionArray(int64_t name, bool *coverageArray,
                                     int64_t length, bedRegion *array,
                                     size_t *numBeds, size_t *arraySize) {
@@ -17,11 +29,11 @@ static bedRegion *getBedRegionArray(int64_t name, bool *coverageArray,
     bedRegion *curRegion = array + *numBeds;
     for (int64_t i = 0; i < length; i++) {
         if (coverageArray[i] && !inCoveredRegion) {
-            curRegion->name = st_nativeInt64ToLittleEndian(name);
-            curRegion->start = st_nativeInt64ToLittleEndian(i);
+            curRegion->name = name;
+            curRegion->start = i;
             inCoveredRegion = true;
         } else if (!coverageArray[i] && inCoveredRegion) {
-            curRegion->stop = st_nativeInt64ToLittleEndian(i);
+            curRegion->stop = i;
             inCoveredRegion = false;
             (*numBeds)++;
             if (*numBeds >= *arraySize) {
@@ -32,7 +44,7 @@ static bedRegion *getBedRegionArray(int64_t name, bool *coverageArray,
         }
     }
     if (inCoveredRegion) {
-        curRegion->stop = st_nativeInt64ToLittleEndian(length);
+        curRegion->stop = length;
         (*numBeds)++;
         if (*numBeds >= *arraySize) {
             *arraySize = *arraySize * 2 + 1;
@@ -43,6 +55,74 @@ static bedRegion *getBedRegionArray(int64_t name, bool *coverageArray,
     return array;
 }
 
+// Sort the bed regions and build a coverage index from them.
+static CoverageIndex *getCoverageIndex(bedRegion *beds, size_t numBeds) {
+    qsort(beds, numBeds, sizeof(bedRegion), (int (*)(const void *, const void *)) bedRegion_cmp);
+    Name *names = st_malloc((numBeds + 1) * sizeof(Name));
+    int64_t *starts = st_malloc((numBeds + 1) * sizeof(int64_t));
+    int64_t *stops = st_malloc((numBeds + 1) * sizeof(int64_t));
+    for (size_t i = 0; i < numBeds; i++) {
+        names[i] = beds[i].name;
+        starts[i] = beds[i].start;
+        stops[i] = beds[i].stop;
+    }
+    CoverageIndex *coverageIndex = coverageIndex_construct(names, starts, stops, numBeds);
+    free(names);
+    free(starts);
+    free(stops);
+    return coverageIndex;
+}
+
+// Check the covered bases reported by a coverage index, built from
+// random overlapping regions, against a brute force count, both before
+// and after writing it to disk and loading it back.
+static void test_coverageIndex(CuTest *testCase) {
+    for (int64_t testNum = 0; testNum < 100; testNum++) {
+        int64_t sequenceNumber = st_randomInt(1, 5);
+        int64_t sequenceLength = st_randomInt(1, 100);
+        bool *coverage = st_calloc(sequenceNumber * sequenceLength, sizeof(bool));
+        size_t numBeds = st_randomInt(0, 50);
+        bedRegion *beds = st_malloc((numBeds + 1) * sizeof(bedRegion));
+        for (size_t i = 0; i < numBeds; i++) {
+            // Sequence names are spaced out, so that some names are missing from the index
+            beds[i].name = 2 * st_randomInt(0, sequenceNumber) + 1;
+            beds[i].start = st_randomInt(0, sequenceLength);
+            beds[i].stop = st_randomInt(beds[i].start, sequenceLength + 1);
+            for (int64_t j = beds[i].start; j < beds[i].stop; j++) {
+                coverage[(beds[i].name / 2) * sequenceLength + j] = 1;
+            }
+        }
+        CoverageIndex *coverageIndex = getCoverageIndex(beds, numBeds);
+
+        char *tempPath = "coverageIndexTest.bin";
+        FILE *fileHandle = fopen(tempPath, "wb");
+        coverageIndex_write(coverageIndex, fileHandle);
+        fclose(fileHandle);
+        CoverageIndex *loadedCoverageIndex = coverageIndex_load(tempPath);
+
+        for (Name name = 0; name <= 2 * sequenceNumber; name++) {
+            for (int64_t start = 0; start <= sequenceLength; start++) {
+                for (int64_t stop = start; stop <= sequenceLength; stop++) {
+                    int64_t coveredBases = 0;
+                    for (int64_t j = start; j < stop && name % 2 == 1; j++) {
+                        coveredBases += coverage[(name / 2) * sequenceLength + j];
+                    }
+                    CuAssertIntEquals(testCase, coveredBases,
+                                      coverageIndex_getCoveredBases(coverageIndex, name, start, stop));
+                    CuAssertIntEquals(testCase, coveredBases,
+                                      coverageIndex_getCoveredBases(loadedCoverageIndex, name, start, stop));
+                }
+            }
+        }
+
+        coverageIndex_destruct(coverageIndex);
+        coverageIndex_destruct(loadedCoverageIndex);
+        stFile_rmtree(tempPath);
+        free(beds);
+        free(coverage);
+    }
+}
+
 // Just check that running a rescue on pinch threads works correctly.
 static void test_rescueRandomSequences(CuTest *testCase) {
     for (int64_t testNum = 0; testNum < 1000; testNum++) {
@@ -108,8 +188,8 @@ static void test_rescueRandomSequences(CuTest *testCase) {
             st_logDebug("\n");
         }
 
-        // Sort the bedRegion array.
-        qsort(bedRegionArray, numBeds, sizeof(bedRegion), (int (*)(const void *, const void *)) bedRegion_cmp);
+        // Sort the bedRegion array and index it.
+        CoverageIndex *coverageIndex = getCoverageIndex(bedRegionArray, numBeds);
 
         // Run the rescue and make sure it worked.
         threadIt = stPinchThreadSet_getIt(threadSet);
@@ -121,7 +201,7 @@ static void test_rescueRandomSequences(CuTest *testCase) {
             CuAssertPtrNotNull(testCase, coverageArray);
             bool *alreadyCovered = stHash_search(regionsAlreadyCovered, thread);
             CuAssertPtrNotNull(testCase, alreadyCovered);
-            rescueCoveredRegions(thread, bedRegionArray, numBeds,
+            rescueCoveredRegions(thread, coverageIndex,
                                  stPinchThread_getName(thread), 1, 0);
             stPinchSegment *segment = stPinchThread_getFirst(thread);
             while (segment != NULL) {
@@ -155,6 +235,7 @@ static void test_rescueRandomSequences(CuTest *testCase) {
         stHash_destruct(coveragesToRescue);
         stHash_destruct(regionsAlreadyCovered);
         stPinchThreadSet_destruct(threadSet);
+        coverageIndex_destruct(coverageIndex);
         free(bedRegionArray);
     }
 }
@@ -162,5 +243,6 @@ static void test_rescueRandomSequences(CuTest *testCase) {
 CuSuite *rescueTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_rescueRandomSequences);
+    SUITE_ADD_TEST(suite, test_coverageIndex);
     return suite;
 }
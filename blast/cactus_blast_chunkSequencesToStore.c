@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "bioioC.h"
+#include "commonC.h"
+
+#include "blastAlignmentLib.h"
+#include "chunkStore.h"
+
+/*
+ * Chunks up the sequences as cactus_blast_chunkSequences does, but into a single chunk store rather than a file per
+ * chunk, and writes the number of chunks to stdout. The chunks are read back with cactus_blast_chunkStoreToFasta.
+ */
+int main(int argc, char *argv[]) {
+    //log-string, chunkSize, overlapSize, chunkStoreFile, seqFilesX n
+    if (argc < 5) {
+        st_errAbort("Usage: cactus_blast_chunkSequencesToStore logLevel chunkSize overlapSize chunkStoreFile "
+                    "[sequenceFiles...]");
+    }
+    st_setLogLevelFromString(argv[1]);
+    int64_t chunkSize, chunkOverlapSize;
+    if (sscanf(argv[2], "%" PRIi64 "", &chunkSize) != 1 || chunkSize <= 0) {
+        st_errAbort("Invalid chunk size %s", argv[2]);
+    }
+    if (sscanf(argv[3], "%" PRIi64 "", &chunkOverlapSize) != 1 || chunkOverlapSize < 0) {
+        st_errAbort("Invalid overlap size %s", argv[3]);
+    }
+    ChunkStoreWriter *writer = chunkStoreWriter_construct(argv[4]);
+    setupToChunkSequencesToStore(chunkSize, chunkOverlapSize, writer);
+    for (int64_t i = 5; i < argc; i++) {
+        FILE *fileHandle2 = fopen(argv[i], "r");
+        if (fileHandle2 == NULL) {
+            st_errnoAbort("Failed to open sequence file %s", argv[i]);
+        }
+        fastaReadToFunction(fileHandle2, NULL, processSequenceToChunk);
+        fclose(fileHandle2);
+    }
+    finishChunkingSequences();
+    chunkStoreWriter_destruct(writer);
+
+    ChunkStore *store = chunkStore_construct(argv[4]);
+    fprintf(stdout, "%" PRIi64 "\n", chunkStore_getChunkNumber(store));
+    chunkStore_destruct(store);
+    return 0;
+}
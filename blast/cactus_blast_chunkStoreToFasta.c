@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <stdio.h>
+#include "sonLib.h"
+#include "chunkStore.h"
+
+/*
+ * Writes the given chunks of a chunk store, made by cactus_blast_chunkSequencesToStore, to stdout as FASTA, the same
+ * as the chunk files of cactus_blast_chunkSequences, for lastz.
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        st_errAbort("Usage: cactus_blast_chunkStoreToFasta chunkStoreFile chunkID [chunkID...]");
+    }
+    ChunkStore *store = chunkStore_construct(argv[1]);
+    for (int64_t i = 2; i < argc; i++) {
+        int64_t chunk;
+        if (sscanf(argv[i], "%" PRIi64 "", &chunk) != 1) {
+            st_errAbort("Invalid chunk ID %s", argv[i]);
+        }
+        chunkStore_writeChunkFasta(store, chunk, stdout);
+    }
+    chunkStore_destruct(store);
+    if (fflush(stdout) != 0) {
+        st_errnoAbort("Failed to write the chunks");
+    }
+    return 0;
+}
@@ -16,6 +16,7 @@
 #include "avl.h"
 #include "pairwiseAlignment.h"
 #include "blastAlignmentLib.h"
+#include "cigarCodec.h"
 
 int main(int argc, char *argv[]) {
     /*
@@ -48,17 +49,26 @@ int main(int argc, char *argv[]) {
     (void)i;
     assert(i == 1);
     assert(roundsOfConversion >= 1);
-    struct PairwiseAlignment *pairwiseAlignment;
-    while ((pairwiseAlignment = cigarRead(fileHandleIn)) != NULL) {
+    stHash *contigs = cigar_constructContigs();
+    stHash *conversions = constructContigConversions();
+    CigarReader *reader = cigarReader_constructWithContigs(fileHandleIn, contigs);
+    CigarWriter *writer = cigarWriter_construct(fileHandleOut);
+    Cigar *cigar = cigar_construct();
+    while (cigarReader_read(reader, cigar)) {
         //Correct coordinates
         for(int64_t j=0; j<roundsOfConversion; j++) {
-            convertCoordinatesOfPairwiseAlignment(pairwiseAlignment,
-                                                  convertContig1,
-                                                  convertContig2);
+            convertCoordinatesOfCigar(cigar, conversions,
+                                      contigs,
+                                      convertContig1,
+                                      convertContig2);
         }
-        cigarWrite(fileHandleOut, pairwiseAlignment, 0);
-        destructPairwiseAlignment(pairwiseAlignment);
+        cigarWriter_write(writer, cigar, 0);
     }
+    cigar_destruct(cigar);
+    cigarReader_destruct(reader);
+    cigarWriter_destruct(writer);
+    stHash_destruct(conversions);
+    stHash_destruct(contigs);
     fclose(fileHandleIn);
     fclose(fileHandleOut);
     return 0;
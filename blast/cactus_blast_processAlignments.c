@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2009-2018 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <getopt.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+#include "alignmentPipeline.h"
+
+/*
+ * Runs the post-processing of the lastz alignments, mirroring, sorting, splitting and calculating mapping
+ * qualities, as a single process, without writing cigar files between the steps. The output is the same as that of
+ * "cactus_mirrorAndOrientAlignments | LC_ALL=C sort -k6,6 -k7,7n -k8,8n | uniq | cactus_splitAlignmentOverlaps |
+ * cactus_calculateMappingQualities".
+ */
+
+static void usage(void) {
+    fprintf(stderr, "cactus_blast_processAlignments [options] [outputFiles...]\n");
+    fprintf(stderr, "Mirrors, sorts, splits and calculates the mapping qualities of the cigars in the input.\n");
+    fprintf(stderr, "If the mapping qualities are calculated the alignments of rank i at each site are written to "
+            "the ith output file, of which there must be maxAlignmentsPerSite, otherwise the alignments are "
+            "written to the output file, if given, or stdout.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "--logLevel <level>: Set the log level\n");
+    fprintf(stderr, "--input <file>: The cigar file to read. Default=stdin\n");
+    fprintf(stderr, "--stages <list>: Comma separated list of the stages to run, out of mirror, sort, split "
+            "and mappingQualities, in that order. Default=all of them\n");
+    fprintf(stderr, "--maxAlignmentsPerSite <N>: Default=1\n");
+    fprintf(stderr, "--minimumMapQValue <x>: Default=0\n");
+    fprintf(stderr, "--alpha <x>: Default=1.0\n");
+    fprintf(stderr, "--maxMemory <bytes>: Memory to sort in before spilling to disk. Default=1GB\n");
+    fprintf(stderr, "--tempDir <dir>: Directory for the sort's temporary files. Default=/tmp\n");
+    fprintf(stderr, "--threads <N>: Number of threads to calculate the mapping qualities of the sites on. Default=1\n");
+}
+
+int main(int argc, char *argv[]) {
+    char *logLevelString = NULL;
+    char *inputFile = NULL;
+    char *stagesString = "mirror,sort,split,mappingQualities";
+    int64_t maxAlignmentsPerSite = 1;
+    float minimumMapQValue = 0.0;
+    float alpha = 1.0;
+    int64_t maxMemory = 1000000000;
+    char *tempDir = "/tmp";
+    int64_t numThreads = 1;
+
+    struct option opts[] = { {"logLevel", required_argument, NULL, 'a'},
+                             {"input", required_argument, NULL, 'i'},
+                             {"stages", required_argument, NULL, 's'},
+                             {"maxAlignmentsPerSite", required_argument, NULL, 'n'},
+                             {"minimumMapQValue", required_argument, NULL, 'q'},
+                             {"alpha", required_argument, NULL, 'p'},
+                             {"maxMemory", required_argument, NULL, 'm'},
+                             {"tempDir", required_argument, NULL, 't'},
+                             {"threads", required_argument, NULL, 'T'},
+                             {"help", no_argument, NULL, 'h'},
+                             {0, 0, 0, 0} };
+    int64_t flag;
+    while((flag = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch(flag) {
+        case 'a':
+            logLevelString = optarg;
+            break;
+        case 'i':
+            inputFile = optarg;
+            break;
+        case 's':
+            stagesString = optarg;
+            break;
+        case 'n':
+            if (sscanf(optarg, "%" PRIi64, &maxAlignmentsPerSite) != 1 || maxAlignmentsPerSite < 1) {
+                st_errAbort("Invalid maximum number of alignments per site %s", optarg);
+            }
+            break;
+        case 'q':
+            if (sscanf(optarg, "%f", &minimumMapQValue) != 1) {
+                st_errAbort("Invalid minimum mapping quality %s", optarg);
+            }
+            break;
+        case 'p':
+            if (sscanf(optarg, "%f", &alpha) != 1) {
+                st_errAbort("Invalid alpha %s", optarg);
+            }
+            break;
+        case 'm':
+            if (sscanf(optarg, "%" PRIi64, &maxMemory) != 1 || maxMemory < 1) {
+                st_errAbort("Invalid maximum memory %s", optarg);
+            }
+            break;
+        case 't':
+            tempDir = optarg;
+            break;
+        case 'T':
+            if (sscanf(optarg, "%" PRIi64, &numThreads) != 1 || numThreads < 1) {
+                st_errAbort("Invalid number of threads %s", optarg);
+            }
+            break;
+        case 'h':
+            usage();
+            return 0;
+        case '?':
+        default:
+            usage();
+            return 1;
+        }
+    }
+    st_setLogLevelFromString(logLevelString);
+#if defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
+
+    // Parse the stages
+    bool mirror = 0, sort = 0, split = 0, mappingQualities = 0;
+    char *stagesCopy = stString_copy(stagesString);
+    for (char *stageName = strtok(stagesCopy, ","); stageName != NULL; stageName = strtok(NULL, ",")) {
+        if (strcmp(stageName, "mirror") == 0) {
+            mirror = 1;
+        } else if (strcmp(stageName, "sort") == 0) {
+            sort = 1;
+        } else if (strcmp(stageName, "split") == 0) {
+            split = 1;
+        } else if (strcmp(stageName, "mappingQualities") == 0) {
+            mappingQualities = 1;
+        } else {
+            st_errAbort("Unknown stage %s", stageName);
+        }
+    }
+    free(stagesCopy);
+
+    FILE *fileHandleIn = stdin;
+    if (inputFile != NULL && (fileHandleIn = fopen(inputFile, "r")) == NULL) {
+        st_errnoAbort("Failed to open input file %s", inputFile);
+    }
+
+    // Build the chain of stages from the last backwards
+    int64_t outputFileNumber = argc - optind;
+    FILE **fileHandleOuts;
+    AlignmentStage *stage;
+    if (mappingQualities) {
+        if (outputFileNumber != maxAlignmentsPerSite) {
+            st_errAbort("Expected %" PRIi64 " output files, got %" PRIi64, maxAlignmentsPerSite, outputFileNumber);
+        }
+        fileHandleOuts = st_malloc(sizeof(FILE *) * outputFileNumber);
+        for (int64_t i = 0; i < outputFileNumber; i++) {
+            if ((fileHandleOuts[i] = fopen(argv[optind + i], "w")) == NULL) {
+                st_errnoAbort("Failed to open output file %s", argv[optind + i]);
+            }
+        }
+        stage = alignmentStage_constructMappingQualities(maxAlignmentsPerSite, minimumMapQValue, alpha,
+                                                         fileHandleOuts);
+    } else {
+        if (outputFileNumber > 1) {
+            st_errAbort("Expected at most one output file without the mappingQualities stage");
+        }
+        fileHandleOuts = st_malloc(sizeof(FILE *));
+        fileHandleOuts[0] = stdout;
+        if (outputFileNumber == 1 && (fileHandleOuts[0] = fopen(argv[optind], "w")) == NULL) {
+            st_errnoAbort("Failed to open output file %s", argv[optind]);
+        }
+        stage = alignmentStage_constructWriter(fileHandleOuts[0]);
+        outputFileNumber = 1;
+    }
+    if (split) {
+        stage = alignmentStage_constructSplit(stage);
+    }
+    if (sort) {
+        stage = alignmentStage_constructSort(stage, maxMemory, tempDir);
+    }
+    if (mirror) {
+        stage = alignmentStage_constructMirror(stage);
+    }
+
+    alignmentStage_addFromFile(stage, fileHandleIn);
+    alignmentStage_finish(stage);
+
+    // Cleanup
+    for (int64_t i = 0; i < outputFileNumber; i++) {
+        if (fclose(fileHandleOuts[i]) != 0) {
+            st_errnoAbort("Failed to close output file");
+        }
+    }
+    free(fileHandleOuts);
+    if (inputFile != NULL) {
+        fclose(fileHandleIn);
+    }
+
+    return 0;
+}
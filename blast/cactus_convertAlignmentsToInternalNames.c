@@ -9,35 +9,49 @@
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
 #include "bioioC.h"
+#include "coverageIndex.h"
+#include "cigarCodec.h"
 
 static void usage(void)
 {
     fprintf(stderr, "cactus_convertAlignmentsToInternalNames --cactusDisk cactusDisk inputFile outputFile\n");
     fprintf(stderr, "Options: --bed input file is a bed file, not a cigar. "
-            "Output will be a sorted binary coverage file.\n");
+            "Output will be a binary coverage index (see coverageIndex.h).\n");
 }
 
-static void convertHeadersToNames(struct PairwiseAlignment *pA, stHash *headerToName)
+/*
+ * Returns the cactus name of the sequence with the header, interned in contigs, as are the headers. The names are
+ * cached in convertedHeaders, keyed by the interned headers, so each is looked up once.
+ */
+static const char *convertHeaderToName(const char *header, stHash *headerToName, stHash *convertedHeaders,
+                                       stHash *contigs)
 {
-    Name *name = NULL;
-    if((name = stHash_search(headerToName, pA->contig1)) == NULL) {
-        fprintf(stderr, "Error: sequence %s is not loaded into the cactus "
-                "database\n", pA->contig1);
-        exit(1);
+    const char *convertedHeader = stHash_search(convertedHeaders, (void *) header);
+    if(convertedHeader == NULL) {
+        Name *name = NULL;
+        if((name = stHash_search(headerToName, (void *) header)) == NULL) {
+            fprintf(stderr, "Error: sequence %s is not loaded into the cactus "
+                    "database\n", header);
+            exit(1);
+        }
+        char *nameString = cactusMisc_nameToString(*name);
+        convertedHeader = cigar_internContig(contigs, nameString);
+        free(nameString);
+        stHash_insert(convertedHeaders, (void *) header, (void *) convertedHeader);
     }
-    pA->contig1 = cactusMisc_nameToString(*name);
+    return convertedHeader;
+}
+
+static void convertHeadersToNames(Cigar *cigar, stHash *headerToName, stHash *convertedHeaders, stHash *contigs)
+{
+    cigar->contig1 = convertHeaderToName(cigar->contig1, headerToName, convertedHeaders, contigs);
     // Coordinates have to be shifted by 2 to keep compatibility with
     // cactus coordinates.
-    pA->start1 += 2;
-    pA->end1 += 2;
-    if((name = stHash_search(headerToName, pA->contig2)) == NULL) {
-        fprintf(stderr, "Error: sequence %s is not loaded into the cactus "
-                "database\n", pA->contig2);
-        exit(1);
-    }
-    pA->contig2 = cactusMisc_nameToString(*name);
-    pA->start2 += 2;
-    pA->end2 += 2;
+    cigar->start1 += 2;
+    cigar->end1 += 2;
+    cigar->contig2 = convertHeaderToName(cigar->contig2, headerToName, convertedHeaders, contigs);
+    cigar->start2 += 2;
+    cigar->end2 += 2;
 }
 
 int main(int argc, char *argv[])
@@ -46,10 +60,6 @@ int main(int argc, char *argv[])
     CactusDisk *cactusDisk;
     stKVDatabaseConf *kvDatabaseConf;
     stHash *headerToName;
-    stList *flowers;
-    Flower_EndIterator *endIt;
-    End_InstanceIterator *capIt;
-    End *end;
     FILE *inputFile;
     FILE *outputFile;
     bool isBedFile = false; // true if bed, false if cigar
@@ -88,41 +98,36 @@ int main(int argc, char *argv[])
     }
     kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskString);
     cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
-    flowers = flowerWriter_parseFlowersFromStdin(cactusDisk);
-    assert(stList_length(flowers) == 1);
-    Flower *flower = stList_get(flowers, 0);
-    endIt = flower_getEndIterator(flower);
-    while ((end = flower_getNextEnd(endIt)) != NULL) {
-        capIt = end_getInstanceIterator(end);
-        Cap *cap;
-        while ((cap = end_getNext(capIt)) != NULL) {
-            const char *header;
-            Name name;
-            Name *heapName;
-            if (!cap_getStrand(cap)) {
-                cap = cap_getReverse(cap);
-            }
-            if (cap_getSide(cap)) {
-                continue;
-            }
-            name = cap_getName(cap);
-            header = sequence_getHeader(cap_getSequence(cap));
-            heapName = st_malloc(sizeof(Name));
-            *heapName = name;
-            // The casts to void * are just to drop the const
-            // qualifier. The functions won't modify the header.
-            if (stHash_search(headerToName, (void *) header)) {
-                // There is already a header -> cap name map, check
-                // that it has the same name.
-                Name *otherName = stHash_search(headerToName, (void *) header);
-                fprintf(stderr, "Collision with header %s: name %" PRIi64
-                        " otherName: %" PRIi64 "\n", header, name, *otherName);
-                assert(*otherName == name);
-            }
-            stHash_insert(headerToName, (void *) header, heapName);
+    // The sequences are looked up in the sequence catalog, rather
+    // than by loading the top-level flower. Cigars are converted to
+    // the names of the caps starting the sequences' threads, bed
+    // files to the names of the sequences.
+    stList *entries = cactusDisk_getSequenceCatalog(cactusDisk);
+    for (int64_t i = 0; i < stList_length(entries); i++) {
+        SequenceCatalogEntry *entry = stList_get(entries, i);
+        const char *header = sequenceCatalogEntry_getHeader(entry);
+        Name name;
+        Name *heapName;
+        if (sequenceCatalogEntry_getThreadName(entry) == NULL_NAME) {
+            // Not an input sequence, e.g. a reference sequence.
+            continue;
+        }
+        name = isBedFile ? sequenceCatalogEntry_getName(entry) : sequenceCatalogEntry_getThreadName(entry);
+        heapName = st_malloc(sizeof(Name));
+        *heapName = name;
+        if (stHash_search(headerToName, (void *) header)) {
+            // There is already a header -> name map, check that it
+            // has the same name.
+            Name *otherName = stHash_search(headerToName, (void *) header);
+            fprintf(stderr, "Collision with header %s: name %" PRIi64
+                    " otherName: %" PRIi64 "\n", header, name, *otherName);
+            assert(*otherName == name);
+            free(heapName);
+            continue;
         }
-        end_destructInstanceIterator(capIt);
+        stHash_insert(headerToName, stString_copy(header), heapName);
     }
+    stList_destruct(entries);
 
     inputFile = fopen(argv[optind], "r");
     if (inputFile == NULL) {
@@ -154,14 +159,7 @@ int main(int argc, char *argv[])
                         "database\n", oldHeader);
             }
 
-            // Use the sequence name instead of the cap name.
-            Cap *cap = flower_getCap(flower, *name);
-            assert(cap != NULL);
-            Sequence *sequence = cap_getSequence(cap);
-            assert(sequence != NULL);
-            Name seqName = sequence_getName(sequence);
-
-            char *newHeader = cactusMisc_nameToString(seqName);
+            char *newHeader = cactusMisc_nameToString(*name);
 
             // Convert the coordinates (they have to be increased by 2
             // to account for the caps and thread start position).
@@ -197,46 +195,59 @@ int main(int argc, char *argv[])
         if (ret) {
             st_errAbort("Sort failed on bed file %s", argv[optind + 1]);
         }
-        // Convert the newly sorted file to a binary format
+        // Convert the newly sorted file to a binary coverage index
         FILE *tempFile = fopen(tempPath, "r");
-        outputFile = fopen(argv[optind + 1], "wb");
+        int64_t regionNumber = 0, maxRegionNumber = 1024;
+        Name *names = st_malloc(sizeof(Name) * maxRegionNumber);
+        int64_t *starts = st_malloc(sizeof(int64_t) * maxRegionNumber);
+        int64_t *stops = st_malloc(sizeof(int64_t) * maxRegionNumber);
         while((line = stFile_getLineFromFile(tempFile)) != NULL) {
-            Name seqName;
-            int64_t startPos, endPos;
+            if (regionNumber == maxRegionNumber) {
+                maxRegionNumber *= 2;
+                names = st_realloc(names, sizeof(Name) * maxRegionNumber);
+                starts = st_realloc(starts, sizeof(int64_t) * maxRegionNumber);
+                stops = st_realloc(stops, sizeof(int64_t) * maxRegionNumber);
+            }
             int k = sscanf(line, "%" PRIi64 "\t%" PRIi64 "\t%" PRIi64,
-                           &seqName, &startPos, &endPos);
+                           &names[regionNumber], &starts[regionNumber], &stops[regionNumber]);
             (void) k;
             assert(k == 3);
-            int64_t toWrite = st_nativeInt64ToLittleEndian(seqName);
-            fwrite(&toWrite, sizeof(int64_t), 1, outputFile);
-            toWrite = st_nativeInt64ToLittleEndian(startPos);
-            fwrite(&toWrite, sizeof(int64_t), 1, outputFile);
-            toWrite = st_nativeInt64ToLittleEndian(endPos);
-            fwrite(&toWrite, sizeof(int64_t), 1, outputFile);
+            regionNumber++;
             free(line);
         }
+        CoverageIndex *coverageIndex = coverageIndex_construct(names, starts, stops, regionNumber);
+        outputFile = fopen(argv[optind + 1], "wb");
+        coverageIndex_write(coverageIndex, outputFile);
+        coverageIndex_destruct(coverageIndex);
+        free(names);
+        free(starts);
+        free(stops);
         fclose(tempFile);
         stFile_rmtree(tempPath);
     } else {
         // Input is a cigar file.
         // Scan over the given alignment file and convert the headers to
         // cactus Names.
-        for (;;) {
-            struct PairwiseAlignment *pA = cigarRead(inputFile);
-            if (pA == NULL) {
-                // Signals end of cigar file.
-                break;
-            }
-            convertHeadersToNames(pA, headerToName);
-            checkPairwiseAlignment(pA);
-            cigarWrite(outputFile, pA, TRUE);
-            destructPairwiseAlignment(pA);
+        stHash *contigs = cigar_constructContigs();
+        stHash *convertedHeaders = stHash_construct();
+        CigarReader *reader = cigarReader_constructWithContigs(inputFile, contigs);
+        CigarWriter *writer = cigarWriter_construct(outputFile);
+        Cigar *cigar = cigar_construct();
+        while (cigarReader_read(reader, cigar)) {
+            convertHeadersToNames(cigar, headerToName, convertedHeaders, contigs);
+            cigar_check(cigar);
+            cigarWriter_write(writer, cigar, TRUE);
         }
+        cigar_destruct(cigar);
+        cigarReader_destruct(reader);
+        cigarWriter_destruct(writer);
+        stHash_destruct(convertedHeaders);
+        stHash_destruct(contigs);
     }
 
     // Cleanup.
     fclose(inputFile);
     fclose(outputFile);
-    flower_destructEndIterator(endIt);
+    stHash_destruct(headerToName);
     cactusDisk_destruct(cactusDisk);
 }
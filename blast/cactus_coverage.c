@@ -3,26 +3,129 @@
 #include "sonLib.h"
 #include "bioioC.h"
 #include "pairwiseAlignment.h"
+#include "cigarCodec.h"
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
-// For blocks on the same contig.
-struct block {
+// Coverage is kept as a list of intervals, each adding its depth to
+// the bases it covers, rather than as an array of the depth of every
+// base. The list starts with the disjoint runs of coverage found so
+// far, in order, followed by the intervals added since, which are
+// folded into the runs by a sweep whenever they outnumber them. So
+// memory scales with the number of distinct coverage runs rather than
+// with the length of the sequence.
+struct interval {
     int64_t start;
     int64_t end;
-    int64_t value;
+    uint32_t depth;
+};
+
+typedef struct _coverage {
+    struct interval *intervals;
+    int64_t runNumber; // The first runNumber intervals are the runs
+    int64_t length;
+    int64_t maxLength;
+    bool saturated; // Whether any depth has hit UINT32_MAX
+} Coverage;
+
+// For the sweep over the ends of the intervals.
+struct depthChange {
+    int64_t position;
+    int64_t change;
 };
 
 // For calculating coverage on the target genome
 static stHash *sequenceLengths = NULL;
 static stList *sequenceNames = NULL;
-static stHash *sequenceCoverage = NULL;
+static stHash *sequenceCoverage = NULL; // Name to Coverage
 // For determining if a sequence belongs to the "query" genome
 // (although there is no relation to the query contig in the cigar):
 // i.e. the genome specified in --from, if any
 static stSet *otherGenomeSequences = NULL;
-// For splitting sequence coverage arrays by ID, if we're using the
+// For splitting sequence coverage by ID, if we're using the
 // --depthByID option.
 static stHash *IDToSequenceCoverage;
 
+static Coverage *coverage_construct(void) {
+    return st_calloc(1, sizeof(Coverage));
+}
+
+static void coverage_destruct(Coverage *coverage) {
+    free(coverage->intervals);
+    free(coverage);
+}
+
+static int compareDepthChanges(const void *a, const void *b) {
+    int64_t i = ((struct depthChange *) a)->position, j = ((struct depthChange *) b)->position;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+// Fold all the intervals into disjoint runs, merging neighbouring runs
+// of the same depth. Depths saturate at UINT32_MAX.
+static void coverage_fold(Coverage *coverage) {
+    if (coverage->length == coverage->runNumber) {
+        return;
+    }
+    int64_t changeNumber = coverage->length * 2;
+    struct depthChange *changes = st_malloc(changeNumber * sizeof(struct depthChange));
+    for (int64_t i = 0; i < coverage->length; i++) {
+        struct interval *interval = &coverage->intervals[i];
+        changes[2 * i] = (struct depthChange) { interval->start, interval->depth };
+        changes[2 * i + 1] = (struct depthChange) { interval->end, -(int64_t) interval->depth };
+    }
+    qsort(changes, changeNumber, sizeof(struct depthChange), compareDepthChanges);
+
+    // There are never more runs than depth changes, so the runs can be
+    // written over the intervals, after making room.
+    if (coverage->maxLength < changeNumber) {
+        coverage->maxLength = changeNumber;
+        coverage->intervals = st_realloc(coverage->intervals, coverage->maxLength * sizeof(struct interval));
+    }
+    int64_t runNumber = 0, depth = 0;
+    for (int64_t i = 0; i < changeNumber;) {
+        int64_t start = changes[i].position;
+        for (; i < changeNumber && changes[i].position == start; i++) {
+            depth += changes[i].change;
+        }
+        assert(depth >= 0);
+        if (depth == 0 || i == changeNumber) {
+            continue;
+        }
+        uint32_t runDepth = depth;
+        if (depth >= UINT32_MAX) {
+            runDepth = UINT32_MAX;
+            coverage->saturated = 1;
+        }
+        struct interval *previousRun = runNumber > 0 ? &coverage->intervals[runNumber - 1] : NULL;
+        if (previousRun != NULL && previousRun->end == start && previousRun->depth == runDepth) {
+            previousRun->end = changes[i].position;
+        } else {
+            coverage->intervals[runNumber++] = (struct interval) { start, changes[i].position, runDepth };
+        }
+    }
+    assert(depth == 0);
+    free(changes);
+    coverage->runNumber = coverage->length = runNumber;
+}
+
+static void coverage_add(Coverage *coverage, int64_t start, int64_t end, uint32_t depth) {
+    assert(start <= end);
+    if (start == end) {
+        return;
+    }
+    if (coverage->length == coverage->maxLength) {
+        if (coverage->length - coverage->runNumber >= coverage->runNumber) {
+            coverage_fold(coverage);
+        }
+        if (coverage->length * 2 >= coverage->maxLength) {
+            coverage->maxLength = coverage->maxLength * 2 + 64;
+            coverage->intervals = st_realloc(coverage->intervals, coverage->maxLength * sizeof(struct interval));
+        }
+    }
+    coverage->intervals[coverage->length++] = (struct interval) { start, end, depth };
+}
+
 // Add a sequence from the genome to sequenceLength and sequenceNames
 static void addSequenceLength(void* destination, const char *name, const char *seq, int64_t len)
 {
@@ -68,50 +171,44 @@ static void usage(void)
     fprintf(stderr, "--depthById: Assume that headers have an 'id=N|' prefix, "
             "where N is an integer. Score coverage depth by the number of "
             "different prefixes that align to a region, rather than the total "
-            "number of alignments. Uses much more memory than the standard mode."
+            "number of alignments. Uses more memory than the standard mode."
             "\n");
     fprintf(stderr, "--from <fromFastaFile>: Only consider alignments for which one sequence is in fastaFile and the other is in fromFastaFile (multiple allowed).\n");
+    fprintf(stderr, "--threads <N>: Number of threads to compute the coverage "
+            "of the sequences on. Default=1\n");
 }
 
-static void printCoverage(char *name, uint16_t *array, int64_t length) {
-    int64_t i, regionStart = 0;
-    uint16_t prevCoverage = 0;
-    for(i = 0; i < length; i++) {
-        if(array[i] != prevCoverage) {
-            if(prevCoverage != 0) {
-                printf("%s\t%" PRIi64 "\t%" PRIi64 "\t\t%u\n", name,
-                       regionStart, i, prevCoverage);
-            }
-            regionStart = i;
-        }
-        prevCoverage = array[i];
+// Print the runs of a folded coverage as BED lines to the file.
+static void printCoverage(FILE *fileHandle, char *name, Coverage *coverage) {
+    assert(coverage->length == coverage->runNumber);
+    if (coverage->saturated) {
+        fprintf(stderr, "WARNING: Coverage hit cap (%" PRIu32 ") on contig: %s\n", UINT32_MAX, name);
     }
-    if(prevCoverage != 0) {
-        printf("%s\t%" PRIi64 "\t%" PRIi64 "\t\t%u\n", name,
-               regionStart, i, prevCoverage);
+    for (int64_t i = 0; i < coverage->runNumber; i++) {
+        struct interval *run = &coverage->intervals[i];
+        fprintf(fileHandle, "%s\t%" PRIi64 "\t%" PRIi64 "\t\t%" PRIu32 "\n", name, run->start, run->end, run->depth);
     }
 }
 
-// Fill in the part of a coverage array that is covered by a
-// particular pairwise alignment. contigNum is which contig this
-// coverage array corresponds to in the CIGAR.
-static void fillCoverage(struct PairwiseAlignment *pA, int contigNum,
-                         uint16_t *coverageArray)
+// Add the coverage of a particular pairwise alignment. contigNum is
+// which contig this coverage corresponds to in the CIGAR.
+static void fillCoverage(Cigar *cigar, int contigNum,
+                         Coverage *coverage)
 {
-    int strand = contigNum == 1 ? pA->strand1 : pA->strand2;
-    int64_t startPos = contigNum == 1 ? pA->start1 : pA->start2;
-    int64_t endPos = contigNum == 1 ? pA->end1 : pA->end2;
-    int64_t i, j;
-    int64_t *lenPtr = stHash_search(sequenceLengths, contigNum == 1 ? pA->contig1 : pA->contig2);
+    int strand = contigNum == 1 ? cigar->strand1 : cigar->strand2;
+    int64_t startPos = contigNum == 1 ? cigar->start1 : cigar->start2;
+    int64_t endPos = contigNum == 1 ? cigar->end1 : cigar->end2;
+    int64_t i;
+    int64_t *lenPtr = stHash_search(sequenceLengths, (void *)(contigNum == 1 ? cigar->contig1 : cigar->contig2));
     assert(lenPtr != NULL);
     int64_t len = *lenPtr;
     if(endPos > len) {
-        fprintf(stderr, "Error: alignment on %s:%" PRIi64 "-%" PRIi64 " is past chr end\n", contigNum == 1 ? pA->contig1 : pA->contig2, startPos, endPos);
+        fprintf(stderr, "Error: alignment on %s:%" PRIi64 "-%" PRIi64 " is past chr end\n", contigNum == 1 ? cigar->contig1 : cigar->contig2, startPos, endPos);
         exit(1);
     }
     int64_t curAlignmentPos = startPos;
-    for(i = 0; i < pA->operationList->length; i++) {
-        struct AlignmentOperation *op = pA->operationList->list[i];
+    for(i = 0; i < cigar->operationNumber; i++) {
+        CigarOperation *op = &cigar->operations[i];
         switch(op->opType) {
         case PAIRWISE_INDEL_Y:
             if(contigNum == 2) {
@@ -133,27 +230,11 @@ static void fillCoverage(struct PairwiseAlignment *pA, int contigNum,
             break;
         case PAIRWISE_MATCH:
             if(strand) {
-                for(j=curAlignmentPos; j < curAlignmentPos + op->length; j++) {
-                    if(coverageArray[j] == 65535) {
-                        fprintf(stderr, "WARNING: Coverage hit cap (65535) on contig: "
-                                "%s pos: %" PRIi64 "\n",
-                                contigNum == 1 ? pA->contig1 : pA->contig2, j);
-                    } else {
-                        coverageArray[j]++;
-                    }
-                }
+                coverage_add(coverage, curAlignmentPos, curAlignmentPos + op->length, 1);
                 curAlignmentPos += op->length;
                 assert(curAlignmentPos <= endPos);
             } else {
-                for(j=curAlignmentPos-1; j >= curAlignmentPos - op->length; j--) {
-                    if(coverageArray[j] == 65535) {
-                        fprintf(stderr, "WARNING: Coverage hit cap (65535) on contig: "
-                                "%s pos: %" PRIi64 "\n",
-                                contigNum == 1 ? pA->contig1 : pA->contig2, j);
-                    } else {
-                        coverageArray[j]++;
-                    }
-                }
+                coverage_add(coverage, curAlignmentPos - op->length, curAlignmentPos, 1);
                 curAlignmentPos -= op->length;
                 assert(curAlignmentPos >= endPos);
             }
@@ -161,15 +242,15 @@ static void fillCoverage(struct PairwiseAlignment *pA, int contigNum,
     }
 }
 
-// Get the proper coverage array to fill in, given the "on" header
+// Get the proper coverage to fill in, given the "on" header
 // (i.e. a header in the fasta provided in the arguments to this
 // program), and the "from" header (the other header in the CIGAR file,
-// which may or may not be in that fasta). Initialize the array if necessary.
-static uint16_t *getCoverageArray(char *onHeader, char *fromHeader,
-                                  int depthById) {
+// which may or may not be in that fasta). Initialize the coverage if necessary.
+static Coverage *getCoverage(char *onHeader, char *fromHeader,
+                             int depthById) {
     stHash *coverageHash;
     if (depthById) {
-        // We're splitting arrays by "id=N|" of the "from" header.
+        // We're splitting coverage by "id=N|" of the "from" header.
         stList *attributes = fastaDecodeHeader(fromHeader);
         char *id = stList_get(attributes, 0);
         if (strncmp(id, "id=", 3)) {
@@ -181,26 +262,21 @@ static uint16_t *getCoverageArray(char *onHeader, char *fromHeader,
             // Initialize coverage sub-hash.
             sequenceSubCoverage = stHash_construct3(stHash_stringKey,
                                                     stHash_stringEqualKey, free,
-                                                    free);
-            stHash_insert(IDToSequenceCoverage, id, sequenceSubCoverage);
+                                                    (void (*)(void *)) coverage_destruct);
+            stHash_insert(IDToSequenceCoverage, stString_copy(id), sequenceSubCoverage);
         }
+        stList_destruct(attributes);
         coverageHash = sequenceSubCoverage;
     } else {
         coverageHash = sequenceCoverage;
     }
-    int64_t *lengthPtr = stHash_search(sequenceLengths, onHeader);
-    assert(lengthPtr != NULL);
-    uint16_t *array;
-    if((array = stHash_search(coverageHash, onHeader)) == NULL) {
-        // Coverage array for this seq doesn't exist yet, so
-        // create it
-        int64_t length = *lengthPtr;
-        array = st_malloc(length * sizeof(uint16_t));
-        memset(array, 0, length * sizeof(uint16_t));
-        stHash_insert(coverageHash, stString_copy(onHeader),
-                      array);
+    assert(stHash_search(sequenceLengths, onHeader) != NULL);
+    Coverage *coverage;
+    if((coverage = stHash_search(coverageHash, onHeader)) == NULL) {
+        coverage = coverage_construct();
+        stHash_insert(coverageHash, stString_copy(onHeader), coverage);
     }
-    return array;
+    return coverage;
 }
 
 int main(int argc, char *argv[])
@@ -211,8 +287,10 @@ int main(int argc, char *argv[])
                              {"onlyContig2", no_argument, NULL, '2'},
                              {"depthById", no_argument, NULL, 'i'},
                              {"from", required_argument, NULL, 'f'},
+                             {"threads", required_argument, NULL, 'T'},
                              {0, 0, 0, 0} };
     int outputOnContig1 = TRUE, outputOnContig2 = TRUE, depthById = FALSE;
+    int64_t numThreads = 1;
     int64_t flag, i;
     while((flag = getopt_long(argc, argv, "", opts, NULL)) != -1) {
         switch(flag) {
@@ -228,6 +306,11 @@ int main(int argc, char *argv[])
         case 'f':
             stList_append(otherGenomeFastaPaths, stString_copy(optarg));
             break;
+        case 'T':
+            if (sscanf(optarg, "%" PRIi64, &numThreads) != 1 || numThreads < 1) {
+                st_errAbort("Invalid number of threads %s", optarg);
+            }
+            break;
         case '?':
         default:
             usage();
@@ -239,6 +322,9 @@ int main(int argc, char *argv[])
                 "mutually exclusive\n");
         return 1;
     }
+#if defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
 
     if(stList_length(otherGenomeFastaPaths) > 0) {
         otherGenomeSequences = stSet_construct3(stHash_stringKey,
@@ -264,7 +350,8 @@ int main(int argc, char *argv[])
     sequenceLengths = stHash_construct3(stHash_stringKey,
                                         stHash_stringEqualKey, free, free);
     sequenceCoverage = stHash_construct3(stHash_stringKey,
-                                         stHash_stringEqualKey, free, free);
+                                         stHash_stringEqualKey, free,
+                                         (void (*)(void *)) coverage_destruct);
     sequenceNames = stList_construct3(0, free);
     IDToSequenceCoverage = stHash_construct3(stHash_stringKey,
                                              stHash_stringEqualKey,
@@ -285,36 +372,36 @@ int main(int argc, char *argv[])
     fastaReadToFunction(fastaHandle, NULL, addSequenceLength);
     fclose(fastaHandle);
 
-    // Fill coverage arrays with the alignments
+    // Fill in the coverage with the alignments, streaming through them
     FILE *alignmentsHandle = fopen(argv[optind + 1], "r");
-    for(;;) {
+    CigarReader *reader = cigarReader_construct(alignmentsHandle);
+    Cigar *cigar = cigar_construct();
+    while(cigarReader_read(reader, cigar)) {
         int64_t *lengthPtr;
-        struct PairwiseAlignment *pA = cigarRead(alignmentsHandle);
-        if(pA == NULL) {
-            // Reached end of alignment file
-            break;
-        }
-        if((outputOnContig1 && (lengthPtr = stHash_search(sequenceLengths, pA->contig1))) && ((otherGenomeSequences == NULL) || stSet_search(otherGenomeSequences, pA->contig2))) {
+        if((outputOnContig1 && (lengthPtr = stHash_search(sequenceLengths, (void *)cigar->contig1))) && ((otherGenomeSequences == NULL) || stSet_search(otherGenomeSequences, (void *)cigar->contig2))) {
             // contig 1 is present in the fasta and contig 2 is in the
             // "from" genome if it exists
-            uint16_t *array = getCoverageArray(pA->contig1, pA->contig2,
-                                               depthById);
-            fillCoverage(pA, 1, array);
+            Coverage *coverage = getCoverage((char *)cigar->contig1, (char *)cigar->contig2,
+                                             depthById);
+            fillCoverage(cigar, 1, coverage);
         }
-        if((outputOnContig2 && (lengthPtr = stHash_search(sequenceLengths, pA->contig2))) && ((otherGenomeSequences == NULL) || stSet_search(otherGenomeSequences, pA->contig1))) {
+        if((outputOnContig2 && (lengthPtr = stHash_search(sequenceLengths, (void *)cigar->contig2))) && ((otherGenomeSequences == NULL) || stSet_search(otherGenomeSequences, (void *)cigar->contig1))) {
             // contig 2 is present in the fasta and contig 1 is in the
             // "from" genome if it exists
-            uint16_t *array = getCoverageArray(pA->contig2, pA->contig1,
-                                               depthById);
-            fillCoverage(pA, 2, array);
+            Coverage *coverage = getCoverage((char *)cigar->contig2, (char *)cigar->contig1,
+                                             depthById);
+            fillCoverage(cigar, 2, coverage);
         }
-        destructPairwiseAlignment(pA);
     }
+    cigar_destruct(cigar);
+    cigarReader_destruct(reader);
     fclose(alignmentsHandle);
 
+    // Gather the coverage of each sequence, and if it's divided by
+    // source ID, the coverage of each ID, so the sequences can be
+    // finished independently.
+    stHash *sequenceIDCoverages = stHash_construct2(NULL, (void (*)(void *)) stList_destruct);
     if (depthById) {
-        // Have to merge all coverage arrays that are divided by
-        // source ID into the main sequenceCoverage hash.
         stHashIterator *idIt = stHash_getIterator(IDToSequenceCoverage);
         char *id;
         while ((id = stHash_getNext(idIt)) != NULL) {
@@ -323,31 +410,54 @@ int main(int argc, char *argv[])
             stHashIterator *sequenceIt = stHash_getIterator(subHash);
             char *sequence;
             while ((sequence = stHash_getNext(sequenceIt)) != NULL) {
-                uint16_t *srcArray = stHash_search(subHash, sequence);
-                assert(srcArray != NULL);
-                uint16_t *destArray = getCoverageArray(sequence, NULL, FALSE);
-                int64_t *length = stHash_search(sequenceLengths, sequence);
-                assert(length != NULL && *length >= 0);
-                for (int64_t i = 0; i < *length; i++) {
-                    if (srcArray[i] > 0) {
-                        destArray[i]++;
-                    }
+                Coverage *coverage = getCoverage(sequence, NULL, FALSE);
+                stList *idCoverages = stHash_search(sequenceIDCoverages, coverage);
+                if (idCoverages == NULL) {
+                    idCoverages = stList_construct();
+                    stHash_insert(sequenceIDCoverages, coverage, idCoverages);
                 }
+                stList_append(idCoverages, stHash_search(subHash, sequence));
             }
+            stHash_destructIterator(sequenceIt);
         }
-        stHash_destruct(IDToSequenceCoverage);
+        stHash_destructIterator(idIt);
     }
 
-    // Print results as BED
-    for(i = 0; i < stList_length(sequenceNames); i++) {
-        uint16_t *array;
+    // Finish the coverage of the sequences in parallel, and print the
+    // results as BED in order.
+    int64_t sequenceNumber = stList_length(sequenceNames);
+#if defined(_OPENMP)
+#pragma omp parallel for ordered schedule(dynamic, 1)
+#endif
+    for(i = 0; i < sequenceNumber; i++) {
         char *name = stList_get(sequenceNames, i);
-        int64_t *lengthPtr = stHash_search(sequenceLengths, name);
-        assert(lengthPtr != NULL);
-        int64_t length = *lengthPtr;
-        if((array = stHash_search(sequenceCoverage, name))) {
-            printCoverage(name, array, length);
+        Coverage *coverage = stHash_search(sequenceCoverage, name);
+        if (coverage != NULL) {
+            stList *idCoverages = stHash_search(sequenceIDCoverages, coverage);
+            if (idCoverages != NULL) {
+                // Each ID covering a base adds one to its depth.
+                for (int64_t j = 0; j < stList_length(idCoverages); j++) {
+                    Coverage *idCoverage = stList_get(idCoverages, j);
+                    coverage_fold(idCoverage);
+                    for (int64_t k = 0; k < idCoverage->runNumber; k++) {
+                        coverage_add(coverage, idCoverage->intervals[k].start, idCoverage->intervals[k].end, 1);
+                    }
+                }
+            }
+            coverage_fold(coverage);
         }
+#if defined(_OPENMP)
+#pragma omp ordered
+#endif
+        {
+            if (coverage != NULL) {
+                printCoverage(stdout, name, coverage);
+            }
+        }
+    }
+    stHash_destruct(sequenceIDCoverages);
+    if (depthById) {
+        stHash_destruct(IDToSequenceCoverage);
     }
 
     // Cleanup
@@ -7,7 +7,7 @@ static void usage(void)
 {
     fprintf(stderr, "cactus_stripUniqueIDs --cactusDisk cactusDisk\n");
     fprintf(stderr, "Strips unique IDs that are temporarily prepended "
-            "to sequence headers in the root flower of the cactus DB.\n");
+            "to sequence headers in the cactus DB.\n");
 }
 
 int main(int argc, char *argv[])
@@ -15,9 +15,6 @@ int main(int argc, char *argv[])
     char *cactusDiskString = NULL;
     stKVDatabaseConf *kvDatabaseConf;
     CactusDisk *cactusDisk;
-    Flower *flower;
-    Flower_SequenceIterator *flowerIt;
-    Sequence *sequence;
     struct option longopts[] = { {"cactusDisk", required_argument, NULL, 'c' },
                                  {0, 0, 0, 0} };
     int flag;
@@ -37,11 +34,18 @@ int main(int argc, char *argv[])
     }
     kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskString);
     cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
-    // Get top-level flower.
-    flower = cactusDisk_getFlower(cactusDisk, 0);
-    flowerIt = flower_getSequenceIterator(flower);
-    while((sequence = flower_getNextSequence(flowerIt)) != NULL) {
-        MetaSequence *metaSequence = sequence_getMetaSequence(sequence);
+    // The headers are rewritten from the sequence catalog, without loading the top-level flower.
+    stList *entries = cactusDisk_getSequenceCatalog(cactusDisk);
+    stList *metaSequenceNames = stList_construct3(0, free);
+    for (int64_t i = 0; i < stList_length(entries); i++) {
+        Name *name = st_malloc(sizeof(Name));
+        *name = sequenceCatalogEntry_getName(stList_get(entries, i));
+        stList_append(metaSequenceNames, name);
+    }
+    stList_destruct(entries);
+    stList *metaSequences = cactusDisk_getMetaSequences(cactusDisk, metaSequenceNames);
+    for (int64_t i = 0; i < stList_length(metaSequences); i++) {
+        MetaSequence *metaSequence = stList_get(metaSequences, i);
         const char *header;
         char *firstToken, *newHeader;
         stList *tokens;
@@ -54,7 +58,10 @@ int main(int argc, char *argv[])
         assert(!strncmp(firstToken, "id=", 3));
         free(firstToken);
         newHeader = fastaEncodeHeader(tokens);
+        stList_destruct(tokens);
         metaSequence_setHeader(metaSequence, newHeader);
     }
+    stList_destruct(metaSequences);
+    stList_destruct(metaSequenceNames);
     cactusDisk_write(cactusDisk);
 }
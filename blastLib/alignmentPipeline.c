@@ -0,0 +1,892 @@
+/*
+ * alignmentPipeline.c
+ *
+ * See alignmentPipeline.h.
+ */
+
+#include <math.h>
+#include <unistd.h>
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+#include "cigarCodec.h"
+#include "alignmentPipeline.h"
+
+struct _alignmentStage {
+    void (*add)(AlignmentStage *stage, Cigar *cigar);
+    void (*finish)(AlignmentStage *stage); // Flushes the stage and frees its data
+    AlignmentStage *next;
+    stHash *contigs; // The interned contig names of the cigars, shared by the chain and destructed by its last stage
+    void *data;
+};
+
+static AlignmentStage *alignmentStage_construct(AlignmentStage *next,
+        void (*add)(AlignmentStage *, Cigar *), void (*finish)(AlignmentStage *), void *data) {
+    AlignmentStage *stage = st_malloc(sizeof(AlignmentStage));
+    stage->add = add;
+    stage->finish = finish;
+    stage->next = next;
+    stage->contigs = next != NULL ? next->contigs : cigar_constructContigs();
+    stage->data = data;
+    return stage;
+}
+
+void alignmentStage_add(AlignmentStage *stage, Cigar *cigar) {
+    stage->add(stage, cigar);
+}
+
+void alignmentStage_addFromFile(AlignmentStage *stage, FILE *fileHandleIn) {
+    CigarReader *reader = cigarReader_constructWithContigs(fileHandleIn, stage->contigs);
+    Cigar *cigar = cigar_construct();
+    while (cigarReader_read(reader, cigar)) {
+        stage->add(stage, cigar);
+    }
+    cigar_destruct(cigar);
+    cigarReader_destruct(reader);
+}
+
+void alignmentStage_finish(AlignmentStage *stage) {
+    while (stage != NULL) {
+        if (stage->finish != NULL) {
+            stage->finish(stage);
+        }
+        AlignmentStage *next = stage->next;
+        if (next == NULL) {
+            stHash_destruct(stage->contigs);
+        }
+        free(stage);
+        stage = next;
+    }
+}
+
+static uint64_t getStartCoordinate(Cigar *cigar) {
+    assert(cigar->strand1); // This code assumes that the alignment is reported with respect
+    // to the positive strand of the first sequence
+    return cigar->start1;
+}
+
+static uint64_t getEndCoordinate(Cigar *cigar) {
+    assert(cigar->strand1); // This code assumes that the alignment is reported with respect
+    // to the positive strand of the first sequence
+    return cigar->end1;
+}
+
+/*
+ * Mirroring and orienting alignments.
+ */
+
+static void invertStrands(Cigar *cigar) {
+    /*
+     * Inverts the strands of the alignment.
+     */
+    // Flips the strands of first sequence
+
+    if(cigar->start1 != cigar->end1) { // If alignment has non zero length on the first sequence
+        int64_t start = cigar->start1;
+        cigar->start1 = cigar->end1;
+        cigar->end1 = start;
+    }
+    cigar->strand1 = cigar->strand1 ? 0 : 1;
+
+    if(cigar->start1 != cigar->end1) { // If alignment has non zero length on the second sequence
+        int64_t start = cigar->start2;
+        cigar->start2 = cigar->end2;
+        cigar->end2 = start;
+    }
+    cigar->strand2 = cigar->strand2 ? 0 : 1;
+
+    // Invert the order of the operations
+    for(int64_t i=0, j=cigar->operationNumber-1; i<j; i++, j--) {
+        CigarOperation op = cigar->operations[i];
+        cigar->operations[i] = cigar->operations[j];
+        cigar->operations[j] = op;
+    }
+}
+
+static void cigarReverse(Cigar *cigar) {
+    /*
+     * Flips the query and target sequences
+     */
+
+    // Swap the 1s and 2s
+    const char *contig1 = cigar->contig1;
+    int64_t start1 = cigar->start1;
+    int64_t end1 = cigar->end1;
+    bool strand1 = cigar->strand1;
+
+    cigar->contig1 = cigar->contig2;
+    cigar->start1 = cigar->start2;
+    cigar->end1 = cigar->end2;
+    cigar->strand1 = cigar->strand2;
+
+    cigar->contig2 = contig1;
+    cigar->start2 = start1;
+    cigar->end2 = end1;
+    cigar->strand2 = strand1;
+
+    // Invert the operations
+    for(int64_t i=0; i<cigar->operationNumber; i++) {
+        CigarOperation *op = &cigar->operations[i];
+        assert(op->length >= 0);
+        if(op->opType == PAIRWISE_INDEL_Y) {
+            op->opType = PAIRWISE_INDEL_X;
+        }
+        else if(op->opType == PAIRWISE_INDEL_X) {
+            op->opType = PAIRWISE_INDEL_Y;
+        }
+    }
+}
+
+static void mirror_add(AlignmentStage *stage, Cigar *cigar) {
+    // Pass on the original alignment, as a copy, which the next stage is free to change
+    if(!cigar->strand1) {
+        invertStrands(cigar);
+    }
+    cigar_check(cigar);
+    Cigar *original = stage->data;
+    cigar_copyTo(cigar, original);
+    alignmentStage_add(stage->next, original);
+
+    // Pass on the mirror alignment (with query and target reversed)
+    cigarReverse(cigar);
+    if(!cigar->strand1) {
+        invertStrands(cigar);
+    }
+    cigar_check(cigar);
+    alignmentStage_add(stage->next, cigar);
+}
+
+static void mirror_finish(AlignmentStage *stage) {
+    cigar_destruct(stage->data);
+}
+
+AlignmentStage *alignmentStage_constructMirror(AlignmentStage *next) {
+    return alignmentStage_construct(next, mirror_add, mirror_finish, cigar_construct());
+}
+
+/*
+ * Sorting alignments, by their cigar lines, so that the order and the removal of duplicates match those of sort and
+ * uniq on the cigar files exactly.
+ */
+
+typedef struct _sortedLine {
+    char *line;
+    // The first sequence interval, the sort keys, from fields 6 to 8 of the line
+    const char *contig;
+    int64_t contigLength;
+    int64_t start;
+    int64_t end;
+} SortedLine;
+
+typedef struct _sorter {
+    SortedLine *lines;
+    int64_t lineNumber;
+    int64_t maxLineNumber;
+    int64_t memory; // Bytes of lines held
+    int64_t maxMemory;
+    char *tempDir;
+    stList *runFiles; // Paths of the sorted runs spilled to disk
+    CigarReader *parser; // Parses the sorted lines back into cigars, interning the names in the chain's table
+    Cigar *cigar;
+} Sorter;
+
+/*
+ * The most runs merged at once, which bounds the files held open by a merge.
+ */
+static const int64_t maxRunsPerMerge = 64;
+
+static SortedLine sortedLine_construct(char *line) {
+    SortedLine sortedLine;
+    sortedLine.line = line;
+    // Skip the first five fields
+    const char *c = line;
+    for (int64_t i = 0; i < 5; i++) {
+        c += strcspn(c, " ");
+        c += strspn(c, " ");
+    }
+    sortedLine.contig = c;
+    sortedLine.contigLength = strcspn(c, " ");
+    if (sscanf(c + sortedLine.contigLength, " %" PRIi64 " %" PRIi64, &sortedLine.start, &sortedLine.end) != 2) {
+        st_errAbort("Malformed cigar: %s", line);
+    }
+    return sortedLine;
+}
+
+static int sortedLine_cmp(const SortedLine *sortedLine1, const SortedLine *sortedLine2) {
+    int64_t length = sortedLine1->contigLength < sortedLine2->contigLength ?
+            sortedLine1->contigLength : sortedLine2->contigLength;
+    int i = memcmp(sortedLine1->contig, sortedLine2->contig, length);
+    if (i == 0) {
+        i = sortedLine1->contigLength < sortedLine2->contigLength ? -1 :
+                (sortedLine1->contigLength > sortedLine2->contigLength ? 1 : 0);
+    }
+    if (i == 0) {
+        i = sortedLine1->start < sortedLine2->start ? -1 : (sortedLine1->start > sortedLine2->start ? 1 : 0);
+    }
+    if (i == 0) {
+        i = sortedLine1->end < sortedLine2->end ? -1 : (sortedLine1->end > sortedLine2->end ? 1 : 0);
+    }
+    if (i == 0) { // As sort does, fall back on comparing the whole lines
+        i = strcmp(sortedLine1->line, sortedLine2->line);
+    }
+    return i;
+}
+
+static void sorter_sortLines(Sorter *sorter) {
+    qsort(sorter->lines, sorter->lineNumber, sizeof(SortedLine),
+            (int (*)(const void *, const void *)) sortedLine_cmp);
+}
+
+static FILE *sorter_makeRunFile(Sorter *sorter, char **runFile) {
+    /*
+     * Makes a new temporary file for a sorted run, returning it open for writing, and its path in runFile.
+     */
+    *runFile = stFile_pathJoin(sorter->tempDir, "alignmentSortRunXXXXXX");
+    int fd = mkstemp(*runFile);
+    FILE *fileHandle = fd == -1 ? NULL : fdopen(fd, "w");
+    if (fileHandle == NULL) {
+        st_errnoAbort("Failed to make a temporary file in %s", sorter->tempDir);
+    }
+    return fileHandle;
+}
+
+static void sorter_spill(Sorter *sorter) {
+    /*
+     * Writes the lines held, sorted, to a new run file.
+     */
+    sorter_sortLines(sorter);
+    char *runFile;
+    FILE *fileHandle = sorter_makeRunFile(sorter, &runFile);
+    for (int64_t i = 0; i < sorter->lineNumber; i++) {
+        if (fputs(sorter->lines[i].line, fileHandle) == EOF) {
+            st_errnoAbort("Failed to write to temporary file %s", runFile);
+        }
+        free(sorter->lines[i].line);
+    }
+    fclose(fileHandle);
+    stList_append(sorter->runFiles, runFile);
+    sorter->lineNumber = 0;
+    sorter->memory = 0;
+}
+
+static void sort_add(AlignmentStage *stage, Cigar *cigar) {
+    Sorter *sorter = stage->data;
+    char *line = cigar_toString(cigar, 0);
+    if (sorter->lineNumber == sorter->maxLineNumber) {
+        sorter->maxLineNumber = sorter->maxLineNumber * 2 + 1024;
+        sorter->lines = st_realloc(sorter->lines, sorter->maxLineNumber * sizeof(SortedLine));
+    }
+    sorter->lines[sorter->lineNumber++] = sortedLine_construct(line);
+    sorter->memory += strlen(line) + 1 + sizeof(SortedLine);
+    if (sorter->memory > sorter->maxMemory) {
+        sorter_spill(sorter);
+    }
+}
+
+static void passOnLine(AlignmentStage *stage, char **previousLine, char *line) {
+    /*
+     * Passes on the alignment of the line, unless it is the same as the previous line, taking ownership of the line.
+     */
+    if (*previousLine != NULL && strcmp(*previousLine, line) == 0) {
+        free(line);
+        return;
+    }
+    free(*previousLine);
+    *previousLine = line;
+    Sorter *sorter = stage->data;
+    cigarReader_parse(sorter->parser, line, sorter->cigar);
+    alignmentStage_add(stage->next, sorter->cigar);
+}
+
+/*
+ * Merges sorted runs, keeping the runs in a min-heap on their next lines, ties broken by the order of the runs.
+ */
+typedef struct _runMerger {
+    int64_t runNumber;
+    char **runFiles;
+    FILE **runs;
+    SortedLine *heads; // The next line of each run, with a NULL line once the run is exhausted
+    int64_t *heap; // The runs with a next line
+    int64_t length;
+} RunMerger;
+
+static bool runMerger_lessThan(RunMerger *merger, int64_t run1, int64_t run2) {
+    int i = sortedLine_cmp(&merger->heads[run1], &merger->heads[run2]);
+    return i < 0 || (i == 0 && run1 < run2);
+}
+
+static void runMerger_siftDown(RunMerger *merger, int64_t i) {
+    int64_t run = merger->heap[i];
+    while (2 * i + 1 < merger->length) {
+        int64_t j = 2 * i + 1;
+        if (j + 1 < merger->length && runMerger_lessThan(merger, merger->heap[j + 1], merger->heap[j])) {
+            j++;
+        }
+        if (!runMerger_lessThan(merger, merger->heap[j], run)) {
+            break;
+        }
+        merger->heap[i] = merger->heap[j];
+        i = j;
+    }
+    merger->heap[i] = run;
+}
+
+static void runMerger_readHead(RunMerger *merger, int64_t run) {
+    char *line = stFile_getLineFromFile(merger->runs[run]);
+    merger->heads[run] = line == NULL ? (SortedLine) { NULL } : sortedLine_construct(stString_print("%s\n", line));
+    free(line);
+}
+
+static RunMerger *runMerger_construct(stList *runFiles, int64_t firstRun, int64_t runNumber) {
+    /*
+     * Opens the runNumber runs of runFiles starting from firstRun.
+     */
+    RunMerger *merger = st_malloc(sizeof(RunMerger));
+    merger->runNumber = runNumber;
+    merger->runFiles = st_malloc(runNumber * sizeof(char *));
+    merger->runs = st_malloc(runNumber * sizeof(FILE *));
+    merger->heads = st_malloc(runNumber * sizeof(SortedLine));
+    merger->heap = st_malloc(runNumber * sizeof(int64_t));
+    merger->length = 0;
+    for (int64_t i = 0; i < runNumber; i++) {
+        merger->runFiles[i] = stList_get(runFiles, firstRun + i);
+        merger->runs[i] = fopen(merger->runFiles[i], "r");
+        if (merger->runs[i] == NULL) {
+            st_errnoAbort("Failed to open temporary file %s", merger->runFiles[i]);
+        }
+        runMerger_readHead(merger, i);
+        if (merger->heads[i].line != NULL) {
+            merger->heap[merger->length++] = i;
+        }
+    }
+    for (int64_t i = merger->length / 2 - 1; i >= 0; i--) {
+        runMerger_siftDown(merger, i);
+    }
+    return merger;
+}
+
+static char *runMerger_next(RunMerger *merger) {
+    /*
+     * Returns the next line of the merge, which the caller then owns, or NULL once the runs are exhausted.
+     */
+    if (merger->length == 0) {
+        return NULL;
+    }
+    int64_t run = merger->heap[0];
+    char *line = merger->heads[run].line;
+    runMerger_readHead(merger, run);
+    if (merger->heads[run].line == NULL) {
+        merger->heap[0] = merger->heap[--merger->length];
+    }
+    if (merger->length > 0) {
+        runMerger_siftDown(merger, 0);
+    }
+    return line;
+}
+
+static void runMerger_destruct(RunMerger *merger) {
+    /*
+     * Closes the runs and deletes their files.
+     */
+    for (int64_t i = 0; i < merger->runNumber; i++) {
+        fclose(merger->runs[i]);
+        unlink(merger->runFiles[i]);
+    }
+    free(merger->runFiles);
+    free(merger->runs);
+    free(merger->heads);
+    free(merger->heap);
+    free(merger);
+}
+
+static void sorter_mergeRunsToFanIn(Sorter *sorter) {
+    /*
+     * Merges the runs in passes, each merging groups of up to maxRunsPerMerge consecutive runs into one, until at
+     * most maxRunsPerMerge runs are left, so that no more than that many files are open at once.
+     */
+    while (stList_length(sorter->runFiles) > maxRunsPerMerge) {
+        stList *mergedRunFiles = stList_construct3(0, free);
+        for (int64_t i = 0; i < stList_length(sorter->runFiles); i += maxRunsPerMerge) {
+            int64_t runNumber = stList_length(sorter->runFiles) - i;
+            runNumber = runNumber < maxRunsPerMerge ? runNumber : maxRunsPerMerge;
+            if (runNumber == 1) {
+                stList_append(mergedRunFiles, stString_copy(stList_get(sorter->runFiles, i)));
+                continue;
+            }
+            char *runFile;
+            FILE *fileHandle = sorter_makeRunFile(sorter, &runFile);
+            RunMerger *merger = runMerger_construct(sorter->runFiles, i, runNumber);
+            char *line;
+            while ((line = runMerger_next(merger)) != NULL) {
+                if (fputs(line, fileHandle) == EOF) {
+                    st_errnoAbort("Failed to write to temporary file %s", runFile);
+                }
+                free(line);
+            }
+            runMerger_destruct(merger);
+            fclose(fileHandle);
+            stList_append(mergedRunFiles, runFile);
+        }
+        stList_destruct(sorter->runFiles);
+        sorter->runFiles = mergedRunFiles;
+    }
+}
+
+static void sort_finish(AlignmentStage *stage) {
+    Sorter *sorter = stage->data;
+    char *previousLine = NULL;
+    if (stList_length(sorter->runFiles) == 0) {
+        sorter_sortLines(sorter);
+        for (int64_t i = 0; i < sorter->lineNumber; i++) {
+            passOnLine(stage, &previousLine, sorter->lines[i].line);
+        }
+    } else {
+        // Merge the sorted runs.
+        if (sorter->lineNumber > 0) {
+            sorter_spill(sorter);
+        }
+        sorter_mergeRunsToFanIn(sorter);
+        RunMerger *merger = runMerger_construct(sorter->runFiles, 0, stList_length(sorter->runFiles));
+        char *line;
+        while ((line = runMerger_next(merger)) != NULL) {
+            passOnLine(stage, &previousLine, line);
+        }
+        runMerger_destruct(merger);
+    }
+    free(previousLine);
+    free(sorter->lines);
+    free(sorter->tempDir);
+    stList_destruct(sorter->runFiles);
+    cigarReader_destruct(sorter->parser);
+    cigar_destruct(sorter->cigar);
+    free(sorter);
+}
+
+AlignmentStage *alignmentStage_constructSort(AlignmentStage *next, int64_t maxMemory, const char *tempDir) {
+    Sorter *sorter = st_calloc(1, sizeof(Sorter));
+    sorter->maxMemory = maxMemory;
+    sorter->tempDir = stString_copy(tempDir);
+    sorter->runFiles = stList_construct3(0, free);
+    sorter->cigar = cigar_construct();
+    AlignmentStage *stage = alignmentStage_construct(next, sort_add, sort_finish, sorter);
+    sorter->parser = cigarReader_constructWithContigs(NULL, stage->contigs);
+    return stage;
+}
+
+/*
+ * Splitting alignments so that they do not partially overlap.
+ */
+
+/*
+ * The alignments overlapping the current position of the split, all of which start at the same coordinate. The
+ * prefixes of an active alignment are passed on as the split proceeds, the operations already passed on being skipped
+ * by an offset rather than removed, and the alignments are kept in a min-heap on end coordinate, ties broken by the
+ * order in which they were added, so that the alignments that end first are at the top.
+ */
+typedef struct _activeAlignment {
+    Cigar *cigar;
+    int64_t firstOperation; // The index of the first operation not yet passed on in a prefix
+    int64_t order;
+} ActiveAlignment;
+
+typedef struct _splitter {
+    ActiveAlignment **heap;
+    int64_t length;
+    int64_t maxLength;
+    int64_t alignmentsAdded;
+    Cigar *prefix; // Holds each prefix as it is passed on
+} Splitter;
+
+static bool activeAlignment_lessThan(ActiveAlignment *aA1, ActiveAlignment *aA2) {
+    return aA1->cigar->end1 < aA2->cigar->end1 ||
+           (aA1->cigar->end1 == aA2->cigar->end1 && aA1->order < aA2->order);
+}
+
+static void splitter_push(Splitter *splitter, ActiveAlignment *activeAlignment) {
+    if (splitter->length == splitter->maxLength) {
+        splitter->maxLength = splitter->maxLength * 2 + 16;
+        splitter->heap = st_realloc(splitter->heap, sizeof(ActiveAlignment *) * splitter->maxLength);
+    }
+    int64_t i = splitter->length++;
+    while (i > 0 && activeAlignment_lessThan(activeAlignment, splitter->heap[(i - 1) / 2])) {
+        splitter->heap[i] = splitter->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    splitter->heap[i] = activeAlignment;
+}
+
+static ActiveAlignment *splitter_pop(Splitter *splitter) {
+    assert(splitter->length > 0);
+    ActiveAlignment *top = splitter->heap[0];
+    ActiveAlignment *last = splitter->heap[--splitter->length];
+    int64_t i = 0;
+    while (2 * i + 1 < splitter->length) {
+        int64_t j = 2 * i + 1;
+        if (j + 1 < splitter->length && activeAlignment_lessThan(splitter->heap[j + 1], splitter->heap[j])) {
+            j++;
+        }
+        if (!activeAlignment_lessThan(splitter->heap[j], last)) {
+            break;
+        }
+        splitter->heap[i] = splitter->heap[j];
+        i = j;
+    }
+    splitter->heap[i] = last;
+    return top;
+}
+
+static void removeAlignmentPrefix(ActiveAlignment *activeAlignment, int64_t prefixEnd, Cigar *prefix) {
+    /*
+     * Makes the prefix of the active alignment up to prefixEnd in prefix.
+     */
+    Cigar *cigar = activeAlignment->cigar;
+    // Store the original start coordinates
+    int64_t start1 = cigar->start1, start2 = cigar->start2;
+    assert(cigar->end1 > prefixEnd);
+    assert(cigar->start1 < prefixEnd);
+    assert(cigar->strand1);
+
+    // Split the ops in the cigar string between the prefix and suffix alignments, the ops copied to the prefix
+    // being skipped by advancing the offset of the first op of the suffix
+    prefix->operationNumber = 0;
+    int64_t i = activeAlignment->firstOperation;
+    do {
+        assert(i < cigar->operationNumber);
+        CigarOperation *op = &cigar->operations[i];
+        assert(op->length > 0);
+
+        if(op->opType == PAIRWISE_INDEL_Y) { // Insert in second sequence
+            cigar_addOperation(prefix, op->opType, op->length, op->score);
+            i++;
+            cigar->start2 += cigar->strand2 ? op->length : -op->length;
+        }
+        else { // Not an insert in second sequence
+            // Op is in the prefix alignment
+            int64_t j;
+            if(cigar->start1 + op->length <= prefixEnd) {
+                cigar_addOperation(prefix, op->opType, op->length, op->score);
+                i++;
+                j = op->length;
+            }
+            // Op spans the prefix and suffix alignments, so split it
+            else {
+                j = prefixEnd-cigar->start1;
+                assert(j > 0);
+                cigar_addOperation(prefix, op->opType, j, op->score);
+                op->length -= j;
+                assert(op->length > 0);
+                assert(cigar->start1+j == prefixEnd);
+            }
+
+            // Update start coordinates of suffix alignments
+            cigar->start1 += j;
+            if(op->opType != PAIRWISE_INDEL_X) {
+                cigar->start2 += cigar->strand2 ? j : -j;
+            }
+        }
+    } while(cigar->start1 < prefixEnd);
+
+    assert(cigar->start1 == prefixEnd);
+    assert(i < cigar->operationNumber);
+    activeAlignment->firstOperation = i;
+
+    // Fill in the coordinates of the prefix
+    prefix->contig1 = cigar->contig1;
+    prefix->start1 = start1;
+    prefix->end1 = cigar->start1;
+    prefix->strand1 = 1;
+    prefix->contig2 = cigar->contig2;
+    prefix->start2 = start2;
+    prefix->end2 = cigar->start2;
+    prefix->strand2 = cigar->strand2;
+    prefix->score = cigar->score;
+}
+
+/*
+ * Returns the suffix of the active alignment that remains, freeing the active alignment.
+ */
+static Cigar *activeAlignment_finish(ActiveAlignment *activeAlignment) {
+    Cigar *cigar = activeAlignment->cigar;
+    if (activeAlignment->firstOperation > 0) {
+        // Remove the ops passed on with the prefixes
+        cigar->operationNumber -= activeAlignment->firstOperation;
+        memmove(cigar->operations, cigar->operations + activeAlignment->firstOperation,
+                cigar->operationNumber * sizeof(CigarOperation));
+    }
+    assert(cigar->operationNumber > 0);
+    free(activeAlignment);
+    return cigar;
+}
+
+static void emitBlock(Splitter *splitter, uint64_t from, uint64_t to, AlignmentStage *next) {
+    /*
+     * Emits block of alignments that are all start, inclusive, at 'from' and end, exclusive, at 'to'.
+     */
+    // First pass on the alignments that end at 'to'
+    while(splitter->length > 0 && getEndCoordinate(splitter->heap[0]->cigar) == to) {
+        assert(getStartCoordinate(splitter->heap[0]->cigar) == from);
+        Cigar *cigar = activeAlignment_finish(splitter_pop(splitter));
+        alignmentStage_add(next, cigar);
+        cigar_destruct(cigar);
+    }
+
+    // Now cleave off and pass on the prefixes of the remaining alignments, which must all end after 'to'. The end
+    // coordinates are unchanged, so the heap remains ordered.
+    for(int64_t i = 0; i < splitter->length; i++) {
+        assert(getStartCoordinate(splitter->heap[i]->cigar) == from);
+        removeAlignmentPrefix(splitter->heap[i], to, splitter->prefix);
+        assert(getStartCoordinate(splitter->prefix) == from);
+        assert(getEndCoordinate(splitter->prefix) == to);
+        alignmentStage_add(next, splitter->prefix);
+    }
+}
+
+static void splitAlignmentOverlaps(Splitter *splitter, uint64_t splitUpto, AlignmentStage *next) {
+    if(splitter->length == 0) {
+        return; // Nothing to do
+    }
+
+    // Process overlaps between alignments that precede splitUpto
+    uint64_t from = getStartCoordinate(splitter->heap[0]->cigar);
+    uint64_t to;
+    // while (minEndCoordinate = Min end coordinate in S) < splitUpto:
+    while(splitter->length > 0 &&
+          (to = getEndCoordinate(splitter->heap[0]->cigar)) < splitUpto) {
+        assert(from < to);
+        emitBlock(splitter, from, to, next);
+        from = to;
+    }
+
+    // Now split at the splitUpto point
+    if(splitter->length > 0 && from < splitUpto) {
+        emitBlock(splitter, from, splitUpto, next);
+    }
+}
+
+static void split_add(AlignmentStage *stage, Cigar *cigar) {
+    Splitter *splitter = stage->data;
+
+    // There are existing alignments
+    if(splitter->length > 0) {
+        // If the new alignment is on the same sequence as the previous sequence
+        if(strcmp(splitter->heap[0]->cigar->contig1, cigar->contig1) == 0) {
+            // Remove overlaps in alignments up to but excluding the start of the cigar
+            splitAlignmentOverlaps(splitter, getStartCoordinate(cigar), stage->next);
+        }
+        else {
+            // If the cigar is on a new sequence
+            splitAlignmentOverlaps(splitter, UINT64_MAX, stage->next);
+            assert(splitter->length == 0);
+        }
+    }
+
+    // Add a copy of the cigar to the active alignments
+    ActiveAlignment *activeAlignment = st_malloc(sizeof(ActiveAlignment));
+    activeAlignment->cigar = cigar_copy(cigar);
+    activeAlignment->firstOperation = 0;
+    activeAlignment->order = splitter->alignmentsAdded++;
+    splitter_push(splitter, activeAlignment);
+}
+
+static void split_finish(AlignmentStage *stage) {
+    Splitter *splitter = stage->data;
+    // Remove remaining overlaps in alignments
+    splitAlignmentOverlaps(splitter, UINT64_MAX, stage->next);
+    assert(splitter->length == 0);
+    free(splitter->heap);
+    cigar_destruct(splitter->prefix);
+    free(splitter);
+}
+
+AlignmentStage *alignmentStage_constructSplit(AlignmentStage *next) {
+    Splitter *splitter = st_calloc(1, sizeof(Splitter));
+    splitter->prefix = cigar_construct();
+    return alignmentStage_construct(next, split_add, split_finish, splitter);
+}
+
+/*
+ * Calculating mapping qualities.
+ */
+
+/*
+ * The sites, each the list of the totally overlapping alignments that share a start coordinate, are gathered into
+ * batches of about MAPPING_QUALITIES_BATCH_SIZE alignments. The sites of a batch are scored and their lines formatted
+ * in parallel, then the lines are written in the order of the sites, so the output is the same as scoring the sites
+ * one by one.
+ */
+#define MAPPING_QUALITIES_BATCH_SIZE 100000
+
+typedef struct _mappingQualities {
+    stList *sites; // The sites of the current batch, the last of which is being added to
+    int64_t alignmentNumber; // The number of alignments in the batch
+    int64_t maxAlignmentsPerSite;
+    float minimumMapQValue;
+    float alpha;
+    int64_t writerNumber;
+    CigarWriter **writers; // The writer of the alignments of each rank
+} MappingQualities;
+
+static int cmpAlignmentsFn(const void *a, const void *b) {
+    const Cigar *cigar1 = a;
+    const Cigar *cigar2 = b;
+    return cigar1->score < cigar2->score ? -1 : (cigar1->score > cigar2->score ? 1 : 0);
+}
+
+static void updateScoresToReflectMappingQualities(stList *alignments, float alpha, uint64_t numAlignmentsToScore) {
+    // Create an array of the scores
+    float *alignmentScores = st_calloc(stList_length(alignments), sizeof(float));
+    for(uint64_t i=0; i<stList_length(alignments); i++) {
+        alignmentScores[i] = ((Cigar *)stList_get(alignments, i))->score;
+    }
+
+    // Calculate mapQs for the best N alignments (N = numAlignmentsToScore).
+    uint64_t start = stList_length(alignments) > numAlignmentsToScore ? stList_length(alignments) - numAlignmentsToScore : 0;
+    for(uint64_t i=start; i<stList_length(alignments); i++) {
+        Cigar *cigar = stList_get(alignments, i);
+
+        // Cut off the calculation if clearly going to be zero
+        if(alpha * (alignmentScores[i] - alignmentScores[stList_length(alignments)-1]) < -10) {
+            cigar->score = 0.0;
+        }
+
+        else {
+            // Calculate the denominator
+            double z = 0.0;
+            for(uint64_t j=0; j<stList_length(alignments); j++) {
+                z += pow(10, alpha * (alignmentScores[j] - alignmentScores[i]));
+            }
+            assert(z >= 1.0);
+
+            if(z <= 1.000001) { // Round scores to max of 60
+                cigar->score = 60.0;
+            }
+            else {
+                cigar->score = -10.0 * log10(1.0 - 1.0/z);
+                assert(cigar->score >= 0.0);
+            }
+        }
+    }
+
+    // Cleanup
+    free(alignmentScores);
+}
+
+/*
+ * Scores the alignments of the site, which are sorted by ascending score, destructing them, and returns the cigar
+ * lines of those reported, in order of rank.
+ */
+static stList *scoreSite(MappingQualities *mappingQualities, stList *alignments) {
+    // Calculate the mapping qualities
+    updateScoresToReflectMappingQualities(alignments, mappingQualities->alpha, mappingQualities->maxAlignmentsPerSite);
+
+    // Format the reported alignments
+    stList *lines = stList_construct3(0, free);
+    while (stList_length(alignments) > 0) {
+        Cigar *cigar = stList_pop(alignments);
+        if(stList_length(lines) < mappingQualities->maxAlignmentsPerSite &&
+           cigar->score >= mappingQualities->minimumMapQValue) {
+            stList_append(lines, cigar_toString(cigar, 0));
+        }
+
+        // Cleanup
+        cigar_destruct(cigar);
+    }
+    stList_destruct(alignments);
+    return lines;
+}
+
+static void reportAlignments(MappingQualities *mappingQualities) {
+    stList *sites = mappingQualities->sites;
+    int64_t siteNumber = stList_length(sites);
+
+    // Sort the alignments of each site by ascending score. This is done serially as stList_sort keeps the
+    // comparison function in a static variable.
+    for (int64_t i = 0; i < siteNumber; i++) {
+        stList_sort(stList_get(sites, i), cmpAlignmentsFn);
+    }
+
+    // Score the sites, which are independent of one another
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 64) if(siteNumber > 1)
+#endif
+    for (int64_t i = 0; i < siteNumber; i++) {
+        stList_set(sites, i, scoreSite(mappingQualities, stList_get(sites, i)));
+    }
+
+    // Write the lines of the sites in order
+    for (int64_t i = 0; i < siteNumber; i++) {
+        stList *lines = stList_get(sites, i);
+        for (int64_t j = 0; j < stList_length(lines); j++) {
+            cigarWriter_writeString(mappingQualities->writers[j], stList_get(lines, j));
+        }
+        stList_destruct(lines);
+    }
+    stList_setLength(sites, 0);
+    mappingQualities->alignmentNumber = 0;
+}
+
+static void mappingQualities_add(AlignmentStage *stage, Cigar *cigar) {
+    MappingQualities *mappingQualities = stage->data;
+    stList *sites = mappingQualities->sites;
+
+    // If the cigar does not share the same interval
+    // as the previous cigars start a new site
+    stList *alignments = stList_length(sites) > 0 ? stList_peek(sites) : NULL;
+    if(alignments == NULL ||
+        strcmp(((Cigar *)stList_peek(alignments))->contig1, cigar->contig1) != 0 ||
+        getStartCoordinate(stList_peek(alignments)) != getStartCoordinate(cigar)) {
+        // Report the batch once it is full and the last site is complete
+        if (mappingQualities->alignmentNumber >= MAPPING_QUALITIES_BATCH_SIZE) {
+            reportAlignments(mappingQualities);
+        }
+        alignments = stList_construct();
+        stList_append(sites, alignments);
+    }
+
+    // Adding a copy of the cigar to the set to consider
+    stList_append(alignments, cigar_copy(cigar));
+    mappingQualities->alignmentNumber++;
+}
+
+static void mappingQualities_finish(AlignmentStage *stage) {
+    MappingQualities *mappingQualities = stage->data;
+    reportAlignments(mappingQualities);
+    assert(stList_length(mappingQualities->sites) == 0);
+    stList_destruct(mappingQualities->sites);
+    for (int64_t i = 0; i < mappingQualities->writerNumber; i++) {
+        cigarWriter_destruct(mappingQualities->writers[i]);
+    }
+    free(mappingQualities->writers);
+    free(mappingQualities);
+}
+
+AlignmentStage *alignmentStage_constructMappingQualities(int64_t maxAlignmentsPerSite, float minimumMapQValue,
+        float alpha, FILE **fileHandleOuts) {
+    MappingQualities *mappingQualities = st_malloc(sizeof(MappingQualities));
+    mappingQualities->sites = stList_construct();
+    mappingQualities->alignmentNumber = 0;
+    mappingQualities->maxAlignmentsPerSite = maxAlignmentsPerSite;
+    mappingQualities->minimumMapQValue = minimumMapQValue;
+    mappingQualities->alpha = alpha;
+    mappingQualities->writerNumber = maxAlignmentsPerSite;
+    mappingQualities->writers = st_malloc(sizeof(CigarWriter *) * maxAlignmentsPerSite);
+    for (int64_t i = 0; i < maxAlignmentsPerSite; i++) {
+        mappingQualities->writers[i] = cigarWriter_construct(fileHandleOuts[i]);
+    }
+    return alignmentStage_construct(NULL, mappingQualities_add, mappingQualities_finish, mappingQualities);
+}
+
+/*
+ * Writing alignments.
+ */
+
+static void writer_add(AlignmentStage *stage, Cigar *cigar) {
+    cigarWriter_write(stage->data, cigar, 0);
+}
+
+static void writer_finish(AlignmentStage *stage) {
+    cigarWriter_destruct(stage->data);
+}
+
+AlignmentStage *alignmentStage_constructWriter(FILE *fileHandleOut) {
+    return alignmentStage_construct(NULL, writer_add, writer_finish, cigarWriter_construct(fileHandleOut));
+}
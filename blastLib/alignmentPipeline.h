@@ -0,0 +1,70 @@
+/*
+ * alignmentPipeline.h
+ *
+ * The stages that the pairwise alignments from lastz go through before caf, as a chain of in-memory stages, each
+ * passing its alignments on to the next as it makes them:
+ *  - mirror: reports each alignment with respect to the positive strand of its first sequence, followed by its mirror,
+ *    with the sequences swapped (cactus_mirrorAndOrientAlignments).
+ *  - sort: sorts the alignments by their first sequence interval, removing duplicates, as "LC_ALL=C sort -k6,6 -k7,7n
+ *    -k8,8n | uniq" does with the cigar lines, spilling sorted runs to disk beyond a memory limit
+ *    and merging them a bounded number at a time.
+ *  - split: splits the sorted alignments so that no two partially overlap on their first sequence
+ *    (cactus_splitAlignmentOverlaps).
+ *  - mapping qualities: replaces the scores with mapping qualities and writes the best alignments at each site to
+ *    one file per rank (cactus_calculateMappingQualities).
+ * The alignments are passed along the chain as cigars (see cigarCodec.h), whose contig names are interned in a table
+ * shared by the stages of the chain. The output of a chain is the same, byte for byte, as that of the separate tools
+ * joined by cigar files.
+ */
+
+#ifndef ALIGNMENTPIPELINE_H_
+#define ALIGNMENTPIPELINE_H_
+
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+#include "cigarCodec.h"
+
+typedef struct _alignmentStage AlignmentStage;
+
+/*
+ * Each constructor takes the stage the alignments are passed on to, which then belongs to the new stage.
+ */
+AlignmentStage *alignmentStage_constructMirror(AlignmentStage *next);
+
+/*
+ * Sorted runs of more than maxMemory bytes of cigar lines are spilled to temporary files in tempDir.
+ */
+AlignmentStage *alignmentStage_constructSort(AlignmentStage *next, int64_t maxMemory, const char *tempDir);
+
+AlignmentStage *alignmentStage_constructSplit(AlignmentStage *next);
+
+/*
+ * Writes the alignments of rank i at each site to fileHandleOuts[i], for i < maxAlignmentsPerSite, if their mapping
+ * quality is at least minimumMapQValue. The files are not closed. The sites are scored in batches, the sites of each
+ * batch in parallel with OpenMP, and written in order, so the output does not depend on the number of threads.
+ */
+AlignmentStage *alignmentStage_constructMappingQualities(int64_t maxAlignmentsPerSite, float minimumMapQValue,
+        float alpha, FILE **fileHandleOuts);
+
+/*
+ * Writes the alignments to the file as cigars. The file is not closed.
+ */
+AlignmentStage *alignmentStage_constructWriter(FILE *fileHandleOut);
+
+/*
+ * Passes the alignment to the stage, which may change the cigar but does not keep it, copying those it holds on to,
+ * so that the caller can reuse it.
+ */
+void alignmentStage_add(AlignmentStage *stage, Cigar *cigar);
+
+/*
+ * Passes each of the cigars in the file to the stage.
+ */
+void alignmentStage_addFromFile(AlignmentStage *stage, FILE *fileHandleIn);
+
+/*
+ * Flushes the alignments held by the stage and the stages after it, then destructs them.
+ */
+void alignmentStage_finish(AlignmentStage *stage);
+
+#endif /* ALIGNMENTPIPELINE_H_ */
@@ -9,6 +9,8 @@
 #include "cactus.h"
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
+#include "chunkStore.h"
+#include "cigarCodec.h"
 
 /*
  * Converting coordinates of pairwise alignments
@@ -43,8 +45,48 @@ void convertCoordinatesOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAli
     checkPairwiseAlignment(pairwiseAlignment);
 }
 
+typedef struct _contigConversion {
+    const char *contig; // The interned converted name
+    int64_t offset; // Added to the coordinates
+} ContigConversion;
+
+stHash *constructContigConversions(void) {
+    // Keyed by the interned names, so by address
+    return stHash_construct2(NULL, free);
+}
+
+static void convertCoordinatesOfCigarP(stHash *conversions, stHash *contigs, const char **contig, int64_t *start,
+                                       int64_t *end) {
+    ContigConversion *conversion = stHash_search(conversions, (void *)*contig);
+    if(conversion == NULL) {
+        conversion = st_malloc(sizeof(ContigConversion));
+        char *convertedContig = stString_copy(*contig);
+        int64_t offset = 0, length = 0;
+        convertCoordinatesP(&convertedContig, &offset, &length);
+        conversion->contig = cigar_internContig(contigs, convertedContig);
+        conversion->offset = offset;
+        free(convertedContig);
+        stHash_insert(conversions, (void *)*contig, conversion);
+    }
+    *contig = conversion->contig;
+    *start = *start + conversion->offset;
+    *end = *end + conversion->offset;
+}
+
+void convertCoordinatesOfCigar(Cigar *cigar, stHash *conversions, stHash *contigs, int convertContig1,
+                               int convertContig2) {
+    cigar_check(cigar);
+    if(convertContig1) {
+        convertCoordinatesOfCigarP(conversions, contigs, &cigar->contig1, &cigar->start1, &cigar->end1);
+    }
+    if(convertContig2) {
+        convertCoordinatesOfCigarP(conversions, contigs, &cigar->contig2, &cigar->start2, &cigar->end2);
+    }
+    cigar_check(cigar);
+}
+
 /*
- * Routine reads in chunk up a set of sequences into overlapping sequence files.
+ * Routine reads in chunk up a set of sequences into overlapping sequence files, or into the chunks of a chunk store.
  */
 
 static int64_t chunkRemaining;
@@ -54,9 +96,14 @@ static int64_t chunkNo = 0;
 static char *tempChunkFile = NULL;
 static int64_t chunkSize;
 static int64_t chunkOverlapSize;
+static ChunkStoreWriter *chunkStoreWriter = NULL;
+static int64_t chunkStoreSequence; // The index in the chunk store of the sequence being chunked
 
 void finishChunkingSequences() {
-    if (chunkFileHandle != NULL) {
+    if (chunkStoreWriter != NULL) {
+        chunkStoreWriter_finishChunk(chunkStoreWriter);
+    }
+    else if (chunkFileHandle != NULL) {
         fclose(chunkFileHandle);
         fprintf(stdout, "%s\n", tempChunkFile);
         free(tempChunkFile);
@@ -75,23 +122,16 @@ static void updateChunkRemaining(int64_t seqLength) {
     }
 }
 
-static int64_t processSubsequenceChunk(char *fastaHeader, int64_t start, char *sequence, int64_t seqLength, int64_t lengthOfChunkRemaining) {
-    if (chunkFileHandle == NULL) {
-        tempChunkFile = stString_print("%s/%" PRIi64 "", chunksDir, chunkNo++);
-        chunkFileHandle = fopen(tempChunkFile, "w");
-    }
+/*
+ * The name of the sequence in the headers of its chunks, which is the header up to the first whitespace.
+ */
+static char *getChunkSequenceName(const char *fastaHeader) {
+    char *name = stString_copy(fastaHeader);
+    name[strcspn(name, " \t")] = '\0';
+    return name;
+}
 
-    int64_t i = 0;
-    fastaHeader = stString_copy(fastaHeader);
-    while (fastaHeader[i] != '\0') {
-        if (fastaHeader[i] == ' ' || fastaHeader[i] == '\t') {
-            fastaHeader[i] = '\0';
-            break;
-        }
-        i++;
-    }
-    char *chunkHeader = stString_print("%s|%" PRIi64 "\n", fastaHeader, start);
-    free(fastaHeader);
+static int64_t processSubsequenceChunk(char *fastaHeader, int64_t start, char *sequence, int64_t seqLength, int64_t lengthOfChunkRemaining) {
     assert(lengthOfChunkRemaining <= chunkSize);
     assert(start >= 0);
     int64_t lengthOfSubsequence = lengthOfChunkRemaining;
@@ -99,12 +139,25 @@ static int64_t processSubsequenceChunk(char *fastaHeader, int64_t start, char *s
         lengthOfSubsequence = seqLength - start;
     }
     assert(lengthOfSubsequence > 0);
-    char c = sequence[start + lengthOfSubsequence];
-    sequence[start + lengthOfSubsequence] = '\0';
-    fastaWrite(&sequence[start], chunkHeader, chunkFileHandle);
-    //fprintf(chunkFileHandle, "%s\n", &sequence[start]);
-    free(chunkHeader);
-    sequence[start + lengthOfSubsequence] = c;
+
+    if (chunkStoreWriter != NULL) {
+        chunkStoreWriter_addSlice(chunkStoreWriter, chunkStoreSequence, start, lengthOfSubsequence);
+    }
+    else {
+        if (chunkFileHandle == NULL) {
+            tempChunkFile = stString_print("%s/%" PRIi64 "", chunksDir, chunkNo++);
+            chunkFileHandle = fopen(tempChunkFile, "w");
+        }
+
+        char *name = getChunkSequenceName(fastaHeader);
+        char *chunkHeader = stString_print("%s|%" PRIi64 "\n", name, start);
+        free(name);
+        char c = sequence[start + lengthOfSubsequence];
+        sequence[start + lengthOfSubsequence] = '\0';
+        fastaWrite(&sequence[start], chunkHeader, chunkFileHandle);
+        free(chunkHeader);
+        sequence[start + lengthOfSubsequence] = c;
+    }
 
     updateChunkRemaining(lengthOfSubsequence);
     return lengthOfSubsequence;
@@ -112,6 +165,12 @@ static int64_t processSubsequenceChunk(char *fastaHeader, int64_t start, char *s
 
 void processSequenceToChunk(void* dest, const char *fastaHeader, const char *sequence, int64_t sequenceLength) {
     if (sequenceLength > 0) {
+        if (chunkStoreWriter != NULL) {
+            // The sequence is stored once, its chunks being slices of it
+            char *name = getChunkSequenceName(fastaHeader);
+            chunkStoreSequence = chunkStoreWriter_addSequence(chunkStoreWriter, name, sequence, sequenceLength);
+            free(name);
+        }
         int64_t lengthOfSubsequence = processSubsequenceChunk((char *) fastaHeader, 0, (char *) sequence, sequenceLength, chunkRemaining);
         while (sequenceLength - lengthOfSubsequence > 0) {
             //Make the non overlap file
@@ -139,6 +198,12 @@ void setupToChunkSequences(int64_t chunkSize2, int64_t overlapSize2, const char
     chunkNo = 0;
     chunkRemaining = chunkSize;
     chunkFileHandle = NULL;
+    chunkStoreWriter = NULL;
+}
+
+void setupToChunkSequencesToStore(int64_t chunkSize2, int64_t overlapSize2, ChunkStoreWriter *writer) {
+    setupToChunkSequences(chunkSize2, overlapSize2, NULL);
+    chunkStoreWriter = writer;
 }
 
 /*
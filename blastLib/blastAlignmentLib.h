@@ -12,6 +12,8 @@
 #include "cactus.h"
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
+#include "chunkStore.h"
+#include "cigarCodec.h"
 
 int64_t writeFlowerSequencesInFile(Flower *flower, const char *tempFile1, int64_t minimumSequenceLength);
 
@@ -21,8 +23,25 @@ int64_t writeFlowerSequencesUnsafe(Flower *flower, void(*processSequence)(void *
 
 void convertCoordinatesOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAlignment, int convertContig1, int convertContig2);
 
+/*
+ * Constructs the cache of contig name conversions used by convertCoordinatesOfCigar, destructed with stHash_destruct.
+ */
+stHash *constructContigConversions(void);
+
+/*
+ * As convertCoordinatesOfPairwiseAlignment, but for a cigar, whose contig names are interned in contigs. Each contig
+ * name is decoded once, its conversion being cached in conversions, and the converted names are interned in contigs.
+ */
+void convertCoordinatesOfCigar(Cigar *cigar, stHash *conversions, stHash *contigs, int convertContig1,
+                               int convertContig2);
+
 void setupToChunkSequences(int64_t chunkSize2, int64_t overlapSize2, const char *chunksDir2);
 
+/*
+ * As setupToChunkSequences, but the chunks are added to the chunk store rather than written to files.
+ */
+void setupToChunkSequencesToStore(int64_t chunkSize2, int64_t overlapSize2, ChunkStoreWriter *writer);
+
 void processSequenceToChunk(void* destination, const char *fastaHeader, const char *sequence, int64_t length);
 
 void finishChunkingSequences();
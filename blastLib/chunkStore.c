@@ -0,0 +1,303 @@
+/*
+ * chunkStore.c
+ *
+ * See chunkStore.h for the file layout.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sonLib.h"
+#include "bioioC.h"
+#include "chunkStore.h"
+
+#define CHUNK_STORE_MAGIC_NUMBER 0x524f54534b4e4843 // "CHNKSTOR"
+#define CHUNK_STORE_VERSION 1
+
+#define CHUNK_STORE_HEADER_FIELDS 7
+#define CHUNK_STORE_SEQUENCE_FIELDS 3
+#define CHUNK_STORE_SLICE_FIELDS 3
+
+#define CHUNK_STORE_WRITE_BLOCK (1 << 24) // The bases of a sequence are written in blocks of this size in parallel
+
+static inline int64_t getField(const int64_t *fields, int64_t i, int64_t fieldNumber, int64_t field) {
+    return st_nativeInt64FromLittleEndian(fields[i * fieldNumber + field]);
+}
+
+/*
+ * Growable arrays of the little-endian fields of the tables.
+ */
+
+typedef struct _fields {
+    int64_t *values;
+    int64_t length;
+    int64_t maxLength;
+} Fields;
+
+static void fields_append(Fields *fields, int64_t value) {
+    if (fields->length == fields->maxLength) {
+        fields->maxLength = fields->maxLength * 2 + 64;
+        fields->values = st_realloc(fields->values, fields->maxLength * sizeof(int64_t));
+    }
+    fields->values[fields->length++] = st_nativeInt64ToLittleEndian(value);
+}
+
+/*
+ * Writing.
+ */
+
+struct _chunkStoreWriter {
+    char *path;
+    int fileDescriptor;
+    int64_t length; // The length of the file written so far
+    Fields sequences;
+    Fields chunks; // The first slice of each chunk, including the current one
+    Fields slices;
+    int64_t sequenceNumber;
+    int64_t chunkNumber;
+    int64_t sliceNumber;
+    char *names;
+    int64_t namesLength;
+    int64_t namesMaxLength;
+};
+
+static void writeAt(ChunkStoreWriter *writer, const void *data, int64_t length, int64_t offset) {
+    const char *bytes = data;
+    while (length > 0) {
+        ssize_t i = pwrite(writer->fileDescriptor, bytes, length, offset);
+        if (i < 0) {
+            st_errnoAbort("Failed to write chunk store %s", writer->path);
+        }
+        bytes += i;
+        length -= i;
+        offset += i;
+    }
+}
+
+ChunkStoreWriter *chunkStoreWriter_construct(const char *path) {
+    ChunkStoreWriter *writer = st_calloc(1, sizeof(ChunkStoreWriter));
+    writer->path = stString_copy(path);
+    writer->fileDescriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fileDescriptor < 0) {
+        st_errnoAbort("Failed to create chunk store %s", path);
+    }
+    // The header is written once the numbers are known
+    writer->length = CHUNK_STORE_HEADER_FIELDS * sizeof(int64_t);
+    fields_append(&writer->chunks, 0);
+    return writer;
+}
+
+void chunkStoreWriter_destruct(ChunkStoreWriter *writer) {
+    chunkStoreWriter_finishChunk(writer);
+
+    // Write the tables, aligned so they can be read in place from the mapped file
+    int64_t tablesOffset = (writer->length + sizeof(int64_t) - 1) / sizeof(int64_t) * sizeof(int64_t);
+    int64_t offset = tablesOffset;
+    Fields *tables[] = { &writer->sequences, &writer->chunks, &writer->slices };
+    for (int64_t i = 0; i < 3; i++) {
+        writeAt(writer, tables[i]->values, tables[i]->length * sizeof(int64_t), offset);
+        offset += tables[i]->length * sizeof(int64_t);
+        free(tables[i]->values);
+    }
+    writeAt(writer, writer->names, writer->namesLength, offset);
+
+    Fields header = { NULL, 0, 0 };
+    fields_append(&header, CHUNK_STORE_MAGIC_NUMBER);
+    fields_append(&header, CHUNK_STORE_VERSION);
+    fields_append(&header, writer->sequenceNumber);
+    fields_append(&header, writer->chunkNumber);
+    fields_append(&header, writer->sliceNumber);
+    fields_append(&header, tablesOffset);
+    fields_append(&header, writer->namesLength);
+    writeAt(writer, header.values, header.length * sizeof(int64_t), 0);
+    free(header.values);
+
+    if (close(writer->fileDescriptor) != 0) {
+        st_errnoAbort("Failed to close chunk store %s", writer->path);
+    }
+    free(writer->names);
+    free(writer->path);
+    free(writer);
+}
+
+int64_t chunkStoreWriter_addSequence(ChunkStoreWriter *writer, const char *name, const char *sequence,
+                                     int64_t length) {
+    int64_t offset = writer->length;
+    int64_t blockNumber = (length + CHUNK_STORE_WRITE_BLOCK - 1) / CHUNK_STORE_WRITE_BLOCK;
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static) if(blockNumber > 1)
+#endif
+    for (int64_t i = 0; i < blockNumber; i++) {
+        int64_t start = i * CHUNK_STORE_WRITE_BLOCK;
+        int64_t blockLength = length - start < CHUNK_STORE_WRITE_BLOCK ? length - start : CHUNK_STORE_WRITE_BLOCK;
+        writeAt(writer, sequence + start, blockLength, offset + start);
+    }
+    writer->length += length;
+
+    int64_t nameLength = strlen(name) + 1;
+    if (writer->namesLength + nameLength > writer->namesMaxLength) {
+        writer->namesMaxLength = (writer->namesLength + nameLength) * 2;
+        writer->names = st_realloc(writer->names, writer->namesMaxLength);
+    }
+    memcpy(writer->names + writer->namesLength, name, nameLength);
+
+    fields_append(&writer->sequences, offset);
+    fields_append(&writer->sequences, length);
+    fields_append(&writer->sequences, writer->namesLength);
+    writer->namesLength += nameLength;
+    return writer->sequenceNumber++;
+}
+
+void chunkStoreWriter_addSlice(ChunkStoreWriter *writer, int64_t sequence, int64_t start, int64_t length) {
+    assert(sequence >= 0 && sequence < writer->sequenceNumber);
+    assert(start >= 0 && length > 0);
+    assert(start + length <= getField(writer->sequences.values, sequence, CHUNK_STORE_SEQUENCE_FIELDS, 1));
+    fields_append(&writer->slices, sequence);
+    fields_append(&writer->slices, start);
+    fields_append(&writer->slices, length);
+    writer->sliceNumber++;
+}
+
+int64_t chunkStoreWriter_finishChunk(ChunkStoreWriter *writer) {
+    if (getField(writer->chunks.values, writer->chunkNumber, 1, 0) == writer->sliceNumber) {
+        return -1; // The current chunk is empty
+    }
+    fields_append(&writer->chunks, writer->sliceNumber);
+    return writer->chunkNumber++;
+}
+
+/*
+ * Reading.
+ */
+
+struct _chunkStore {
+    char *data; // The whole of the mapped file
+    size_t mappedLength;
+    int64_t sequenceNumber;
+    int64_t chunkNumber;
+    int64_t sliceNumber;
+    const int64_t *sequences; // Point into data
+    const int64_t *chunks;
+    const int64_t *slices;
+    const char *names;
+};
+
+bool chunkStore_isChunkStore(const char *path) {
+    FILE *fileHandle = fopen(path, "rb");
+    if (fileHandle == NULL) {
+        st_errnoAbort("Failed to open %s", path);
+    }
+    int64_t magicNumber;
+    bool isChunkStore = fread(&magicNumber, sizeof(int64_t), 1, fileHandle) == 1 &&
+                        getField(&magicNumber, 0, 1, 0) == CHUNK_STORE_MAGIC_NUMBER;
+    fclose(fileHandle);
+    return isChunkStore;
+}
+
+ChunkStore *chunkStore_construct(const char *path) {
+    int fileDescriptor = open(path, O_RDONLY);
+    if (fileDescriptor < 0) {
+        st_errnoAbort("Failed to open chunk store %s", path);
+    }
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0) {
+        st_errnoAbort("Failed to stat chunk store %s", path);
+    }
+    if (fileStat.st_size < (off_t)(CHUNK_STORE_HEADER_FIELDS * sizeof(int64_t))) {
+        st_errAbort("Chunk store %s is truncated", path);
+    }
+
+    ChunkStore *store = st_malloc(sizeof(ChunkStore));
+    store->mappedLength = fileStat.st_size;
+    store->data = mmap(NULL, store->mappedLength, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    if (store->data == MAP_FAILED) {
+        st_errnoAbort("Failure mapping chunk store %s", path);
+    }
+    close(fileDescriptor);
+
+    const int64_t *header = (const int64_t *)store->data;
+    if (getField(header, 0, 1, 0) != CHUNK_STORE_MAGIC_NUMBER) {
+        st_errAbort("%s is not a chunk store", path);
+    }
+    if (getField(header, 1, 1, 0) != CHUNK_STORE_VERSION) {
+        st_errAbort("Chunk store %s has version %" PRIi64 ", expected %i", path, getField(header, 1, 1, 0),
+                    CHUNK_STORE_VERSION);
+    }
+    store->sequenceNumber = getField(header, 2, 1, 0);
+    store->chunkNumber = getField(header, 3, 1, 0);
+    store->sliceNumber = getField(header, 4, 1, 0);
+    int64_t tablesOffset = getField(header, 5, 1, 0);
+    int64_t namesLength = getField(header, 6, 1, 0);
+    int64_t tablesLength = (store->sequenceNumber * CHUNK_STORE_SEQUENCE_FIELDS + store->chunkNumber + 1
+                            + store->sliceNumber * CHUNK_STORE_SLICE_FIELDS) * sizeof(int64_t);
+    if (tablesOffset % sizeof(int64_t) != 0 || tablesOffset + tablesLength + namesLength != fileStat.st_size) {
+        st_errAbort("Chunk store %s is truncated", path);
+    }
+    store->sequences = (const int64_t *)(store->data + tablesOffset);
+    store->chunks = store->sequences + store->sequenceNumber * CHUNK_STORE_SEQUENCE_FIELDS;
+    store->slices = store->chunks + store->chunkNumber + 1;
+    store->names = (const char *)(store->slices + store->sliceNumber * CHUNK_STORE_SLICE_FIELDS);
+    return store;
+}
+
+void chunkStore_destruct(ChunkStore *store) {
+    munmap(store->data, store->mappedLength);
+    free(store);
+}
+
+int64_t chunkStore_getChunkNumber(ChunkStore *store) {
+    return store->chunkNumber;
+}
+
+int64_t chunkStore_getSliceNumber(ChunkStore *store, int64_t chunk) {
+    if (chunk < 0 || chunk >= store->chunkNumber) {
+        st_errAbort("Chunk %" PRIi64 " is not in the chunk store of %" PRIi64 " chunks", chunk, store->chunkNumber);
+    }
+    return getField(store->chunks, chunk + 1, 1, 0) - getField(store->chunks, chunk, 1, 0);
+}
+
+void chunkStore_getSlice(ChunkStore *store, int64_t chunk, int64_t i, const char **name, int64_t *start,
+                         const char **bases, int64_t *length) {
+    assert(i >= 0 && i < chunkStore_getSliceNumber(store, chunk));
+    int64_t slice = getField(store->chunks, chunk, 1, 0) + i;
+    int64_t sequence = getField(store->slices, slice, CHUNK_STORE_SLICE_FIELDS, 0);
+    *start = getField(store->slices, slice, CHUNK_STORE_SLICE_FIELDS, 1);
+    *length = getField(store->slices, slice, CHUNK_STORE_SLICE_FIELDS, 2);
+    *name = store->names + getField(store->sequences, sequence, CHUNK_STORE_SEQUENCE_FIELDS, 2);
+    *bases = store->data + getField(store->sequences, sequence, CHUNK_STORE_SEQUENCE_FIELDS, 0) + *start;
+}
+
+void chunkStore_writeChunkFasta(ChunkStore *store, int64_t chunk, FILE *fileHandle) {
+    int64_t sliceNumber = chunkStore_getSliceNumber(store, chunk);
+    for (int64_t i = 0; i < sliceNumber; i++) {
+        const char *name, *bases;
+        int64_t start, length;
+        chunkStore_getSlice(store, chunk, i, &name, &start, &bases, &length);
+        // fastaWrite needs a terminated sequence, which the mapped bases are not
+        char *sequence = st_malloc(length + 1);
+        memcpy(sequence, bases, length);
+        sequence[length] = '\0';
+        char *header = stString_print("%s|%" PRIi64 "\n", name, start);
+        fastaWrite(sequence, header, fileHandle);
+        free(header);
+        free(sequence);
+    }
+}
+
+void chunkStore_writeMergedChunks(ChunkStore *store, FILE *fileHandle) {
+    for (int64_t chunk = 0; chunk < store->chunkNumber; chunk++) {
+        int64_t sliceNumber = chunkStore_getSliceNumber(store, chunk);
+        for (int64_t i = 0; i < sliceNumber; i++) {
+            const char *name, *bases;
+            int64_t start, length;
+            chunkStore_getSlice(store, chunk, i, &name, &start, &bases, &length);
+            if (start == 0) {
+                fprintf(fileHandle, ">%s\n", name);
+            }
+            if (fwrite(bases, 1, length, fileHandle) != (size_t)length || putc('\n', fileHandle) == EOF) {
+                st_errnoAbort("Failed to write merged chunks");
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * chunkStore.h
+ *
+ * A single file holding the chunks that sequences are cut into for lastz, in place of a file per chunk. Each
+ * sequence is stored once, as raw bases, and each chunk is a list of slices of the sequences, so the chunks
+ * overlapping one another cost nothing extra. The store is written by cactus_blast_chunkSequencesToStore, and memory
+ * mapped to read a chunk by its ID, either as the FASTA the chunk file would have held or as the raw slices.
+ *
+ * The file is made of little-endian 64-bit integers, apart from the bases and names:
+ *   - a header: magic number, version, number of sequences, number of chunks, number of slices, the offset of the
+ *     tables, the length of the names.
+ *   - the bases of the sequences, one after another.
+ *   - padding up to a multiple of 8 bytes, then the tables:
+ *       - the sequences: the offset of the bases, the length, the offset of the name within the names.
+ *       - the chunks: the index of the first slice of each chunk, followed by the number of slices, so chunk i has
+ *         the slices from entry i up to entry i + 1.
+ *       - the slices: the index of the sequence, the start within the sequence, the length.
+ *   - the names, each terminated by a '\0'.
+ */
+
+#ifndef CHUNKSTORE_H_
+#define CHUNKSTORE_H_
+
+#include "sonLib.h"
+
+typedef struct _chunkStore ChunkStore;
+
+typedef struct _chunkStoreWriter ChunkStoreWriter;
+
+/*
+ * Creates the store at the path, replacing any existing file.
+ */
+ChunkStoreWriter *chunkStoreWriter_construct(const char *path);
+
+/*
+ * Writes the tables and the header and closes the store.
+ */
+void chunkStoreWriter_destruct(ChunkStoreWriter *writer);
+
+/*
+ * Writes the bases of the sequence to the store, large sequences being written in parallel, and returns the index of
+ * the sequence for its slices.
+ */
+int64_t chunkStoreWriter_addSequence(ChunkStoreWriter *writer, const char *name, const char *sequence,
+                                     int64_t length);
+
+/*
+ * Adds the slice of the sequence to the current chunk.
+ */
+void chunkStoreWriter_addSlice(ChunkStoreWriter *writer, int64_t sequence, int64_t start, int64_t length);
+
+/*
+ * Ends the current chunk, returning its ID, or -1 if it has no slices, in which case no chunk is made.
+ */
+int64_t chunkStoreWriter_finishChunk(ChunkStoreWriter *writer);
+
+/*
+ * Returns non-zero if the file at the path is a chunk store.
+ */
+bool chunkStore_isChunkStore(const char *path);
+
+/*
+ * Memory maps the store at the path.
+ */
+ChunkStore *chunkStore_construct(const char *path);
+
+void chunkStore_destruct(ChunkStore *store);
+
+int64_t chunkStore_getChunkNumber(ChunkStore *store);
+
+int64_t chunkStore_getSliceNumber(ChunkStore *store, int64_t chunk);
+
+/*
+ * Gets the ith slice of the chunk: the name of its sequence, its start within the sequence and its bases, which
+ * point into the mapped store and are not '\0' terminated.
+ */
+void chunkStore_getSlice(ChunkStore *store, int64_t chunk, int64_t i, const char **name, int64_t *start,
+                         const char **bases, int64_t *length);
+
+/*
+ * Writes the chunk as FASTA, each slice headed by "name|start", the same as the file cactus_blast_chunkSequences
+ * writes for the chunk.
+ */
+void chunkStore_writeChunkFasta(ChunkStore *store, int64_t chunk, FILE *fileHandle);
+
+/*
+ * Writes the sequences of the chunks, in order, as cactus_batch_mergeChunks does: a header for each slice that starts
+ * its sequence, followed by the bases of every slice, written directly from the mapped store.
+ */
+void chunkStore_writeMergedChunks(ChunkStore *store, FILE *fileHandle);
+
+#endif /* CHUNKSTORE_H_ */
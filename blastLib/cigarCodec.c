@@ -0,0 +1,539 @@
+/*
+ * cigarCodec.c
+ *
+ * See cigarCodec.h.
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+#include "cigarCodec.h"
+
+#define CIGAR_BUFFER_SIZE (1 << 22) // The size of the reader's and writer's buffers
+
+/*
+ * Growable character buffers, that the cigar lines are formatted into.
+ */
+
+typedef struct _buffer {
+    char *string;
+    int64_t length;
+    int64_t maxLength;
+} Buffer;
+
+static void buffer_reserve(Buffer *buffer, int64_t length) {
+    if (buffer->length + length > buffer->maxLength) {
+        buffer->maxLength = (buffer->length + length) * 2;
+        buffer->string = st_realloc(buffer->string, buffer->maxLength);
+    }
+}
+
+static void buffer_appendChar(Buffer *buffer, char c) {
+    buffer_reserve(buffer, 1);
+    buffer->string[buffer->length++] = c;
+}
+
+static void buffer_appendString(Buffer *buffer, const char *string) {
+    int64_t length = strlen(string);
+    buffer_reserve(buffer, length);
+    memcpy(buffer->string + buffer->length, string, length);
+    buffer->length += length;
+}
+
+static void buffer_appendInt(Buffer *buffer, int64_t i) {
+    char digits[20];
+    int64_t digitNumber = 0;
+    uint64_t j = i < 0 ? -(uint64_t)i : (uint64_t)i;
+    do {
+        digits[digitNumber++] = '0' + j % 10;
+        j /= 10;
+    } while (j > 0);
+    buffer_reserve(buffer, digitNumber + 1);
+    if (i < 0) {
+        buffer->string[buffer->length++] = '-';
+    }
+    while (digitNumber > 0) {
+        buffer->string[buffer->length++] = digits[--digitNumber];
+    }
+}
+
+static void buffer_appendFloat(Buffer *buffer, float f) {
+    // Scores are mostly integers, as lastz reports them, which are formatted by hand, otherwise they need the exact
+    // rounding of %f, so are left to snprintf
+    if (f > -1.0e15 && f < 1.0e15 && f == (int64_t)f) {
+        if (f == 0.0 && signbit(f)) {
+            buffer_appendChar(buffer, '-');
+        }
+        buffer_appendInt(buffer, (int64_t)f);
+        buffer_appendString(buffer, ".000000");
+        return;
+    }
+    buffer_reserve(buffer, 64);
+    int64_t length = snprintf(buffer->string + buffer->length, 64, "%f", f);
+    if (length >= 64) {
+        buffer_reserve(buffer, length + 1);
+        snprintf(buffer->string + buffer->length, length + 1, "%f", f);
+    }
+    buffer->length += length;
+}
+
+static char opTypeToChar(int32_t opType) {
+    switch (opType) {
+    case PAIRWISE_MATCH:
+        return 'M';
+    case PAIRWISE_INDEL_X:
+        return 'D';
+    case PAIRWISE_INDEL_Y:
+        return 'I';
+    default:
+        st_errAbort("Unknown alignment operation type %" PRIi32, opType);
+        return 0;
+    }
+}
+
+static void appendCigarHeader(Buffer *buffer, const char *contig1, int64_t start1, int64_t end1, bool strand1,
+                              const char *contig2, int64_t start2, int64_t end2, bool strand2, float score) {
+    buffer_appendString(buffer, "cigar: ");
+    buffer_appendString(buffer, contig2);
+    buffer_appendChar(buffer, ' ');
+    buffer_appendInt(buffer, start2);
+    buffer_appendChar(buffer, ' ');
+    buffer_appendInt(buffer, end2);
+    buffer_appendString(buffer, strand2 ? " + " : " - ");
+    buffer_appendString(buffer, contig1);
+    buffer_appendChar(buffer, ' ');
+    buffer_appendInt(buffer, start1);
+    buffer_appendChar(buffer, ' ');
+    buffer_appendInt(buffer, end1);
+    buffer_appendString(buffer, strand1 ? " + " : " - ");
+    buffer_appendFloat(buffer, score);
+}
+
+static void appendOperation(Buffer *buffer, int32_t opType, int64_t length, float score, bool withScores) {
+    buffer_appendChar(buffer, ' ');
+    buffer_appendChar(buffer, opTypeToChar(opType));
+    buffer_appendChar(buffer, ' ');
+    buffer_appendInt(buffer, length);
+    if (withScores) {
+        buffer_appendChar(buffer, ' ');
+        buffer_appendFloat(buffer, score);
+    }
+}
+
+static void appendCigar(Buffer *buffer, Cigar *cigar, bool withScores) {
+    appendCigarHeader(buffer, cigar->contig1, cigar->start1, cigar->end1, cigar->strand1,
+                      cigar->contig2, cigar->start2, cigar->end2, cigar->strand2, cigar->score);
+    for (int64_t i = 0; i < cigar->operationNumber; i++) {
+        CigarOperation *op = &cigar->operations[i];
+        appendOperation(buffer, op->opType, op->length, op->score, withScores);
+    }
+    buffer_appendChar(buffer, '\n');
+}
+
+static void appendPairwiseAlignment(Buffer *buffer, struct PairwiseAlignment *pairwiseAlignment, bool withScores) {
+    appendCigarHeader(buffer, pairwiseAlignment->contig1, pairwiseAlignment->start1, pairwiseAlignment->end1,
+                      pairwiseAlignment->strand1, pairwiseAlignment->contig2, pairwiseAlignment->start2,
+                      pairwiseAlignment->end2, pairwiseAlignment->strand2, pairwiseAlignment->score);
+    for (int64_t i = 0; i < pairwiseAlignment->operationList->length; i++) {
+        struct AlignmentOperation *op = pairwiseAlignment->operationList->list[i];
+        appendOperation(buffer, op->opType, op->length, op->score, withScores);
+    }
+    buffer_appendChar(buffer, '\n');
+}
+
+/*
+ * Cigars.
+ */
+
+Cigar *cigar_construct(void) {
+    return st_calloc(1, sizeof(Cigar));
+}
+
+void cigar_destruct(Cigar *cigar) {
+    free(cigar->operations);
+    free(cigar);
+}
+
+static void cigar_reserve(Cigar *cigar, int64_t operationNumber) {
+    if (operationNumber > cigar->maxOperationNumber) {
+        cigar->maxOperationNumber = operationNumber * 2 + 16;
+        cigar->operations = st_realloc(cigar->operations, cigar->maxOperationNumber * sizeof(CigarOperation));
+    }
+}
+
+void cigar_copyTo(Cigar *cigar, Cigar *copy) {
+    CigarOperation *operations = copy->operations;
+    int64_t maxOperationNumber = copy->maxOperationNumber;
+    *copy = *cigar;
+    copy->operations = operations;
+    copy->maxOperationNumber = maxOperationNumber;
+    cigar_reserve(copy, cigar->operationNumber);
+    memcpy(copy->operations, cigar->operations, cigar->operationNumber * sizeof(CigarOperation));
+}
+
+Cigar *cigar_copy(Cigar *cigar) {
+    Cigar *copy = cigar_construct();
+    cigar_copyTo(cigar, copy);
+    return copy;
+}
+
+void cigar_addOperation(Cigar *cigar, int32_t opType, int64_t length, float score) {
+    cigar_reserve(cigar, cigar->operationNumber + 1);
+    CigarOperation *op = &cigar->operations[cigar->operationNumber++];
+    op->opType = opType;
+    op->length = length;
+    op->score = score;
+}
+
+void cigar_check(Cigar *cigar) {
+    int64_t i = cigar->start1, j = cigar->start2;
+    for (int64_t k = 0; k < cigar->operationNumber; k++) {
+        CigarOperation *op = &cigar->operations[k];
+        if (op->length < 0) {
+            st_errAbort("Alignment operation of negative length %" PRIi64 " in cigar of %s and %s", op->length,
+                        cigar->contig1, cigar->contig2);
+        }
+        if (op->opType != PAIRWISE_INDEL_Y) {
+            i += cigar->strand1 ? op->length : -op->length;
+        }
+        if (op->opType != PAIRWISE_INDEL_X) {
+            j += cigar->strand2 ? op->length : -op->length;
+        }
+    }
+    if (i != cigar->end1 || j != cigar->end2) {
+        st_errAbort("The operations of the cigar of %s %" PRIi64 " %" PRIi64 " and %s %" PRIi64 " %" PRIi64
+                    " end at %" PRIi64 " and %" PRIi64, cigar->contig1, cigar->start1, cigar->end1,
+                    cigar->contig2, cigar->start2, cigar->end2, i, j);
+    }
+}
+
+struct PairwiseAlignment *cigar_toPairwiseAlignment(Cigar *cigar) {
+    struct List *ops = constructEmptyList(0, (void (*)(void *))destructAlignmentOperation);
+    for (int64_t i = 0; i < cigar->operationNumber; i++) {
+        CigarOperation *op = &cigar->operations[i];
+        listAppend(ops, constructAlignmentOperation(op->opType, op->length, op->score));
+    }
+    return constructPairwiseAlignment((char *)cigar->contig1, cigar->start1, cigar->end1, cigar->strand1,
+                                      (char *)cigar->contig2, cigar->start2, cigar->end2, cigar->strand2,
+                                      cigar->score, ops);
+}
+
+char *cigar_toString(Cigar *cigar, bool withScores) {
+    Buffer buffer = { NULL, 0, 0 };
+    appendCigar(&buffer, cigar, withScores);
+    buffer_appendChar(&buffer, '\0');
+    return buffer.string;
+}
+
+stHash *cigar_constructContigs(void) {
+    return stHash_construct3(stHash_stringKey, stHash_stringEqualKey, free, NULL);
+}
+
+const char *cigar_internContig(stHash *contigs, const char *contig) {
+    char *internedContig = stHash_search(contigs, (void *)contig);
+    if (internedContig == NULL) {
+        internedContig = stString_copy(contig);
+        stHash_insert(contigs, internedContig, internedContig);
+    }
+    return internedContig;
+}
+
+/*
+ * Reading.
+ */
+
+struct _cigarReader {
+    FILE *fileHandle;
+    char *buffer; // Holds the lines read from the file that are not yet parsed, from start to end
+    int64_t start;
+    int64_t end;
+    int64_t maxLength;
+    bool endOfFile;
+    int64_t lineNumber; // The number of lines read from the file
+    stHash *contigs; // The interned contig names
+    bool ownsContigs;
+    Cigar cigar; // The cigar read by cigarReader_readPairwiseAlignment
+    Buffer line; // Holds the copy of a line being parsed by cigarReader_parse
+    const char *parsedLine; // The line being parsed by cigarReader_parse, for error messages
+};
+
+CigarReader *cigarReader_constructWithContigs(FILE *fileHandle, stHash *contigs) {
+    CigarReader *reader = st_calloc(1, sizeof(CigarReader));
+    reader->fileHandle = fileHandle;
+    if (fileHandle != NULL) {
+        reader->maxLength = CIGAR_BUFFER_SIZE;
+        reader->buffer = st_malloc(reader->maxLength);
+    }
+    reader->contigs = contigs;
+    return reader;
+}
+
+CigarReader *cigarReader_construct(FILE *fileHandle) {
+    CigarReader *reader = cigarReader_constructWithContigs(fileHandle, cigar_constructContigs());
+    reader->ownsContigs = 1;
+    return reader;
+}
+
+void cigarReader_destruct(CigarReader *reader) {
+    free(reader->buffer);
+    free(reader->line.string);
+    free(reader->cigar.operations);
+    if (reader->ownsContigs) {
+        stHash_destruct(reader->contigs);
+    }
+    free(reader);
+}
+
+/*
+ * Returns the next line of the file, without its newline, or NULL at the end of the file.
+ */
+static char *readLine(CigarReader *reader) {
+    while (1) {
+        char *newline = memchr(reader->buffer + reader->start, '\n', reader->end - reader->start);
+        if (newline != NULL) {
+            char *line = reader->buffer + reader->start;
+            *newline = '\0';
+            reader->start = newline - reader->buffer + 1;
+            return line;
+        }
+        // Move the partial line to the front of the buffer, then fill the rest of it
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        if (reader->end >= reader->maxLength - 1) { // Leaves room to terminate the last line
+            reader->maxLength *= 2;
+            reader->buffer = st_realloc(reader->buffer, reader->maxLength);
+        }
+        if (reader->endOfFile) {
+            if (reader->end == 0) {
+                return NULL;
+            }
+            // The last line has no newline
+            reader->buffer[reader->end] = '\0';
+            reader->start = reader->end;
+            return reader->buffer;
+        }
+        size_t i = fread(reader->buffer + reader->end, 1, reader->maxLength - reader->end - 1, reader->fileHandle);
+        if (i == 0) {
+            if (ferror(reader->fileHandle)) {
+                st_errnoAbort("Failed to read cigars");
+            }
+            reader->endOfFile = 1;
+        }
+        reader->end += i;
+    }
+}
+
+static inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * Returns the next space separated token of the line, terminating it in place, or NULL at the end of the line.
+ */
+static char *getToken(char **c) {
+    while (isSpace(**c)) {
+        (*c)++;
+    }
+    if (**c == '\0') {
+        return NULL;
+    }
+    char *token = *c;
+    while (**c != '\0' && !isSpace(**c)) {
+        (*c)++;
+    }
+    if (**c != '\0') {
+        *(*c)++ = '\0';
+    }
+    return token;
+}
+
+static void parseError(CigarReader *reader, const char *expected, const char *token) {
+    if (reader->parsedLine != NULL) {
+        st_errAbort("Expected %s, got \"%s\", in cigar: %s", expected, token, reader->parsedLine);
+    }
+    st_errAbort("Expected %s, got \"%s\", in cigar on line %" PRIi64, expected, token, reader->lineNumber);
+}
+
+static char *getRequiredToken(CigarReader *reader, char **c) {
+    char *token = getToken(c);
+    if (token == NULL) {
+        parseError(reader, "more fields", "");
+    }
+    return token;
+}
+
+static int64_t parseInt(CigarReader *reader, const char *token) {
+    const char *c = token;
+    bool negative = *c == '-';
+    if (*c == '-' || *c == '+') {
+        c++;
+    }
+    if (!isdigit(*c)) {
+        parseError(reader, "an integer", token);
+    }
+    int64_t i = 0;
+    while (isdigit(*c)) {
+        i = i * 10 + (*c++ - '0');
+    }
+    if (*c != '\0') {
+        parseError(reader, "an integer", token);
+    }
+    return negative ? -i : i;
+}
+
+static float parseFloat(CigarReader *reader, const char *token) {
+    // Integers, as lastz reports its scores, are converted exactly as strtof would, but faster
+    const char *c = token;
+    int64_t i = 0;
+    while (isdigit(*c) && c - token < 18) {
+        i = i * 10 + (*c++ - '0');
+    }
+    if (*c == '\0' && c != token) {
+        return (float)i;
+    }
+    char *end;
+    float f = strtof(token, &end);
+    if (end == token || *end != '\0') {
+        parseError(reader, "a number", token);
+    }
+    return f;
+}
+
+static bool parseStrand(CigarReader *reader, const char *token) {
+    if ((token[0] != '+' && token[0] != '-') || token[1] != '\0') {
+        parseError(reader, "a strand", token);
+    }
+    return token[0] == '+';
+}
+
+static int32_t parseOpType(CigarReader *reader, const char *token) {
+    if (token[0] != '\0' && token[1] == '\0') {
+        switch (token[0]) {
+        case 'M':
+            return PAIRWISE_MATCH;
+        case 'D':
+            return PAIRWISE_INDEL_X;
+        case 'I':
+            return PAIRWISE_INDEL_Y;
+        }
+    }
+    parseError(reader, "an alignment operation", token);
+    return 0;
+}
+
+/*
+ * Parses the line, which is modified in place, into the cigar.
+ */
+static void parseCigar(CigarReader *reader, char *c, Cigar *cigar) {
+    char *token = getRequiredToken(reader, &c);
+    if (strcmp(token, "cigar:") != 0) {
+        parseError(reader, "\"cigar:\"", token);
+    }
+    cigar->contig2 = cigar_internContig(reader->contigs, getRequiredToken(reader, &c));
+    cigar->start2 = parseInt(reader, getRequiredToken(reader, &c));
+    cigar->end2 = parseInt(reader, getRequiredToken(reader, &c));
+    cigar->strand2 = parseStrand(reader, getRequiredToken(reader, &c));
+    cigar->contig1 = cigar_internContig(reader->contigs, getRequiredToken(reader, &c));
+    cigar->start1 = parseInt(reader, getRequiredToken(reader, &c));
+    cigar->end1 = parseInt(reader, getRequiredToken(reader, &c));
+    cigar->strand1 = parseStrand(reader, getRequiredToken(reader, &c));
+    cigar->score = parseFloat(reader, getRequiredToken(reader, &c));
+    cigar->operationNumber = 0;
+    token = getToken(&c);
+    while (token != NULL) {
+        cigar_reserve(cigar, cigar->operationNumber + 1);
+        CigarOperation *op = &cigar->operations[cigar->operationNumber++];
+        op->opType = parseOpType(reader, token);
+        op->length = parseInt(reader, getRequiredToken(reader, &c));
+        op->score = 0.0;
+        // The operation may be followed by its score
+        token = getToken(&c);
+        if (token != NULL && !isalpha(token[0])) {
+            op->score = parseFloat(reader, token);
+            token = getToken(&c);
+        }
+    }
+}
+
+bool cigarReader_read(CigarReader *reader, Cigar *cigar) {
+    char *line;
+    while ((line = readLine(reader)) != NULL) {
+        reader->lineNumber++;
+        char *c = line;
+        while (isSpace(*c)) {
+            c++;
+        }
+        if (*c != '\0') { // Skip blank lines
+            parseCigar(reader, c, cigar);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct PairwiseAlignment *cigarReader_readPairwiseAlignment(CigarReader *reader) {
+    return cigarReader_read(reader, &reader->cigar) ? cigar_toPairwiseAlignment(&reader->cigar) : NULL;
+}
+
+void cigarReader_parse(CigarReader *reader, const char *line, Cigar *cigar) {
+    reader->line.length = 0;
+    buffer_appendString(&reader->line, line);
+    buffer_appendChar(&reader->line, '\0');
+    reader->parsedLine = line;
+    parseCigar(reader, reader->line.string, cigar);
+    reader->parsedLine = NULL;
+}
+
+/*
+ * Writing.
+ */
+
+struct _cigarWriter {
+    FILE *fileHandle;
+    Buffer buffer;
+};
+
+CigarWriter *cigarWriter_construct(FILE *fileHandle) {
+    CigarWriter *writer = st_calloc(1, sizeof(CigarWriter));
+    writer->fileHandle = fileHandle;
+    buffer_reserve(&writer->buffer, CIGAR_BUFFER_SIZE);
+    return writer;
+}
+
+void cigarWriter_flush(CigarWriter *writer) {
+    if (writer->buffer.length > 0 &&
+        fwrite(writer->buffer.string, 1, writer->buffer.length, writer->fileHandle) != (size_t)writer->buffer.length) {
+        st_errnoAbort("Failed to write cigars");
+    }
+    writer->buffer.length = 0;
+}
+
+void cigarWriter_destruct(CigarWriter *writer) {
+    cigarWriter_flush(writer);
+    free(writer->buffer.string);
+    free(writer);
+}
+
+void cigarWriter_write(CigarWriter *writer, Cigar *cigar, bool withScores) {
+    appendCigar(&writer->buffer, cigar, withScores);
+    if (writer->buffer.length >= CIGAR_BUFFER_SIZE) {
+        cigarWriter_flush(writer);
+    }
+}
+
+void cigarWriter_writePairwiseAlignment(CigarWriter *writer, struct PairwiseAlignment *pairwiseAlignment,
+                                        bool withScores) {
+    appendPairwiseAlignment(&writer->buffer, pairwiseAlignment, withScores);
+    if (writer->buffer.length >= CIGAR_BUFFER_SIZE) {
+        cigarWriter_flush(writer);
+    }
+}
+
+void cigarWriter_writeString(CigarWriter *writer, const char *string) {
+    buffer_appendString(&writer->buffer, string);
+    if (writer->buffer.length >= CIGAR_BUFFER_SIZE) {
+        cigarWriter_flush(writer);
+    }
+}
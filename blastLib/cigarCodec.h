@@ -0,0 +1,146 @@
+/*
+ * cigarCodec.h
+ *
+ * Reading and writing of lastz cigar lines, as read by cigarRead and written by cigarWrite, for tools that stream
+ * through large cigar files. The reader parses lines out of a large buffer, interning the contig names, and parses
+ * each line into a Cigar whose operations are held in a single array that is reused from one line to the next. The
+ * writer formats cigars into a large buffer that is written out as it fills.
+ *
+ * The format is:
+ *     cigar: contig2 start2 end2 strand2 contig1 start1 end1 strand1 score [op length [opScore]]*
+ * where op is M (PAIRWISE_MATCH), D (PAIRWISE_INDEL_X) or I (PAIRWISE_INDEL_Y). The output is the same, byte for
+ * byte, as that of cigarWrite.
+ */
+
+#ifndef CIGARCODEC_H_
+#define CIGARCODEC_H_
+
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+
+typedef struct _cigarOperation {
+    int32_t opType; // PAIRWISE_MATCH, PAIRWISE_INDEL_X or PAIRWISE_INDEL_Y
+    int64_t length;
+    float score;
+} CigarOperation;
+
+typedef struct _cigar {
+    const char *contig1; // Interned by the reader, valid as long as its table of contig names
+    int64_t start1;
+    int64_t end1;
+    bool strand1;
+    const char *contig2;
+    int64_t start2;
+    int64_t end2;
+    bool strand2;
+    float score;
+    int64_t operationNumber;
+    CigarOperation *operations;
+    int64_t maxOperationNumber; // The allocated length of operations
+} Cigar;
+
+typedef struct _cigarReader CigarReader;
+
+typedef struct _cigarWriter CigarWriter;
+
+Cigar *cigar_construct(void);
+
+void cigar_destruct(Cigar *cigar);
+
+/*
+ * Returns a copy of the cigar, which shares its interned contig names.
+ */
+Cigar *cigar_copy(Cigar *cigar);
+
+/*
+ * Copies the cigar into copy, reusing the operations array of copy.
+ */
+void cigar_copyTo(Cigar *cigar, Cigar *copy);
+
+void cigar_addOperation(Cigar *cigar, int32_t opType, int64_t length, float score);
+
+/*
+ * Aborts unless the operations of the cigar span its coordinates, as checkPairwiseAlignment does.
+ */
+void cigar_check(Cigar *cigar);
+
+/*
+ * Makes a pairwise alignment with the same contents as the cigar, with copies of the contig names.
+ */
+struct PairwiseAlignment *cigar_toPairwiseAlignment(Cigar *cigar);
+
+/*
+ * Returns the cigar line of the cigar, ending with a newline, as cigarWrite would write it.
+ */
+char *cigar_toString(Cigar *cigar, bool withScores);
+
+/*
+ * Constructs an empty table of interned contig names, which may be shared by several readers and is destructed
+ * with stHash_destruct.
+ */
+stHash *cigar_constructContigs(void);
+
+/*
+ * Returns the interned copy of the contig name, adding it to the table if it is not there.
+ */
+const char *cigar_internContig(stHash *contigs, const char *contig);
+
+/*
+ * Constructs a reader of the file, which is not closed by the reader, with a table of contig names of its own. The
+ * file may be NULL for a reader used only to parse strings.
+ */
+CigarReader *cigarReader_construct(FILE *fileHandle);
+
+/*
+ * Constructs a reader that interns the contig names in the given table, which the reader does not destruct, so that
+ * the names of the cigars it reads outlive it.
+ */
+CigarReader *cigarReader_constructWithContigs(FILE *fileHandle, stHash *contigs);
+
+void cigarReader_destruct(CigarReader *reader);
+
+/*
+ * Reads the next cigar of the file into the given cigar, returning false at the end of the file.
+ */
+bool cigarReader_read(CigarReader *reader, Cigar *cigar);
+
+/*
+ * Reads the next cigar of the file as a pairwise alignment, returning NULL at the end of the file, like cigarRead.
+ * The line is parsed into a cigar held by the reader, so only the pairwise alignment is allocated.
+ */
+struct PairwiseAlignment *cigarReader_readPairwiseAlignment(CigarReader *reader);
+
+/*
+ * Parses the cigar line, which need not end with a newline, into the given cigar.
+ */
+void cigarReader_parse(CigarReader *reader, const char *line, Cigar *cigar);
+
+/*
+ * Constructs a writer to the file, which is not closed by the writer.
+ */
+CigarWriter *cigarWriter_construct(FILE *fileHandle);
+
+/*
+ * Flushes the writer and destructs it.
+ */
+void cigarWriter_destruct(CigarWriter *writer);
+
+void cigarWriter_flush(CigarWriter *writer);
+
+/*
+ * Writes the cigar, including the scores of its operations if withScores is true.
+ */
+void cigarWriter_write(CigarWriter *writer, Cigar *cigar, bool withScores);
+
+/*
+ * Writes the pairwise alignment as cigarWrite would.
+ */
+void cigarWriter_writePairwiseAlignment(CigarWriter *writer, struct PairwiseAlignment *pairwiseAlignment,
+                                        bool withScores);
+
+/*
+ * Writes the string as is, for cigar lines already formatted by cigar_toString.
+ */
+void cigarWriter_writeString(CigarWriter *writer, const char *string);
+
+#endif /* CIGARCODEC_H_ */
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2009-2018 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "CuTest.h"
+#include "sonLib.h"
+#include "blastAlignmentLib.h"
+#include "chunkStore.h"
+
+static const char *tempDir = "chunkStoreTestTempDir";
+
+static char *storePath;
+
+static void setup(void) {
+    if (stFile_exists(tempDir)) {
+        stFile_rmtree(tempDir);
+    }
+    stFile_mkdir(tempDir);
+    storePath = stFile_pathJoin(tempDir, "chunks.store");
+}
+
+static void teardown(void) {
+    free(storePath);
+    stFile_rmtree(tempDir);
+}
+
+static char *getRandomBases(int64_t length) {
+    char *bases = st_malloc(length + 1);
+    for (int64_t i = 0; i < length; i++) {
+        bases[i] = "ACGTN"[st_randomInt(0, 5)];
+    }
+    bases[length] = '\0';
+    return bases;
+}
+
+/*
+ * Checks the ith slice of the chunk is the given slice of the sequence.
+ */
+static void checkSlice(CuTest *testCase, ChunkStore *store, int64_t chunk, int64_t i, const char *expectedName,
+                       const char *sequence, int64_t expectedStart, int64_t expectedLength) {
+    const char *name, *bases;
+    int64_t start, length;
+    chunkStore_getSlice(store, chunk, i, &name, &start, &bases, &length);
+    CuAssertStrEquals(testCase, expectedName, name);
+    CuAssertIntEquals(testCase, expectedStart, start);
+    CuAssertIntEquals(testCase, expectedLength, length);
+    CuAssertTrue(testCase, memcmp(sequence + expectedStart, bases, length) == 0);
+}
+
+static void testChunkStore_roundTrip(CuTest *testCase) {
+    setup();
+
+    // A sequence longer than the blocks the writer writes in parallel, and two short ones
+    int64_t lengths[] = { (1 << 24) + 1001, 57, 1 };
+    const char *names[] = { "longSequence", "shortSequence", "oneBase" };
+    char *sequences[3];
+    int64_t sequenceIndices[3];
+    ChunkStoreWriter *writer = chunkStoreWriter_construct(storePath);
+    for (int64_t i = 0; i < 3; i++) {
+        sequences[i] = getRandomBases(lengths[i]);
+        sequenceIndices[i] = chunkStoreWriter_addSequence(writer, names[i], sequences[i], lengths[i]);
+        CuAssertIntEquals(testCase, i, sequenceIndices[i]);
+    }
+    // Overlapping slices of the long sequence, then a chunk of the two short sequences
+    chunkStoreWriter_addSlice(writer, sequenceIndices[0], 0, 1 << 24);
+    CuAssertIntEquals(testCase, 0, chunkStoreWriter_finishChunk(writer));
+    CuAssertIntEquals(testCase, -1, chunkStoreWriter_finishChunk(writer));
+    chunkStoreWriter_addSlice(writer, sequenceIndices[0], (1 << 24) - 500, 1501);
+    CuAssertIntEquals(testCase, 1, chunkStoreWriter_finishChunk(writer));
+    chunkStoreWriter_addSlice(writer, sequenceIndices[1], 0, 57);
+    chunkStoreWriter_addSlice(writer, sequenceIndices[2], 0, 1);
+    // The last chunk is finished by the destructor
+    chunkStoreWriter_destruct(writer);
+
+    CuAssertTrue(testCase, chunkStore_isChunkStore(storePath));
+    ChunkStore *store = chunkStore_construct(storePath);
+    CuAssertIntEquals(testCase, 3, chunkStore_getChunkNumber(store));
+    CuAssertIntEquals(testCase, 1, chunkStore_getSliceNumber(store, 0));
+    CuAssertIntEquals(testCase, 1, chunkStore_getSliceNumber(store, 1));
+    CuAssertIntEquals(testCase, 2, chunkStore_getSliceNumber(store, 2));
+    checkSlice(testCase, store, 0, 0, names[0], sequences[0], 0, 1 << 24);
+    checkSlice(testCase, store, 1, 0, names[0], sequences[0], (1 << 24) - 500, 1501);
+    checkSlice(testCase, store, 2, 0, names[1], sequences[1], 0, 57);
+    checkSlice(testCase, store, 2, 1, names[2], sequences[2], 0, 1);
+
+    chunkStore_destruct(store);
+    for (int64_t i = 0; i < 3; i++) {
+        free(sequences[i]);
+    }
+    teardown();
+}
+
+static char *readFile(const char *path, int64_t *length) {
+    FILE *fileHandle = fopen(path, "rb");
+    assert(fileHandle != NULL);
+    fseek(fileHandle, 0, SEEK_END);
+    *length = ftell(fileHandle);
+    rewind(fileHandle);
+    char *contents = st_malloc(*length + 1);
+    size_t i = fread(contents, 1, *length, fileHandle);
+    (void) i;
+    fclose(fileHandle);
+    return contents;
+}
+
+static void testChunkStore_sameAsChunkFiles(CuTest *testCase) {
+    /*
+     * Chunks random sequences, with overlaps, into files and into a store, and checks the FASTA of each chunk of the
+     * store is byte for byte that of its chunk file.
+     */
+    setup();
+
+    stList *sequences = stList_construct3(0, free);
+    for (int64_t i = 0; i < 20; i++) {
+        stList_append(sequences, getRandomBases(st_randomInt(1, 5000)));
+    }
+    char *chunksDir = stFile_pathJoin(tempDir, "chunks");
+    stFile_mkdir(chunksDir);
+    for (int64_t toStore = 0; toStore < 2; toStore++) {
+        ChunkStoreWriter *writer = NULL;
+        if (toStore) {
+            writer = chunkStoreWriter_construct(storePath);
+            setupToChunkSequencesToStore(1000, 100, writer);
+        } else {
+            setupToChunkSequences(1000, 100, chunksDir);
+        }
+        for (int64_t i = 0; i < stList_length(sequences); i++) {
+            char *header = stString_print("sequence%" PRIi64 " description", i);
+            char *sequence = stList_get(sequences, i);
+            processSequenceToChunk(NULL, header, sequence, strlen(sequence));
+            free(header);
+        }
+        finishChunkingSequences();
+        if (toStore) {
+            chunkStoreWriter_destruct(writer);
+        }
+    }
+
+    ChunkStore *store = chunkStore_construct(storePath);
+    int64_t chunkNumber = chunkStore_getChunkNumber(store);
+    stList *chunkFiles = stFile_getFileNamesInDirectory(chunksDir);
+    CuAssertIntEquals(testCase, stList_length(chunkFiles), chunkNumber);
+    stList_destruct(chunkFiles);
+    char *fastaPath = stFile_pathJoin(tempDir, "chunk.fa");
+    for (int64_t chunk = 0; chunk < chunkNumber; chunk++) {
+        FILE *fileHandle = fopen(fastaPath, "w");
+        chunkStore_writeChunkFasta(store, chunk, fileHandle);
+        fclose(fileHandle);
+        char *chunkFile = stString_print("%s/%" PRIi64, chunksDir, chunk);
+        int64_t length, expectedLength;
+        char *fasta = readFile(fastaPath, &length);
+        char *expectedFasta = readFile(chunkFile, &expectedLength);
+        CuAssertIntEquals(testCase, expectedLength, length);
+        CuAssertTrue(testCase, memcmp(expectedFasta, fasta, length) == 0);
+        free(fasta);
+        free(expectedFasta);
+        free(chunkFile);
+    }
+    chunkStore_destruct(store);
+    free(fastaPath);
+    free(chunksDir);
+    stList_destruct(sequences);
+    teardown();
+}
+
+/*
+ * Returns non-zero if reading the store at the path aborts, which is done in a child process as the abort exits.
+ */
+static bool readingStoreAborts(const char *path) {
+    fflush(NULL); // Else the child flushes the buffered output again when it exits
+    pid_t pid = fork();
+    if (pid < 0) {
+        st_errnoAbort("Failed to fork");
+    }
+    if (pid == 0) {
+        chunkStore_destruct(chunkStore_construct(path));
+        _exit(0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid) {
+        st_errnoAbort("Failed to wait for the child process");
+    }
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+static void testChunkStore_sizeValidation(CuTest *testCase) {
+    setup();
+
+    char *sequence = getRandomBases(100);
+    ChunkStoreWriter *writer = chunkStoreWriter_construct(storePath);
+    int64_t sequenceIndex = chunkStoreWriter_addSequence(writer, "sequence", sequence, 100);
+    chunkStoreWriter_addSlice(writer, sequenceIndex, 10, 50);
+    chunkStoreWriter_destruct(writer);
+    CuAssertTrue(testCase, !readingStoreAborts(storePath));
+
+    // A store missing the end of its names, or with a byte too many, does not have the size its header gives
+    struct stat fileStat;
+    CuAssertIntEquals(testCase, 0, stat(storePath, &fileStat));
+    int64_t length = fileStat.st_size;
+    CuAssertIntEquals(testCase, 0, truncate(storePath, length - 1));
+    CuAssertTrue(testCase, chunkStore_isChunkStore(storePath));
+    CuAssertTrue(testCase, readingStoreAborts(storePath));
+    CuAssertIntEquals(testCase, 0, truncate(storePath, length + 1));
+    CuAssertTrue(testCase, readingStoreAborts(storePath));
+
+    // As does one too short to hold the header
+    CuAssertIntEquals(testCase, 0, truncate(storePath, 5));
+    CuAssertTrue(testCase, readingStoreAborts(storePath));
+
+    free(sequence);
+    teardown();
+}
+
+CuSuite *chunkStoreTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testChunkStore_roundTrip);
+    SUITE_ADD_TEST(suite, testChunkStore_sameAsChunkFiles);
+    SUITE_ADD_TEST(suite, testChunkStore_sizeValidation);
+    return suite;
+}
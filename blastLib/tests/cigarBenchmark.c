@@ -0,0 +1,255 @@
+/*
+ * Benchmarks the throughput of reading and writing cigar files with the cigar codec (cigarCodec.h), against
+ * cigarRead and cigarWrite. Each method copies the same cigar file, which is either given or generated, seeded, to
+ * the requested size, and the copies are checked to be identical to that of cigarWrite. The results are reported as
+ * lines of CSV.
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+#include "cigarCodec.h"
+
+void usage() {
+    fprintf(stderr, "cactus_cigarBenchmark, version 0.1\n");
+    fprintf(stderr, "-a --logLevel : Set the log level\n");
+    fprintf(stderr, "-i --input : The cigar file to copy. If not given a file of --size bytes is generated\n");
+    fprintf(stderr, "-z --size : (int > 0) The size in bytes of the generated cigar file (default 4000000000)\n");
+    fprintf(stderr, "-s --seed : (int) The random seed used to generate the cigars (default 0)\n");
+    fprintf(stderr, "-t --tempDir : The directory to write the generated cigar file and the copies to (default /tmp)\n");
+    fprintf(stderr, "-h --help : Print this help screen\n");
+}
+
+static double getWallTime() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1.0e9;
+}
+
+/*
+ * Generates a cigar file of about size bytes, with alignments between a few hundred contigs.
+ */
+static void generateCigars(const char *path, int64_t size, int64_t seed) {
+    st_randomSeed(seed);
+    int64_t contigNumber = 500;
+    char **contigs = st_malloc(sizeof(char *) * contigNumber);
+    for (int64_t i = 0; i < contigNumber; i++) {
+        contigs[i] = stString_print("id=%" PRIi64 "|chr%" PRIi64 "", i % 4, i);
+    }
+    FILE *fileHandle = fopen(path, "w");
+    if (fileHandle == NULL) {
+        st_errnoAbort("Couldn't open %s", path);
+    }
+    CigarWriter *writer = cigarWriter_construct(fileHandle);
+    Cigar *cigar = cigar_construct();
+    while (ftello(fileHandle) < size) {
+        cigar->contig1 = contigs[st_randomInt(0, contigNumber)];
+        cigar->contig2 = contigs[st_randomInt(0, contigNumber)];
+        cigar->strand1 = st_random() < 0.5;
+        cigar->strand2 = st_random() < 0.5;
+        cigar->score = st_randomInt(0, 100000);
+        cigar->operationNumber = st_randomInt(1, 50);
+        if (cigar->operationNumber > cigar->maxOperationNumber) {
+            cigar->maxOperationNumber = cigar->operationNumber;
+            cigar->operations = st_realloc(cigar->operations, sizeof(CigarOperation) * cigar->maxOperationNumber);
+        }
+        int64_t length1 = 0, length2 = 0;
+        for (int64_t i = 0; i < cigar->operationNumber; i++) {
+            CigarOperation *op = &cigar->operations[i];
+            op->opType = i % 2 == 0 ? PAIRWISE_MATCH : (st_random() < 0.5 ? PAIRWISE_INDEL_X : PAIRWISE_INDEL_Y);
+            op->length = st_randomInt(1, op->opType == PAIRWISE_MATCH ? 1000 : 20);
+            op->score = 0.0;
+            length1 += op->opType != PAIRWISE_INDEL_Y ? op->length : 0;
+            length2 += op->opType != PAIRWISE_INDEL_X ? op->length : 0;
+        }
+        int64_t start1 = st_randomInt(0, 100000000), start2 = st_randomInt(0, 100000000);
+        cigar->start1 = cigar->strand1 ? start1 : start1 + length1;
+        cigar->end1 = cigar->strand1 ? start1 + length1 : start1;
+        cigar->start2 = cigar->strand2 ? start2 : start2 + length2;
+        cigar->end2 = cigar->strand2 ? start2 + length2 : start2;
+        cigarWriter_write(writer, cigar, 0);
+        cigarWriter_flush(writer); // So the size of the file is known
+    }
+    cigarWriter_destruct(writer);
+    cigar_destruct(cigar);
+    fclose(fileHandle);
+    for (int64_t i = 0; i < contigNumber; i++) {
+        free(contigs[i]);
+    }
+    free(contigs);
+}
+
+/*
+ * The methods of copying the cigar file, each returning the number of cigars copied.
+ */
+
+static int64_t copyWithCigarRead(FILE *in, FILE *out) {
+    int64_t cigarNumber = 0;
+    struct PairwiseAlignment *pairwiseAlignment;
+    while ((pairwiseAlignment = cigarRead(in)) != NULL) {
+        cigarWrite(out, pairwiseAlignment, 0);
+        destructPairwiseAlignment(pairwiseAlignment);
+        cigarNumber++;
+    }
+    return cigarNumber;
+}
+
+static int64_t copyWithCigarCodec(FILE *in, FILE *out) {
+    int64_t cigarNumber = 0;
+    CigarReader *reader = cigarReader_construct(in);
+    CigarWriter *writer = cigarWriter_construct(out);
+    Cigar *cigar = cigar_construct();
+    while (cigarReader_read(reader, cigar)) {
+        cigarWriter_write(writer, cigar, 0);
+        cigarNumber++;
+    }
+    cigar_destruct(cigar);
+    cigarWriter_destruct(writer);
+    cigarReader_destruct(reader);
+    return cigarNumber;
+}
+
+static int64_t copyWithCigarCodecPairwiseAlignments(FILE *in, FILE *out) {
+    int64_t cigarNumber = 0;
+    CigarReader *reader = cigarReader_construct(in);
+    CigarWriter *writer = cigarWriter_construct(out);
+    struct PairwiseAlignment *pairwiseAlignment;
+    while ((pairwiseAlignment = cigarReader_readPairwiseAlignment(reader)) != NULL) {
+        cigarWriter_writePairwiseAlignment(writer, pairwiseAlignment, 0);
+        destructPairwiseAlignment(pairwiseAlignment);
+        cigarNumber++;
+    }
+    cigarWriter_destruct(writer);
+    cigarReader_destruct(reader);
+    return cigarNumber;
+}
+
+static bool filesAreIdentical(const char *path1, const char *path2) {
+    FILE *fileHandle1 = fopen(path1, "r"), *fileHandle2 = fopen(path2, "r");
+    if (fileHandle1 == NULL || fileHandle2 == NULL) {
+        st_errnoAbort("Couldn't open %s or %s", path1, path2);
+    }
+    int64_t bufferSize = 1 << 20;
+    char *buffer1 = st_malloc(bufferSize), *buffer2 = st_malloc(bufferSize);
+    bool identical = true;
+    size_t i;
+    do {
+        i = fread(buffer1, 1, bufferSize, fileHandle1);
+        identical = fread(buffer2, 1, bufferSize, fileHandle2) == i && memcmp(buffer1, buffer2, i) == 0;
+    } while (identical && i > 0);
+    free(buffer1);
+    free(buffer2);
+    fclose(fileHandle1);
+    fclose(fileHandle2);
+    return identical;
+}
+
+/*
+ * Copies the input with the method, reporting the throughput and whether the copy is the same as the reference copy,
+ * if given.
+ */
+static void benchmark(const char *methodName, int64_t (*copy)(FILE *, FILE *), const char *inputPath,
+                      const char *outputPath, const char *referencePath) {
+    FILE *in = fopen(inputPath, "r"), *out = fopen(outputPath, "w");
+    if (in == NULL || out == NULL) {
+        st_errnoAbort("Couldn't open %s or %s", inputPath, outputPath);
+    }
+    fseeko(in, 0, SEEK_END);
+    int64_t inputBytes = ftello(in);
+    fseeko(in, 0, SEEK_SET);
+    double t = getWallTime();
+    int64_t cigarNumber = copy(in, out);
+    fclose(out);
+    double wallTime = getWallTime() - t;
+    fclose(in);
+    printf("%s,%" PRIi64 ",%" PRIi64 ",%f,%f,%s\n", methodName, inputBytes, cigarNumber, wallTime,
+           inputBytes / 1.0e6 / wallTime,
+           referencePath == NULL ? "" : (filesAreIdentical(outputPath, referencePath) ? "true" : "false"));
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    char *logLevelString = NULL;
+    char *inputPath = NULL;
+    char *tempDir = "/tmp";
+    int64_t size = 4000000000, seed = 0;
+
+    /*
+     * Parse the options.
+     */
+    while (1) {
+        static struct option long_options[] = { { "logLevel", required_argument, 0, 'a' },
+                                                { "input", required_argument, 0, 'i' },
+                                                { "size", required_argument, 0, 'z' },
+                                                { "seed", required_argument, 0, 's' },
+                                                { "tempDir", required_argument, 0, 't' },
+                                                { "help", no_argument, 0, 'h' },
+                                                { 0, 0, 0, 0 } };
+        int option_index = 0;
+        int key = getopt_long(argc, argv, "a:i:z:s:t:h", long_options, &option_index);
+        if (key == -1) {
+            break;
+        }
+        switch (key) {
+            case 'a':
+                logLevelString = optarg;
+                st_setLogLevelFromString(logLevelString);
+                break;
+            case 'i':
+                inputPath = optarg;
+                break;
+            case 'z':
+                if (sscanf(optarg, "%" PRIi64 "", &size) != 1 || size <= 0) {
+                    st_errAbort("Invalid size %s", optarg);
+                }
+                break;
+            case 's':
+                if (sscanf(optarg, "%" PRIi64 "", &seed) != 1) {
+                    st_errAbort("Invalid seed %s", optarg);
+                }
+                break;
+            case 't':
+                tempDir = optarg;
+                break;
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    char *generatedPath = NULL;
+    if (inputPath == NULL) {
+        generatedPath = stString_print("%s/cactus_cigarBenchmark_%i.cigar", tempDir, (int)getpid());
+        generateCigars(generatedPath, size, seed);
+        inputPath = generatedPath;
+    }
+    char *referencePath = stString_print("%s/cactus_cigarBenchmark_%i.reference", tempDir, (int)getpid());
+    char *outputPath = stString_print("%s/cactus_cigarBenchmark_%i.copy", tempDir, (int)getpid());
+
+    printf("method,inputBytes,cigars,wallSeconds,megabytesPerSecond,identical\n");
+    benchmark("cigarRead", copyWithCigarRead, inputPath, referencePath, NULL);
+    benchmark("cigarCodec", copyWithCigarCodec, inputPath, outputPath, referencePath);
+    benchmark("cigarCodecPairwiseAlignments", copyWithCigarCodecPairwiseAlignments, inputPath, outputPath,
+              referencePath);
+
+    unlink(referencePath);
+    unlink(outputPath);
+    if (generatedPath != NULL) {
+        unlink(generatedPath);
+        free(generatedPath);
+    }
+    free(referencePath);
+    free(outputPath);
+    return 0;
+}
@@ -112,6 +112,18 @@ static int64_t *getInts(const char *string, int64_t *arrayLength) {
     return iA;
 }
 
+/*
+ * Alignment files are parsed on a separate thread while the pinches are being annealed, see
+ * stPinchIterator_constructPipelined.
+ */
+#define PINCH_ITERATOR_BATCH_SIZE 4096
+#define PINCH_ITERATOR_BATCH_NUMBER 8
+
+static stPinchIterator *constructPinchIteratorFromFile(const char *alignmentFile) {
+    return stPinchIterator_constructPipelined(stPinchIterator_constructFromFile(alignmentFile),
+            PINCH_ITERATOR_BATCH_SIZE, PINCH_ITERATOR_BATCH_NUMBER);
+}
+
 static int64_t minimumIngroupDegree = 0, minimumOutgroupDegree = 0, minimumDegree = 0, minimumNumberOfSpecies = 0;
 static float minimumTreeCoverage = 0.0;
 static Flower *flower = NULL;
@@ -764,7 +776,7 @@ int main(int argc, char *argv[]) {
 
     stPinchIterator *pinchIteratorForConstraints = NULL;
     if (constraintsFile != NULL) {
-        pinchIteratorForConstraints = stPinchIterator_constructFromFile(constraintsFile);
+        pinchIteratorForConstraints = constructPinchIteratorFromFile(constraintsFile);
         st_logInfo("Created an iterator for the alignment constaints from file: %s\n", constraintsFile);
     }
 
@@ -813,18 +825,18 @@ int main(int argc, char *argv[]) {
                 if (sortAlignments) {
                     tempFile1 = getTempFile();
                     stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, tempFile1);
-                    pinchIterator = stPinchIterator_constructFromFile(tempFile1);
+                    pinchIterator = constructPinchIteratorFromFile(tempFile1);
                 } else {
-                    pinchIterator = stPinchIterator_constructFromFile(alignmentsFile);
+                    pinchIterator = constructPinchIteratorFromFile(alignmentsFile);
                 }
 
                 if(secondaryAlignmentsFile != NULL) {
                     if (sortSecondaryAlignments) {
                         tempFile2 = getTempFile();
                         stCaf_sortCigarsFileByScoreInDescendingOrder(secondaryAlignmentsFile, tempFile2);
-                        secondaryPinchIterator = stPinchIterator_constructFromFile(tempFile2);
+                        secondaryPinchIterator = constructPinchIteratorFromFile(tempFile2);
                     } else {
-                        secondaryPinchIterator = stPinchIterator_constructFromFile(secondaryAlignmentsFile);
+                        secondaryPinchIterator = constructPinchIteratorFromFile(secondaryAlignmentsFile);
                     }
                 }
 
@@ -998,7 +1010,7 @@ int main(int argc, char *argv[]) {
             stPinchThreadSet_destruct(threadSet);
             stPinchIterator_destruct(pinchIterator);
             if(secondaryPinchIterator != NULL) {
-            	free(secondaryPinchIterator);
+            	stPinchIterator_destruct(secondaryPinchIterator);
             }
             stSet_destruct(outgroupThreads);
 
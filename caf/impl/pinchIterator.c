@@ -6,6 +6,7 @@
  */
 
 #include <stdlib.h>
+#include <pthread.h>
 #include "sonLib.h"
 #include "stPinchGraphs.h"
 #include "stPinchIterator.h"
@@ -173,3 +174,159 @@ stPinchIterator *stPinchIterator_constructFromAlignedPairs(stSortedSet *alignedP
 void stPinchIterator_setTrim(stPinchIterator *pinchIterator, int64_t alignmentTrim) {
     pinchIterator->alignmentTrim = alignmentTrim;
 }
+
+/*
+ * Pipelined iterator. A single producer thread pulls pinches out of the wrapped iterator (which is where
+ * the cigar parsing and name conversion happen) and copies them into a ring of fixed size batches.
+ * The consumer, the annealing thread, takes whole batches off the ring. A batch shorter than batchSize
+ * marks the end of the alignments. The wrapped iterators are inherently sequential (a file stream or
+ * a list iterator), so there is only ever one producer.
+ */
+
+typedef struct _pipelinedPinchIterator {
+    stPinchIterator *pinchIterator; // The wrapped iterator
+    int64_t batchSize, batchNumber;
+    stPinch *pinches; // batchNumber * batchSize pinches
+    int64_t *batchLengths;
+    int64_t head, tail, filledBatches; // Ring buffer state, protected by mutex
+    bool stop; // Set by the consumer to ask the producer to exit early
+    bool running; // Is the producer thread running (or finished but not yet joined)
+    bool finished; // Has the consumer seen the last batch
+    stPinch *currentBatch; // Batch being read by the consumer, still counted in filledBatches
+    int64_t currentBatchLength, currentIndex;
+    pthread_t producer;
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty, notFull;
+} PipelinedPinchIterator;
+
+static void *pipelinedPinchIterator_produce(void *arg) {
+    PipelinedPinchIterator *pP = arg;
+    stPinchIterator *pinchIterator = pP->pinchIterator;
+    while (1) {
+        pthread_mutex_lock(&pP->mutex);
+        while (pP->filledBatches == pP->batchNumber && !pP->stop) {
+            pthread_cond_wait(&pP->notFull, &pP->mutex);
+        }
+        if (pP->stop) {
+            pthread_mutex_unlock(&pP->mutex);
+            return NULL;
+        }
+        int64_t batch = pP->tail;
+        pthread_mutex_unlock(&pP->mutex);
+
+        // Fill the batch outside of the lock, this is where the parse cost is hidden
+        stPinch *pinches = pP->pinches + batch * pP->batchSize;
+        int64_t length = 0;
+        stPinch *pinch;
+        while (length < pP->batchSize && (pinch = pinchIterator->getNextAlignment(pinchIterator->alignmentArg)) != NULL) {
+            pinches[length++] = *pinch;
+        }
+
+        pthread_mutex_lock(&pP->mutex);
+        pP->batchLengths[batch] = length;
+        pP->tail = (pP->tail + 1) % pP->batchNumber;
+        pP->filledBatches++;
+        pthread_cond_signal(&pP->notEmpty);
+        pthread_mutex_unlock(&pP->mutex);
+        if (length < pP->batchSize) { // Was the last batch
+            return NULL;
+        }
+    }
+}
+
+static void pipelinedPinchIterator_stopProducer(PipelinedPinchIterator *pP) {
+    if (pP->running) {
+        pthread_mutex_lock(&pP->mutex);
+        pP->stop = 1;
+        pthread_cond_signal(&pP->notFull);
+        pthread_mutex_unlock(&pP->mutex);
+        pthread_join(pP->producer, NULL);
+        pP->running = 0;
+    }
+    pP->stop = 0;
+    pP->head = 0;
+    pP->tail = 0;
+    pP->filledBatches = 0;
+    pP->currentBatch = NULL;
+}
+
+static void pipelinedPinchIterator_releaseBatch(PipelinedPinchIterator *pP) {
+    pthread_mutex_lock(&pP->mutex);
+    pP->head = (pP->head + 1) % pP->batchNumber;
+    pP->filledBatches--;
+    pthread_cond_signal(&pP->notFull);
+    pthread_mutex_unlock(&pP->mutex);
+    pP->currentBatch = NULL;
+}
+
+static stPinch *pipelinedPinchIterator_getNext(PipelinedPinchIterator *pP) {
+    while (1) {
+        if (pP->currentBatch != NULL) {
+            if (pP->currentIndex < pP->currentBatchLength) {
+                return &pP->currentBatch[pP->currentIndex++];
+            }
+            pipelinedPinchIterator_releaseBatch(pP);
+            if (pP->currentBatchLength < pP->batchSize) { // That was the last batch
+                pP->finished = 1;
+                pipelinedPinchIterator_stopProducer(pP); // Joins the producer, which has already exited
+            }
+        }
+        if (pP->finished) {
+            return NULL;
+        }
+        if (!pP->running) {
+            if (pthread_create(&pP->producer, NULL, pipelinedPinchIterator_produce, pP) != 0) {
+                st_errnoAbort("Failed to start the pinch iterator producer thread");
+            }
+            pP->running = 1;
+        }
+        pthread_mutex_lock(&pP->mutex);
+        while (pP->filledBatches == 0) {
+            pthread_cond_wait(&pP->notEmpty, &pP->mutex);
+        }
+        pP->currentBatch = pP->pinches + pP->head * pP->batchSize;
+        pP->currentBatchLength = pP->batchLengths[pP->head];
+        pthread_mutex_unlock(&pP->mutex);
+        pP->currentIndex = 0;
+    }
+}
+
+static PipelinedPinchIterator *pipelinedPinchIterator_reset(PipelinedPinchIterator *pP) {
+    pipelinedPinchIterator_stopProducer(pP);
+    pP->finished = 0;
+    stPinchIterator_reset(pP->pinchIterator);
+    return pP;
+}
+
+static void pipelinedPinchIterator_destruct(PipelinedPinchIterator *pP) {
+    pipelinedPinchIterator_stopProducer(pP);
+    stPinchIterator_destruct(pP->pinchIterator);
+    pthread_mutex_destroy(&pP->mutex);
+    pthread_cond_destroy(&pP->notEmpty);
+    pthread_cond_destroy(&pP->notFull);
+    free(pP->pinches);
+    free(pP->batchLengths);
+    free(pP);
+}
+
+stPinchIterator *stPinchIterator_constructPipelined(stPinchIterator *pinchIterator,
+        int64_t batchSize, int64_t batchNumber) {
+    assert(batchSize > 0);
+    assert(batchNumber > 0);
+    PipelinedPinchIterator *pP = st_calloc(1, sizeof(PipelinedPinchIterator));
+    pP->pinchIterator = pinchIterator;
+    pP->batchSize = batchSize;
+    pP->batchNumber = batchNumber;
+    pP->pinches = st_malloc(sizeof(stPinch) * batchSize * batchNumber);
+    pP->batchLengths = st_calloc(batchNumber, sizeof(int64_t));
+    pthread_mutex_init(&pP->mutex, NULL);
+    pthread_cond_init(&pP->notEmpty, NULL);
+    pthread_cond_init(&pP->notFull, NULL);
+
+    stPinchIterator *pipelinedIterator = st_calloc(1, sizeof(stPinchIterator));
+    pipelinedIterator->alignmentArg = pP;
+    pipelinedIterator->getNextAlignment = (stPinch *(*)(void *)) pipelinedPinchIterator_getNext;
+    pipelinedIterator->destructAlignmentArg = (void(*)(void *)) pipelinedPinchIterator_destruct;
+    pipelinedIterator->startAlignmentStack = (void *(*)(void *)) pipelinedPinchIterator_reset;
+    return pipelinedIterator;
+}
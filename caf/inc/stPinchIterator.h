@@ -61,4 +61,17 @@ stPinchIterator *stPinchIterator_constructFromAlignedPairs(
  */
 void stPinchIterator_setTrim(stPinchIterator *pinchIterator, int64_t alignmentTrim);
 
+/*
+ * Wraps an iterator so that its alignments are parsed on a separate producer thread, which
+ * fills a bounded ring of batchNumber batches of batchSize pinches. The consumer reads the pinches
+ * back in exactly the order the wrapped iterator would have returned them, so annealing is unchanged.
+ * Works with the iterator returned by any of the constructors above.
+ *
+ * Takes ownership of the wrapped iterator, which is destroyed along with the returned iterator.
+ * The trim of the wrapped iterator is ignored: set the trim on the returned iterator instead.
+ * The pinches returned are valid until the next call to stPinchIterator_getNext.
+ */
+stPinchIterator *stPinchIterator_constructPipelined(stPinchIterator *pinchIterator,
+        int64_t batchSize, int64_t batchNumber);
+
 #endif /* ST_PINCH_ITERATOR_H_ */
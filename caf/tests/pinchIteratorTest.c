@@ -120,9 +120,41 @@ static void testPinchIteratorFromList(CuTest *testCase) {
     }
 }
 
+static void testPipelinedPinchIterator(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random pipelined pinch iterator test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Small batches so that the ring buffer wraps around and the producer has to wait
+        int64_t batchSize = st_randomInt(1, 5);
+        int64_t batchNumber = st_randomInt(1, 4);
+        //From a list
+        stPinchIterator *pinchIterator = stPinchIterator_constructPipelined(
+                stPinchIterator_constructFromList(pairwiseAlignments), batchSize, batchNumber);
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        stPinchIterator_destruct(pinchIterator);
+        //From a file
+        char *tempFile = "tempFileForPinchIteratorTest.cig";
+        FILE *fileHandle = fopen(tempFile, "w");
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            cigarWrite(fileHandle, stList_get(pairwiseAlignments, i), 0);
+        }
+        fclose(fileHandle);
+        pinchIterator = stPinchIterator_constructPipelined(stPinchIterator_constructFromFile(tempFile), batchSize, batchNumber);
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Reset part way through, to check the producer is stopped cleanly
+        stPinchIterator_getNext(pinchIterator);
+        stPinchIterator_reset(pinchIterator);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmtree(tempFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
 CuSuite* pinchIteratorTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testPinchIteratorFromFile);
     SUITE_ADD_TEST(suite, testPinchIteratorFromList);
+    SUITE_ADD_TEST(suite, testPipelinedPinchIterator);
     return suite;
 }
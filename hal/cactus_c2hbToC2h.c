@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cactus.h"
+#include "sonLib.h"
+#include "c2hb.h"
+
+/*
+ * Decodes the binary .c2hb alignment written by cactus_halGenerator into the .c2h text that cactus2hal reads.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "cactus_c2hbToC2h inputFile.c2hb outputFile.c2h\n");
+        return 1;
+    }
+    FILE *fileHandleIn = fopen(argv[1], "rb");
+    if (fileHandleIn == NULL) {
+        st_errnoAbort("Failed to open input file %s", argv[1]);
+    }
+    FILE *fileHandleOut = fopen(argv[2], "w");
+    if (fileHandleOut == NULL) {
+        st_errnoAbort("Failed to open output file %s", argv[2]);
+    }
+    c2hb_convertToC2h(fileHandleIn, fileHandleOut);
+    fclose(fileHandleIn);
+    if (fclose(fileHandleOut) != 0) {
+        st_errnoAbort("Failed to write output file %s", argv[2]);
+    }
+    return 0;
+}
@@ -11,6 +11,9 @@
 #include <stdlib.h>
 #include <time.h>
 #include <getopt.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 #include "cactus.h"
 #include "sonLib.h"
@@ -28,9 +31,17 @@ void usage() {
     fprintf(
             stderr,
             "-l --showOnlySubstitutionsWithRespectToReference : Put stars in place of characters that are identical to the reference.\n");
+    fprintf(stderr, "-t --text : Build the alignment as the .c2h text rather than the binary .c2hb, for debugging. Must be given for every flower of a run\n");
+    fprintf(stderr, "-T --threads : Number of threads to build the alignments of the flowers on, integer >= 1. Default=1\n");
     fprintf(stderr, "-h --help : Print this help screen\n");
 }
 
+static Name getReferenceEventName(Flower *flower, char *referenceEventString) {
+    Event *referenceEvent = eventTree_getEventByHeader(flower_getEventTree(flower), referenceEventString);
+    assert(referenceEvent != NULL);
+    return event_getName(referenceEvent);
+}
+
 int main(int argc, char *argv[]) {
     /*
      * Script for adding a reference genome to a flower.
@@ -45,6 +56,8 @@ int main(int argc, char *argv[]) {
     char *referenceEventString =
             (char *) cactusMisc_getDefaultReferenceEventHeader();
     char *outputFile = NULL;
+    bool binary = 1;
+    int64_t numThreads = 1;
 
     ///////////////////////////////////////////////////////////////////////////
     // (0) Parse the inputs handed by genomeCactus.py / setup stuff.
@@ -58,12 +71,13 @@ int main(int argc, char *argv[]) {
                         "help", no_argument, 0, 'h' }, { "outputFile",
                         required_argument, 0, 'k' }, {
                         "showOnlySubstitutionsWithRespectToReference",
-                        no_argument, 0, 'l' },
+                        no_argument, 0, 'l' }, { "text", no_argument, 0, 't' },
+                { "threads", required_argument, 0, 'T' },
                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "a:c:d:e:g:hk:l", long_options,
+        int key = getopt_long(argc, argv, "a:c:d:e:g:hk:ltT:", long_options,
                 &option_index);
 
         if (key == -1) {
@@ -89,6 +103,17 @@ int main(int argc, char *argv[]) {
             case 'k':
                 outputFile = stString_copy(optarg);
                 break;
+            case 't':
+                binary = 0;
+                break;
+            case 'T': {
+                int64_t j = sscanf(optarg, "%" PRIi64 "", &numThreads);
+                assert(j == 1);
+                if (numThreads < 1) {
+                    stThrowNew("RUNTIME_ERROR", "Threads is not valid %" PRIi64 "", numThreads);
+                }
+                break;
+            }
             default:
                 usage();
                 return 1;
@@ -106,6 +131,9 @@ int main(int argc, char *argv[]) {
     //////////////////////////////////////////////
 
     st_setLogLevelFromString(logLevelString);
+#if defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
 
     //////////////////////////////////////////////
     //Load the database
@@ -128,37 +156,44 @@ int main(int argc, char *argv[]) {
     st_logInfo("Set up the secondary database\n");
 
     FlowerStream *flowerStream = flowerWriter_getFlowerStream(cactusDisk, stdin);
-    if (outputFile != NULL && flowerStream_size(flowerStream) != 1) {
-        stThrowNew("RUNTIME_ERROR",
-                   "Output file specified, but there is more than one flower\n");
-    }
-    Flower *flower;
-    while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
+    if (outputFile != NULL) {
+        if (flowerStream_size(flowerStream) != 1) {
+            stThrowNew("RUNTIME_ERROR",
+                       "Output file specified, but there is more than one flower\n");
+        }
+        Flower *flower = flowerStream_getNext(flowerStream);
+        FILE *fileHandle = fopen(outputFile, "w");
+        makeHalFormat(flower, sequenceDatabase, getReferenceEventName(flower, referenceEventString), binary,
+                      fileHandle);
+        fclose(fileHandle);
+    } else {
         ///////////////////////////////////////////////////////////////////////////
-        // Get the reference event name
+        // Build the threads of the flowers of each batch in parallel, storing
+        // them in the secondary database in order as they are finished.
         ///////////////////////////////////////////////////////////////////////////
 
-        Event *referenceEvent = eventTree_getEventByHeader(
-            flower_getEventTree(flower), referenceEventString);
-        assert(referenceEvent != NULL);
-        Name referenceEventName = event_getName(referenceEvent);
-
-        ///////////////////////////////////////////////////////////////////////////
-        // Now process each flower in turn.
-        ///////////////////////////////////////////////////////////////////////////
-        FILE *fileHandle = NULL;
-        if(outputFile != NULL) {
-            fileHandle = fopen(outputFile, "w");
+        stList *flowers;
+        while ((flowers = flowerStream_getNextBatch(flowerStream)) != NULL) {
+            int64_t flowerNumber = stList_length(flowers);
+#if defined(_OPENMP)
+#pragma omp parallel for ordered schedule(dynamic, 1) if(flowerNumber > 1)
+#endif
+            for (int64_t i = 0; i < flowerNumber; i++) {
+                Flower *flower = stList_get(flowers, i);
+                RecursiveThreads *recursiveThreads = getHalFormatThreads(flower,
+                        getReferenceEventName(flower, referenceEventString), binary);
+#if defined(_OPENMP)
+#pragma omp ordered
+#endif
+                {
+                    storeRecursiveThreads(sequenceDatabase, recursiveThreads);
+                }
+            }
         }
-        makeHalFormat(flower, sequenceDatabase, referenceEventName, fileHandle);
-        if(fileHandle != NULL) {
-            fclose(fileHandle);
-        }
-
-        // We aren't making any changes to the flower itself, only to
-        // the secondary database. So there's no need to save the
-        // flower here.
     }
+    // We aren't making any changes to the flowers themselves, only to
+    // the secondary database. So there's no need to save them here.
+    flowerStream_destruct(flowerStream);
 
     ///////////////////////////////////////////////////////////////////////////
     //Clean up memory
@@ -0,0 +1,214 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cactus.h"
+#include "sonLib.h"
+#include "c2hb.h"
+
+/*
+ * See hal.c for the layout of a .c2hb file.
+ */
+
+#define C2HB_MAX_RECORD_FIELDS 4
+
+static int64_t encodeVarint(char *buffer, int64_t value) {
+    assert(value >= 0);
+    uint64_t i = (uint64_t) value + 1;
+    int64_t length = 0;
+    while (i >= 0x80) {
+        buffer[length++] = (char) ((i & 0x7F) | 0x80);
+        i >>= 7;
+    }
+    buffer[length++] = (char) i;
+    return length;
+}
+
+static char *encodeRecord(char type, int64_t *fields, int64_t fieldNumber) {
+    assert(fieldNumber <= C2HB_MAX_RECORD_FIELDS);
+    char *record = st_malloc(1 + C2HB_MAX_RECORD_FIELDS * 10 + 1);
+    int64_t length = 0;
+    record[length++] = type;
+    for (int64_t i = 0; i < fieldNumber; i++) {
+        length += encodeVarint(record + length, fields[i]);
+    }
+    record[length] = '\0';
+    return record;
+}
+
+char *c2hb_bottomSegment(Name segmentName, int64_t start, int64_t length) {
+    int64_t fields[] = { segmentName, start, length };
+    return encodeRecord('b', fields, 3);
+}
+
+char *c2hb_topSegment(int64_t start, int64_t length, Name parentSegmentName, bool orientation) {
+    int64_t fields[] = { start, length, parentSegmentName, orientation };
+    return encodeRecord('t', fields, 4);
+}
+
+char *c2hb_unalignedTopSegment(int64_t start, int64_t length) {
+    int64_t fields[] = { start, length };
+    return encodeRecord('i', fields, 2);
+}
+
+static void writeBytes(FILE *fileHandle, const char *bytes, int64_t length) {
+    if (fwrite(bytes, sizeof(char), length, fileHandle) != (size_t) length) {
+        st_errnoAbort("Failed to write .c2hb file");
+    }
+}
+
+static void writeVarint(FILE *fileHandle, int64_t value) {
+    char buffer[10];
+    writeBytes(fileHandle, buffer, encodeVarint(buffer, value));
+}
+
+static void writeString(FILE *fileHandle, const char *string) {
+    writeBytes(fileHandle, string, strlen(string) + 1);
+}
+
+void c2hb_writeHeader(FILE *fileHandle, stList *eventHeaders, C2hbSequence *sequences, int64_t sequenceNumber) {
+    writeBytes(fileHandle, "c2hb", 4);
+    writeVarint(fileHandle, C2HB_VERSION);
+    writeVarint(fileHandle, stList_length(eventHeaders));
+    for (int64_t i = 0; i < stList_length(eventHeaders); i++) {
+        writeString(fileHandle, stList_get(eventHeaders, i));
+    }
+    writeVarint(fileHandle, sequenceNumber);
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        assert(sequences[i].eventIndex < stList_length(eventHeaders));
+        writeVarint(fileHandle, sequences[i].eventIndex);
+        writeString(fileHandle, sequences[i].header);
+        writeVarint(fileHandle, sequences[i].isBottom);
+    }
+}
+
+void c2hb_writeThreadHeader(FILE *fileHandle, int64_t sequenceIndex) {
+    writeBytes(fileHandle, "s", 1);
+    writeVarint(fileHandle, sequenceIndex);
+}
+
+/*
+ * Decoding.
+ */
+
+static int readByte(FILE *fileHandle) {
+    int c = getc(fileHandle);
+    if (c == EOF) {
+        if (ferror(fileHandle)) {
+            st_errnoAbort("Failed to read .c2hb file");
+        }
+        st_errAbort("Truncated .c2hb file");
+    }
+    return c;
+}
+
+static int64_t readVarint(FILE *fileHandle) {
+    uint64_t i = 0;
+    int64_t shift = 0;
+    int c;
+    do {
+        c = readByte(fileHandle);
+        if (shift > 63) {
+            st_errAbort("Malformed integer in .c2hb file");
+        }
+        i |= (uint64_t) (c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    if (i == 0 || i - 1 > INT64_MAX) {
+        st_errAbort("Malformed integer in .c2hb file");
+    }
+    return (int64_t) (i - 1);
+}
+
+static char *readString(FILE *fileHandle) {
+    int64_t length = 0, maxLength = 64;
+    char *string = st_malloc(maxLength);
+    int c;
+    while ((c = readByte(fileHandle)) != '\0') {
+        if (length + 1 == maxLength) {
+            maxLength *= 2;
+            string = st_realloc(string, maxLength);
+        }
+        string[length++] = (char) c;
+    }
+    string[length] = '\0';
+    return string;
+}
+
+void c2hb_convertToC2h(FILE *fileHandleIn, FILE *fileHandleOut) {
+    char magic[4];
+    if (fread(magic, sizeof(char), 4, fileHandleIn) != 4 || memcmp(magic, "c2hb", 4) != 0) {
+        st_errAbort("Not a .c2hb file");
+    }
+    int64_t version = readVarint(fileHandleIn);
+    if (version != C2HB_VERSION) {
+        st_errAbort("Unsupported .c2hb version %" PRIi64 ", expected %i", version, C2HB_VERSION);
+    }
+
+    // The dictionaries
+    stList *eventHeaders = stList_construct3(0, free);
+    int64_t eventNumber = readVarint(fileHandleIn);
+    for (int64_t i = 0; i < eventNumber; i++) {
+        stList_append(eventHeaders, readString(fileHandleIn));
+    }
+    int64_t sequenceNumber = readVarint(fileHandleIn);
+    stList *sequenceLines = stList_construct3(0, free); // The "s" line of each sequence
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        int64_t eventIndex = readVarint(fileHandleIn);
+        if (eventIndex >= eventNumber) {
+            st_errAbort("Event index %" PRIi64 " out of range in .c2hb file", eventIndex);
+        }
+        char *header = readString(fileHandleIn);
+        int64_t isBottom = readVarint(fileHandleIn);
+        stList_append(sequenceLines, stString_print("s\t'%s'\t'%s'\t%i\n", (char *) stList_get(eventHeaders, eventIndex),
+                header, (int) isBottom));
+        free(header);
+    }
+
+    // The threads
+    int c;
+    while ((c = getc(fileHandleIn)) != EOF) {
+        if (c != 's') {
+            st_errAbort("Expected the start of a sequence in .c2hb file, got byte %i", c);
+        }
+        int64_t sequenceIndex = readVarint(fileHandleIn);
+        if (sequenceIndex >= sequenceNumber) {
+            st_errAbort("Sequence index %" PRIi64 " out of range in .c2hb file", sequenceIndex);
+        }
+        fputs(stList_get(sequenceLines, sequenceIndex), fileHandleOut);
+        while ((c = readByte(fileHandleIn)) != '\n') {
+            int64_t fields[C2HB_MAX_RECORD_FIELDS];
+            switch (c) {
+            case 'b':
+                for (int64_t i = 0; i < 3; i++) {
+                    fields[i] = readVarint(fileHandleIn);
+                }
+                fprintf(fileHandleOut, "a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", fields[0], fields[1], fields[2]);
+                break;
+            case 't':
+                for (int64_t i = 0; i < 4; i++) {
+                    fields[i] = readVarint(fileHandleIn);
+                }
+                fprintf(fileHandleOut, "a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", fields[0], fields[1],
+                        fields[2], fields[3]);
+                break;
+            case 'i':
+                for (int64_t i = 0; i < 2; i++) {
+                    fields[i] = readVarint(fileHandleIn);
+                }
+                fprintf(fileHandleOut, "a\t%" PRIi64 "\t%" PRIi64 "\n", fields[0], fields[1]);
+                break;
+            default:
+                st_errAbort("Unknown record type %i in .c2hb file", c);
+            }
+        }
+        fputc('\n', fileHandleOut);
+    }
+    if (ferror(fileHandleIn)) {
+        st_errnoAbort("Failed to read .c2hb file");
+    }
+    stList_destruct(sequenceLines);
+    stList_destruct(eventHeaders);
+}
@@ -7,8 +7,7 @@
 #include "cactus.h"
 #include "sonLib.h"
 #include "recursiveThreadBuilder.h"
-
-static Name globalReferenceEventName;
+#include "c2hb.h"
 
 /*
  * Hal encodes a hierarchical alignment format.
@@ -75,20 +74,74 @@ static Name globalReferenceEventName;
  * alignmentOrientation :
  *      0
  *      1
+ *
+ * The binary form, .c2hb, holds the same alignment more compactly, and is decoded back into the .c2h text by
+ * c2hb_convertToC2h. Every integer in it is an unsigned LEB128 varint of the value plus one, so no byte of a record
+ * is zero and the records can be built into threads as strings.
+ *
+ * c2hb :
+ *      "c2hb" version eventNumber eventHeaders sequenceNumber sequenceEntries sequences
+ *
+ * #The event and sequence dictionaries, each string being terminated by a zero byte
+ * sequenceEntry :
+ *      eventIndex sequenceHeader isBottom
+ *
+ * sequence :
+ *      's' sequenceIndex records '\n'
+ *
+ * #Each record is a type byte followed by a fixed number of integers
+ * record :
+ *      'b' segmentName start length     #A bottom segment
+ *      't' start length parentSegment alignmentOrientation     #A top segment with a parent
+ *      'i' start length     #A top segment without a parent, e.g. an insertion
+ */
+
+/*
+ * The writers below are passed the form being written as their extraArg, rather than keeping it in statics, so the
+ * threads of different flowers can be written in parallel.
  */
+typedef struct _halFormat {
+    Name referenceEventName;
+    bool binary;
+    stHash *sequenceIndices; // When writing a .c2hb file, the index of each sequence in its dictionary
+} HalFormat;
 
-static void writeSequenceHeader(FILE *fileHandle, Sequence *sequence) {
+static char *writeBottomSegment(HalFormat *format, Name segmentName, int64_t start, int64_t length) {
+    if (format->binary) {
+        return c2hb_bottomSegment(segmentName, start, length);
+    }
+    return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", segmentName, start, length);
+}
+
+static char *writeTopSegment(HalFormat *format, int64_t start, int64_t length, Name parentSegmentName,
+        bool orientation) {
+    if (format->binary) {
+        return c2hb_topSegment(start, length, parentSegmentName, orientation);
+    }
+    return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", start, length,
+            parentSegmentName, (int64_t) orientation);
+}
+
+static char *writeUnalignedTopSegment(HalFormat *format, int64_t start, int64_t length) {
+    if (format->binary) {
+        return c2hb_unalignedTopSegment(start, length);
+    }
+    return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\n", start, length);
+}
+
+static void writeSequenceHeader(FILE *fileHandle, Sequence *sequence, Name referenceEventName) {
     //s eventName sequenceName isBottom
     Event *event = sequence_getEvent(sequence);
     assert(event != NULL);
     assert(event_getHeader(event) != NULL);
     assert(sequence_getHeader(sequence) != NULL);
     fprintf(fileHandle, "s\t'%s'\t'%s'\t%i\n", event_getHeader(event), sequence_getHeader(sequence),
-            event_getName(event) == globalReferenceEventName);
+            event_getName(event) == referenceEventName);
 }
 
-static char *writeTerminalAdjacency(Cap *cap) {
+static char *writeTerminalAdjacency(Cap *cap, void *extraArg) {
     //a start length reference-segment block-orientation
+    HalFormat *format = extraArg;
     Cap *adjacentCap = cap_getAdjacency(cap);
     assert(adjacentCap != NULL);
     int64_t adjacencyLength = cap_getCoordinate(adjacentCap) - cap_getCoordinate(cap) - 1;
@@ -97,60 +150,88 @@ static char *writeTerminalAdjacency(Cap *cap) {
         Sequence *sequence = cap_getSequence(cap);
         assert(sequence != NULL);
         assert(cap_getEvent(cap) != NULL);
-        if (event_getName(cap_getEvent(cap)) == globalReferenceEventName) {
-            return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", cap_getName(cap), cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength);
+        if (event_getName(cap_getEvent(cap)) == format->referenceEventName) {
+            return writeBottomSegment(format, cap_getName(cap), cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength);
         }
-        return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\n", cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength);
+        return writeUnalignedTopSegment(format, cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength);
     }
     else {
         return stString_copy("");
     }
 }
 
-static char *writeSegment(Segment *segment) {
+static char *writeSegment(Segment *segment, void *extraArg) {
+    HalFormat *format = extraArg;
     Block *block = segment_getBlock(segment);
-    Segment *referenceSegment = block_getSegmentForEvent(block, globalReferenceEventName);
+    Segment *referenceSegment = block_getSegmentForEvent(block, format->referenceEventName);
     if (referenceSegment == NULL) {
         Cap *cap5 = segment_get5Cap(segment);
         Cap *cap3 = segment_get3Cap(segment);
         Sequence *sequence = cap_getSequence(cap5);
-        return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\n", cap_getCoordinate(cap5) - sequence_getStart(sequence), cap_getCoordinate(cap3) - cap_getCoordinate(cap5) + 1);
+        return writeUnalignedTopSegment(format, cap_getCoordinate(cap5) - sequence_getStart(sequence), cap_getCoordinate(cap3) - cap_getCoordinate(cap5) + 1);
     }
     Sequence *sequence = segment_getSequence(segment);
     assert(sequence != NULL);
     Name eventName = event_getName(segment_getEvent(segment));
-    if (referenceSegment != segment && eventName != globalReferenceEventName) { //Is a top segment
-        return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment), segment_getName(referenceSegment), segment_getStrand(referenceSegment));
+    if (referenceSegment != segment && eventName != format->referenceEventName) { //Is a top segment
+        return writeTopSegment(format, segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment), segment_getName(referenceSegment), segment_getStrand(referenceSegment));
     } else {
         //Is a bottom segment
-        return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", segment_getName(segment), segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment));
+        return writeBottomSegment(format, segment_getName(segment), segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment));
     }
 }
 
-static int compareCaps(Cap *cap, Cap *cap2) {
-    Event *event = cap_getEvent(cap);
-    Event *event2 = cap_getEvent(cap2);
-    int i = cactusMisc_nameCompare(event_getName(event), event_getName(event2));
+/*
+ * The sort key of a cap, worked out before sorting so the comparison needs no reference to the reference event,
+ * leaving the sort reentrant.
+ */
+typedef struct _capKey {
+    Cap *cap;
+    bool isReference;
+    Name eventName;
+    Name sequenceName;
+    int64_t coordinate;
+} CapKey;
+
+static int compareCapKeys(const void *a, const void *b) {
+    const CapKey *key = a, *key2 = b;
+    int i = cactusMisc_nameCompare(key->eventName, key2->eventName);
     if (i != 0) {
-        return event_getName(event) == globalReferenceEventName ? -1 : (event_getName(event2) == globalReferenceEventName ? 1 : i);
+        return key->isReference ? -1 : (key2->isReference ? 1 : i);
     }
-    Sequence *sequence = cap_getSequence(cap);
-    Sequence *sequence2 = cap_getSequence(cap2);
-    i = cactusMisc_nameCompare(sequence_getName(sequence), sequence_getName(sequence2));
+    i = cactusMisc_nameCompare(key->sequenceName, key2->sequenceName);
     if (i == 0) {
-        i = cap_getCoordinate(cap) > cap_getCoordinate(cap2) ? 1 : (cap_getCoordinate(cap) < cap_getCoordinate(cap2) ? -1 : 0);
+        i = key->coordinate > key2->coordinate ? 1 : (key->coordinate < key2->coordinate ? -1 : 0);
     }
     return i;
 }
 
-static stList *getCaps(Flower *flower) {
+static void sortCaps(stList *caps, Name referenceEventName) {
+    int64_t capNumber = stList_length(caps);
+    CapKey *capKeys = st_malloc(capNumber * sizeof(CapKey));
+    for (int64_t i = 0; i < capNumber; i++) {
+        Cap *cap = stList_get(caps, i);
+        capKeys[i].cap = cap;
+        capKeys[i].eventName = event_getName(cap_getEvent(cap));
+        capKeys[i].isReference = capKeys[i].eventName == referenceEventName;
+        capKeys[i].sequenceName = sequence_getName(cap_getSequence(cap));
+        capKeys[i].coordinate = cap_getCoordinate(cap);
+    }
+    qsort(capKeys, capNumber, sizeof(CapKey), compareCapKeys);
+    for (int64_t i = 0; i < capNumber; i++) {
+        stList_set(caps, i, capKeys[i].cap);
+    }
+    free(capKeys);
+}
+
+static stList *getCaps(Flower *flower, Name referenceEventName) {
     //Get the caps in order
     stList *caps = stList_construct();
     End *end;
     Flower_EndIterator *endIt = flower_getEndIterator(flower);
     while ((end = flower_getNextEnd(endIt)) != NULL) {
         if (end_isStubEnd(end)) { // && end_isAttached(end)) {
-            Cap *cap; // = end_getCapForEvent(end, globalReferenceEventName);
+            Cap *cap; // = end_getCapForEvent(end, referenceEventName);
             End_InstanceIterator *capIt = end_getInstanceIterator(end);
             while ((cap = end_getNext(capIt)) != NULL) {
                 if (cap_getSequence(cap) != NULL) {
@@ -164,26 +245,96 @@ static stList *getCaps(Flower *flower) {
         }
     }
     flower_destructEndIterator(endIt);
-    stList_sort(caps, (int(*)(const void *, const void *)) compareCaps);
+    sortCaps(caps, referenceEventName);
     return caps;
 }
 
-void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventName, FILE *fileHandle) {
-    globalReferenceEventName = referenceEventName;
-    stList *caps = getCaps(flower);
+static bool writeThreadHeader(Cap *cap, FILE *fileHandle, void *extraArg) {
+    if (metaSequence_isTrivialSequence(sequence_getMetaSequence(cap_getSequence(cap)))) {
+        return 0;
+    }
+    writeSequenceHeader(fileHandle, cap_getSequence(cap), ((HalFormat *) extraArg)->referenceEventName);
+    return 1;
+}
+
+static bool writeBinaryThreadHeader(Cap *cap, FILE *fileHandle, void *extraArg) {
+    int64_t *sequenceIndex = stHash_search(((HalFormat *) extraArg)->sequenceIndices, cap_getSequence(cap));
+    if (sequenceIndex == NULL) {
+        return 0;
+    }
+    c2hb_writeThreadHeader(fileHandle, *sequenceIndex);
+    return 1;
+}
+
+static int64_t getIndex(stHash *indices, void *key, stList *keys) {
+    int64_t *index = stHash_search(indices, key);
+    if (index == NULL) {
+        index = st_malloc(sizeof(int64_t));
+        *index = stList_length(keys);
+        stHash_insert(indices, key, index);
+        stList_append(keys, key);
+    }
+    return *index;
+}
+
+static void writeBinaryHeader(HalFormat *format, stList *caps, FILE *fileHandle) {
+    /*
+     * Writes the header of a .c2hb file, with the dictionaries of the events and the sequences of the threads, and
+     * fills in the sequence indices of the format.
+     */
+    stHash *eventIndices = stHash_construct2(NULL, free);
+    stList *events = stList_construct();
+    stList *sequences = stList_construct();
+    for (int64_t i = 0; i < stList_length(caps); i++) {
+        Sequence *sequence = cap_getSequence(stList_get(caps, i));
+        if (!metaSequence_isTrivialSequence(sequence_getMetaSequence(sequence))) {
+            getIndex(format->sequenceIndices, sequence, sequences);
+            getIndex(eventIndices, sequence_getEvent(sequence), events);
+        }
+    }
+    stList *eventHeaders = stList_construct();
+    for (int64_t i = 0; i < stList_length(events); i++) {
+        stList_append(eventHeaders, (void *) event_getHeader(stList_get(events, i)));
+    }
+    int64_t sequenceNumber = stList_length(sequences);
+    C2hbSequence *sequenceEntries = st_malloc(sequenceNumber * sizeof(C2hbSequence));
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        Sequence *sequence = stList_get(sequences, i);
+        Event *event = sequence_getEvent(sequence);
+        sequenceEntries[i].eventIndex = *(int64_t *) stHash_search(eventIndices, event);
+        sequenceEntries[i].header = sequence_getHeader(sequence);
+        sequenceEntries[i].isBottom = event_getName(event) == format->referenceEventName;
+    }
+    c2hb_writeHeader(fileHandle, eventHeaders, sequenceEntries, sequenceNumber);
+    free(sequenceEntries);
+    stList_destruct(eventHeaders);
+    stList_destruct(sequences);
+    stList_destruct(events);
+    stHash_destruct(eventIndices);
+}
+
+void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventName, bool binary, FILE *fileHandle) {
+    HalFormat format = { referenceEventName, binary, NULL };
+    stList *caps = getCaps(flower, referenceEventName);
     if (fileHandle == NULL) {
-        buildRecursiveThreads(database, caps, writeSegment, writeTerminalAdjacency);
+        buildRecursiveThreads(database, caps, writeSegment, writeTerminalAdjacency, &format);
+    } else if (binary) {
+        format.sequenceIndices = stHash_construct2(NULL, free);
+        writeBinaryHeader(&format, caps, fileHandle);
+        writeRecursiveThreads(database, caps, writeSegment, writeTerminalAdjacency, writeBinaryThreadHeader,
+                fileHandle, &format);
+        stHash_destruct(format.sequenceIndices);
     } else {
-        stList *threadStrings = buildRecursiveThreadsInList(database, caps, writeSegment, writeTerminalAdjacency);
-        assert(stList_length(threadStrings) == stList_length(caps));
-        for (int64_t i = 0; i < stList_length(threadStrings); i++) {
-            Cap *cap = stList_get(caps, i);
-            if(!metaSequence_isTrivialSequence(sequence_getMetaSequence(cap_getSequence(cap)))) {
-                char *threadString = stList_get(threadStrings, i);
-                writeSequenceHeader(fileHandle, cap_getSequence(cap));
-                fprintf(fileHandle, "%s\n", threadString);
-            }
-        }
+        writeRecursiveThreads(database, caps, writeSegment, writeTerminalAdjacency, writeThreadHeader, fileHandle,
+                &format);
     }
     stList_destruct(caps);
 }
+
+RecursiveThreads *getHalFormatThreads(Flower *flower, Name referenceEventName, bool binary) {
+    HalFormat format = { referenceEventName, binary, NULL };
+    stList *caps = getCaps(flower, referenceEventName);
+    RecursiveThreads *recursiveThreads = getRecursiveThreads(caps, writeSegment, writeTerminalAdjacency, &format);
+    stList_destruct(caps);
+    return recursiveThreads;
+}
@@ -0,0 +1,51 @@
+/*
+ * c2hb.h
+ *
+ * The compact binary form of the .c2h alignment, .c2hb, see hal.c, and its decoding back into the .c2h text, which is
+ * what cactus2hal reads.
+ */
+
+#ifndef C2HB_H_
+#define C2HB_H_
+
+#include "sonLib.h"
+#include "cactus.h"
+
+#define C2HB_VERSION 1
+
+/*
+ * A sequence of the dictionary at the start of a .c2hb file.
+ */
+typedef struct _c2hbSequence {
+    int64_t eventIndex; // The index of the header of its event in the dictionary
+    const char *header;
+    bool isBottom;
+} C2hbSequence;
+
+/*
+ * The segment records of a thread, each returned as a string that holds no zero byte, so that the records can be
+ * built into threads as strings.
+ */
+char *c2hb_bottomSegment(Name segmentName, int64_t start, int64_t length);
+
+char *c2hb_topSegment(int64_t start, int64_t length, Name parentSegmentName, bool orientation);
+
+char *c2hb_unalignedTopSegment(int64_t start, int64_t length);
+
+/*
+ * Writes the start of a .c2hb file, with the dictionaries of the event headers and of the sequences.
+ */
+void c2hb_writeHeader(FILE *fileHandle, stList *eventHeaders, C2hbSequence *sequences, int64_t sequenceNumber);
+
+/*
+ * Writes the start of the thread of the sequenceIndex-th sequence of the dictionary, which is followed by its records
+ * and then a new line.
+ */
+void c2hb_writeThreadHeader(FILE *fileHandle, int64_t sequenceIndex);
+
+/*
+ * Decodes the .c2hb file into the .c2h text that makeHalFormat would have written, byte for byte.
+ */
+void c2hb_convertToC2h(FILE *fileHandleIn, FILE *fileHandleOut);
+
+#endif /* C2HB_H_ */
@@ -10,10 +10,23 @@
 
 #include "sonLib.h"
 #include "cactus.h"
+#include "recursiveThreadBuilder.h"
 
-void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventName,
+/*
+ * Builds the alignment threads of the flower, from those of its nested flowers in the database. If fileHandle is
+ * NULL they are stored in the database for the parent flower, else the complete alignment is written to the file. If
+ * binary is non-zero the alignment is in the .c2hb form rather than the .c2h text, see hal.c. All the flowers of a run
+ * must use the same form.
+ */
+void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventName, bool binary,
                    FILE *fileHandle);
 
+/*
+ * As makeHalFormat with no file, but returns the threads of the flower to be stored with storeRecursiveThreads,
+ * without touching the database. Can be called for different flowers in parallel.
+ */
+RecursiveThreads *getHalFormatThreads(Flower *flower, Name referenceEventName, bool binary);
+
 void printFastaSequences(Flower *flower, FILE *fileHandle, Name referenceEventName);
 
 #endif /* HAL_H_ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "c2hb.h"
+
+static int64_t getRandomValue(void) {
+    // Mostly small values, whose varints are a single byte and may be a new line, and some large ones
+    switch (st_randomInt(0, 4)) {
+    case 0:
+        return st_randomInt(0, 20);
+    case 1:
+        return st_randomInt(120, 140);
+    case 2:
+        return st_randomInt(0, INT32_MAX);
+    default:
+        return ((int64_t) st_randomInt(0, INT32_MAX) << 31) + st_randomInt(0, INT32_MAX);
+    }
+}
+
+static char *readFile(FILE *fileHandle) {
+    fflush(fileHandle);
+    int64_t length = ftell(fileHandle);
+    rewind(fileHandle);
+    char *contents = st_malloc(length + 1);
+    size_t i = fread(contents, 1, length, fileHandle);
+    (void) i;
+    contents[length] = '\0';
+    return contents;
+}
+
+static void testC2hb_roundTrip(CuTest *testCase) {
+    /*
+     * Writes random .c2hb files, as makeHalFormat does, and checks each decodes to the .c2h text of the same
+     * alignment, written as makeHalFormat writes it.
+     */
+    for (int64_t test = 0; test < 100; test++) {
+        stList *eventHeaders = stList_construct3(0, free);
+        int64_t eventNumber = st_randomInt(1, 5);
+        for (int64_t i = 0; i < eventNumber; i++) {
+            stList_append(eventHeaders, stString_print("event%" PRIi64, i));
+        }
+        int64_t sequenceNumber = st_randomInt(0, 10);
+        C2hbSequence *sequences = st_malloc(sequenceNumber * sizeof(C2hbSequence) + 1);
+        for (int64_t i = 0; i < sequenceNumber; i++) {
+            sequences[i].eventIndex = st_randomInt(0, eventNumber);
+            sequences[i].header = stString_print("sequence%" PRIi64 " a description", i);
+            sequences[i].isBottom = st_random() > 0.5;
+        }
+
+        FILE *binaryFileHandle = tmpfile();
+        CuAssertTrue(testCase, binaryFileHandle != NULL);
+        CuString *expected = CuStringNew();
+        c2hb_writeHeader(binaryFileHandle, eventHeaders, sequences, sequenceNumber);
+        int64_t threadNumber = sequenceNumber == 0 ? 0 : st_randomInt(0, 20);
+        for (int64_t i = 0; i < threadNumber; i++) {
+            // A sequence may have several threads, and a thread no records
+            C2hbSequence *sequence = &sequences[st_randomInt(0, sequenceNumber)];
+            c2hb_writeThreadHeader(binaryFileHandle, sequence - sequences);
+            char *line = stString_print("s\t'%s'\t'%s'\t%i\n", (char *) stList_get(eventHeaders, sequence->eventIndex),
+                    sequence->header, sequence->isBottom);
+            CuStringAppend(expected, line);
+            free(line);
+            int64_t recordNumber = st_randomInt(0, 20);
+            for (int64_t j = 0; j < recordNumber; j++) {
+                int64_t start = getRandomValue(), length = getRandomValue() + 1, name = getRandomValue();
+                char *record;
+                switch (st_randomInt(0, 3)) {
+                case 0:
+                    record = c2hb_bottomSegment(name, start, length);
+                    line = stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", name, start, length);
+                    break;
+                case 1: {
+                    bool orientation = st_random() > 0.5;
+                    record = c2hb_topSegment(start, length, name, orientation);
+                    line = stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", start, length,
+                            name, (int64_t) orientation);
+                    break;
+                }
+                default:
+                    record = c2hb_unalignedTopSegment(start, length);
+                    line = stString_print("a\t%" PRIi64 "\t%" PRIi64 "\n", start, length);
+                }
+                CuAssertTrue(testCase, strlen(record) > 1);
+                fputs(record, binaryFileHandle);
+                CuStringAppend(expected, line);
+                free(record);
+                free(line);
+            }
+            fputc('\n', binaryFileHandle);
+            CuStringAppend(expected, "\n");
+        }
+
+        rewind(binaryFileHandle);
+        FILE *fileHandle = tmpfile();
+        CuAssertTrue(testCase, fileHandle != NULL);
+        c2hb_convertToC2h(binaryFileHandle, fileHandle);
+        char *text = readFile(fileHandle);
+        CuAssertStrEquals(testCase, expected->buffer, text);
+
+        free(text);
+        fclose(fileHandle);
+        fclose(binaryFileHandle);
+        CuStringDelete(expected);
+        for (int64_t i = 0; i < sequenceNumber; i++) {
+            free((char *) sequences[i].header);
+        }
+        free(sequences);
+        stList_destruct(eventHeaders);
+    }
+}
+
+CuSuite *c2hbTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testC2hb_roundTrip);
+    return suite;
+}
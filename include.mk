@@ -38,6 +38,12 @@ include ${sonLibRootDir}/include.mk
 #https://github.com/ComparativeGenomicsToolkit/cactus/issues/235
 CFLAGS += -UNDEBUG
 
+# OpenMP is used to process independent flowers and ends in parallel. Set NO_OPENMP=1
+# for compilers without it, everything then runs on a single thread.
+ifeq (${NO_OPENMP},)
+    CFLAGS += -fopenmp
+endif
+
 dataSetsPath=/Users/benedictpaten/Dropbox/Documents/work/myPapers/genomeCactusPaper/dataSets
 
 inclDirs = api/inc bar/inc caf/inc hal/inc reference/inc submodules/sonLib/C/inc \
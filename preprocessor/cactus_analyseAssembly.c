@@ -18,76 +18,272 @@
 #include <dirent.h>
 #include <math.h>
 #include <ctype.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "bioioC.h"
 #include "cactus.h"
 
+/*
+ * The files are read in blocks, and the bases between the headers counted as they are, without assembling the
+ * sequences. Line breaks and other bytes up to and including the space are not bases.
+ */
+
+#define BUFFER_SIZE 16777216
+
 void usage() {
     fprintf(stderr, "cactus_analyseAssembly [fastaFile]xN\n");
+    fprintf(stderr, "-t --threads N: Number of files to analyse at once. Default=1\n");
 }
 
 //We want to report number of sequences,
-static stList *sequenceLengths;
-static stList *repeatBaseCounts;
-int64_t nCount;
-static const char *fileNameForStats;
-void setupStatsCollation(const char *fileName) {
-    fileNameForStats = fileName;
-    sequenceLengths = stList_construct3(0, (void (*)(void *))stIntTuple_destruct);
-    repeatBaseCounts = stList_construct3(0, (void (*)(void *))stIntTuple_destruct);
-    nCount = 0;
+typedef struct _assemblyStats {
+    const char *fileName;
+    int64_t *sequenceLengths;
+    int64_t sequenceNumber;
+    int64_t maxSequenceNumber;
+    int64_t repeatBaseCount; // Bases that are not uppercase, or are Ns.
+    int64_t nCount;
+} AssemblyStats;
+
+/*
+ * Counts the bases of seq[0, length), those that are repeat masked and the Ns.
+ */
+static void countBases(const char *seq, int64_t length, int64_t *bases, int64_t *repeatBases, int64_t *ns) {
+    int64_t layoutCount = 0, upperCount = 0, nCount = 0, upperNCount = 0;
+    int64_t i = 0;
+#if defined(__SSE2__)
+    // Each byte of the accumulators counts the bytes of its lane, so is summed before it can overflow.
+    while (i + 16 <= length) {
+        __m128i layout = _mm_setzero_si128(), upper = _mm_setzero_si128();
+        __m128i n = _mm_setzero_si128(), upperN = _mm_setzero_si128();
+        for (int64_t j = 0; j < 255 && i + 16 <= length; j++, i += 16) {
+            __m128i c = _mm_loadu_si128((const __m128i *) (seq + i));
+            __m128i isUpperN = _mm_cmpeq_epi8(c, _mm_set1_epi8('N'));
+            layout = _mm_sub_epi8(layout, _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(-1)),
+                                                        _mm_cmplt_epi8(c, _mm_set1_epi8(' ' + 1))));
+            upper = _mm_sub_epi8(upper, _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                                                      _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1))));
+            n = _mm_sub_epi8(n, _mm_or_si128(isUpperN, _mm_cmpeq_epi8(c, _mm_set1_epi8('n'))));
+            upperN = _mm_sub_epi8(upperN, isUpperN);
+        }
+        __m128i sums[4] = { _mm_sad_epu8(layout, _mm_setzero_si128()), _mm_sad_epu8(upper, _mm_setzero_si128()),
+                            _mm_sad_epu8(n, _mm_setzero_si128()), _mm_sad_epu8(upperN, _mm_setzero_si128()) };
+        int64_t *counts[4] = { &layoutCount, &upperCount, &nCount, &upperNCount };
+        for (int64_t j = 0; j < 4; j++) {
+            *counts[j] += _mm_cvtsi128_si32(sums[j]) + _mm_cvtsi128_si32(_mm_srli_si128(sums[j], 8));
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        char c = seq[i];
+        layoutCount += (unsigned char) c <= ' ';
+        upperCount += c >= 'A' && c <= 'Z';
+        nCount += c == 'N' || c == 'n';
+        upperNCount += c == 'N';
+    }
+    *bases += length - layoutCount;
+    *repeatBases += length - layoutCount - upperCount + upperNCount;
+    *ns += nCount;
 }
 
-void processSequenceForStats(void* destination, const char *fastaHeader, const char *string, int64_t length) {
-    //Collate stats
-    int64_t sequenceLength = strlen(string);
-    stList_append(sequenceLengths, stIntTuple_construct1(sequenceLength));
-    int64_t j=0;
-    for(int64_t i=0; i<sequenceLength; i++) {
-        bool isN = string[i] == 'N' || string[i] == 'n';
-        j += (tolower(string[i]) == string[i] || isN) ? 1 : 0;
-        nCount += isN ? 1 : 0;
+static void addSequence(AssemblyStats *stats, int64_t sequenceLength) {
+    if (stats->sequenceNumber == stats->maxSequenceNumber) {
+        stats->maxSequenceNumber = stats->maxSequenceNumber == 0 ? 1024 : stats->maxSequenceNumber * 2;
+        stats->sequenceLengths = st_realloc(stats->sequenceLengths, sizeof(int64_t) * stats->maxSequenceNumber);
+    }
+    stats->sequenceLengths[stats->sequenceNumber++] = sequenceLength;
+}
+
+static inline bool isLineStart(const char *buffer, int64_t i, bool atLineStart) {
+    return i == 0 ? atLineStart : buffer[i - 1] == '\n';
+}
+
+static void collateStats(FILE *fileHandle, AssemblyStats *stats) {
+    char *buffer = st_malloc(BUFFER_SIZE);
+    bool inHeader = 0, inSequence = 0, atLineStart = 1;
+    int64_t sequenceLength = 0;
+    int64_t length;
+    while ((length = fread(buffer, 1, BUFFER_SIZE, fileHandle)) > 0) {
+        int64_t i = 0;
+        while (i < length) {
+            if (inHeader) {
+                const char *lineEnd = memchr(buffer + i, '\n', length - i);
+                if (lineEnd == NULL) {
+                    break;
+                }
+                inHeader = 0;
+                i = lineEnd - buffer;
+            }
+            // Find the next header, the bases before it belonging to the current sequence.
+            int64_t j = i;
+            const char *header;
+            while ((header = memchr(buffer + j, '>', length - j)) != NULL
+                    && !isLineStart(buffer, header - buffer, atLineStart)) {
+                j = header - buffer + 1;
+            }
+            int64_t end = header == NULL ? length : header - buffer;
+            if (inSequence) {
+                countBases(buffer + i, end - i, &sequenceLength, &stats->repeatBaseCount, &stats->nCount);
+            }
+            if (header != NULL) {
+                if (inSequence) {
+                    addSequence(stats, sequenceLength);
+                }
+                inSequence = 1;
+                sequenceLength = 0;
+                inHeader = 1;
+                end++;
+            }
+            i = end;
+        }
+        atLineStart = buffer[length - 1] == '\n';
+    }
+    if (ferror(fileHandle)) {
+        st_errnoAbort("Could not read input file %s", stats->fileName);
+    }
+    if (inSequence) {
+        addSequence(stats, sequenceLength);
+    }
+    free(buffer);
+}
+
+/*
+ * Partitions values[0, n) into those greater than the pivot, those equal to it and those less than it, in that order,
+ * setting the number greater and the number equal.
+ */
+static void partition(int64_t *values, int64_t n, int64_t pivot, int64_t *greater, int64_t *equal) {
+    int64_t i = 0, j = 0, k = n;
+    while (j < k) {
+        int64_t v = values[j];
+        if (v > pivot) {
+            values[j++] = values[i];
+            values[i++] = v;
+        } else if (v < pivot) {
+            values[j] = values[--k];
+            values[k] = v;
+        } else {
+            j++;
+        }
+    }
+    *greater = i;
+    *equal = k - i;
+}
+
+static int64_t choosePivot(int64_t *values, int64_t n) {
+    int64_t a = values[0], b = values[n / 2], c = values[n - 1];
+    return a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+}
+
+/*
+ * Returns the value at index k of values[0, n) if it were sorted in descending order, reordering the values.
+ */
+static int64_t selectValue(int64_t *values, int64_t n, int64_t k) {
+    while (1) {
+        int64_t greater, equal;
+        partition(values, n, choosePivot(values, n), &greater, &equal);
+        if (k < greater) {
+            n = greater;
+        } else if (k < greater + equal) {
+            return values[greater];
+        } else {
+            values += greater + equal;
+            n -= greater + equal;
+            k -= greater + equal;
+        }
+    }
+}
+
+/*
+ * Returns the N50 of values[0, n), the value at which the sum of the values, taken in descending order, reaches
+ * halfLength, reordering the values.
+ */
+static int64_t selectN50(int64_t *values, int64_t n, int64_t halfLength) {
+    while (1) {
+        int64_t greater, equal, pivot = choosePivot(values, n);
+        partition(values, n, pivot, &greater, &equal);
+        int64_t greaterLength = 0;
+        for (int64_t i = 0; i < greater; i++) {
+            greaterLength += values[i];
+        }
+        if (greater > 0 && greaterLength >= halfLength) {
+            n = greater;
+        } else if (greaterLength + equal * pivot >= halfLength) {
+            return pivot;
+        } else {
+            values += greater + equal;
+            n -= greater + equal;
+            halfLength -= greaterLength + equal * pivot;
+        }
     }
-    stList_append(repeatBaseCounts, stIntTuple_construct1(j));
 }
 
-void cleanupAndReportStatsCollection() {
+void cleanupAndReportStatsCollection(AssemblyStats *stats) {
     //Collate stats
-    int64_t totalSequences = stList_length(sequenceLengths);
+    int64_t totalSequences = stats->sequenceNumber;
     int64_t totalLength = 0;
-    int64_t repeatBaseCount = 0;
-    stList_sort(sequenceLengths, (int (*)(const void *, const void *))stIntTuple_cmpFn);
+    int64_t maxSequenceLength = 0, minSequenceLength = 0;
     for(int64_t i=0; i<totalSequences; i++) {
-        totalLength += stIntTuple_get(stList_get(sequenceLengths, i), 0);
-        repeatBaseCount += stIntTuple_get(stList_get(repeatBaseCounts, i), 0);
-    }
-    int64_t medianSequenceLength = totalSequences > 0 ? stIntTuple_get(stList_get(sequenceLengths, totalSequences/2), 0) : 0;
-    int64_t maxSequenceLength = totalSequences > 0 ? stIntTuple_get(stList_peek(sequenceLengths), 0) : 0;
-    int64_t minSequenceLength = totalSequences > 0 ? stIntTuple_get(stList_get(sequenceLengths, 0), 0) : 0;
-    int64_t n50 = 0;
-    int64_t j=0;
-    for(int64_t i=totalSequences-1; i>=0; i--) {
-        n50 = stIntTuple_get(stList_get(sequenceLengths, i), 0);
-        j += n50;
-        if(j >= totalLength/2) {
-            break;
-        }
+        int64_t sequenceLength = stats->sequenceLengths[i];
+        totalLength += sequenceLength;
+        maxSequenceLength = i == 0 || sequenceLength > maxSequenceLength ? sequenceLength : maxSequenceLength;
+        minSequenceLength = i == 0 || sequenceLength < minSequenceLength ? sequenceLength : minSequenceLength;
     }
+    int64_t medianSequenceLength = totalSequences > 0 ? selectValue(stats->sequenceLengths, totalSequences, totalSequences - 1 - totalSequences/2) : 0;
+    int64_t n50 = totalSequences > 0 ? (totalLength/2 > 0 ? selectN50(stats->sequenceLengths, totalSequences, totalLength/2) : maxSequenceLength) : 0;
+    int64_t repeatBaseCount = stats->repeatBaseCount, nCount = stats->nCount;
     fprintf(stdout, "Input-sample: %s Total-sequences: %" PRIi64 " Total-length: %" PRIi64 " Proportion-repeat-masked: %f ProportionNs: %f Total-Ns: %" PRIi64 " N50: %" PRIi64 " Median-sequence-length: %" PRIi64 " Max-sequence-length: %" PRIi64 " Min-sequence-length: %" PRIi64 "\n",
-            fileNameForStats, totalSequences, totalLength, ((double)repeatBaseCount)/totalLength, ((double)nCount)/totalLength, nCount, n50, medianSequenceLength, maxSequenceLength, minSequenceLength);
+            stats->fileName, totalSequences, totalLength, ((double)repeatBaseCount)/totalLength, ((double)nCount)/totalLength, nCount, n50, medianSequenceLength, maxSequenceLength, minSequenceLength);
     //Cleanup
-    stList_destruct(sequenceLengths);
-    stList_destruct(repeatBaseCounts);
+    free(stats->sequenceLengths);
 }
 
 
 int main(int argc, char *argv[]) {
-    if(argc == 1) {
+    int64_t numThreads = 1;
+
+    while (1) {
+        static struct option long_options[] = { { "threads", required_argument, 0, 't' },
+                                                { 0, 0, 0, 0 } };
+
+        int option_index = 0;
+
+        int key = getopt_long(argc, argv, "t:", long_options, &option_index);
+
+        if (key == -1) {
+            break;
+        }
+
+        switch (key) {
+        case 't':
+            if (sscanf(optarg, "%" PRIi64 "", &numThreads) != 1 || numThreads < 1) {
+                st_errAbort("Invalid number of threads %s", optarg);
+            }
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if(optind == argc) {
         usage();
         return 0;
     }
 
-    for (int64_t j = 1; j < argc; j++) {
+#if defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
+
+    //The files are analysed at once, and reported in order.
+#if defined(_OPENMP)
+#pragma omp parallel for ordered schedule(dynamic)
+#endif
+    for (int64_t j = optind; j < argc; j++) {
         FILE *fileHandle;
         if (strcmp(argv[j], "-") == 0) {
             fileHandle = stdin;
@@ -97,10 +293,13 @@ int main(int argc, char *argv[]) {
                 st_errnoAbort("Could not open input file %s", argv[j]);
             }
         }
-        setupStatsCollation(argv[j]);
-        fastaReadToFunction(fileHandle, NULL, processSequenceForStats);
-        cleanupAndReportStatsCollection();
+        AssemblyStats stats = { argv[j], NULL, 0, 0, 0, 0 };
+        collateStats(fileHandle, &stats);
         fclose(fileHandle);
+#if defined(_OPENMP)
+#pragma omp ordered
+#endif
+        cleanupAndReportStatsCollection(&stats);
     }
 
     return 0;
@@ -7,6 +7,8 @@
 /*
  * MERGE POTENTIALLY OVERLAPPING FASTA FILES GENERATED BY
  * cactus_batch_chunkSequences INTO A SINGLE FASTA FILE, reads fasta files from stdin, writes them merged to stdout.
+ * A chunk store made by cactus_blast_chunkSequencesToStore may be given in place of fasta files, in which case its
+ * chunks are merged straight from the mapped store, without being parsed.
  */
 
 #include <stdio.h>
@@ -18,6 +20,7 @@
 
 #include "bioioC.h"
 #include "commonC.h"
+#include "chunkStore.h"
 
 /* Read fasta sequence from files into the "cur" variables.
  * Then merge into the outputFile (stdout)
@@ -44,6 +47,12 @@ int main(int argc, char *argv[]) {
     if(line != NULL) {
         stList *files = stString_split(line);
         for(int64_t i=0; i<stList_length(files); i++) {
+            if (chunkStore_isChunkStore(stList_get(files, i))) {
+                ChunkStore *store = chunkStore_construct(stList_get(files, i));
+                chunkStore_writeMergedChunks(store, stdout);
+                chunkStore_destruct(store);
+                continue;
+            }
             FILE* chunkFile = fopen(stList_get(files, i), "r");
             fastaReadToFunction(chunkFile, NULL, readFastaCallback);
             fclose(chunkFile);
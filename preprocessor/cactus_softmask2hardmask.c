@@ -12,64 +12,380 @@
 #include <time.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/param.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
 #include <math.h>
 #include <ctype.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "bioioC.h"
 #include "cactus.h"
 
+/*
+ * The input is masked in blocks, which are written straight back out, so the layout of the input, its headers and
+ * line breaks, is kept. A run of lowercase bases carries on over line breaks, but not over a header. Each block is
+ * cut into segments that are masked on separate threads; the runs crossing the boundaries of the segments, or of the
+ * blocks, are joined up afterwards, in order. The bytes of a run that crosses into the next block and is not yet known
+ * to be long enough to mask are held back and masked along with that block.
+ */
+
+#define BLOCK_SIZE 67108864
+#define MIN_SEGMENT_SIZE 1048576
+
 void usage() {
     fprintf(stderr, "cactus_softmask2hardmask [fastaFile]\n");
     fprintf(stderr, "-m --minLength N: Only mask intervals > Nbp\n");
+    fprintf(stderr, "-i --inPlace: Mask the fasta files in place, rather than writing them to stdout\n");
+    fprintf(stderr, "-t --threads N: Number of threads to mask each block of the input on. Default=1\n");
 }
 
-static void hardmask(void* min_length_p, const char* name, const char* seq, int64_t length) {
-    int64_t min_length = *(int64_t*)min_length_p;
-    char* uc_seq = (char*)seq;
-    int64_t start = -1;
-    for (int64_t i = 0; i < length; ++i) {
-        bool lower = islower(uc_seq[i]);
-        if (lower) {
-            if (start == -1) {
-                start = i;
-            }
+/*
+ * Finding and masking lowercase bases, 16 bytes at a time where SSE2 is available. Bytes up to and including the
+ * space are line breaks and other layout, which neither count as bases nor end a run.
+ */
+
+static inline bool isLowercase(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+static inline bool isLayout(char c) {
+    return (unsigned char) c <= ' ';
+}
+
+#if defined(__SSE2__)
+static inline __m128i lowercaseMask(__m128i c) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+}
+
+static inline __m128i layoutMask(__m128i c) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(-1)), _mm_cmplt_epi8(c, _mm_set1_epi8(' ' + 1)));
+}
+#endif
+
+/*
+ * Returns the index of the first lowercase base or '>', which may start a header, in seq[i, end), or end if there is
+ * neither.
+ */
+static int64_t findRunStart(const char *seq, int64_t i, int64_t end) {
+#if defined(__SSE2__)
+    for (; i + 16 <= end; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (seq + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(lowercaseMask(c), _mm_cmpeq_epi8(c, _mm_set1_epi8('>'))));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
         }
-        if (start != -1) {
-            int64_t end = -1;
-            if (!lower) {
-                end = i - 1;
-            } else if (i == length - 1) {
-                end = i;
-            }
-            if (end > start + min_length - 1) {
-                for (int64_t j = start; j <= end; ++j) {
-                    assert(islower(uc_seq[j]));
-                    uc_seq[j] = 'N';
-                }                
-            }
-            if (end != -1) {
-                start = -1;
-            }
+    }
+#endif
+    for (; i < end && !isLowercase(seq[i]) && seq[i] != '>'; i++);
+    return i;
+}
+
+/*
+ * Returns the index of the first byte in seq[i, end) that ends a run, being neither a lowercase base nor layout, or end
+ * if there is none.
+ */
+static int64_t findRunEnd(const char *seq, int64_t i, int64_t end) {
+#if defined(__SSE2__)
+    for (; i + 16 <= end; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (seq + i));
+        int mask = ~_mm_movemask_epi8(_mm_or_si128(lowercaseMask(c), layoutMask(c))) & 0xFFFF;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < end && (isLowercase(seq[i]) || isLayout(seq[i])); i++);
+    return i;
+}
+
+static int64_t countLowercase(const char *seq, int64_t i, int64_t end) {
+    int64_t count = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= end; i += 16) {
+        count += __builtin_popcount(_mm_movemask_epi8(lowercaseMask(_mm_loadu_si128((const __m128i *) (seq + i)))));
+    }
+#endif
+    for (; i < end; i++) {
+        count += isLowercase(seq[i]);
+    }
+    return count;
+}
+
+static void maskLowercase(char *seq, int64_t i, int64_t end) {
+#if defined(__SSE2__)
+    for (; i + 16 <= end; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *) (seq + i));
+        __m128i lowercase = lowercaseMask(c);
+        _mm_storeu_si128((__m128i *) (seq + i),
+                         _mm_or_si128(_mm_and_si128(lowercase, _mm_set1_epi8('N')), _mm_andnot_si128(lowercase, c)));
+    }
+#endif
+    for (; i < end; i++) {
+        if (isLowercase(seq[i])) {
+            seq[i] = 'N';
+        }
+    }
+}
+
+/*
+ * Masks the run seq[i, end) if it has more than minLength lowercase bases.
+ */
+static void maskRun(char *seq, int64_t i, int64_t end, int64_t minLength) {
+    if (end - i > minLength && countLowercase(seq, i, end) > minLength) {
+        maskLowercase(seq, i, end);
+    }
+}
+
+/*
+ * Masking the segments of a block.
+ */
+
+typedef struct _blockSegment {
+    int64_t start;
+    int64_t end;
+    int64_t leadingEnd; // The end of the run the segment starts with, which may carry on from the previous segment.
+    int64_t trailingStart; // The start of the run the segment ends with, which may carry on into the next segment.
+} BlockSegment;
+
+static inline bool isLineStart(const char *block, int64_t i, bool atLineStart) {
+    return i == 0 ? atLineStart : block[i - 1] == '\n';
+}
+
+/*
+ * Masks the runs within the segment, leaving those at its ends to be joined with those of the neighbouring segments.
+ * A segment never starts within a header.
+ */
+static void maskSegment(char *block, BlockSegment *segment, int64_t minLength, bool atLineStart) {
+    segment->leadingEnd = findRunEnd(block, segment->start, segment->end);
+    segment->trailingStart = segment->end;
+    int64_t i = segment->leadingEnd;
+    while (i < segment->end) {
+        // block[i] ends a run, skip over it, or the header it starts.
+        if (block[i] == '>' && isLineStart(block, i, atLineStart)) {
+            const char *lineEnd = memchr(block + i, '\n', segment->end - i);
+            i = lineEnd == NULL ? segment->end : lineEnd - block;
+        } else {
+            i++;
+        }
+        int64_t runStart = findRunStart(block, i, segment->end);
+        if (runStart == segment->end) {
+            break;
+        }
+        if (block[runStart] == '>') {
+            i = runStart;
+            continue;
+        }
+        int64_t runEnd = findRunEnd(block, runStart, segment->end);
+        if (runEnd == segment->end) {
+            segment->trailingStart = runStart;
+            break;
+        }
+        maskRun(block, runStart, runEnd, minLength);
+        i = runEnd;
+    }
+}
+
+/*
+ * The state carried from one block to the next.
+ */
+typedef struct _maskState {
+    bool atLineStart; // The byte before the block is a line break, or there is none.
+    bool inHeader; // The block starts within a header.
+    int64_t runBases; // The number of lowercase bases of the run the block starts with that are before it, or held back.
+    int64_t heldBack; // The number of bytes at the start of the block held back from the previous block.
+} MaskState;
+
+/*
+ * Gets the boundaries of the segments of block[start, length), moving any boundary that falls within a header to its
+ * end.
+ */
+static BlockSegment *getSegments(const char *block, int64_t start, int64_t length, MaskState *state,
+                                 int64_t *segmentNumber) {
+    int64_t headerNumber = 0, maxHeaderNumber = 16;
+    int64_t *headerStarts = st_malloc(sizeof(int64_t) * maxHeaderNumber);
+    int64_t *headerEnds = st_malloc(sizeof(int64_t) * maxHeaderNumber);
+    const char *p = block + start;
+    while (p < block + length && (p = memchr(p, '>', block + length - p)) != NULL) {
+        int64_t i = p - block;
+        if (!isLineStart(block, i, state->atLineStart)) {
+            p++;
+            continue;
+        }
+        if (headerNumber == maxHeaderNumber) {
+            maxHeaderNumber *= 2;
+            headerStarts = st_realloc(headerStarts, sizeof(int64_t) * maxHeaderNumber);
+            headerEnds = st_realloc(headerEnds, sizeof(int64_t) * maxHeaderNumber);
+        }
+        const char *lineEnd = memchr(p, '\n', block + length - p);
+        headerStarts[headerNumber] = i;
+        headerEnds[headerNumber++] = lineEnd == NULL ? length : lineEnd - block;
+        p = block + headerEnds[headerNumber - 1];
+    }
+    state->inHeader = headerNumber > 0 && headerEnds[headerNumber - 1] == length;
+
+    int64_t threadNumber = 1;
+#if defined(_OPENMP)
+    threadNumber = omp_get_max_threads();
+#endif
+    *segmentNumber = (length - start) / MIN_SEGMENT_SIZE;
+    *segmentNumber = *segmentNumber < 1 ? 1 : (*segmentNumber > threadNumber ? threadNumber : *segmentNumber);
+    BlockSegment *segments = st_malloc(sizeof(BlockSegment) * *segmentNumber);
+    int64_t j = 0;
+    for (int64_t i = 0; i < *segmentNumber; i++) {
+        int64_t segmentStart = i == 0 ? start : start + (length - start) / *segmentNumber * i;
+        if (i > 0 && segmentStart < segments[i - 1].start) {
+            segmentStart = segments[i - 1].start;
+        }
+        while (j < headerNumber && headerEnds[j] <= segmentStart) {
+            j++;
+        }
+        if (j < headerNumber && headerStarts[j] < segmentStart) {
+            segmentStart = headerEnds[j];
+        }
+        segments[i].start = segmentStart;
+        if (i > 0) {
+            segments[i - 1].end = segmentStart;
         }
     }
-    fastaWrite(uc_seq, (char*)name, stdout);
+    segments[*segmentNumber - 1].end = length;
+    free(headerStarts);
+    free(headerEnds);
+    return segments;
+}
+
+/*
+ * Masks the block, returning the number of bytes at its start that are finished with. The rest are held back, to be
+ * masked at the start of the next block.
+ */
+static int64_t maskBlock(char *block, int64_t length, int64_t minLength, bool lastBlock, MaskState *state) {
+    int64_t start = state->heldBack;
+    if (state->inHeader) {
+        const char *lineEnd = memchr(block, '\n', length);
+        if (lineEnd == NULL) {
+            state->atLineStart = length > 0 ? 0 : state->atLineStart;
+            return length;
+        }
+        start = lineEnd - block;
+    }
+    int64_t segmentNumber;
+    BlockSegment *segments = getSegments(block, start, length, state, &segmentNumber);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        maskSegment(block, &segments[i], minLength, state->atLineStart);
+    }
+
+    // Join up the runs crossing the boundaries of the segments, starting with any carried from the previous block.
+    // A run held back from the previous block starts at the start of this one.
+    int64_t runStart = state->heldBack > 0 ? 0 : start, runBases = state->runBases;
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        BlockSegment *segment = &segments[i];
+        runBases += countLowercase(block, segment->start, segment->leadingEnd);
+        if (segment->leadingEnd == segment->end) {
+            continue;
+        }
+        if (runBases > minLength) {
+            maskLowercase(block, runStart, segment->leadingEnd);
+        }
+        runStart = segment->trailingStart;
+        runBases = countLowercase(block, segment->trailingStart, segment->end);
+    }
+    free(segments);
+
+    int64_t finished = length;
+    if (runBases > minLength || lastBlock) {
+        if (runBases > minLength) {
+            maskLowercase(block, runStart, length);
+        }
+        state->runBases = runBases > minLength ? runBases : 0;
+        state->heldBack = 0;
+    } else if (runBases > 0) {
+        finished = runStart;
+        state->runBases = runBases;
+        state->heldBack = length - runStart;
+    } else {
+        state->runBases = 0;
+        state->heldBack = 0;
+    }
+    if (finished > 0) {
+        state->atLineStart = block[finished - 1] == '\n';
+    }
+    return finished;
+}
+
+static void maskFile(FILE *fileHandle, int64_t minLength) {
+    MaskState state = { 1, 0, 0, 0 };
+    int64_t bufferSize = BLOCK_SIZE;
+    char *buffer = st_malloc(bufferSize);
+    bool lastBlock = 0;
+    while (!lastBlock) {
+        if (bufferSize - state.heldBack < BLOCK_SIZE) {
+            bufferSize = state.heldBack + BLOCK_SIZE;
+            buffer = st_realloc(buffer, bufferSize);
+        }
+        int64_t length = state.heldBack + fread(buffer + state.heldBack, 1, bufferSize - state.heldBack, fileHandle);
+        if (ferror(fileHandle)) {
+            st_errnoAbort("Failed to read the fasta input");
+        }
+        lastBlock = length < bufferSize;
+        int64_t finished = maskBlock(buffer, length, minLength, lastBlock, &state);
+        if (fwrite(buffer, 1, finished, stdout) != (size_t)finished) {
+            st_errnoAbort("Failed to write the masked fasta");
+        }
+        memmove(buffer, buffer + finished, length - finished);
+    }
+    free(buffer);
+}
+
+static void maskFileInPlace(const char *fileName, int64_t minLength) {
+    int fd = open(fileName, O_RDWR);
+    if (fd == -1) {
+        st_errnoAbort("Could not open input file %s", fileName);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        st_errnoAbort("Could not stat input file %s", fileName);
+    }
+    if (fileStat.st_size > 0) {
+        char *block = mmap(NULL, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (block == MAP_FAILED) {
+            st_errnoAbort("Could not map input file %s", fileName);
+        }
+        MaskState state = { 1, 0, 0, 0 };
+        maskBlock(block, fileStat.st_size, minLength, 1, &state);
+        if (munmap(block, fileStat.st_size) != 0) {
+            st_errnoAbort("Could not unmap input file %s", fileName);
+        }
+    }
+    close(fd);
 }
 
 int main(int argc, char *argv[]) {
 
     int64_t min_length = 0;
-    
+    bool inPlace = 0;
+    int64_t numThreads = 1;
+
     while (1) {
         static struct option long_options[] = { { "minLength", required_argument, 0, 'm' },
+                                                { "inPlace", no_argument, 0, 'i' },
+                                                { "threads", required_argument, 0, 't' },
                                                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "m:", long_options, &option_index);
+        int key = getopt_long(argc, argv, "m:it:", long_options, &option_index);
         int i = 0;
 
         if (key == -1) {
@@ -81,6 +397,14 @@ int main(int argc, char *argv[]) {
             i = sscanf(optarg, "%" PRIi64 "", &min_length);
             assert(i == 1);
             break;
+        case 'i':
+            inPlace = 1;
+            break;
+        case 't':
+            if (sscanf(optarg, "%" PRIi64 "", &numThreads) != 1 || numThreads < 1) {
+                st_errAbort("Invalid number of threads %s", optarg);
+            }
+            break;
         default:
             usage();
             return 1;
@@ -92,7 +416,18 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+#if defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
+
     for (int64_t j = optind; j < argc; j++) {
+        if (inPlace) {
+            if (strcmp(argv[j], "-") == 0) {
+                st_errAbort("Can not mask stdin in place");
+            }
+            maskFileInPlace(argv[j], min_length);
+            continue;
+        }
         FILE *fileHandle;
         if (strcmp(argv[j], "-") == 0) {
             fileHandle = stdin;
@@ -102,7 +437,10 @@ int main(int argc, char *argv[]) {
                 st_errnoAbort("Could not open input file %s", argv[j]);
             }
         }
-        fastaReadToFunction(fileHandle, &min_length, hardmask);
+        maskFile(fileHandle, min_length);
+        if (fileHandle != stdin) {
+            fclose(fileHandle);
+        }
     }
 
     return 0;
@@ -16,6 +16,9 @@
 #include <limits.h>
 #include <inttypes.h>
 #include <stdint.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 #include "sonLib.h"
 
@@ -23,13 +26,14 @@ typedef int8_t   s8;
 typedef uint8_t  u8;
 typedef int32_t  s32;
 typedef uint32_t u32;
+typedef uint64_t u64;
 
 // program revision vitals (not the best way to do this!))
 
 #define programVersionMajor    "0"
-#define programVersionMinor    "0"
-#define programVersionSubMinor "3"
-#define programRevisionDate    "20131202"
+#define programVersionMinor    "1"
+#define programVersionSubMinor "0"
+#define programRevisionDate    "20261018"
 
 //----------
 //
@@ -45,21 +49,53 @@ typedef struct chr_info
     u32          lineNumber;    // line number where this chromosome first seen
     } chr_info;
 
+// intervals collected for a chromosome;  the starts and ends are sorted
+// separately and swept together to find the depth at each position, and the
+// covered intervals are written to the output text, to be written in input
+// order once the chromosomes processed alongside it are done;  positions more
+// than the look-back behind the furthest start are swept while reading, so
+// the sweep state is kept with the intervals still pending
+
+typedef struct chr_intervals
+    {
+    char*        chrom;         // chromosome name
+    u32*         starts;        // interval starts
+    u32*         ends;          // interval ends
+    u64          len;           // number of intervals
+    u64          size;          // number of intervals allocated
+    char*        output;        // covered intervals, as lines of text
+    u64          outputLen;     // length of the output text
+    u64          outputSize;    // number of bytes allocated for the output
+    u32          maxStart;      // furthest interval start seen
+    u32          sweptTo;       // positions before this have been swept
+    u64          flushLen;      // number of intervals at which to sweep next
+    int          inRun;         // true => a covered run is pending at sweptTo
+    u32          runStart;      // start of the pending run
+    } chr_intervals;
+
 // command line options
 
 stHash* chromsSeen    = NULL;
-u32   windowSize      = 1*1000*1000;
 int   inputHasOffsets = false;
 int   originOne       = false;
 int   endComment      = false;
 int   reportChroms    = false;
-u8    depthThreshold  = 1;
+u32   depthThreshold  = 1;
+u32   lookBack        = 1*1000*1000;
+int   numThreads      = 1;
+
+// the number of intervals to collect before processing the chromosomes
+// collected so far, if there are fewer of them than threads
 
-#define maxDepth 255
+#define maxBatchIntervals (64*1000*1000)
+
+// the least number of intervals a chromosome collects before those more than
+// the look-back behind are swept
+
+#define minFlushIntervals (1000*1000)
 
 int   debugReportInputIntervals  = false;
 int   debugReportParsedIntervals = false;
-int   debugWindowSlide           = false;
 
 //----------
 //
@@ -72,12 +108,16 @@ int main (int argc, char** argv);
 // private functions
 
 static void  parse_options       (int _argc, char** _argv);
-static void  emit_intervals      (FILE* f, u8 minDepth,
-                                  u8* window, char* chrom,
-                                  u32 pendingRun, u32 windowStart, u32 windowEnd);
-static u32   emit_some_intervals (FILE* f, u8 minDepth,
-                                  u8* window, char* chrom,
-                                  u32 pendingRun, u32 windowStart, u32 windowEnd);
+static chr_intervals* new_chromosome   (char* chrom);
+static void  add_interval        (chr_intervals* c, u32 start, u32 end);
+static void  process_chromosomes (FILE* f, u32 minDepth,
+                                  chr_intervals** batch, int batchLen);
+static void  find_intervals      (u32 minDepth, chr_intervals* c);
+static u64   flush_intervals     (u32 minDepth, chr_intervals* c);
+static u64   sweep_intervals     (u32 minDepth, chr_intervals* c,
+                                  int toEnd, u32 limit);
+static void  emit_interval       (chr_intervals* c, u32 start, u32 end);
+static void  sort_positions      (u32* positions, u64 len);
 static chr_info* find_chromosome (char* chrom);
 static int   read_alignment      (FILE* f,
                                   char* buffer, int bufferLen,
@@ -115,12 +155,15 @@ static void usage
     fprintf (stderr, "\n");
     //                123456789-123456789-123456789-123456789-123456789-123456789-123456789-123456789
     fprintf (stderr, "  M=<depth>              report any position that is covered by at least this\n");
-    fprintf (stderr, "                         many alignments; the maximum allowed depth is 255\n");
+    fprintf (stderr, "                         many alignments\n");
     fprintf (stderr, "                         (by default this is 1)\n");
-    fprintf (stderr, "  W=<length>             size of internal bitmap \"window\", in bases;  this\n");
-    fprintf (stderr, "                         should be at least twice the size of the query\n");
-    fprintf (stderr, "                         fragments being aligned/reported\n");
+    fprintf (stderr, "  W=<length>             how far, in bases, an interval may start before the\n");
+    fprintf (stderr, "                         furthest start seen on its chromosome;  positions\n");
+    fprintf (stderr, "                         further back than this are reported as we read, so\n");
+    fprintf (stderr, "                         only the intervals within it are held in memory\n");
     fprintf (stderr, "                         (by default this is 1M)\n");
+    fprintf (stderr, "  --threads=<N>          number of chromosomes to process at once\n");
+    fprintf (stderr, "                         (by default this is 1)\n");
     fprintf (stderr, "  --queryoffsets         input query names contain offsets, as described below\n");
     fprintf (stderr, "                         (by default input query names do not contain offsets)\n");
     fprintf (stderr, "  --origin=zero          *output* intervals are origin-zero, half-open\n");
@@ -142,6 +185,8 @@ static void usage
     fprintf (stderr, "                                  <qstart+> and <qend+>;  usually this is\n");
     fprintf (stderr, "                                  the start of a fragment given to the\n");
     fprintf (stderr, "                                  aligner\n");
+    fprintf (stderr, "The alignments for each query chromosome must be together in the input, and\n");
+    fprintf (stderr, "nearly sorted by query start, as described for W.\n");
     exit (EXIT_FAILURE);
     }
 
@@ -194,9 +239,7 @@ static void parse_options
                 chastise ("depth threshold can't be 0 (\"%s\")\n", arg);
             if (tempInt < 0)
                 chastise ("depth threshold can't be negative (\"%s\")\n", arg);
-            if (tempInt > maxDepth)
-                chastise ("depth threshold can't be more than %d (\"%s\")\n", maxDepth, arg);
-            depthThreshold = (u8) tempInt;
+            depthThreshold = (u32) tempInt;
             goto next_arg;
             }
 
@@ -211,7 +254,18 @@ static void parse_options
                 chastise ("chromosome length can't be 0 (\"%s\")\n", arg);
             if (tempInt < 0)
                 chastise ("chromosome length can't be negative (\"%s\")\n", arg);
-            windowSize = (u32) tempInt;
+            lookBack = (u32) tempInt;
+            goto next_arg;
+            }
+
+        // --threads=<N>
+
+        if (strcmp_prefix (arg, "--threads=") == 0)
+            {
+            tempInt = string_to_unitized_int (argVal, /*thousands*/ true);
+            if (tempInt <= 0)
+                chastise ("number of threads must be positive (\"%s\")\n", arg);
+            numThreads = tempInt;
             goto next_arg;
             }
 
@@ -260,9 +314,6 @@ static void parse_options
         if (strcmp (arg, "--debug=report:parsed") == 0)
             { debugReportParsedIntervals = true;  goto next_arg; }
 
-        if (strcmp (arg, "--debug=slide") == 0)
-            { debugWindowSlide = true;  goto next_arg; }
-
         // unknown -- argument
 
         if (strcmp_prefix (arg, "--") == 0)
@@ -286,24 +337,27 @@ int main
     char**  argv)
     {
     char    lineBuffer[1000];
-    char    prevChrom[1000];
-    u8*     window = NULL;
-    u32     windowStart, pendingRun, newWindowStart, prefixSize, suffixSize;
+    chr_intervals** batch = NULL;
+    chr_intervals*  current = NULL;
+    int     batchLen;
+    u64     batchIntervals;
     u32     lineNumber;
     char*   rChrom, *qChrom;
     chr_info*   chromInfo;
-    u32     rStart, rEnd, qStart, qEnd, qStartOriginal, qEndOriginal;
-    u32     ix;
+    u32     rStart, rEnd, qStart, qEnd;
     int     ok;
 
     parse_options (argc, argv);
+#if defined(_OPENMP)
+    omp_set_num_threads (numThreads);
+#endif
 
     //////////
     // allocate memory
     //////////
 
-    window = (u8*) malloc (windowSize);
-    if (window == NULL) goto cant_allocate_window;
+    batch = (chr_intervals**) malloc (numThreads * sizeof(chr_intervals*));
+    if (batch == NULL) goto cant_allocate_batch;
 
     chromsSeen = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, free, free);
 
@@ -311,11 +365,11 @@ int main
     // process intervals
     //////////
 
-    // read intervals and accumulate depth
+    // read intervals, collecting them by chromosome;  the chromosomes are
+    // processed in batches of up to one per thread, so the memory we hold is
+    // bounded by the intervals of the chromosomes in the batch
 
-    prevChrom[0] = 0;
-    windowStart = 0;  pendingRun = 0;
-    //memset (window, 0, windowSize); // (not necessary, happens later)
+    batchLen = 0;  batchIntervals = 0;
 
     while (true)
         {
@@ -323,24 +377,16 @@ int main
                              &rChrom, &rStart, &rEnd, &qChrom, &qStart, &qEnd);
         if (!ok) break;
 
-        qStartOriginal = qStart;
-        qEndOriginal   = qEnd;
-
         if (debugReportParsedIntervals)
             fprintf (stderr, "%s %u %u %s %u %u\n",
                              rChrom, rStart, rEnd, qChrom, qStart, qEnd);
 
-        // if this is a new chromosome, emit pending intervals for the previous
-        // chromosome and reset the window;  also make sure that we don't see
-        // a chromsome in non-consecutive batches
+        // if this is a new chromosome, start collecting its intervals,
+        // processing the batch first if it is full;  also make sure that we
+        // don't see a chromsome in non-consecutive batches
 
-        if (strcmp (qChrom, prevChrom) != 0)
+        if ((current == NULL) || (strcmp (qChrom, current->chrom) != 0))
             {
-            if (prevChrom[0] != 0)
-                emit_intervals (stdout, depthThreshold,
-                                window, prevChrom, pendingRun,
-                                windowStart, windowStart + windowSize);
-
             chromInfo = find_chromosome (qChrom);
             if (chromInfo != NULL) goto chrom_not_together;
 
@@ -352,9 +398,14 @@ int main
 
             if (reportChroms)
                 fprintf (stderr, "progress: reading %s (line %u)\n", qChrom, lineNumber);
-            strncpy (prevChrom, qChrom, sizeof(prevChrom));
-            windowStart = 0;  pendingRun = 0;
-            memset (window, 0, windowSize);
+
+            if ((batchLen == numThreads) || (batchIntervals >= maxBatchIntervals))
+                {
+                process_chromosomes (stdout, depthThreshold, batch, batchLen);
+                batchLen = 0;  batchIntervals = 0;
+                }
+
+            current = batch[batchLen++] = new_chromosome (qChrom);
             }
 
         // ignore trivial self-alignments
@@ -362,67 +413,32 @@ int main
         if ((strcmp (qChrom, rChrom) == 0) && (qStart == rStart) && (qEnd == rEnd))
             continue;
 
-        // if this interval won't fit in the window, emit some intervals and
-        // slide the window
+        // ignore empty intervals, which cover nothing
 
-        if (qStart < windowStart) goto window_slide_problem;
+        if (qEnd <= qStart)
+            continue;
 
-        if (qEnd > windowStart + windowSize)
-            {
-            newWindowStart = qEnd - windowSize/2;
+        if (qStart < current->sweptTo) goto not_nearly_sorted;
 
-            if (newWindowStart > windowStart + windowSize)
-                {
-                // there is no overlap between old window and new
-                emit_intervals (stdout, depthThreshold,
-                                window, qChrom, pendingRun,
-                                windowStart, windowStart + windowSize);
-                windowStart = newWindowStart;
-                pendingRun  = 0;
-                memset (window, 0, windowSize);
-                if (debugWindowSlide)
-                    fprintf (stderr, "moving window to %u\n", windowStart);
-                }
-            else
-                {
-                // there is some overlap between old window and new
-                prefixSize = newWindowStart - windowStart;
-                suffixSize = windowSize-prefixSize;
-                pendingRun = emit_some_intervals (stdout, depthThreshold,
-                                                  window, qChrom, pendingRun,
-                                                  windowStart, newWindowStart);
-                memcpy (/*to*/ window, /*from*/ window+prefixSize, suffixSize);
-                memset (window+suffixSize, 0, prefixSize);
-                windowStart = newWindowStart;
-                if (debugWindowSlide)
-                    fprintf (stderr, "sliding window to %u\n", windowStart);
-                }
-            }
+        add_interval (current, qStart, qEnd);
+        batchIntervals++;
 
-        // mark this interval in the window
-        // $$$ note that we're tracking depth;  someday we may want to add a
-        // $$$ .. depth threshold instead of 0/1
+        // sweep the positions that no later interval can reach, to free the
+        // intervals that end before them
 
-        qStart -= windowStart;
-        qEnd   -= windowStart;
-        if (qEnd > windowSize) goto window_too_short;
-
-        for (ix=qStart ; ix<qEnd ; ix++)
-            { if (window[ix] < maxDepth) window[ix]++; }
+        if (current->len >= current->flushLen)
+            batchIntervals -= flush_intervals (depthThreshold, current);
         }
 
-    // emit pending intervals for the final chromosome
+    // process the final batch
 
-    if (prevChrom[0] != 0)
-        emit_intervals (stdout, depthThreshold,
-                        window, prevChrom, pendingRun,
-                        windowStart, windowStart + windowSize);
+    process_chromosomes (stdout, depthThreshold, batch, batchLen);
 
     //////////
     // success
     //////////
 
-    free (window);
+    free (batch);
 
     stHash_destruct(chromsSeen);
     chromsSeen = NULL;
@@ -436,9 +452,9 @@ int main
     // failure exits
     //////////
 
-cant_allocate_window:
-    fprintf (stderr, "failed to allocate %d-entry counting window\n",
-                     windowSize);
+cant_allocate_batch:
+    fprintf (stderr, "failed to allocate %d-entry chromosome batch\n",
+                     numThreads);
     return EXIT_FAILURE;
 
 cant_allocate_info:
@@ -446,99 +462,329 @@ cant_allocate_info:
                      (int) sizeof(chr_info), qChrom);
     return EXIT_FAILURE;
 
-window_slide_problem:
-    fprintf (stderr, "%s %u %u is behind the sliding window (window start = %u)\n",
-                     qChrom, qStartOriginal, qEndOriginal, windowStart);
-    return EXIT_FAILURE;
-
-window_too_short:
-    fprintf (stderr, "W=%u is unable to accomodate %s %u %u (window start = %u)\n",
-                     windowSize, qChrom, qStartOriginal, qEndOriginal, windowStart);
-    return EXIT_FAILURE;
-
 chrom_not_together:
     fprintf (stderr, "alignments for \"%s\" are not together in the input (lines %u and %u)\n",
                      qChrom, chromInfo->lineNumber, lineNumber);
     return EXIT_FAILURE;
+
+not_nearly_sorted:
+    fprintf (stderr, "alignment for \"%s\" at line %u starts at %u, more than W=%u before %u;"
+                     " try a larger W\n",
+                     qChrom, lineNumber, qStart, lookBack, current->maxStart);
+    return EXIT_FAILURE;
     }
 
 //----------
 //
-// emit_intervals--
-//  Emit covered intervals from the sliding window.
-// emit_some_intervals--
-//  Emit covered intervals from a prefix of the sliding window.
+// new_chromosome--
+//  Create an empty collection of intervals for a chromosome.
+// add_interval--
+//  Add an interval to a chromosome's collection.
 //
 //----------
 //
 // Arguments:
-//  FILE*   f:              file to write to.
-//  u8      minDepth:       minimum depth a position must have, to be
-//                          .. considered "covered"
-//  u8*     window:         depth-of-coverage vector.
-//  char*   chrom:          name of the chromosome.
-//  u32     pendingRun:     length of run preceding the first entry in the
-//                          .. vector.
-//  u32     windowStart:    position (on the chromosome) of the first entry in
-//                          .. the vector.
-//  u32     windowEnd:      position (on the chromosome) beyond the last entry
-//                          .. in the vector;  for emit_some_intervals this is
-//                          .. at the end of the prefix.
+//  char*           chrom:  name of the chromosome.
+//  chr_intervals*  c:      the collection to add to.
+//  u32             start:  start of the interval, origin-zero.
+//  u32             end:    end of the interval, greater than the start.
 //
 // Returns:
-//  (emit_intervals)      nothing
-//  (emit_some_intervals) length of the unreported run at the end of the prefix
+//  (new_chromosome) a pointer to the new collection;  failures result in
+//                   program termination.
+//  (add_interval)   nothing;  failures result in program termination.
 //
 //----------
 
-//=== emit_intervals ===
+//=== new_chromosome ===
 
-static void emit_intervals
-   (FILE*   f,
-    u8      minDepth,
-    u8*     window,
-    char*   chrom,
-    u32     pendingRun,
-    u32     windowStart,
-    u32     windowEnd)
+static chr_intervals* new_chromosome
+   (char*   chrom)
     {
-    u32     run;
-    u32     o = (originOne)? 1:0;
+    chr_intervals* c;
+
+    c = (chr_intervals*) calloc (1, sizeof(chr_intervals));
+    if (c == NULL)
+        {
+        fprintf (stderr, "failed to allocate intervals for %s\n", chrom);
+        exit (EXIT_FAILURE);
+        }
+
+    c->chrom    = copy_string (chrom);
+    c->flushLen = minFlushIntervals;
+    return c;
+    }
+
+
+//=== add_interval ===
+
+static void add_interval
+   (chr_intervals*  c,
+    u32             start,
+    u32             end)
+    {
+    if (c->len == c->size)
+        {
+        c->size   = (c->size == 0)? 1024 : 2*c->size;
+        c->starts = (u32*) realloc (c->starts, c->size * sizeof(u32));
+        c->ends   = (u32*) realloc (c->ends,   c->size * sizeof(u32));
+        if ((c->starts == NULL) || (c->ends == NULL))
+            {
+            fprintf (stderr, "failed to allocate %llu intervals for %s\n",
+                             (unsigned long long) c->size, c->chrom);
+            exit (EXIT_FAILURE);
+            }
+        }
+
+    c->starts[c->len] = start;
+    c->ends  [c->len] = end;
+    c->len++;
+
+    if (start > c->maxStart) c->maxStart = start;
+    }
+
+//----------
+//
+// process_chromosomes--
+//  Find the covered intervals of a batch of chromosomes, one per thread, and
+//  emit them in the order the chromosomes were read.
+//
+//----------
+//
+// Arguments:
+//  FILE*           f:          file to write to.
+//  u32             minDepth:   minimum depth a position must have, to be
+//                              .. considered "covered"
+//  chr_intervals** batch:      the chromosomes;  these are disposed of.
+//  int             batchLen:   number of chromosomes in the batch.
+//
+// Returns:
+//  nothing
+//
+//----------
+
+static void process_chromosomes
+   (FILE*           f,
+    u32             minDepth,
+    chr_intervals** batch,
+    int             batchLen)
+    {
+    int             ix;
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (ix=0 ; ix<batchLen ; ix++)
+        find_intervals (minDepth, batch[ix]);
 
-    run = emit_some_intervals (f, minDepth,
-                               window, chrom, pendingRun, windowStart, windowEnd);
-    if (run > 0)
-        fprintf (f, "%s\t%d\t%d\n", chrom, (windowEnd-run)+o, windowEnd);
+    for (ix=0 ; ix<batchLen ; ix++)
+        {
+        if (batch[ix]->outputLen > 0)
+            fwrite (batch[ix]->output, 1, batch[ix]->outputLen, f);
+        free (batch[ix]->output);
+        free (batch[ix]->chrom);
+        free (batch[ix]);
+        }
+    }
+
+//----------
+//
+// find_intervals--
+//  Find the covered intervals of a chromosome, once all its intervals have
+//  been read.
+// flush_intervals--
+//  Find the covered intervals of a chromosome before the furthest start seen,
+//  less the look-back;  no interval read later can start before that.
+// sweep_intervals--
+//  Sweep a chromosome's sorted interval starts and ends together, up to a
+//  limit;  the depth only changes at these positions, so the covered
+//  intervals are the runs between them where the depth is at least the
+//  minimum.  The intervals that end before the limit are disposed of, and
+//  those that cross it are clipped to start at it, which leaves the depth
+//  beyond it the same.
+//
+//----------
+//
+// Arguments:
+//  u32             minDepth:   minimum depth a position must have, to be
+//                              .. considered "covered"
+//  chr_intervals*  c:          the chromosome;  its output is filled in.
+//  int             toEnd:      (sweep_intervals only) true => sweep all the
+//                              .. intervals, disposing of them
+//  u32             limit:      (sweep_intervals only) if not toEnd, the
+//                              .. position to sweep up to;  no interval
+//                              .. may be added that starts before it
+//
+// Returns:
+//  (find_intervals)  nothing
+//  (flush_intervals, sweep_intervals)  the number of intervals disposed of
+//
+//----------
+
+//=== find_intervals ===
+
+static void find_intervals
+   (u32             minDepth,
+    chr_intervals*  c)
+    {
+    sweep_intervals (minDepth, c, true, 0);
     }
 
 
-//=== emit_some_intervals ===
+//=== flush_intervals ===
+
+static u64 flush_intervals
+   (u32             minDepth,
+    chr_intervals*  c)
+    {
+    u64     disposed = 0;
+
+    if ((c->maxStart > lookBack) && (c->maxStart - lookBack > c->sweptTo))
+        disposed = sweep_intervals (minDepth, c, false, c->maxStart - lookBack);
+
+    // the intervals crossing the limit are kept, so wait until there are
+    // twice as many before sweeping again
+
+    c->flushLen = (2*c->len > minFlushIntervals)? 2*c->len : minFlushIntervals;
+    return disposed;
+    }
+
+
+//=== sweep_intervals ===
+
+static u64 sweep_intervals
+   (u32             minDepth,
+    chr_intervals*  c,
+    int             toEnd,
+    u32             limit)
+    {
+    u64     startIx, endIx, keep, ix;
+    u32     depth, pos;
+
+    sort_positions (c->starts, c->len);
+    sort_positions (c->ends,   c->len);
+
+    // every interval ends at or after its start, so the ends are exhausted last
+
+    depth = 0;
+    for (startIx=endIx=0 ; endIx<c->len ; )
+        {
+        pos = c->ends[endIx];
+        if ((startIx < c->len) && (c->starts[startIx] < pos))
+            pos = c->starts[startIx];
+        if ((!toEnd) && (pos >= limit))
+            break;
+
+        while ((startIx < c->len) && (c->starts[startIx] == pos))
+            { depth++;  startIx++; }
+        while ((endIx < c->len) && (c->ends[endIx] == pos))
+            { depth--;  endIx++; }
+
+        if ((depth >= minDepth) && (!c->inRun))
+            { c->runStart = pos;  c->inRun = true; }
+        else if ((depth < minDepth) && (c->inRun))
+            { emit_interval (c, c->runStart, pos);  c->inRun = false; }
+        }
+
+    if (toEnd)
+        {
+        free (c->starts);  c->starts = NULL;
+        free (c->ends);    c->ends   = NULL;
+        c->len = c->size = 0;
+        return endIx;
+        }
+
+    // keep the intervals that end at or after the limit;  the depth is the
+    // number of them that started before it, which are clipped to start at
+    // the limit, the starts still to come all being at or after it
+
+    keep = c->len - endIx;
+    memmove (c->ends, c->ends + endIx, keep * sizeof(u32));
+    memmove (c->starts + depth, c->starts + startIx, (c->len - startIx) * sizeof(u32));
+    for (ix=0 ; ix<depth ; ix++)
+        c->starts[ix] = limit;
+    c->len     = keep;
+    c->sweptTo = limit;
+    return endIx;
+    }
 
-static u32 emit_some_intervals
-   (FILE*   f,
-    u8      minDepth,
-    u8*     window,
-    char*   chrom,
-    u32     pendingRun,
-    u32     windowStart,
-    u32     windowEnd)
+//----------
+//
+// emit_interval--
+//  Add a covered interval to a chromosome's output.
+//
+//----------
+//
+// Arguments:
+//  chr_intervals*  c:      the chromosome.
+//  u32             start:  start of the interval, origin-zero.
+//  u32             end:    end of the interval.
+//
+// Returns:
+//  nothing;  failures result in program termination.
+//
+//----------
+
+static void emit_interval
+   (chr_intervals*  c,
+    u32             start,
+    u32             end)
     {
-    u32     run = pendingRun;
     u32     o = (originOne)? 1:0;
-    u32     ix, pos;
+    u64     needed = strlen (c->chrom) + 2*11 + 3;  // two %d, two tabs, \n
 
-    for (ix=0,pos=windowStart ; pos<windowEnd ; ix++,pos++)
+    if (c->outputLen + needed >= c->outputSize)
         {
-        if (window[ix] >= minDepth)
-            run++;
-        else if (run > 0)
+        c->outputSize = 2*c->outputSize + needed + 1;
+        c->output = (char*) realloc (c->output, c->outputSize);
+        if (c->output == NULL)
             {
-            fprintf (f, "%s\t%d\t%d\n", chrom, (pos-run)+o, pos);
-            run = 0;
+            fprintf (stderr, "failed to allocate %llu bytes of output for %s\n",
+                             (unsigned long long) c->outputSize, c->chrom);
+            exit (EXIT_FAILURE);
             }
         }
 
-    return run;
+    c->outputLen += sprintf (c->output + c->outputLen, "%s\t%d\t%d\n",
+                             c->chrom, start+o, end);
+    }
+
+//----------
+//
+// sort_positions--
+//  Sort positions into increasing order.  The input is nearly sorted, so the
+//  positions are often already in order, in which case we leave them be.
+//
+//----------
+//
+// Arguments:
+//  u32*    positions:  the positions to sort.
+//  u64     len:        number of positions.
+//
+// Returns:
+//  nothing
+//
+//----------
+
+static int compare_positions (const void* a, const void* b)
+    {
+    u32 pa = *(const u32*) a;
+    u32 pb = *(const u32*) b;
+    return (pa > pb) - (pa < pb);
+    }
+
+
+static void sort_positions
+   (u32*    positions,
+    u64     len)
+    {
+    u64     ix;
+
+    for (ix=1 ; ix<len ; ix++)
+        { if (positions[ix] < positions[ix-1]) break; }
+
+    if (ix < len)
+        qsort (positions, len, sizeof(u32), compare_positions);
     }
 
 //----------
@@ -11,6 +11,9 @@
 #include <stdlib.h>
 #include <time.h>
 #include <getopt.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 #include "cactus.h"
 #include "sonLib.h"
@@ -27,6 +30,9 @@ void usage() {
             "-e --matchingAlgorithm : Name of matching algorithm, either 'greedy', 'maxWeight', 'maxCardinality', 'blossom5'\n");
     fprintf(stderr, "-g --referenceEventString : String identifying the reference event.\n");
     fprintf(stderr, "-i --permutations : Number of permutations of gibss sampling, integer >= 0\n");
+    fprintf(stderr,
+            "-r --samplingChains : Number of independent chains of gibbs sampling to run from the greedy reference, keeping the best, integer >= 1. Default=1\n");
+    fprintf(stderr, "-T --threads : Number of threads to build the references of sibling flowers on, integer >= 1. Default=1\n");
     fprintf(stderr, "-j --useSimulatedAnnealing : Use a cooling schedule\n");
     fprintf(stderr, "-k --theta : The value of theta, higher values are more tolerant of rearrangement.\n");
     fprintf(stderr,
@@ -66,6 +72,8 @@ int main(int argc, char *argv[]) {
     chooseMatching_greedy;
     char *referenceEventString = (char *) cactusMisc_getDefaultReferenceEventHeader();
     int64_t permutations = 10;
+    int64_t samplingChains = 1;
+    int64_t numThreads = 1;
     double theta = 0.001;
     double phi = 1.0;
     bool useSimulatedAnnealing = 0;
@@ -89,11 +97,12 @@ int main(int argc, char *argv[]) {
         required_argument, 0, 's' }, { "maxWalkForCalculatingZ", required_argument, 0, 'l' }, { "ignoreUnalignedGaps",
         no_argument, 0, 'm' }, { "wiggle", required_argument, 0, 'n' }, { "numberOfNs", required_argument, 0, 'o' }, {
                 "minNumberOfSequencesToSupportAdjacency", required_argument, 0, 'p' }, { "makeScaffolds", no_argument,
-                0, 'q' }, { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+                0, 'q' }, { "samplingChains", required_argument, 0, 'r' }, { "threads", required_argument, 0, 'T' }, {
+                "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "a:c:d:e:g:i:jk:hl:mn:o:p:qs:", long_options, &option_index);
+        int key = getopt_long(argc, argv, "a:c:d:e:g:i:jk:hl:mn:o:p:qr:s:T:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -188,6 +197,20 @@ int main(int argc, char *argv[]) {
         case 'q':
             makeScaffolds = 1;
             break;
+        case 'r':
+            j = sscanf(optarg, "%" PRIi64 "", &samplingChains);
+            assert(j == 1);
+            if (samplingChains < 1) {
+                stThrowNew(REFERENCE_BUILDING_EXCEPTION, "Sampling chains is not valid %" PRIi64 "", samplingChains);
+            }
+            break;
+        case 'T':
+            j = sscanf(optarg, "%" PRIi64 "", &numThreads);
+            assert(j == 1);
+            if (numThreads < 1) {
+                stThrowNew(REFERENCE_BUILDING_EXCEPTION, "Threads is not valid %" PRIi64 "", numThreads);
+            }
+            break;
         default:
             usage();
             return 1;
@@ -199,10 +222,14 @@ int main(int argc, char *argv[]) {
     //////////////////////////////////////////////
 
     st_setLogLevelFromString(logLevelString);
+#if defined(_OPENMP)
+    omp_set_num_threads(numThreads);
+#endif
 
     st_logInfo("The theta parameter has been set to %lf\n", theta);
     st_logInfo("The ignore unaligned gaps parameter is %i\n", ignoreUnalignedGaps);
     st_logInfo("The number of permutations is %" PRIi64 "\n", permutations);
+    st_logInfo("The number of sampling chains is %" PRIi64 "\n", samplingChains);
     st_logInfo("Simulated annealing is %" PRIi64 "\n", useSimulatedAnnealing);
     st_logInfo("Max number of segments in thread to calculate z-score between is %" PRIi64 "\n",
             maxWalkForCalculatingZ);
@@ -247,24 +274,39 @@ int main(int argc, char *argv[]) {
         stList_destruct(flowers);
 
         if (!flower_hasParentGroup(flower)) {
-            buildReferenceTopDown(flower, referenceEventString, permutations, matchingAlgorithm, temperatureFn, theta,
+            buildReferenceTopDown(flower, referenceEventString, permutations, samplingChains, matchingAlgorithm, temperatureFn, theta,
                     phi, maxWalkForCalculatingZ, ignoreUnalignedGaps, wiggle, numberOfNsForScaffoldGap,
                     minNumberOfSequencesToSupportAdjacency, makeScaffolds);
             cactusDisk_addUpdateRequest(cactusDisk, flower);
         }
+        /*
+         * The references of the nested flowers only depend on the reference of this flower, so are built in
+         * parallel. Each thread loads one nested flower at a time and unloads it once its update request is made,
+         * so at most one nested flower per thread is in memory.
+         */
+        stList *groups = stList_construct();
         Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
         Group *group;
         while ((group = flower_getNextGroup(groupIt)) != NULL) {
-            Flower *subFlower = group_getNestedFlower(group);
+            if (!group_isLeaf(group)) {
+                stList_append(groups, group);
+            }
+        }
+        flower_destructGroupIterator(groupIt);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 1) if(stList_length(groups) > 1)
+#endif
+        for (int64_t i = 0; i < stList_length(groups); i++) {
+            Flower *subFlower = group_getNestedFlower(stList_get(groups, i));
             if (subFlower != NULL) {
-                buildReferenceTopDown(subFlower, referenceEventString, permutations,
+                buildReferenceTopDown(subFlower, referenceEventString, permutations, samplingChains,
                         matchingAlgorithm, temperatureFn, theta, phi, maxWalkForCalculatingZ, ignoreUnalignedGaps,
                         wiggle, numberOfNsForScaffoldGap, minNumberOfSequencesToSupportAdjacency, makeScaffolds);
                 cactusDisk_addUpdateRequest(cactusDisk, subFlower);
                 flower_unload(subFlower);
             }
         }
-        flower_destructGroupIterator(groupIt);
+        stList_destruct(groups);
         assert(!flower_isParentLoaded(flower));
         cactusDisk_clearCache(cactusDisk);
     }
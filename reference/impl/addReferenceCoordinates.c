@@ -173,14 +173,13 @@ static void recoverBrokenAdjacencies(Flower *flower, stList *recoveredCaps, Name
     flower_destructGroupIterator(groupIt);
 }
 
-static char *terminalAdjacencyWriteFn(Cap *cap) {
+static char *terminalAdjacencyWriteFn(Cap *cap, void *extraArg) {
     return stString_copy("");
 }
 
-static stHash *segmentWriteFn_flowerToPhylogeneticTreeHash;
-
-static char *segmentWriteFn(Segment *segment) {
-    stTree *phylogeneticTree = stHash_search(segmentWriteFn_flowerToPhylogeneticTreeHash, block_getFlower(segment_getBlock(segment)));
+static char *segmentWriteFn(Segment *segment, void *extraArg) {
+    stHash *flowerToPhylogeneticTreeHash = extraArg;
+    stTree *phylogeneticTree = stHash_search(flowerToPhylogeneticTreeHash, block_getFlower(segment_getBlock(segment)));
     assert(phylogeneticTree != NULL);
     char *segmentString = getMaximumLikelihoodString(phylogeneticTree, segment_getBlock(segment));
     //We append a zero to a segment string if it is part of block containing only a reference segment, else we append a 1.
@@ -301,17 +300,17 @@ void bottomUp(stList *flowers, stKVDatabase *sequenceDatabase, Name referenceEve
     }
 
     //Build the phylogenetic event trees for base calling.
-    segmentWriteFn_flowerToPhylogeneticTreeHash = stHash_construct2(NULL, (void (*)(void *))cleanupPhylogeneticTree);
+    stHash *flowerToPhylogeneticTreeHash = stHash_construct2(NULL, (void (*)(void *))cleanupPhylogeneticTree);
     for(int64_t i=0; i<stList_length(flowers); i++) {
         Flower *flower = stList_get(flowers, i);
         Event *refEvent = eventTree_getEvent(flower_getEventTree(flower), referenceEventName);
         assert(refEvent != NULL);
-        stHash_insert(segmentWriteFn_flowerToPhylogeneticTreeHash, flower, getPhylogeneticTreeRootedAtGivenEvent(refEvent, generateSubstitutionMatrix));
+        stHash_insert(flowerToPhylogeneticTreeHash, flower, getPhylogeneticTreeRootedAtGivenEvent(refEvent, generateSubstitutionMatrix));
     }
 
     if (isTop) {
         stList *threadStrings = buildRecursiveThreadsInList(sequenceDatabase, caps, segmentWriteFn,
-                terminalAdjacencyWriteFn);
+                terminalAdjacencyWriteFn, flowerToPhylogeneticTreeHash);
         assert(stList_length(threadStrings) == stList_length(caps));
 
         int64_t nonTrivialSeqIndex = 0, trivialSeqIndex = stList_length(threadStrings); //These are used as indices for the names of trivial and non-trivial sequences.
@@ -332,9 +331,10 @@ void bottomUp(stList *flowers, stKVDatabase *sequenceDatabase, Name referenceEve
         stList_setDestructor(threadStrings, NULL); //The strings are already cleaned up by the above loop
         stList_destruct(threadStrings);
     } else {
-        buildRecursiveThreads(sequenceDatabase, caps, segmentWriteFn, terminalAdjacencyWriteFn);
+        buildRecursiveThreads(sequenceDatabase, caps, segmentWriteFn, terminalAdjacencyWriteFn,
+                flowerToPhylogeneticTreeHash);
     }
-    stHash_destruct(segmentWriteFn_flowerToPhylogeneticTreeHash);
+    stHash_destruct(flowerToPhylogeneticTreeHash);
     stList_destruct(caps);
 }
 
@@ -5,6 +5,7 @@
 #include "stCheckEdges.h"
 #include "stMatchingAlgorithms.h"
 #include "stReferenceProblem2.h"
+#include "referenceSampler.h"
 #include <math.h>
 
 const char *REFERENCE_BUILDING_EXCEPTION = "REFERENCE_BUILDING_EXCEPTION";
@@ -106,41 +107,15 @@ static stList *calculateZP(Cap *cap, stHash *endsToNodes) {
     return NULL;
 }
 
-static Cap *calculateZP4(Cap *cap, stHash *endsToNodes) {
-    if (cap_getOtherSegmentCap(cap) == NULL) {
-        return NULL;
-    }
-    while (1) {
-        cap = cap_getOtherSegmentCap(cap);
-        assert(cap != NULL);
-        End *end = end_getPositiveOrientation(cap_getEnd(cap));
-        if (stHash_search(endsToNodes, end) != NULL) {
-            return cap;
-        }
-        cap = cap_getAdjacency(cap);
-        assert(cap != NULL);
-        end = end_getPositiveOrientation(cap_getEnd(cap));
-        assert(stHash_search(endsToNodes, end) == NULL);
-        if (end_isStubEnd(end)) {
-            //if(!end_isFree(end)) { //Not true is normalisation is disabled
-            //    assert(!flower_hasParentGroup(end_getFlower(end)));
-            //}
-            return NULL;
-        }
-    }
-    return NULL;
-}
-
-static int64_t calculateZP2(Cap *cap, stHash *endsToNodes) {
+static int64_t calculateZP2(Cap *cap, Cap *otherCap) {
     /*
      * Calculate the length of a segment that can be traversed from a cap,
-     * before hitting the end of the sequence of one of the other ends in the set
-     * endsToNodes.
+     * before hitting otherCap, the next cap along the sequence from an end in the set
+     * endsToNodes, or, if otherCap is NULL, the end of the sequence.
      */
     assert(cap_getStrand(cap));
     Sequence *sequence = cap_getSequence(cap);
     assert(sequence != NULL);
-    Cap *otherCap = calculateZP4(cap, endsToNodes);
     int64_t capLength;
     if (otherCap == NULL) {
         //capLength = 1000000000; //make the length really long if attached, so that we don't bias toward one or the other end.
@@ -284,26 +259,145 @@ static stSet *getEventsWithSequences(Flower *flower) {
     return seqSet;
 }
 
-static double calculateZScoreWeightedAdapterFn(Cap *_5Cap, int64_t length5Segment, int64_t length3Segment, int64_t gap, void *extraArgs) {
-    double theta = *((double *)((void **) extraArgs)[0]);
-    assert(theta >= 0.0);
-    assert(cap_getEvent(_5Cap) != NULL);
-    assert(stHash_search(((void **) extraArgs)[1], cap_getEvent(_5Cap)) != NULL);
-    assert(stDoubleTuple_length(stHash_search(((void **) extraArgs)[1], cap_getEvent(_5Cap))) == 1);
-    double weight = stDoubleTuple_getPosition(stHash_search(((void **) extraArgs)[1], cap_getEvent(_5Cap)), 0);
-    return calculateZScore(length5Segment, length3Segment, gap, theta) * weight;
+/*
+ * A set of adjacency scores to calculate with calculateZ.
+ */
+typedef struct _zParameters {
+    int64_t maxWalk; // The number of adjacencies to walk along a sequence from each cap
+    bool ignoreUnalignedGaps; // If true, unaligned sequence between the caps is not counted in the gap
+    bool count; // If true, the adjacencies are counted, otherwise they are given weighted z-scores
+    double theta; // The decay of the z-score with the gap between caps
+    refAdjList *aL; // The scores, constructed by calculateZ
+    refNeighbours *nL; // If not NULL, given the pairs of nodes with a score in aL
+} ZParameters;
+
+/*
+ * The caps of a sequence that represent the ends of the chains and stubs, with their node, the
+ * length of sequence that follows each cap, and the unaligned sequence before each 5 cap.
+ */
+typedef struct _zThread {
+    bool startsWith5Cap;
+    int64_t length;
+    int64_t maxLength;
+    int64_t *nodes;
+    int64_t *coordinates;
+    int64_t *capSizes;
+    int64_t *unaligned;
+} ZThread;
+
+static void zThread_fill(ZThread *zThread, Cap *cap, stHash *endsToNodes) {
+    stList *caps = calculateZP(cap, endsToNodes);
+    zThread->length = stList_length(caps);
+    zThread->startsWith5Cap = zThread->length > 0 && cap_getSide(stList_get(caps, 0));
+    if (zThread->length > zThread->maxLength) {
+        zThread->maxLength = zThread->length * 2;
+        zThread->nodes = st_realloc(zThread->nodes, sizeof(int64_t) * zThread->maxLength);
+        zThread->coordinates = st_realloc(zThread->coordinates, sizeof(int64_t) * zThread->maxLength);
+        zThread->capSizes = st_realloc(zThread->capSizes, sizeof(int64_t) * zThread->maxLength);
+        zThread->unaligned = st_realloc(zThread->unaligned, sizeof(int64_t) * zThread->maxLength);
+    }
+    for (int64_t i = 0; i < zThread->length; i++) {
+        Cap *cap = stList_get(caps, i);
+        zThread->nodes[i] = stIntTuple_get(stHash_search(endsToNodes, end_getPositiveOrientation(cap_getEnd(cap))), 0);
+        zThread->coordinates[i] = cap_getCoordinate(cap);
+        /*
+         * The caps alternate between 3 and 5 caps along the sequence, so the next cap of an end in endsToNodes
+         * is the following cap for a 5 cap and the preceding cap for a 3 cap.
+         */
+        Cap *otherCap = NULL;
+        if (cap_getSide(cap)) {
+            assert(cap_getAdjacency(cap) != NULL);
+            assert(cap_getCoordinate(cap) - cap_getCoordinate(cap_getAdjacency(cap)) - 1 >= 0);
+            zThread->unaligned[i] = cap_getCoordinate(cap) - cap_getCoordinate(cap_getAdjacency(cap)) - 1;
+            if (cap_getOtherSegmentCap(cap) != NULL && i + 1 < zThread->length) {
+                otherCap = stList_get(caps, i + 1);
+            }
+        } else {
+            zThread->unaligned[i] = 0;
+            if (cap_getOtherSegmentCap(cap) != NULL && i > 0) {
+                otherCap = stList_get(caps, i - 1);
+            }
+        }
+        zThread->capSizes[i] = calculateZP2(cap, otherCap);
+    }
+    stList_destruct(caps);
 }
 
-static double countAdapterFn(Cap *_5Cap, int64_t length5Segment, int64_t length3Segment, int64_t gap, void *extraArgs) {
-    return 1;
+static void calculateZP3(ZThread *zThread, double weight, ZParameters *zParameters, int64_t zParameterNumber) {
+    /*
+     * Iterate through all pairs of 5' and 3' caps of the sequence to calculate additions to the scores.
+     */
+    int64_t maxWalk = 0;
+    for (int64_t r = 0; r < zParameterNumber; r++) {
+        maxWalk = zParameters[r].maxWalk > maxWalk ? zParameters[r].maxWalk : maxWalk;
+    }
+    bool walking[zParameterNumber];
+    for (int64_t i = zThread->startsWith5Cap ? 1 : 0; i < zThread->length; i += 2) {
+        int64_t _3Node = zThread->nodes[i];
+        int64_t _3CapSize = zThread->capSizes[i];
+        int64_t unaligned = 0;
+        for (int64_t r = 0; r < zParameterNumber; r++) {
+            walking[r] = 1;
+        }
+        for (int64_t k = 0; k < maxWalk; k++) {
+            int64_t j = k * 2 + i + 1;
+            if (j >= zThread->length) {
+                break;
+            }
+            unaligned += zThread->unaligned[j];
+            int64_t _5Node = zThread->nodes[j];
+            int64_t _5CapSize = zThread->capSizes[j];
+            assert(zThread->coordinates[j] - zThread->coordinates[i] > 0);
+            bool stillWalking = 0;
+            for (int64_t r = 0; r < zParameterNumber; r++) {
+                ZParameters *z = &zParameters[r];
+                if (!walking[r] || k >= z->maxWalk) {
+                    continue;
+                }
+                int64_t diff = zThread->coordinates[j] - zThread->coordinates[i] - (z->ignoreUnalignedGaps ? unaligned : 0);
+                assert(diff >= 1);
+                double score = 1.0;
+                if (!z->count) {
+                    if (calculateZScore(1, 1, diff, z->theta) * weight < 0.0000000001) { //no point walking when score gets too small, should be effective for theta >= 0.000001
+                        walking[r] = 0;
+                        continue;
+                    }
+                    score = calculateZScore(_5CapSize, _3CapSize, diff, z->theta) * weight;
+                    assert(score >= -0.0001);
+                    if (score <= 0.0) {
+                        score = 1e-10; //Make slightly non-zero.
+                    }
+                }
+                assert(score > 0.0);
+                if (z->nL != NULL && refAdjList_getWeight(z->aL, _3Node, _5Node) == 0.0
+                        && refAdjList_getWeight(z->aL, -_3Node, _5Node) == 0.0
+                        && refAdjList_getWeight(z->aL, _3Node, -_5Node) == 0.0
+                        && refAdjList_getWeight(z->aL, -_3Node, -_5Node) == 0.0) {
+                    refNeighbours_add(z->nL, _3Node, _5Node);
+                }
+                refAdjList_addToWeight(z->aL, _3Node, _5Node, score);
+                assert(refAdjList_getWeight(z->aL, _3Node, _5Node) == refAdjList_getWeight(z->aL, _5Node, _3Node));
+                assert(refAdjList_getWeight(z->aL, _3Node, _5Node) >= 0.0);
+                stillWalking = 1;
+            }
+            if (!stillWalking) {
+                break;
+            }
+        }
+    }
 }
 
-refAdjList *calculateZ(Flower *flower, stHash *endsToNodes, int64_t nodeNumber, int64_t maxWalkForCalculatingZ,
-bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *), void *zScoreExtraArgs) {
+static void calculateZ(Flower *flower, stHash *endsToNodes, int64_t nodeNumber, stHash *eventWeighting,
+        ZParameters *zParameters, int64_t zParameterNumber) {
     /*
-     * Calculate the zScores between all ends.
+     * Calculate the zScores between all ends, for each of the given sets of parameters together, so that each
+     * sequence is only walked once. The weighted z-scores are weighted by the event of the sequence, given
+     * by eventWeighting, which may be NULL if the adjacencies are only counted.
      */
-    refAdjList *aL = refAdjList_construct(nodeNumber);
+    for (int64_t r = 0; r < zParameterNumber; r++) {
+        zParameters[r].aL = refAdjList_construct(nodeNumber);
+    }
+    ZThread zThread = { 0, 0, 0, NULL, NULL, NULL, NULL };
     Flower_EndIterator *endIt = flower_getEndIterator(flower);
     End *end;
     while ((end = flower_getNextEnd(endIt)) != NULL) {
@@ -313,67 +407,27 @@ bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, v
             while ((cap = end_getNext(capIt)) != NULL) {
                 cap = cap_getStrand(cap) ? cap : cap_getReverse(cap);
                 if (!cap_getSide(cap) && cap_getSequence(cap) != NULL) {
-                    stList *caps = calculateZP(cap, endsToNodes);
-
-                    /*
-                     * Calculate the lengths of the sequences following the 3 caps, for efficiency.
-                     */
-                    int64_t *capSizes = st_malloc(sizeof(int64_t) * stList_length(caps));
-                    for (int64_t i = 0; i < stList_length(caps); i++) {
-                        Cap *cap = stList_get(caps, i);
-                        capSizes[i] = calculateZP2(cap, endsToNodes);
-                    }
-
-                    /*
-                     * Iterate through all pairs of 5' and 3' caps to calculate additions to scores.
-                     */
-                    for (int64_t i = (stList_length(caps) > 0 && cap_getSide(stList_get(caps, 0))) ? 1 : 0; i < stList_length(caps); i += 2) {
-                        Cap *_3Cap = stList_get(caps, i);
-                        assert(!cap_getSide(_3Cap));
-                        int64_t _3CapSize = capSizes[i];
-                        int64_t _3Node = stIntTuple_get(stHash_search(endsToNodes, end_getPositiveOrientation(cap_getEnd(_3Cap))), 0);
-                        int64_t unaligned = 0;
-                        for (int64_t k = 0; k < maxWalkForCalculatingZ; k++) {
-                            int64_t j = k * 2 + i + 1;
-                            if (j >= stList_length(caps)) {
-                                break;
-                            }
-                            Cap *_5Cap = stList_get(caps, j);
-                            assert(cap_getSide(_5Cap));
-                            assert(cap_getAdjacency(_5Cap) != NULL);
-                            if (ignoreUnalignedGaps) {
-                                assert(cap_getCoordinate(_5Cap) - cap_getCoordinate(cap_getAdjacency(_5Cap)) - 1 >= 0);
-                                unaligned += cap_getCoordinate(_5Cap) - cap_getCoordinate(cap_getAdjacency(_5Cap)) - 1;
-                            }
-                            int64_t _5Node = stIntTuple_get(stHash_search(endsToNodes, end_getPositiveOrientation(cap_getEnd(_5Cap))), 0);
-                            int64_t _5CapSize = capSizes[j];
-                            assert(cap_getCoordinate(_5Cap) - cap_getCoordinate(_3Cap) > 0);
-                            int64_t diff = cap_getCoordinate(_5Cap) - cap_getCoordinate(_3Cap) - unaligned;
-                            assert(diff >= 1);
-                            if (zScoreFn(_5Cap, 1, 1, diff, zScoreExtraArgs) < 0.0000000001) { //no point walking when score gets too small, should be effective for theta >= 0.000001
-                                break;
-                            }
-                            double score = zScoreFn(_5Cap, _5CapSize, _3CapSize, diff, zScoreExtraArgs);
-                            assert(score >= -0.0001);
-                            if (score <= 0.0) {
-                                score = 1e-10; //Make slightly non-zero.
-                            }
-                            assert(score > 0.0);
-                            refAdjList_addToWeight(aL, _3Node, _5Node, score);
-                            assert(refAdjList_getWeight(aL, _3Node, _5Node) == refAdjList_getWeight(aL, _5Node, _3Node));
-                            assert(refAdjList_getWeight(aL, _3Node, _5Node) >= 0.0);
-                        }
+                    // All the caps of the sequence share its event, and so its weight
+                    double weight = 1.0;
+                    if (eventWeighting != NULL) {
+                        assert(cap_getEvent(cap) != NULL);
+                        stDoubleTuple *eventWeight = stHash_search(eventWeighting, cap_getEvent(cap));
+                        assert(eventWeight != NULL);
+                        assert(stDoubleTuple_length(eventWeight) == 1);
+                        weight = stDoubleTuple_getPosition(eventWeight, 0);
                     }
-                    stList_destruct(caps);
-                    free(capSizes);
+                    zThread_fill(&zThread, cap, endsToNodes);
+                    calculateZP3(&zThread, weight, zParameters, zParameterNumber);
                 }
             }
             end_destructInstanceIterator(capIt);
         }
     }
     flower_destructEndIterator(endIt);
-
-    return aL;
+    free(zThread.nodes);
+    free(zThread.coordinates);
+    free(zThread.capSizes);
+    free(zThread.unaligned);
 }
 
 ////////////////////////////////////
@@ -593,13 +647,12 @@ static void getStubEdgesInTopLevelFlower(reference *ref, Flower *flower, stHash
      * Create a matching for the parent stub edges.
      */
     stHash *stubEndsToNodes = makeStubEdgesToNodesHash(stubEnds, endsToNodes);
-    double theta = 0.0;
     stSet *chosenEvents = getEventsWithSequences(flower);
     stHash *eventWeighting = getEventWeighting(referenceEvent, phi, chosenEvents);
     stSet_destruct(chosenEvents);
-    void *zArgs[2] = { &theta, eventWeighting };
-    refAdjList *stubAL = calculateZ(flower, stubEndsToNodes, nodeNumber,
-    INT64_MAX, 1, calculateZScoreWeightedAdapterFn, zArgs);
+    ZParameters stubZ = { INT64_MAX, 1, 0, 0.0, NULL, NULL };
+    calculateZ(flower, stubEndsToNodes, nodeNumber, eventWeighting, &stubZ, 1);
+    refAdjList *stubAL = stubZ.aL;
     stHash_destruct(eventWeighting);
     st_logDebug(
             "Building a matching for %" PRIi64 " stub nodes in the top level problem from %" PRIi64 " total stubs of which %" PRIi64 " attached , %" PRIi64 " total ends, %" PRIi64 " chains, %" PRIi64 " blocks %" PRIi64 " groups and %" PRIi64 " sequences\n",
@@ -977,6 +1030,92 @@ stList *getReferenceIntervalsToPreserve(reference *ref, refAdjList *dAL, int64_t
     return referenceIntervalsToPreserve;
 }
 
+////////////////////////////////////
+////////////////////////////////////
+//Sample the reference ordering from multiple starts
+////////////////////////////////////
+////////////////////////////////////
+
+static reference *sampleReference(refAdjList *aL, refAdjList *dAL, refNeighbours *nL, reference *ref, int64_t nodeNumber,
+        int64_t permutations, int64_t samplingChains, int64_t seed) {
+    /*
+     * Runs a permutation sampler and then greedy nudging on samplingChains copies of the greedy reference, in
+     * parallel, and returns the reference with the highest score, breaking ties by the fewest bad adjacencies.
+     * The other references, including ref if it is not the best, are destroyed.
+     *
+     * The first chain runs updateReferenceGreedily and nudgeGreedily on ref, drawing from the shared random number
+     * generator as a single chain always has. Those samplers cannot be given a generator of their own, so the other
+     * chains run the samplers of referenceSampler.h, chain i with a generator seeded from seed + i, and their
+     * results do not depend on the thread count. The chains only read aL, dAL and nL.
+     */
+    int64_t maxNudge = 100;
+    int64_t nudgePermutations = 100;
+    reference **refs = st_malloc(sizeof(reference *) * samplingChains);
+    double *scores = st_malloc(sizeof(double) * samplingChains);
+    int64_t *badAdjacencies = st_malloc(sizeof(int64_t) * samplingChains);
+    sampledReference **sampledRefs = st_malloc(sizeof(sampledReference *) * samplingChains);
+    refs[0] = ref;
+    for (int64_t i = 1; i < samplingChains; i++) {
+        sampledRefs[i] = sampledReference_construct(ref, nodeNumber, (uint64_t) (seed + i));
+    }
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 1) if(samplingChains > 1)
+#endif
+    for (int64_t i = 0; i < samplingChains; i++) {
+        if (i == 0) {
+            updateReferenceGreedily(aL, dAL, refs[i], permutations);
+        } else {
+            sampledReference_updateGreedily(sampledRefs[i], aL, nL, permutations);
+            refs[i] = sampledReference_getReference(sampledRefs[i]);
+        }
+        st_logDebug(
+                "The score of the solution of chain %" PRIi64 " after permutation sampling is %f/%" PRIi64 " after %" PRIi64 " rounds of greedy permutation\n",
+                i, getReferenceScore(aL, refs[i]), getBadAdjacencyCount(dAL, refs[i]), permutations);
+
+        //reorderReferenceToAvoidBreakpoints(dAL2, ref);
+        //int64_t badAdjacenciesAfterTopologicalReordering = getBadAdjacencyCount(dAL, ref);
+        //double totalScoreAfterTopologicalReordering = getReferenceScore(aL, ref);
+        //st_logDebug(
+        //        "The score of the solution after topological reordering is %f/%" PRIi64 " after %" PRIi64 " rounds of greedy permutation out of a max possible %f\n",
+        //        totalScoreAfterTopologicalReordering, badAdjacenciesAfterTopologicalReordering, permutations, maxPossibleScore);
+
+        if (i == 0) {
+            nudgeGreedily(dAL, aL, refs[i], nudgePermutations, maxNudge);
+        } else {
+            sampledReference_nudgeGreedily(sampledRefs[i], dAL, aL, nL, nudgePermutations, maxNudge);
+            reference_destruct(refs[i]);
+            refs[i] = sampledReference_getReference(sampledRefs[i]);
+            sampledReference_destruct(sampledRefs[i]);
+        }
+        scores[i] = getReferenceScore(aL, refs[i]);
+        badAdjacencies[i] = getBadAdjacencyCount(dAL, refs[i]);
+        st_logDebug("The score of the solution of chain %" PRIi64 " is %f/%" PRIi64 " after %" PRIi64 " rounds of greedy nudging\n",
+                i, scores[i], badAdjacencies[i], nudgePermutations);
+    }
+
+    int64_t best = 0;
+    for (int64_t i = 1; i < samplingChains; i++) {
+        if (scores[i] > scores[best] || (scores[i] == scores[best] && badAdjacencies[i] < badAdjacencies[best])) {
+            best = i;
+        }
+    }
+    for (int64_t i = 0; i < samplingChains; i++) {
+        if (i != best) {
+            reference_destruct(refs[i]);
+        }
+    }
+    ref = refs[best];
+    if (samplingChains > 1) {
+        st_logDebug("Chose the solution of chain %" PRIi64 " of %" PRIi64 "\n", best, samplingChains);
+    }
+    free(refs);
+    free(sampledRefs);
+    free(scores);
+    free(badAdjacencies);
+    return ref;
+}
+
 ////////////////////////////////////
 ////////////////////////////////////
 //Main function
@@ -984,7 +1123,7 @@ stList *getReferenceIntervalsToPreserve(reference *ref, refAdjList *dAL, int64_t
 ////////////////////////////////////
 
 void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int64_t permutations,
-        stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber), double (*temperature)(double),
+        int64_t samplingChains, stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber), double (*temperature)(double),
         double theta, double phi, int64_t maxWalkForCalculatingZ,
         bool ignoreUnalignedGaps, double wiggle, int64_t numberOfNsForScaffoldGap, int64_t minNumberOfSequencesToSupportAdjacency, bool makeScaffolds) {
     /*
@@ -1038,23 +1177,31 @@ void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int
     stList *referenceIntervalsToPreserve = NULL;
     if (makeScaffolds) {
         stHash *stubEndsToNodes = makeStubEdgesToNodesHash(stubTangleEnds, endsToNodes);
-        refAdjList *stubDAL = calculateZ(flower, stubEndsToNodes, nodeNumber, 1, 1, countAdapterFn, NULL); //Gets set of adjacencies between stub ends.
+        ZParameters stubDZ = { 1, 1, 1, 0.0, NULL, NULL };
+        calculateZ(flower, stubEndsToNodes, nodeNumber, NULL, &stubDZ, 1);
+        refAdjList *stubDAL = stubDZ.aL; //Gets set of adjacencies between stub ends.
         stHash_destruct(stubEndsToNodes);
         referenceIntervalsToPreserve = getReferenceIntervalsToPreserve(ref, stubDAL, minNumberOfSequencesToSupportAdjacency); //List of int-tuple pairs identifying the matchings between ends that should be preserved.
         refAdjList_destruct(stubDAL);
     }
 
     /*
-     * Calculate z functions, using phylogenetic weighting.
+     * Calculate z functions, using phylogenetic weighting, along with the direct adjacencies and the counts of
+     * direct adjacencies used later to split the reference, in one pass over the sequences.
      */
     stSet *chosenEvents = getEventsWithSequences(flower);
     stHash *eventWeighting = getEventWeighting(referenceEvent, phi, chosenEvents);
     stSet_destruct(chosenEvents);
-    void *zArgs[2] = { &theta, eventWeighting };
-    refAdjList *aL = calculateZ(flower, endsToNodes, nodeNumber, maxWalkForCalculatingZ, ignoreUnalignedGaps, calculateZScoreWeightedAdapterFn, zArgs);
-    int64_t directTheta = 0.0;
-    zArgs[0] = &directTheta;
-    refAdjList *dAL = calculateZ(flower, endsToNodes, nodeNumber, 1, ignoreUnalignedGaps, calculateZScoreWeightedAdapterFn, zArgs); //Gets set of direct of direct adjacencies
+    ZParameters zParameters[3] = {
+            { maxWalkForCalculatingZ, ignoreUnalignedGaps, 0, theta, NULL,
+                    samplingChains > 1 ? refNeighbours_construct(nodeNumber) : NULL }, //The neighbours are only needed by the extra chains
+            { 1, ignoreUnalignedGaps, 0, 0.0, NULL, NULL }, //Gets set of direct of direct adjacencies
+            { 1, 1, 1, 0.0, NULL, NULL } }; //Gets the counts of direct adjacencies
+    calculateZ(flower, endsToNodes, nodeNumber, eventWeighting, zParameters, 3);
+    refAdjList *aL = zParameters[0].aL;
+    refAdjList *dAL = zParameters[1].aL;
+    refAdjList *countDAL = zParameters[2].aL;
+    refNeighbours *nL = zParameters[0].nL;
     stHash_destruct(eventWeighting);
 
     /*
@@ -1071,31 +1218,17 @@ void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int
     st_logDebug("The score of the initial solution is %f/%" PRIi64 " out of a max possible %f\n", totalScoreAfterGreedy, badAdjacenciesAfterGreedy,
             maxPossibleScore);
 
-    updateReferenceGreedily(aL, dAL, ref, permutations);
-
-    int64_t badAdjacenciesAfterGreedySampling = getBadAdjacencyCount(dAL, ref);
-    double totalScoreAfterGreedySampling = getReferenceScore(aL, ref);
-    st_logDebug(
-            "The score of the solution after permutation sampling is %f/%" PRIi64 " after %" PRIi64 " rounds of greedy permutation out of a max possible %f\n",
-            totalScoreAfterGreedySampling, badAdjacenciesAfterGreedySampling, permutations, maxPossibleScore);
-
-    //reorderReferenceToAvoidBreakpoints(dAL2, ref);
-    //int64_t badAdjacenciesAfterTopologicalReordering = getBadAdjacencyCount(dAL, ref);
-    //double totalScoreAfterTopologicalReordering = getReferenceScore(aL, ref);
-    //st_logDebug(
-    //        "The score of the solution after topological reordering is %f/%" PRIi64 " after %" PRIi64 " rounds of greedy permutation out of a max possible %f\n",
-    //        totalScoreAfterTopologicalReordering, badAdjacenciesAfterTopologicalReordering, permutations, maxPossibleScore);
-
-    int64_t maxNudge = 100;
-    int64_t nudgePermutations = 100;
-    nudgeGreedily(dAL, aL, ref, nudgePermutations, maxNudge);
+    ref = sampleReference(aL, dAL, nL, ref, nodeNumber, permutations, samplingChains, flower_getName(flower));
     int64_t badAdjacenciesAfterNudging = getBadAdjacencyCount(dAL, ref);
     double totalScoreAfterNudging = getReferenceScore(aL, ref);
-    st_logDebug("The score of the final solution is %f/%" PRIi64 " after %" PRIi64 " rounds of greedy nudging out of a max possible %f\n",
-            totalScoreAfterNudging, badAdjacenciesAfterNudging, nudgePermutations, maxPossibleScore);
+    st_logDebug("The score of the final solution is %f/%" PRIi64 " from %" PRIi64 " sampling chains out of a max possible %f\n",
+            totalScoreAfterNudging, badAdjacenciesAfterNudging, samplingChains, maxPossibleScore);
     //The aL and dAL arrays are no longer valid as we've added additional nodes to the reference, let's clean up the arrays explicitly.
     refAdjList_destruct(aL);
     refAdjList_destruct(dAL);
+    if (nL != NULL) {
+        refNeighbours_destruct(nL);
+    }
 
     /*
      * Split reference intervals where the ordering of adjacent nodes
@@ -1105,7 +1238,6 @@ void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int
      * The function returns a list of additional extra stub nodes, which
      * must then be turned into ends in the flower.
      */
-    refAdjList *countDAL = calculateZ(flower, endsToNodes, nodeNumber, 1, 1, countAdapterFn, NULL); //Gets set of adjacencies between stub ends.
     void *extraArgs[3] = { nodesToEnds, countDAL, &minNumberOfSequencesToSupportAdjacency };
     stList *extraStubNodes = splitReferenceAtIndicatedLocations(ref, referenceSplitFn, extraArgs);
     refAdjList_destruct(countDAL);
@@ -11,218 +11,749 @@
 
 #include "cactus.h"
 #include "sonLib.h"
+#include "recursiveThreadBuilder.h"
 
-static void *compress(char *string, int64_t *dataSize) {
-    void *data = stCompression_compress(string, strlen(string) + 1, dataSize, 1); //going with least, fastest compression-1);
-    free(string);
-    return data;
-}
+/*
+ * The threads are stored in the database as two kinds of record:
+ *  - chunks, each the compressed string of at most THREAD_CHUNK_SIZE bytes of the consecutive terminal adjacencies
+ *    and segments of the threads of a flower, keyed by a hash of their contents. These keys are always negative, so
+ *    never clash with the names of caps. Identical chunks are stored once, the stored bytes being compared when keys
+ *    match, and a chunk whose key is taken by a different chunk is given the next lower free key.
+ *  - thread records, keyed by the name of the first cap of the thread, each an array of the number of entries
+ *    followed by the entries. An entry is either the name of the first cap of a thread of a nested flower, or the
+ *    key of a chunk followed by the offset and length of a piece of it.
+ * A thread is therefore built from the threads of its nested flowers by reference, without reading or copying them,
+ * and the complete thread is only assembled, a batch of chunks at a time, when it is finally written out. The
+ * records read to assemble the threads are then removed from the database.
+ */
 
-static char *decompress(void *data, int64_t dataSize) {
-    int64_t uncompressedSize;
-    char *string = stCompression_decompress(data, dataSize, &uncompressedSize);
-    assert(strlen(string)+1 == uncompressedSize);
-    free(data);
-    return string;
-}
+#define THREAD_CHUNK_SIZE 65536
+#define THREAD_CHUNKS_PER_REQUEST 256
+#define THREAD_RECORDS_PER_REQUEST 10000
+#define THREAD_PIECES_PER_BATCH 65536
 
-static void cacheNonNestedRecords(stCache *cache, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
-    /*
-     * Caches the set of terminal adjacency and segment records present in the threads.
-     */
-    for (int64_t i = 0; i < stList_length(caps); i++) {
-        Cap *cap = stList_get(caps, i);
-        int64_t recordSize;
-        while (1) {
-            Cap *adjacentCap = cap_getAdjacency(cap);
-            assert(adjacentCap != NULL);
-            Group *group = end_getGroup(cap_getEnd(cap));
-            assert(group != NULL);
-            if (group_isLeaf(group)) { //Record must not be in the database already
-                void *data = compress(terminalAdjacencyWriteFn(cap), &recordSize);
-                assert(!stCache_containsRecord(cache, cap_getName(cap), 0, INT64_MAX));
-                stCache_setRecord(cache, cap_getName(cap), 0, recordSize, data);
-                free(data);
-            }
-            if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
-                break;
-            }
-            Segment *segment = cap_getSegment(adjacentCap);
-            assert(!stCache_containsRecord(cache, segment_getName(segment), 0, INT64_MAX));
-            void *data = compress(segmentWriteFn(segment), &recordSize);
-            stCache_setRecord(cache, segment_getName(segment), 0, recordSize, data);
-            free(data);
-        }
+static int64_t getChunkKey(const char *string, int64_t length) {
+    //64-bit FNV-1a hash of the chunk, made negative.
+    uint64_t h = 14695981039346656037ULL;
+    for (int64_t i = 0; i < length; i++) {
+        h ^= (uint8_t) string[i];
+        h *= 1099511628211ULL;
     }
+    return -((int64_t) (h >> 1)) - 1;
 }
 
-static stList *getNestedRecordNames(stList *caps) {
-    /*
-     * Gets the names of non-terminal adjacencies as a list of cap names.
-     */
-    stList *getRequests = stList_construct3(0, free);
-    for (int64_t i = 0; i < stList_length(caps); i++) {
-        Cap *cap = stList_get(caps, i);
-        while (1) {
-            Cap *adjacentCap = cap_getAdjacency(cap);
-            assert(adjacentCap != NULL);
-            Group *group = end_getGroup(cap_getEnd(cap));
-            assert(group != NULL);
-            if (!group_isLeaf(group)) { //Record must be in the database already
-                int64_t *j = st_malloc(sizeof(int64_t));
-                j[0] = cap_getName(cap);
-                stList_append(getRequests, j);
-            }
-            if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
-                break;
-            }
-        }
-    }
-    return getRequests;
+static int64_t getNextChunkKey(int64_t key) {
+    //The key to try when key is taken by a different chunk, staying negative.
+    return key == INT64_MIN ? -1 : key - 1;
 }
 
-static void cacheNestedRecords(stKVDatabase *database, stCache *cache, stList *caps) {
-    /*
-     * Caches all the non-terminal adjacencies by retrieving them from the database.
-     */
-    stList *getRequests = getNestedRecordNames(caps);
-    if (stList_length(caps) > 10000) {
-        st_logCritical("Going to request %" PRIi64 " records from the database: %" PRIi64 "\n", stList_length(caps));
+static void setRecords(stKVDatabase *database, stList *requests) {
+    if (stList_length(requests) == 0) {
+        return;
     }
-    //Do the retrieval of the records
+    stTry {
+            stKVDatabase_bulkSetRecords(database, requests);
+        }stCatch(except)
+            {
+                stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                        "An unknown database error occurred when we tried to bulk insert records from the database");
+            }stTryEnd;
+    while (stList_length(requests) > 0) {
+        stKVDatabaseBulkRequest_destruct(stList_pop(requests));
+    }
+}
+
+static stList *getRecords(stKVDatabase *database, stList *keys) {
     stList *records = NULL;
     stTry {
-            records = stKVDatabase_bulkGetRecords(database, getRequests);
+            records = stKVDatabase_bulkGetRecords(database, keys);
         }stCatch(except)
             {
                 stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when we tried to bulk get records from the database");
             }stTryEnd;
     assert(records != NULL);
-    assert(stList_length(records) == stList_length(getRequests));
-    //Now cache the resulting records
-    while (stList_length(records) > 0) {
-        stKVDatabaseBulkResult *result = stList_pop(records);
-        int64_t *recordName = stList_pop(getRequests);
-        int64_t recordSize;
-        void *record = stKVDatabaseBulkResult_getRecord(result, &recordSize);
-        assert(record != NULL);
-        assert(!stCache_containsRecord(cache, *recordName, 0, INT64_MAX));
-        stCache_setRecord(cache, *recordName, 0, recordSize, record);
-        stKVDatabaseBulkResult_destruct(result); //Cleanup the memory as we go.
-        free(recordName);
-    }
-    assert(stList_length(getRequests) == 0);
-    stList_destruct(getRequests);
-    stList_destruct(records);
-}
-
-static stCache *cacheRecords(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
-    /*
-     * Cache all the elements needed to construct the set of threads.
-     */
-    stCache *cache = stCache_construct();
-    cacheNestedRecords(database, cache, caps);
-    cacheNonNestedRecords(cache, caps, segmentWriteFn, terminalAdjacencyWriteFn);
-    return cache;
+    assert(stList_length(records) == stList_length(keys));
+    stList_setDestructor(records, (void (*)(void *)) stKVDatabaseBulkResult_destruct);
+    return records;
 }
 
-static void deleteNestedRecords(stKVDatabase *database, stList *caps) {
-    /*
-     * Removes the non-terminal adjacencies from the database.
-     */
-    stList *deleteRequests = getNestedRecordNames(caps);
-    for (int64_t i = 0; i < stList_length(deleteRequests); i++) {
-        int64_t *record = stList_get(deleteRequests, i);
-        stList_set(deleteRequests, i, stIntTuple_construct1( record[0])); //Hack
-        free(record);
-    }
-    stList_setDestructor(deleteRequests, (void(*)(void *)) stIntTuple_destruct);
-    //Do the deletion of the records
+static void *getRecord(stKVDatabase *database, int64_t key, int64_t *recordSize) {
+    void *record = NULL;
     stTry {
-            stKVDatabase_bulkRemoveRecords(database, deleteRequests);
+            record = stKVDatabase_getRecord2(database, key, recordSize);
+        }stCatch(except)
+            {
+                stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                        "An unknown database error occurred when we tried to get a record from the database");
+            }stTryEnd;
+    return record;
+}
+
+static void removeRecords(stKVDatabase *database, stList *keys) {
+    if (stList_length(keys) == 0) {
+        return;
+    }
+    stTry {
+            stKVDatabase_bulkRemoveRecords(database, keys);
         }stCatch(except)
             {
                 stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when we tried to bulk remove records from the database");
             }stTryEnd;
-    stList_destruct(deleteRequests);
+    while (stList_length(keys) > 0) {
+        stIntTuple_destruct(stList_pop(keys));
+    }
 }
 
-static char *getThread(stCache *cache, Cap *startCap) {
+static bool isThreadRecord(int64_t *record, int64_t recordSize) {
     /*
-     * Iterate through, first calculating the length of the final record, then concatenating the results.
+     * Checks the record is the number of entries followed by the entries, with the pieces of chunks whole.
+     */
+    if (record == NULL || recordSize < (int64_t) sizeof(int64_t) || recordSize % sizeof(int64_t) != 0
+            || record[0] != recordSize / (int64_t) sizeof(int64_t) - 1) {
+        return 0;
+    }
+    for (int64_t i = 1; i <= record[0]; i++) {
+        if (record[i] < 0 && (i += 2) > record[0]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+////////////////////////////////////
+////////////////////////////////////
+//Building threads
+////////////////////////////////////
+////////////////////////////////////
+
+typedef struct _chunk {
+    int64_t key;
+    void *data; // The compressed string, or the string once fetched for writing
+    int64_t dataSize;
+} Chunk;
+
+static void chunk_destruct(Chunk *chunk) {
+    free(chunk->data);
+    free(chunk);
+}
+
+static bool chunk_isStoredAs(Chunk *chunk, void *data, int64_t dataSize) {
+    return chunk->dataSize == dataSize && memcmp(chunk->data, data, dataSize) == 0;
+}
+
+typedef struct _recursiveThreads ThreadBuilder;
+
+struct _recursiveThreads {
+    stList *chunks; // The distinct chunks made, in order
+    stList *slots; // The chunk of each run of the string made into a chunk, repeated if an identical one was made
+    stHash *chunkKeys; // The keys of the chunks, as stIntTuples, to the chunks
+    char *chunk; // The thread string not yet made into a chunk
+    int64_t chunkLength;
+    int64_t *entries; // The entries of the current thread, the piece of a chunk in slot i starting with -(i + 1)
+    int64_t entryNumber;
+    int64_t maxEntryNumber;
+    int64_t lastPiece; // The index of the last entry if it is a piece of a chunk, else -1
+    stList *threadRecords; // The name of the first cap of each thread made, followed by its record
+};
+
+static ThreadBuilder *threadBuilder_construct(void) {
+    ThreadBuilder *threadBuilder = st_calloc(1, sizeof(ThreadBuilder));
+    threadBuilder->chunks = stList_construct3(0, (void (*)(void *)) chunk_destruct);
+    threadBuilder->slots = stList_construct();
+    threadBuilder->chunkKeys = stHash_construct3((uint64_t (*)(const void *)) stIntTuple_hashKey,
+            (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct, NULL);
+    threadBuilder->chunk = st_malloc(THREAD_CHUNK_SIZE);
+    threadBuilder->threadRecords = stList_construct3(0, free);
+    return threadBuilder;
+}
+
+static void threadBuilder_destruct(ThreadBuilder *threadBuilder) {
+    stList_destruct(threadBuilder->chunks);
+    stList_destruct(threadBuilder->slots);
+    stHash_destruct(threadBuilder->chunkKeys);
+    free(threadBuilder->chunk);
+    free(threadBuilder->entries);
+    stList_destruct(threadBuilder->threadRecords);
+    free(threadBuilder);
+}
+
+static void threadBuilder_addEntry(ThreadBuilder *threadBuilder, int64_t entry) {
+    if (threadBuilder->entryNumber == threadBuilder->maxEntryNumber) {
+        threadBuilder->maxEntryNumber = threadBuilder->maxEntryNumber * 2 + 16;
+        threadBuilder->entries = st_realloc(threadBuilder->entries, sizeof(int64_t) * threadBuilder->maxEntryNumber);
+    }
+    threadBuilder->entries[threadBuilder->entryNumber++] = entry;
+}
+
+static Chunk *threadBuilder_getChunk(ThreadBuilder *threadBuilder, int64_t key) {
+    stIntTuple *keyTuple = stIntTuple_construct1(key);
+    Chunk *chunk = stHash_search(threadBuilder->chunkKeys, keyTuple);
+    stIntTuple_destruct(keyTuple);
+    return chunk;
+}
+
+static void threadBuilder_finishChunk(ThreadBuilder *threadBuilder) {
+    /*
+     * Makes the string not yet in a chunk into a chunk, unless an identical chunk has been made already.
+     */
+    if (threadBuilder->chunkLength == 0) {
+        return;
+    }
+    int64_t dataSize;
+    void *data = stCompression_compress(threadBuilder->chunk, threadBuilder->chunkLength, &dataSize, 1); //going with least, fastest compression
+    int64_t key = getChunkKey(threadBuilder->chunk, threadBuilder->chunkLength);
+    Chunk *chunk;
+    while (1) {
+        if ((chunk = threadBuilder_getChunk(threadBuilder, key)) == NULL) {
+            chunk = st_malloc(sizeof(Chunk));
+            chunk->data = data;
+            chunk->dataSize = dataSize;
+            chunk->key = key;
+            stHash_insert(threadBuilder->chunkKeys, stIntTuple_construct1(key), chunk);
+            stList_append(threadBuilder->chunks, chunk);
+            break;
+        }
+        if (chunk_isStoredAs(chunk, data, dataSize)) { //The same chunk has been made already
+            free(data);
+            break;
+        }
+        key = getNextChunkKey(key);
+    }
+    stList_append(threadBuilder->slots, chunk);
+    threadBuilder->chunkLength = 0;
+}
+
+static void threadBuilder_addString(ThreadBuilder *threadBuilder, char *string) {
+    /*
+     * Adds the string to the thread, extending the last piece of the thread if it ends where the string will start,
+     * cleaning the string up.
+     */
+    int64_t length = strlen(string);
+    int64_t i = 0;
+    while (i < length) {
+        int64_t j = length - i < THREAD_CHUNK_SIZE - threadBuilder->chunkLength ?
+                length - i : THREAD_CHUNK_SIZE - threadBuilder->chunkLength;
+        memcpy(threadBuilder->chunk + threadBuilder->chunkLength, string + i, j);
+        int64_t slot = -stList_length(threadBuilder->slots) - 1;
+        int64_t *piece = threadBuilder->lastPiece != -1 ? threadBuilder->entries + threadBuilder->lastPiece : NULL;
+        if (piece != NULL && piece[0] == slot && piece[1] + piece[2] == threadBuilder->chunkLength) {
+            piece[2] += j;
+        } else {
+            threadBuilder->lastPiece = threadBuilder->entryNumber;
+            threadBuilder_addEntry(threadBuilder, slot);
+            threadBuilder_addEntry(threadBuilder, threadBuilder->chunkLength);
+            threadBuilder_addEntry(threadBuilder, j);
+        }
+        threadBuilder->chunkLength += j;
+        i += j;
+        if (threadBuilder->chunkLength == THREAD_CHUNK_SIZE) {
+            threadBuilder_finishChunk(threadBuilder);
+        }
+    }
+    free(string);
+}
+
+static void threadBuilder_addThread(ThreadBuilder *threadBuilder, Cap *startCap,
+        char *(*segmentWriteFn)(Segment *, void *), char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg) {
+    /*
+     * Gets the entries of the thread starting from startCap, the terminal adjacencies and segments being added as
+     * strings, and the other adjacencies by reference to the threads of the nested flowers. The strings are
+     * packed into chunks with those of the previous threads, so the chunk is not finished here.
      */
     Cap *cap = startCap;
-    stList *strings = stList_construct3(0, free);
-    while (1) { //Calculate the size of the entries in the DB that represent the thread.
+    threadBuilder->entryNumber = 0;
+    threadBuilder->lastPiece = -1;
+    while (1) {
         Cap *adjacentCap = cap_getAdjacency(cap);
         assert(adjacentCap != NULL);
-        int64_t recordSize;
-        assert(stCache_containsRecord(cache, cap_getName(cap), 0, INT64_MAX));
-        void *data = stCache_getRecord(cache, cap_getName(cap), 0, INT64_MAX, &recordSize);
-        stList_append(strings, decompress(data, recordSize));
+        Group *group = end_getGroup(cap_getEnd(cap));
+        assert(group != NULL);
+        if (group_isLeaf(group)) {
+            threadBuilder_addString(threadBuilder, terminalAdjacencyWriteFn(cap, extraArg));
+        } else { //Record must be in the database already
+            threadBuilder_addEntry(threadBuilder, cap_getName(cap));
+            threadBuilder->lastPiece = -1;
+        }
         if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
             break;
         }
-        assert(stCache_containsRecord(cache, segment_getName(cap_getSegment(adjacentCap)), 0, INT64_MAX));
-        data = stCache_getRecord(cache, segment_getName(cap_getSegment(adjacentCap)), 0, INT64_MAX, &recordSize);
-        stList_append(strings, decompress(data, recordSize));
+        threadBuilder_addString(threadBuilder, segmentWriteFn(cap_getSegment(adjacentCap), extraArg));
     }
-    char *string = stString_join2("", strings);
-    stList_destruct(strings);
-    return string;
 }
 
-void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
-    //Cache records
-    stCache *cache = cacheRecords(database, caps, segmentWriteFn, terminalAdjacencyWriteFn);
+static void threadBuilder_addThreadRecord(ThreadBuilder *threadBuilder, Cap *cap) {
+    int64_t *threadRecord = st_malloc((threadBuilder->entryNumber + 2) * sizeof(int64_t));
+    threadRecord[0] = cap_getName(cap);
+    threadRecord[1] = threadBuilder->entryNumber;
+    memcpy(threadRecord + 2, threadBuilder->entries, threadBuilder->entryNumber * sizeof(int64_t));
+    stList_append(threadBuilder->threadRecords, threadRecord);
+}
 
-    //Build new threads
-    stList *records = stList_construct3(0, (void(*)(void *)) stKVDatabaseBulkRequest_destruct);
-    for (int64_t i = 0; i < stList_length(caps); i++) {
-        Cap *cap = stList_get(caps, i);
-        char *string = getThread(cache, cap);
-        assert(string != NULL);
-        int64_t recordSize;
-        void *data = compress(string, &recordSize);
-        stList_append(records, stKVDatabaseBulkRequest_constructInsertRequest(cap_getName(cap), data, recordSize));
-        free(data);
+static bool threadBuilder_checkStoredChunk(ThreadBuilder *threadBuilder, stKVDatabase *database, Chunk *chunk,
+        void *record, int64_t recordSize) {
+    /*
+     * Checks the chunk against the record stored under its key, if any, moving the chunk to the next key that is free
+     * or holds the same chunk while the record is of a different chunk. Returns non-zero if the chunk is not yet
+     * stored.
+     */
+    void *fetchedRecord = NULL;
+    while (record != NULL && !chunk_isStoredAs(chunk, record, recordSize)) {
+        st_logDebug("The key %" PRIi64 " of a thread chunk is taken by a different chunk\n", chunk->key);
+        int64_t key = chunk->key;
+        do {
+            key = getNextChunkKey(key);
+        } while (threadBuilder_getChunk(threadBuilder, key) != NULL);
+        stIntTuple *keyTuple = stIntTuple_construct1(chunk->key);
+        stHash_removeAndFreeKey(threadBuilder->chunkKeys, keyTuple);
+        stIntTuple_destruct(keyTuple);
+        chunk->key = key;
+        stHash_insert(threadBuilder->chunkKeys, stIntTuple_construct1(key), chunk);
+        free(fetchedRecord);
+        record = fetchedRecord = getRecord(database, key, &recordSize);
     }
+    free(fetchedRecord);
+    return record == NULL;
+}
 
-    //Delete old records and insert new records
-    deleteNestedRecords(database, caps);
-    stTry {
-            stKVDatabase_bulkSetRecords(database, records);
-        }stCatch(except)
-            {
-                stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
-                        "An unknown database error occurred when we tried to bulk insert records from the database");
-            }stTryEnd;
+static bool threadRecord_startsInNestedFlower(int64_t *threadRecord) {
+    //The first cap of a thread is also the first cap of its thread in the nested flower, if it starts in one.
+    return threadRecord[1] > 0 && threadRecord[2] == threadRecord[0];
+}
 
-    //Cleanup
-    stCache_destruct(cache);
-    stList_destruct(records);
+static int64_t *threadBuilder_makeRecord(ThreadBuilder *threadBuilder, int64_t *threadRecord, int64_t *nestedRecord,
+        int64_t *recordSize) {
+    /*
+     * Makes the record of the thread, giving the keys of the chunks of its pieces. If the thread starts in a nested
+     * flower the record of the thread there, which has the same name and so is replaced by this record, is spliced
+     * in place of the reference to it.
+     */
+    int64_t entryNumber = threadRecord[1];
+    int64_t *entries = threadRecord + 2;
+    int64_t length = nestedRecord != NULL ? entryNumber - 1 + nestedRecord[0] : entryNumber;
+    int64_t *record = st_malloc((length + 1) * sizeof(int64_t));
+    record[0] = length;
+    int64_t i = 0, j = 1;
+    if (nestedRecord != NULL) {
+        memcpy(record + 1, nestedRecord + 1, nestedRecord[0] * sizeof(int64_t));
+        i = 1;
+        j += nestedRecord[0];
+    }
+    for (; i < entryNumber; i++) {
+        if (entries[i] < 0) {
+            record[j++] = ((Chunk *) stList_get(threadBuilder->slots, -entries[i] - 1))->key;
+            record[j++] = entries[++i];
+            record[j++] = entries[++i];
+        } else {
+            record[j++] = entries[i];
+        }
+    }
+    assert(j == length + 1);
+    *recordSize = (length + 1) * sizeof(int64_t);
+    return record;
 }
 
-stList *buildRecursiveThreadsInList(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
-    stList *threadStrings = stList_construct3(0, free);
+static void threadBuilder_store(ThreadBuilder *threadBuilder, stKVDatabase *database) {
+    /*
+     * Writes the chunks not already in the database, then the thread records referencing them.
+     */
+    threadBuilder_finishChunk(threadBuilder);
+    stList *requests = stList_construct();
+    for (int64_t i = 0; i < stList_length(threadBuilder->chunks); i += THREAD_CHUNKS_PER_REQUEST) {
+        stList *keys = stList_construct3(0, free);
+        for (int64_t j = i; j < stList_length(threadBuilder->chunks) && j < i + THREAD_CHUNKS_PER_REQUEST; j++) {
+            int64_t *key = st_malloc(sizeof(int64_t));
+            key[0] = ((Chunk *) stList_get(threadBuilder->chunks, j))->key;
+            stList_append(keys, key);
+        }
+        stList *records = getRecords(database, keys);
+        for (int64_t j = 0; j < stList_length(keys); j++) {
+            Chunk *chunk = stList_get(threadBuilder->chunks, i + j);
+            int64_t recordSize;
+            void *record = stKVDatabaseBulkResult_getRecord(stList_get(records, j), &recordSize);
+            if (threadBuilder_checkStoredChunk(threadBuilder, database, chunk, record, recordSize)) {
+                stList_append(requests, stKVDatabaseBulkRequest_constructSetRequest(chunk->key, chunk->data,
+                        chunk->dataSize));
+            }
+        }
+        stList_destruct(records);
+        stList_destruct(keys);
+        setRecords(database, requests);
+    }
+    for (int64_t i = 0; i < stList_length(threadBuilder->threadRecords); i += THREAD_RECORDS_PER_REQUEST) { //The chunks are written before the records referencing them
+        int64_t batchEnd = i + THREAD_RECORDS_PER_REQUEST < stList_length(threadBuilder->threadRecords) ?
+                i + THREAD_RECORDS_PER_REQUEST : stList_length(threadBuilder->threadRecords);
+        stList *keys = stList_construct3(0, free);
+        for (int64_t j = i; j < batchEnd; j++) {
+            int64_t *threadRecord = stList_get(threadBuilder->threadRecords, j);
+            if (threadRecord_startsInNestedFlower(threadRecord)) {
+                int64_t *key = st_malloc(sizeof(int64_t));
+                key[0] = threadRecord[0];
+                stList_append(keys, key);
+            }
+        }
+        stList *records = stList_length(keys) > 0 ? getRecords(database, keys) : NULL;
+        for (int64_t j = i, k = 0; j < batchEnd; j++) {
+            int64_t *threadRecord = stList_get(threadBuilder->threadRecords, j);
+            int64_t *nestedRecord = NULL;
+            if (threadRecord_startsInNestedFlower(threadRecord)) {
+                int64_t nestedRecordSize;
+                nestedRecord = stKVDatabaseBulkResult_getRecord(stList_get(records, k++), &nestedRecordSize);
+                if (!isThreadRecord(nestedRecord, nestedRecordSize)) {
+                    st_errAbort("The record of the nested thread starting at cap %" PRIi64 " is missing or malformed",
+                            threadRecord[0]);
+                }
+            }
+            int64_t recordSize;
+            int64_t *record = threadBuilder_makeRecord(threadBuilder, threadRecord, nestedRecord, &recordSize);
+            stList_append(requests, stKVDatabaseBulkRequest_constructSetRequest(threadRecord[0], record, recordSize));
+            free(record);
+        }
+        if (records != NULL) {
+            stList_destruct(records);
+        }
+        stList_destruct(keys);
+        setRecords(database, requests);
+    }
+    setRecords(database, requests);
+    stList_destruct(requests);
+}
+
+////////////////////////////////////
+////////////////////////////////////
+//Writing threads
+////////////////////////////////////
+////////////////////////////////////
+
+typedef struct _piece {
+    Chunk *chunk; // The chunk, if made by the thread builder, else NULL
+    int64_t key;
+    int64_t offset;
+    int64_t length;
+} Piece;
+
+typedef struct _threadWriter {
+    stKVDatabase *database;
+    Piece *pieces; // The batch of pieces not yet written
+    int64_t pieceNumber;
+    stSet *chunkKeys; // The keys of the chunks of the batch to fetch
+    stSet *readKeys; // The keys of the records read, to remove once all the threads are written
+    void (*writeFn)(const char *string, int64_t length, void *extraArg);
+    void *extraArg;
+} ThreadWriter;
+
+static stSet *constructKeySet(void) {
+    return stSet_construct3((uint64_t (*)(const void *)) stIntTuple_hashKey,
+            (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct);
+}
+
+static bool addKey(stSet *keys, int64_t key) {
+    /*
+     * Adds the key to the set, returning non-zero if it was not already present.
+     */
+    stIntTuple *keyTuple = stIntTuple_construct1(key);
+    if (stSet_search(keys, keyTuple) != NULL) {
+        stIntTuple_destruct(keyTuple);
+        return 0;
+    }
+    stSet_insert(keys, keyTuple);
+    return 1;
+}
+
+static ThreadWriter *threadWriter_construct(stKVDatabase *database) {
+    ThreadWriter *threadWriter = st_calloc(1, sizeof(ThreadWriter));
+    threadWriter->database = database;
+    threadWriter->pieces = st_malloc(sizeof(Piece) * THREAD_PIECES_PER_BATCH);
+    threadWriter->chunkKeys = constructKeySet();
+    threadWriter->readKeys = constructKeySet();
+    return threadWriter;
+}
+
+static void threadWriter_destruct(ThreadWriter *threadWriter) {
+    /*
+     * Removes the records read from the database, as all the threads referencing them have been written.
+     */
+    stList *keys = stList_construct();
+    stSetIterator *it = stSet_getIterator(threadWriter->readKeys);
+    stIntTuple *key;
+    while ((key = stSet_getNext(it)) != NULL) {
+        stList_append(keys, stIntTuple_construct1(stIntTuple_get(key, 0)));
+        if (stList_length(keys) >= THREAD_RECORDS_PER_REQUEST) {
+            removeRecords(threadWriter->database, keys);
+        }
+    }
+    stSet_destructIterator(it);
+    removeRecords(threadWriter->database, keys);
+    stList_destruct(keys);
+    stSet_destruct(threadWriter->readKeys);
+    stSet_destruct(threadWriter->chunkKeys);
+    free(threadWriter->pieces);
+    free(threadWriter);
+}
+
+static void threadWriter_flush(ThreadWriter *threadWriter) {
+    /*
+     * Fetches the chunks of the batch of pieces and writes the pieces out in order.
+     */
+    stHash *chunks = stHash_construct3((uint64_t (*)(const void *)) stIntTuple_hashKey,
+            (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct,
+            (void (*)(void *)) chunk_destruct);
+    stList *keys = stList_construct3(0, free);
+    stSetIterator *it = stSet_getIterator(threadWriter->chunkKeys);
+    stIntTuple *key;
+    while ((key = stSet_getNext(it)) != NULL) {
+        int64_t *j = st_malloc(sizeof(int64_t));
+        j[0] = stIntTuple_get(key, 0);
+        stList_append(keys, j);
+    }
+    stSet_destructIterator(it);
+    if (stList_length(keys) > 0) {
+        stList *records = getRecords(threadWriter->database, keys);
+        for (int64_t i = 0; i < stList_length(keys); i++) {
+            int64_t name = *(int64_t *) stList_get(keys, i);
+            int64_t recordSize;
+            void *record = stKVDatabaseBulkResult_getRecord(stList_get(records, i), &recordSize);
+            if (record == NULL) {
+                st_errAbort("The chunk %" PRIi64 " of a thread is missing", name);
+            }
+            Chunk *chunk = st_malloc(sizeof(Chunk));
+            chunk->key = name;
+            chunk->data = stCompression_decompress(record, recordSize, &chunk->dataSize);
+            stHash_insert(chunks, stIntTuple_construct1(name), chunk);
+            addKey(threadWriter->readKeys, name);
+        }
+        stList_destruct(records);
+    }
+    stList_destruct(keys);
+
+    Chunk *madeChunk = NULL; //The last chunk of the thread builder decompressed, and its string
+    Chunk madeString = { 0, NULL, 0 };
+    for (int64_t i = 0; i < threadWriter->pieceNumber; i++) {
+        Piece *piece = &threadWriter->pieces[i];
+        Chunk *chunk;
+        if (piece->chunk != NULL) {
+            if (piece->chunk != madeChunk) {
+                free(madeString.data);
+                madeString.data = stCompression_decompress(piece->chunk->data, piece->chunk->dataSize,
+                        &madeString.dataSize);
+                madeChunk = piece->chunk;
+            }
+            chunk = &madeString;
+        } else {
+            key = stIntTuple_construct1(piece->key);
+            chunk = stHash_search(chunks, key);
+            stIntTuple_destruct(key);
+            assert(chunk != NULL);
+        }
+        if (piece->offset < 0 || piece->length < 0 || piece->offset + piece->length > chunk->dataSize) {
+            st_errAbort("A piece of a thread lies outside the chunk %" PRIi64, piece->key);
+        }
+        threadWriter->writeFn((char *) chunk->data + piece->offset, piece->length, threadWriter->extraArg);
+    }
+    free(madeString.data);
+    stHash_destruct(chunks);
+    stSet_destruct(threadWriter->chunkKeys);
+    threadWriter->chunkKeys = constructKeySet();
+    threadWriter->pieceNumber = 0;
+}
+
+static void threadWriter_addPiece(ThreadWriter *threadWriter, Chunk *chunk, int64_t key, int64_t offset,
+        int64_t length) {
+    if (threadWriter->pieceNumber == THREAD_PIECES_PER_BATCH) {
+        threadWriter_flush(threadWriter);
+    }
+    if (chunk == NULL) {
+        stIntTuple *keyTuple = stIntTuple_construct1(key);
+        if (stSet_search(threadWriter->chunkKeys, keyTuple) == NULL) {
+            if (stSet_size(threadWriter->chunkKeys) == THREAD_CHUNKS_PER_REQUEST) {
+                threadWriter_flush(threadWriter);
+            }
+            stSet_insert(threadWriter->chunkKeys, keyTuple);
+        } else {
+            stIntTuple_destruct(keyTuple);
+        }
+    }
+    Piece *piece = &threadWriter->pieces[threadWriter->pieceNumber++];
+    piece->chunk = chunk;
+    piece->key = key;
+    piece->offset = offset;
+    piece->length = length;
+}
+
+static void getThreadRecordKeys(stSet *requested, int64_t *entries, int64_t entryNumber, stList *keys) {
+    /*
+     * Adds the keys of the thread records referenced by the entries and not yet requested to keys.
+     */
+    for (int64_t i = 0; i < entryNumber; i++) {
+        if (entries[i] < 0) {
+            i += 2;
+        } else if (addKey(requested, entries[i])) {
+            int64_t *j = st_malloc(sizeof(int64_t));
+            j[0] = entries[i];
+            stList_append(keys, j);
+        }
+    }
+}
+
+static stHash *getAllThreadRecords(ThreadWriter *threadWriter, ThreadBuilder *threadBuilder) {
+    /*
+     * Fetches the thread records referenced by the current thread of the thread builder, and those referenced by
+     * them in turn, a level of the flower tree at a time. Returns a hash of keys to the records.
+     */
+    stHash *threadRecords = stHash_construct3((uint64_t (*)(const void *)) stIntTuple_hashKey,
+            (int (*)(const void *, const void *)) stIntTuple_equalsFn, (void (*)(void *)) stIntTuple_destruct, free);
+    stSet *requested = constructKeySet();
+    stList *keys = stList_construct3(0, free);
+    getThreadRecordKeys(requested, threadBuilder->entries, threadBuilder->entryNumber, keys);
+    while (stList_length(keys) > 0) {
+        stList *nextKeys = stList_construct3(0, free);
+        while (stList_length(keys) > 0) {
+            stList *batch = stList_construct3(0, free);
+            while (stList_length(keys) > 0 && stList_length(batch) < THREAD_RECORDS_PER_REQUEST) {
+                stList_append(batch, stList_pop(keys));
+            }
+            stList *records = getRecords(threadWriter->database, batch);
+            for (int64_t i = 0; i < stList_length(batch); i++) {
+                int64_t name = *(int64_t *) stList_get(batch, i);
+                int64_t recordSize;
+                int64_t *record = stKVDatabaseBulkResult_getRecord(stList_get(records, i), &recordSize);
+                if (!isThreadRecord(record, recordSize)) {
+                    st_errAbort("The record of the thread starting at cap %" PRIi64 " is missing or malformed", name);
+                }
+                getThreadRecordKeys(requested, record + 1, record[0], nextKeys);
+                int64_t *recordCopy = st_malloc(recordSize);
+                memcpy(recordCopy, record, recordSize);
+                stHash_insert(threadRecords, stIntTuple_construct1(name), recordCopy);
+                addKey(threadWriter->readKeys, name);
+            }
+            stList_destruct(records);
+            stList_destruct(batch);
+        }
+        stList_destruct(keys);
+        keys = nextKeys;
+    }
+    stList_destruct(keys);
+    stSet_destruct(requested);
+    return threadRecords;
+}
+
+static void threadWriter_addEntries(ThreadWriter *threadWriter, stHash *threadRecords, ThreadBuilder *threadBuilder,
+        int64_t *entries, int64_t entryNumber) {
+    /*
+     * Adds the pieces of the entries, in order, expanding the thread records. The chunks of the pieces are those of
+     * the thread builder if it is not NULL, else those in the database.
+     */
+    for (int64_t i = 0; i < entryNumber; i++) {
+        if (entries[i] >= 0) {
+            stIntTuple *key = stIntTuple_construct1(entries[i]);
+            int64_t *record = stHash_search(threadRecords, key);
+            stIntTuple_destruct(key);
+            assert(record != NULL);
+            threadWriter_addEntries(threadWriter, threadRecords, NULL, record + 1, record[0]);
+        } else {
+            Chunk *chunk = threadBuilder != NULL ? stList_get(threadBuilder->slots, -entries[i] - 1) : NULL;
+            threadWriter_addPiece(threadWriter, chunk, entries[i], entries[i + 1], entries[i + 2]);
+            i += 2;
+        }
+    }
+}
+
+static void threadWriter_writeThread(ThreadWriter *threadWriter, ThreadBuilder *threadBuilder,
+        void (*writeFn)(const char *string, int64_t length, void *extraArg), void *extraArg) {
+    /*
+     * Writes out the current thread of the thread builder with writeFn, a batch of chunks at a time.
+     */
+    threadBuilder_finishChunk(threadBuilder);
+    stHash *threadRecords = getAllThreadRecords(threadWriter, threadBuilder);
+    threadWriter->writeFn = writeFn;
+    threadWriter->extraArg = extraArg;
+    threadWriter_addEntries(threadWriter, threadRecords, threadBuilder, threadBuilder->entries,
+            threadBuilder->entryNumber);
+    threadWriter_flush(threadWriter);
+    stHash_destruct(threadRecords);
+}
+
+static void writeToFile(const char *string, int64_t length, void *fileHandle) {
+    if (fwrite(string, sizeof(char), length, fileHandle) != (size_t) length) {
+        st_errnoAbort("Writing a thread failed");
+    }
+}
+
+typedef struct _threadString {
+    char *string;
+    int64_t length;
+    int64_t maxLength;
+} ThreadString;
+
+static void writeToString(const char *string, int64_t length, ThreadString *threadString) {
+    if (threadString->length + length + 1 > threadString->maxLength) {
+        threadString->maxLength = (threadString->length + length + 1) * 2;
+        threadString->string = st_realloc(threadString->string, threadString->maxLength);
+    }
+    memcpy(threadString->string + threadString->length, string, length);
+    threadString->length += length;
+    threadString->string[threadString->length] = '\0';
+}
 
-    //Cache records
-    stCache *cache = cacheRecords(database, caps, segmentWriteFn, terminalAdjacencyWriteFn);
+////////////////////////////////////
+////////////////////////////////////
+//Public functions
+////////////////////////////////////
+////////////////////////////////////
 
-    //Build new threads
+void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg) {
+    storeRecursiveThreads(database, getRecursiveThreads(caps, segmentWriteFn, terminalAdjacencyWriteFn, extraArg));
+}
+
+RecursiveThreads *getRecursiveThreads(stList *caps, char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg) {
+    ThreadBuilder *threadBuilder = threadBuilder_construct();
     for (int64_t i = 0; i < stList_length(caps); i++) {
         Cap *cap = stList_get(caps, i);
-        stList_append(threadStrings, getThread(cache, cap));
+        threadBuilder_addThread(threadBuilder, cap, segmentWriteFn, terminalAdjacencyWriteFn, extraArg);
+        threadBuilder_addThreadRecord(threadBuilder, cap);
     }
+    return threadBuilder;
+}
 
-    stCache_destruct(cache);
+void storeRecursiveThreads(stKVDatabase *database, RecursiveThreads *recursiveThreads) {
+    threadBuilder_store(recursiveThreads, database);
+    threadBuilder_destruct(recursiveThreads);
+}
 
+stList *buildRecursiveThreadsInList(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg) {
+    stList *threadStrings = stList_construct3(0, free);
+    ThreadWriter *threadWriter = threadWriter_construct(database);
+    for (int64_t i = 0; i < stList_length(caps); i++) {
+        ThreadBuilder *threadBuilder = threadBuilder_construct();
+        threadBuilder_addThread(threadBuilder, stList_get(caps, i), segmentWriteFn, terminalAdjacencyWriteFn,
+                extraArg);
+        ThreadString threadString = { stString_copy(""), 0, 1 };
+        threadWriter_writeThread(threadWriter, threadBuilder, (void (*)(const char *, int64_t, void *)) writeToString,
+                &threadString);
+        threadBuilder_destruct(threadBuilder);
+        stList_append(threadStrings, threadString.string);
+    }
+    threadWriter_destruct(threadWriter);
     return threadStrings;
 }
 
+void writeRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), bool (*threadHeaderFn)(Cap *, FILE *, void *), FILE *fileHandle,
+        void *extraArg) {
+    ThreadWriter *threadWriter = threadWriter_construct(database);
+    for (int64_t i = 0; i < stList_length(caps); i++) {
+        Cap *cap = stList_get(caps, i);
+        if (threadHeaderFn(cap, fileHandle, extraArg)) {
+            ThreadBuilder *threadBuilder = threadBuilder_construct();
+            threadBuilder_addThread(threadBuilder, cap, segmentWriteFn, terminalAdjacencyWriteFn, extraArg);
+            threadWriter_writeThread(threadWriter, threadBuilder, writeToFile, fileHandle);
+            threadBuilder_destruct(threadBuilder);
+            fprintf(fileHandle, "\n");
+        }
+    }
+    threadWriter_destruct(threadWriter);
+}
@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "sonLib.h"
+#include "stReferenceProblem2.h"
+#include "referenceSampler.h"
+
+////////////////////////////////////
+////////////////////////////////////
+//Neighbours of each node
+////////////////////////////////////
+////////////////////////////////////
+
+struct _refNeighbours {
+    int64_t nodeNumber;
+    int64_t *lengths;
+    int64_t *maxLengths;
+    int64_t **nodes; // Indexed by the absolute value of a node, the absolute values of its neighbours
+};
+
+refNeighbours *refNeighbours_construct(int64_t nodeNumber) {
+    refNeighbours *nL = st_malloc(sizeof(refNeighbours));
+    nL->nodeNumber = nodeNumber;
+    nL->lengths = st_calloc(nodeNumber + 1, sizeof(int64_t));
+    nL->maxLengths = st_calloc(nodeNumber + 1, sizeof(int64_t));
+    nL->nodes = st_calloc(nodeNumber + 1, sizeof(int64_t *));
+    return nL;
+}
+
+void refNeighbours_destruct(refNeighbours *nL) {
+    for (int64_t i = 0; i <= nL->nodeNumber; i++) {
+        free(nL->nodes[i]);
+    }
+    free(nL->nodes);
+    free(nL->lengths);
+    free(nL->maxLengths);
+    free(nL);
+}
+
+static void refNeighbours_append(refNeighbours *nL, int64_t node1, int64_t node2) {
+    if (nL->lengths[node1] == nL->maxLengths[node1]) {
+        nL->maxLengths[node1] = nL->maxLengths[node1] * 2 + 2;
+        nL->nodes[node1] = st_realloc(nL->nodes[node1], sizeof(int64_t) * nL->maxLengths[node1]);
+    }
+    nL->nodes[node1][nL->lengths[node1]++] = node2;
+}
+
+void refNeighbours_add(refNeighbours *nL, int64_t node1, int64_t node2) {
+    node1 = llabs(node1);
+    node2 = llabs(node2);
+    assert(node1 > 0 && node1 <= nL->nodeNumber);
+    assert(node2 > 0 && node2 <= nL->nodeNumber);
+    if (node1 != node2) {
+        refNeighbours_append(nL, node1, node2);
+        refNeighbours_append(nL, node2, node1);
+    }
+}
+
+////////////////////////////////////
+////////////////////////////////////
+//Sampled reference
+////////////////////////////////////
+////////////////////////////////////
+
+/*
+ * The scores of a node to one of its neighbours in the reference, if placed before or after the neighbour,
+ * in each orientation.
+ */
+typedef struct _insertionScore {
+    int64_t interval;
+    double label;
+    int64_t node;
+    double before[2]; // The score if the neighbour is before the node, with the node in its positive then negative orientation
+    double after[2]; // The score if the neighbour is after the node
+} InsertionScore;
+
+/*
+ * The intervals are kept as doubly linked lists of the absolute values of the nodes, each node with a label
+ * that increases along its interval, so whether one node precedes another is found without walking the interval.
+ */
+struct _sampledReference {
+    int64_t nodeNumber;
+    int64_t intervalNumber;
+    int64_t *firstNodes; // The first node of each interval, as placed
+    int64_t *lastNodes; // The last node of each interval, as placed
+    int64_t *nodes; // Indexed by the absolute value of a node, the node as placed, or 0 if not in the reference
+    int64_t *intervals; // The interval of each node
+    int64_t *previous; // The previous node in the interval, or 0 for the first node
+    int64_t *next; // The next node in the interval, or 0 for the last node
+    double *labels;
+    int64_t movableNodeNumber;
+    int64_t *movableNodes; // The nodes that are not the first or last of an interval
+    uint64_t randomState;
+    int64_t maxInsertionScores;
+    InsertionScore *insertionScores;
+};
+
+static const double scoreTolerance = 1e-9;
+
+static bool isImprovement(double score, double bestScore) {
+    return score > bestScore + scoreTolerance * (1.0 + fabs(bestScore));
+}
+
+static uint64_t sampledReference_random(sampledReference *sR) {
+    /*
+     * An xorshift64* generator.
+     */
+    uint64_t x = sR->randomState;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sR->randomState = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static int64_t sampledReference_randomInt(sampledReference *sR, int64_t n) {
+    return (int64_t) (sampledReference_random(sR) % (uint64_t) n);
+}
+
+static void sampledReference_shuffleMovableNodes(sampledReference *sR) {
+    for (int64_t i = sR->movableNodeNumber - 1; i > 0; i--) {
+        int64_t j = sampledReference_randomInt(sR, i + 1);
+        int64_t node = sR->movableNodes[i];
+        sR->movableNodes[i] = sR->movableNodes[j];
+        sR->movableNodes[j] = node;
+    }
+}
+
+static void sampledReference_place(sampledReference *sR, int64_t node, int64_t interval, int64_t pNode, double label) {
+    /*
+     * Adds the node after pNode, the last node so far of the interval, or as the first node if pNode is 0.
+     */
+    int64_t n = llabs(node);
+    assert(n > 0 && n <= sR->nodeNumber);
+    assert(sR->nodes[n] == 0);
+    sR->nodes[n] = node;
+    sR->intervals[n] = interval;
+    sR->labels[n] = label;
+    sR->previous[n] = pNode;
+    sR->next[n] = 0;
+    if (pNode != 0) {
+        sR->next[pNode] = n;
+    }
+}
+
+sampledReference *sampledReference_construct(reference *ref, int64_t nodeNumber, uint64_t seed) {
+    sampledReference *sR = st_calloc(1, sizeof(sampledReference));
+    sR->nodeNumber = nodeNumber;
+    sR->intervalNumber = reference_getIntervalNumber(ref);
+    sR->firstNodes = st_malloc(sizeof(int64_t) * sR->intervalNumber);
+    sR->lastNodes = st_malloc(sizeof(int64_t) * sR->intervalNumber);
+    sR->nodes = st_calloc(nodeNumber + 1, sizeof(int64_t));
+    sR->intervals = st_calloc(nodeNumber + 1, sizeof(int64_t));
+    sR->previous = st_calloc(nodeNumber + 1, sizeof(int64_t));
+    sR->next = st_calloc(nodeNumber + 1, sizeof(int64_t));
+    sR->labels = st_calloc(nodeNumber + 1, sizeof(double));
+    sR->movableNodes = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    for (int64_t i = 0; i < sR->intervalNumber; i++) {
+        int64_t firstNode = reference_getFirstOfInterval(ref, i);
+        int64_t lastNode = reference_getLast(ref, firstNode);
+        sR->firstNodes[i] = firstNode;
+        sR->lastNodes[i] = lastNode;
+        double label = 0.0;
+        sampledReference_place(sR, firstNode, i, 0, label++);
+        int64_t pNode = firstNode;
+        int64_t node;
+        while ((node = reference_getNext(ref, pNode)) != lastNode) {
+            sampledReference_place(sR, node, i, llabs(pNode), label++);
+            sR->movableNodes[sR->movableNodeNumber++] = llabs(node);
+            pNode = node;
+        }
+        sampledReference_place(sR, lastNode, i, llabs(pNode), label);
+    }
+    /*
+     * Mix the seed with splitmix64, so nearby seeds give unrelated streams, and avoid the all zero state.
+     */
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    sR->randomState = z != 0 ? z : 0x9E3779B97F4A7C15ULL;
+    return sR;
+}
+
+void sampledReference_destruct(sampledReference *sR) {
+    free(sR->firstNodes);
+    free(sR->lastNodes);
+    free(sR->nodes);
+    free(sR->intervals);
+    free(sR->previous);
+    free(sR->next);
+    free(sR->labels);
+    free(sR->movableNodes);
+    free(sR->insertionScores);
+    free(sR);
+}
+
+reference *sampledReference_getReference(sampledReference *sR) {
+    reference *ref = reference_construct(sR->nodeNumber);
+    for (int64_t i = 0; i < sR->intervalNumber; i++) {
+        int64_t firstNode = sR->firstNodes[i];
+        int64_t lastNode = sR->lastNodes[i];
+        reference_makeNewInterval(ref, firstNode, lastNode);
+        int64_t pNode = firstNode;
+        int64_t n = sR->next[llabs(firstNode)];
+        while (n != llabs(lastNode)) {
+            reference_insertNode(ref, pNode, sR->nodes[n]);
+            pNode = sR->nodes[n];
+            n = sR->next[n];
+        }
+    }
+    return ref;
+}
+
+static void sampledReference_remove(sampledReference *sR, int64_t n) {
+    int64_t pNode = sR->previous[n];
+    int64_t nNode = sR->next[n];
+    assert(pNode != 0 && nNode != 0);
+    sR->next[pNode] = nNode;
+    sR->previous[nNode] = pNode;
+    sR->intervals[n] = -1;
+}
+
+static void sampledReference_relabel(sampledReference *sR, int64_t interval) {
+    double label = 0.0;
+    for (int64_t n = llabs(sR->firstNodes[interval]); n != 0; n = sR->next[n]) {
+        sR->labels[n] = label++;
+    }
+}
+
+static void sampledReference_insertAfter(sampledReference *sR, int64_t pNode, int64_t node) {
+    /*
+     * Inserts the node, as placed, after the node with absolute value pNode.
+     */
+    int64_t n = llabs(node);
+    int64_t nNode = sR->next[pNode];
+    assert(nNode != 0);
+    int64_t interval = sR->intervals[pNode];
+    double label = (sR->labels[pNode] + sR->labels[nNode]) / 2.0;
+    if (!(label > sR->labels[pNode] && label < sR->labels[nNode])) { // Run out of precision between the labels
+        sampledReference_relabel(sR, interval);
+        label = (sR->labels[pNode] + sR->labels[nNode]) / 2.0;
+    }
+    sR->nodes[n] = node;
+    sR->intervals[n] = interval;
+    sR->labels[n] = label;
+    sR->previous[n] = pNode;
+    sR->next[n] = nNode;
+    sR->next[pNode] = n;
+    sR->previous[nNode] = n;
+}
+
+static int insertionScore_cmp(const void *a, const void *b) {
+    const InsertionScore *i = a, *j = b;
+    if (i->interval != j->interval) {
+        return i->interval < j->interval ? -1 : 1;
+    }
+    return i->label < j->label ? -1 : (i->label > j->label ? 1 : 0);
+}
+
+static int64_t sampledReference_getInsertionScores(sampledReference *sR, refAdjList *aL, refNeighbours *nL, int64_t n) {
+    /*
+     * Fills in the scores of the node, which is not in the reference, to each of its neighbours that is,
+     * ordered by interval then position, and returns their number.
+     */
+    int64_t length = nL->lengths[n];
+    if (length > sR->maxInsertionScores) {
+        sR->maxInsertionScores = length * 2;
+        sR->insertionScores = st_realloc(sR->insertionScores, sizeof(InsertionScore) * sR->maxInsertionScores);
+    }
+    int64_t k = 0;
+    for (int64_t i = 0; i < length; i++) {
+        int64_t m = nL->nodes[n][i];
+        if (sR->nodes[m] == 0 || sR->intervals[m] < 0) {
+            continue;
+        }
+        InsertionScore *insertionScore = &sR->insertionScores[k++];
+        insertionScore->interval = sR->intervals[m];
+        insertionScore->label = sR->labels[m];
+        insertionScore->node = m;
+        for (int64_t o = 0; o < 2; o++) {
+            int64_t node = o == 0 ? n : -n;
+            insertionScore->before[o] = refAdjList_getWeight(aL, -sR->nodes[m], node);
+            insertionScore->after[o] = refAdjList_getWeight(aL, -node, sR->nodes[m]);
+        }
+    }
+    if (k > 1) {
+        qsort(sR->insertionScores, k, sizeof(InsertionScore), insertionScore_cmp);
+    }
+    return k;
+}
+
+static double sampledReference_getScoreAfter(sampledReference *sR, int64_t insertionScoreNumber, int64_t pNode, int64_t o) {
+    /*
+     * Returns the score of the node the insertion scores are for if placed after pNode, in the given orientation.
+     */
+    double score = 0.0;
+    for (int64_t i = 0; i < insertionScoreNumber; i++) {
+        InsertionScore *insertionScore = &sR->insertionScores[i];
+        if (insertionScore->interval == sR->intervals[pNode]) {
+            score += insertionScore->label <= sR->labels[pNode] ? insertionScore->before[o] : insertionScore->after[o];
+        }
+    }
+    return score;
+}
+
+static void sampledReference_considerPlace(sampledReference *sR, double score, int64_t pNode, int64_t node,
+        double *bestScore, int64_t *bestPNode, int64_t *bestNode, int64_t *ties) {
+    /*
+     * Keeps the place if it improves on the best so far, or, with equal chance among the places that score equally
+     * and improve on where the node was, if it ties with it.
+     */
+    if (isImprovement(score, *bestScore)) {
+        *bestScore = score;
+        *bestPNode = pNode;
+        *bestNode = node;
+        *ties = 1;
+    } else if (*ties > 0 && score == *bestScore && sampledReference_randomInt(sR, ++(*ties)) == 0) {
+        *bestPNode = pNode;
+        *bestNode = node;
+    }
+}
+
+static double sampledReference_moveGreedily(sampledReference *sR, refAdjList *aL, refNeighbours *nL, int64_t n) {
+    /*
+     * Moves the node to the place and orientation where it scores highest, or leaves it where it is if nowhere
+     * is better. Returns the gain in score.
+     */
+    int64_t pNode = sR->previous[n];
+    int64_t node = sR->nodes[n];
+    sampledReference_remove(sR, n);
+    int64_t insertionScoreNumber = sampledReference_getInsertionScores(sR, aL, nL, n);
+    double currentScore = sampledReference_getScoreAfter(sR, insertionScoreNumber, pNode, node > 0 ? 0 : 1);
+    double bestScore = currentScore;
+    int64_t bestPNode = pNode, bestNode = node, ties = 0;
+    for (int64_t o = 0; o < 2; o++) {
+        int64_t i = 0;
+        while (i < insertionScoreNumber) {
+            /*
+             * The score only changes as the place passes a neighbour, so only the places just after the first
+             * node of the interval and just after each neighbour need be tried.
+             */
+            int64_t interval = sR->insertionScores[i].interval;
+            int64_t firstNode = llabs(sR->firstNodes[interval]);
+            int64_t lastNode = llabs(sR->lastNodes[interval]);
+            int64_t j = i;
+            double score = 0.0;
+            while (j < insertionScoreNumber && sR->insertionScores[j].interval == interval) {
+                score += sR->insertionScores[j++].after[o];
+            }
+            if (sR->insertionScores[i].node == firstNode) {
+                score += sR->insertionScores[i].before[o] - sR->insertionScores[i].after[o];
+                i++;
+            }
+            sampledReference_considerPlace(sR, score, firstNode, o == 0 ? n : -n, &bestScore, &bestPNode, &bestNode, &ties);
+            for (; i < j; i++) {
+                score += sR->insertionScores[i].before[o] - sR->insertionScores[i].after[o];
+                if (sR->insertionScores[i].node != lastNode) {
+                    sampledReference_considerPlace(sR, score, sR->insertionScores[i].node, o == 0 ? n : -n,
+                            &bestScore, &bestPNode, &bestNode, &ties);
+                }
+            }
+        }
+    }
+    sampledReference_insertAfter(sR, bestPNode, bestNode);
+    return bestScore - currentScore;
+}
+
+void sampledReference_updateGreedily(sampledReference *sR, refAdjList *aL, refNeighbours *nL, int64_t permutations) {
+    for (int64_t permutation = 0; permutation < permutations; permutation++) {
+        sampledReference_shuffleMovableNodes(sR);
+        double gain = 0.0;
+        for (int64_t i = 0; i < sR->movableNodeNumber; i++) {
+            gain += sampledReference_moveGreedily(sR, aL, nL, sR->movableNodes[i]);
+        }
+        if (gain <= 0.0) {
+            break;
+        }
+    }
+}
+
+static int64_t isBadAdjacency(refAdjList *dAL, int64_t node1, int64_t node2) {
+    return refAdjList_getWeight(dAL, -node1, node2) <= 0.0 ? 1 : 0;
+}
+
+static int64_t sampledReference_getBadAdjacencyChange(sampledReference *sR, refAdjList *dAL, int64_t pNode, int64_t node) {
+    /*
+     * Returns the change in the number of bad adjacencies from placing the node after pNode.
+     */
+    int64_t nNode = sR->next[pNode];
+    return isBadAdjacency(dAL, sR->nodes[pNode], node) + isBadAdjacency(dAL, node, sR->nodes[nNode])
+            - isBadAdjacency(dAL, sR->nodes[pNode], sR->nodes[nNode]);
+}
+
+static bool sampledReference_nudge(sampledReference *sR, refAdjList *dAL, refAdjList *aL, refNeighbours *nL, int64_t n,
+        int64_t maxNudge) {
+    /*
+     * Moves the node, by at most maxNudge places within its interval and in either orientation, to where it makes
+     * the fewest bad adjacencies, provided its score does not fall, breaking ties by the higher score. Returns
+     * non-zero if the node was moved.
+     */
+    int64_t pNode = sR->previous[n];
+    int64_t node = sR->nodes[n];
+    int64_t lastNode = llabs(sR->lastNodes[sR->intervals[n]]);
+    sampledReference_remove(sR, n);
+    int64_t insertionScoreNumber = sampledReference_getInsertionScores(sR, aL, nL, n);
+    double currentScore = sampledReference_getScoreAfter(sR, insertionScoreNumber, pNode, node > 0 ? 0 : 1);
+    int64_t currentBadAdjacencies = sampledReference_getBadAdjacencyChange(sR, dAL, pNode, node);
+    double bestScore = currentScore;
+    int64_t bestBadAdjacencies = currentBadAdjacencies;
+    int64_t bestPNode = pNode, bestNode = node;
+    int64_t candidate = pNode;
+    for (int64_t i = 0; i < maxNudge && sR->previous[candidate] != 0; i++) {
+        candidate = sR->previous[candidate];
+    }
+    int64_t stepsAfter = 0;
+    while (candidate != lastNode) {
+        for (int64_t o = 0; o < 2; o++) {
+            int64_t candidateNode = o == 0 ? n : -n;
+            if (candidate == pNode && candidateNode == node) {
+                continue;
+            }
+            double score = sampledReference_getScoreAfter(sR, insertionScoreNumber, candidate, o);
+            if (isImprovement(currentScore, score)) {
+                continue;
+            }
+            int64_t badAdjacencies = sampledReference_getBadAdjacencyChange(sR, dAL, candidate, candidateNode);
+            if (badAdjacencies < bestBadAdjacencies
+                    || (badAdjacencies == bestBadAdjacencies && isImprovement(score, bestScore))) {
+                bestScore = score;
+                bestBadAdjacencies = badAdjacencies;
+                bestPNode = candidate;
+                bestNode = candidateNode;
+            }
+        }
+        if (candidate == pNode) {
+            stepsAfter = 1;
+        } else if (stepsAfter > 0 && stepsAfter++ >= maxNudge) {
+            break;
+        }
+        candidate = sR->next[candidate];
+    }
+    sampledReference_insertAfter(sR, bestPNode, bestNode);
+    return bestPNode != pNode || bestNode != node;
+}
+
+void sampledReference_nudgeGreedily(sampledReference *sR, refAdjList *dAL, refAdjList *aL, refNeighbours *nL,
+        int64_t permutations, int64_t maxNudge) {
+    for (int64_t permutation = 0; permutation < permutations; permutation++) {
+        sampledReference_shuffleMovableNodes(sR);
+        bool moved = 0;
+        for (int64_t i = 0; i < sR->movableNodeNumber; i++) {
+            moved = sampledReference_nudge(sR, dAL, aL, nL, sR->movableNodes[i], maxNudge) || moved;
+        }
+        if (!moved) {
+            break;
+        }
+    }
+}
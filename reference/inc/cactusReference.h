@@ -22,10 +22,13 @@
 extern const char *REFERENCE_BUILDING_EXCEPTION;
 
 /*
- * Construct a reference for the flower, top down.
+ * Construct a reference for the flower, top down. The ordering found greedily is refined by samplingChains
+ * independent runs of the sampler, each of the given number of permutations, keeping the best scoring.
+ * The first chain is the one always run. Chain i of the others has its own random number generator,
+ * seeded with the flower's name plus i.
  */
 void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader,
-        int64_t permutations,
+        int64_t permutations, int64_t samplingChains,
         stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber),
         double (*temperature)(double),
         double theta,
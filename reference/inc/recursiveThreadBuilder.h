@@ -8,12 +8,51 @@
 #ifndef RECURSIVETHREADBUILDER_H_
 #define RECURSIVETHREADBUILDER_H_
 
+/*
+ * Builds the threads starting at each of the given caps, storing each in the database under the name of its cap.
+ * The strings of the segments and terminal adjacencies are given by segmentWriteFn and terminalAdjacencyWriteFn,
+ * each passed extraArg, while the other adjacencies refer to the threads already built for the nested flowers. A
+ * thread that starts in a nested flower replaces the record of the thread there, which must therefore already be
+ * stored.
+ */
 void buildRecursiveThreads(stKVDatabase *database, stList *caps,
-        char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *));
+        char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg);
+
+/*
+ * The records of a set of threads made by getRecursiveThreads, not yet stored in the database.
+ */
+typedef struct _recursiveThreads RecursiveThreads;
+
+/*
+ * As buildRecursiveThreads, but keeps the records in memory rather than storing them, without touching the
+ * database, so the threads of different flowers can be made in parallel. They are stored by storeRecursiveThreads.
+ */
+RecursiveThreads *getRecursiveThreads(stList *caps,
+        char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg);
 
+/*
+ * Stores the records made by getRecursiveThreads in the database, destroying recursiveThreads.
+ */
+void storeRecursiveThreads(stKVDatabase *database, RecursiveThreads *recursiveThreads);
+
+/*
+ * As buildRecursiveThreads, but returns the complete thread strings, in the order of the caps, rather than storing them.
+ * The records read to make them are then removed from the database.
+ */
 stList *buildRecursiveThreadsInList(stKVDatabase *database, stList *caps,
-        char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *));
+        char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *), void *extraArg);
+
+/*
+ * As buildRecursiveThreadsInList, but writes each complete thread to the file, followed by a new line, holding only a
+ * bounded number of chunks of it in memory at a time. For each cap threadHeaderFn is first called, which can write a
+ * header for the thread and returns non-zero if the thread is to be written; it is also passed extraArg.
+ */
+void writeRecursiveThreads(stKVDatabase *database, stList *caps,
+        char *(*segmentWriteFn)(Segment *, void *),
+        char *(*terminalAdjacencyWriteFn)(Cap *, void *),
+        bool (*threadHeaderFn)(Cap *, FILE *, void *), FILE *fileHandle, void *extraArg);
 
 #endif /* RECURSIVETHREADBUILDER_H_ */
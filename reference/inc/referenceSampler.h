@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/*
+ * referenceSampler.h
+ *
+ * Samplers that refine a reference ordering in the manner of updateReferenceGreedily and nudgeGreedily,
+ * but that draw from a random number generator of their own, so that several chains can be run at once
+ * and each gives the same result for the same seed.
+ */
+
+#ifndef REFERENCE_SAMPLER_H_
+#define REFERENCE_SAMPLER_H_
+
+#include "sonLib.h"
+#include "stReferenceProblem2.h"
+
+/*
+ * The nodes each node has a non-zero score to in an adjacency list, ignoring orientation, which
+ * the samplers use to find where a node scores without looking at every other node.
+ */
+typedef struct _refNeighbours refNeighbours;
+
+refNeighbours *refNeighbours_construct(int64_t nodeNumber);
+
+void refNeighbours_destruct(refNeighbours *nL);
+
+/*
+ * Records that the nodes have a score between them. The caller adds each pair once.
+ */
+void refNeighbours_add(refNeighbours *nL, int64_t node1, int64_t node2);
+
+/*
+ * A copy of a reference that the samplers can reorder, with its own random number generator.
+ */
+typedef struct _sampledReference sampledReference;
+
+sampledReference *sampledReference_construct(reference *ref, int64_t nodeNumber, uint64_t seed);
+
+void sampledReference_destruct(sampledReference *sR);
+
+/*
+ * Returns a new reference with the intervals and ordering of the sampled reference.
+ */
+reference *sampledReference_getReference(sampledReference *sR);
+
+/*
+ * For up to the given number of rounds, each stopping when a round makes no improvement, visits the nodes
+ * that are not the stubs of an interval in a random order and moves each, in either orientation, to where
+ * it contributes most to the score of aL.
+ */
+void sampledReference_updateGreedily(sampledReference *sR, refAdjList *aL, refNeighbours *nL, int64_t permutations);
+
+/*
+ * For up to the given number of rounds, visits the nodes in a random order and moves each by at most maxNudge
+ * places within its interval where that removes bad adjacencies, those without support in dAL, without
+ * lowering the score of aL.
+ */
+void sampledReference_nudgeGreedily(sampledReference *sR, refAdjList *dAL, refAdjList *aL, refNeighbours *nL,
+        int64_t permutations, int64_t maxNudge);
+
+#endif /* REFERENCE_SAMPLER_H_ */
@@ -10,6 +10,7 @@
 CuSuite *buildReferenceTestSuite(void);
 CuSuite* addReferenceCoordinatesTestSuite(void);
 CuSuite* recursiveThreadBuilderTestSuite(void);
+CuSuite *referenceSamplerTestSuite(void);
 
 int referenceRunAllTests(void) {
     CuString *output = CuStringNew();
@@ -17,6 +18,7 @@ int referenceRunAllTests(void) {
     CuSuiteAddSuite(suite, buildReferenceTestSuite());
     CuSuiteAddSuite(suite, addReferenceCoordinatesTestSuite());
     CuSuiteAddSuite(suite, recursiveThreadBuilderTestSuite());
+    CuSuiteAddSuite(suite, referenceSamplerTestSuite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
@@ -6,17 +6,18 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "sonLib.h"
 #include "cactus.h"
 #include "CuTest.h"
 #include "recursiveThreadBuilder.h"
 
-static char *writeSegment(Segment *segment) {
+static char *writeSegment(Segment *segment, void *extraArg) {
     return stString_print("%" PRIi64 " %s ", segment_getStart(segment), segment_getString(segment));
 }
 
-static char *writeTerminalAdjacency(Cap *cap) {
+static char *writeTerminalAdjacency(Cap *cap, void *extraArg) {
     if(cap_getCoordinate(cap_getAdjacency(cap)) - cap_getCoordinate(cap) - 1 == 0) {
         return stString_print("");
     }
@@ -25,17 +26,25 @@ static char *writeTerminalAdjacency(Cap *cap) {
     return stString_print("%" PRIi64 " %s ", cap_getCoordinate(cap), sequence_getString(sequence, cap_getCoordinate(cap)+1, cap_getCoordinate(cap_getAdjacency(cap)) - cap_getCoordinate(cap) - 1, 1));
 }
 
-static void recursiveFileBuilder_test(CuTest *testCase) {
-    //Make flower with two ends and 2 blocks, and one child, one empty adjacency and two containing additional blocks.
+static bool writeThreadHeader(Cap *cap, FILE *fileHandle, void *extraArg) {
+    fprintf(fileHandle, "> %" PRIi64 "\n", cap_getName(cap));
+    return 1;
+}
 
-    const char *tempDir = "recursiveFileBuilderTestTempDir";
+static const char *tempDir = "recursiveFileBuilderTestTempDir";
+static CactusDisk *cactusDisk;
+static Cap *cap1;
+static Flower *nestedFlower;
+
+static void setup(void) {
+    //Make flower with two ends and 2 blocks, and one child, one empty adjacency and two containing additional blocks.
     if(stFile_exists(tempDir)) {
         stFile_rmtree(tempDir);
     }
     stFile_mkdir(tempDir);
     stKVDatabaseConf *conf = stKVDatabaseConf_constructTokyoCabinet(
                 stFile_pathJoin(tempDir, "temporaryCactusDisk"));
-    CactusDisk *cactusDisk = cactusDisk_construct(conf, true, true);
+    cactusDisk = cactusDisk_construct(conf, true, true);
     eventTree_construct2(cactusDisk);
     Flower *flower = flower_construct(cactusDisk);
     End *end1 = end_construct2(0, 1, flower);
@@ -48,7 +57,7 @@ static void recursiveFileBuilder_test(CuTest *testCase) {
     MetaSequence *metaSequence1 = metaSequence_construct(1, 5, "ACGTA", "ref sequence", event_getName(referenceEvent), cactusDisk);
     Sequence *sequence1 = sequence_construct(metaSequence1, flower);
     //First reference thread
-    Cap *cap1 = cap_construct2(end1, 0, 1, sequence1);
+    cap1 = cap_construct2(end1, 0, 1, sequence1);
     Cap *cap2 = cap_construct2(end2, 6, 1, sequence1);
     cap_makeAdjacent(cap1, cap2);
 
@@ -58,7 +67,7 @@ static void recursiveFileBuilder_test(CuTest *testCase) {
     end_setGroup(end2, group1);
 
     //Make nested flower
-    Flower *nestedFlower = group_makeNestedFlower(group1);
+    nestedFlower = group_makeNestedFlower(group1);
 
     //Now will fill in blocks at lower level
     Block *block1 = block_construct(3, nestedFlower);
@@ -75,32 +84,121 @@ static void recursiveFileBuilder_test(CuTest *testCase) {
         end_setGroup(end, nestedGroup);
     }
     flower_destructEndIterator(endIt);
+}
+
+static void teardown(void) {
+    cactusDisk_destruct(cactusDisk);
+    stFile_rmtree(tempDir);
+}
+
+static stKVDatabase *constructSecondaryDatabase(const char *name, bool create) {
+    stKVDatabaseConf *secondaryConf = stKVDatabaseConf_constructTokyoCabinet(stFile_pathJoin(tempDir, name));
+    return stKVDatabase_construct(secondaryConf, create);
+}
+
+static void storeNestedThread(stKVDatabase *secondaryDatabase, char *(*segmentWriteFn)(Segment *, void *)) {
+    stList *nestedCaps = stList_construct();
+    stList_append(nestedCaps, flower_getCap(nestedFlower, cap_getName(cap1)));
+    buildRecursiveThreads(secondaryDatabase, nestedCaps, segmentWriteFn, writeTerminalAdjacency, NULL);
+    stList_destruct(nestedCaps);
+}
+
+static void recursiveFileBuilder_test(CuTest *testCase) {
+    setup();
 
     //Create the sequence database
-    stKVDatabaseConf *secondaryConf = stKVDatabaseConf_constructTokyoCabinet(
-                    stFile_pathJoin(tempDir, "temporaryCactusDisk2"));
-    stKVDatabase *secondaryDatabase = stKVDatabase_construct(secondaryConf, 1);
-    stList *caps = stList_construct();
-    stList_append(caps, flower_getCap(nestedFlower, cap_getName(cap1)));
-    buildRecursiveThreads(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency);
+    stKVDatabase *secondaryDatabase = constructSecondaryDatabase("temporaryCactusDisk2", 1);
+    storeNestedThread(secondaryDatabase, writeSegment);
     stKVDatabase_destruct(secondaryDatabase);
 
     //Now complete the alignment
-    secondaryDatabase = stKVDatabase_construct(secondaryConf, 0);
-    stList_pop(caps);
+    secondaryDatabase = constructSecondaryDatabase("temporaryCactusDisk2", 0);
+    stList *caps = stList_construct();
     stList_append(caps, cap1);
-    stList *threadStrings = buildRecursiveThreadsInList(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency);
+    stList *threadStrings = buildRecursiveThreadsInList(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency, NULL);
+
+    CuAssertIntEquals(testCase, 1, stList_length(threadStrings));
+    CuAssertStrEquals(testCase, "1 ACG 3 TA ", stList_get(threadStrings, 0));
+    stList_destruct(threadStrings);
+    //The records used to make the complete threads are removed
+    CuAssertIntEquals(testCase, 0, stKVDatabase_getNumberOfRecords(secondaryDatabase));
+
+    //Build the nested thread again and write the thread out to a file
+    storeNestedThread(secondaryDatabase, writeSegment);
+    char *threadFile = stFile_pathJoin(tempDir, "thread.txt");
+    FILE *fileHandle = fopen(threadFile, "w");
+    writeRecursiveThreads(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency, writeThreadHeader, fileHandle,
+            NULL);
+    fclose(fileHandle);
+    fileHandle = fopen(threadFile, "r");
+    char *line = stFile_getLineFromFile(fileHandle);
+    char *expectedHeader = stString_print("> %" PRIi64, cap_getName(cap1));
+    CuAssertStrEquals(testCase, expectedHeader, line);
+    free(line);
+    line = stFile_getLineFromFile(fileHandle);
+    CuAssertStrEquals(testCase, "1 ACG 3 TA ", line);
+    free(line);
+    CuAssertPtrEquals(testCase, NULL, stFile_getLineFromFile(fileHandle));
+    fclose(fileHandle);
+    free(expectedHeader);
+    free(threadFile);
     stKVDatabase_deleteFromDisk(secondaryDatabase);
 
+    //Build the nested thread again, storing it separately, and check the alignment is the same
+    secondaryDatabase = constructSecondaryDatabase("temporaryCactusDisk3", 1);
+    stList *nestedCaps = stList_construct();
+    stList_append(nestedCaps, flower_getCap(nestedFlower, cap_getName(cap1)));
+    storeRecursiveThreads(secondaryDatabase, getRecursiveThreads(nestedCaps, writeSegment, writeTerminalAdjacency,
+            NULL));
+    threadStrings = buildRecursiveThreadsInList(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency, NULL);
     CuAssertIntEquals(testCase, 1, stList_length(threadStrings));
     CuAssertStrEquals(testCase, "1 ACG 3 TA ", stList_get(threadStrings, 0));
+    stList_destruct(threadStrings);
+    stList_destruct(nestedCaps);
+    stList_destruct(caps);
+    stKVDatabase_deleteFromDisk(secondaryDatabase);
 
-    cactusDisk_destruct(cactusDisk);
-    stFile_rmtree(tempDir);
+    teardown();
+}
+
+#define LONG_SEGMENT_LENGTH 200000
+
+static char *writeLongSegment(Segment *segment, void *extraArg) {
+    //A segment string spanning several chunks, all but the last of which are identical.
+    char *string = st_malloc(LONG_SEGMENT_LENGTH + 1);
+    memset(string, 'A', LONG_SEGMENT_LENGTH);
+    string[LONG_SEGMENT_LENGTH] = '\0';
+    return string;
+}
+
+static void recursiveFileBuilder_testLongThread(CuTest *testCase) {
+    setup();
+
+    stKVDatabase *secondaryDatabase = constructSecondaryDatabase("temporaryCactusDisk2", 1);
+    storeNestedThread(secondaryDatabase, writeLongSegment);
+    //The thread record, one chunk of As stored once for the identical chunks, and the chunk holding the rest
+    CuAssertIntEquals(testCase, 3, stKVDatabase_getNumberOfRecords(secondaryDatabase));
+
+    stList *caps = stList_construct();
+    stList_append(caps, cap1);
+    stList *threadStrings = buildRecursiveThreadsInList(secondaryDatabase, caps, writeLongSegment,
+            writeTerminalAdjacency, NULL);
+    CuAssertIntEquals(testCase, 1, stList_length(threadStrings));
+    char *threadString = stList_get(threadStrings, 0);
+    CuAssertIntEquals(testCase, LONG_SEGMENT_LENGTH + strlen("3 TA "), strlen(threadString));
+    CuAssertIntEquals(testCase, LONG_SEGMENT_LENGTH, strspn(threadString, "A"));
+    CuAssertStrEquals(testCase, "3 TA ", threadString + LONG_SEGMENT_LENGTH);
+    CuAssertIntEquals(testCase, 0, stKVDatabase_getNumberOfRecords(secondaryDatabase));
+    stList_destruct(threadStrings);
+    stList_destruct(caps);
+    stKVDatabase_deleteFromDisk(secondaryDatabase);
+
+    teardown();
 }
 
 CuSuite* recursiveThreadBuilderTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, recursiveFileBuilder_test);
+    SUITE_ADD_TEST(suite, recursiveFileBuilder_testLongThread);
     return suite;
 }
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stReferenceProblem2.h"
+#include "referenceSampler.h"
+
+static void addRandomWeight(refAdjList *aL, refNeighbours *nL, int64_t node1, int64_t node2, double weight) {
+    if (refAdjList_getWeight(aL, node1, node2) == 0.0 && refAdjList_getWeight(aL, -node1, node2) == 0.0
+            && refAdjList_getWeight(aL, node1, -node2) == 0.0 && refAdjList_getWeight(aL, -node1, -node2) == 0.0) {
+        refNeighbours_add(nL, node1, node2);
+    }
+    refAdjList_addToWeight(aL, node1, node2, weight);
+}
+
+static int64_t getNodeCount(reference *ref) {
+    int64_t nodes = 0;
+    for (int64_t i = 0; i < reference_getIntervalNumber(ref); i++) {
+        int64_t node = reference_getFirstOfInterval(ref, i);
+        int64_t lastNode = reference_getLast(ref, node);
+        nodes++;
+        while (node != lastNode) {
+            node = reference_getNext(ref, node);
+            nodes++;
+        }
+    }
+    return nodes;
+}
+
+static void testReferenceSampler_random(CuTest *testCase) {
+    /*
+     * Samples random problems, checking the samplers keep every node, do not lower the score, that nudging does not
+     * add bad adjacencies, and that the same seed gives the same reference.
+     */
+    for (int64_t test = 0; test < 100; test++) {
+        int64_t intervalNumber = st_randomInt(1, 4);
+        int64_t nodeNumber = intervalNumber * 2 + st_randomInt(0, 50);
+        refAdjList *aL = refAdjList_construct(nodeNumber);
+        refAdjList *dAL = refAdjList_construct(nodeNumber);
+        refNeighbours *nL = refNeighbours_construct(nodeNumber);
+        int64_t edgeNumber = st_randomInt(0, 3 * nodeNumber);
+        for (int64_t i = 0; i < edgeNumber; i++) {
+            int64_t node1 = st_randomInt(1, nodeNumber + 1) * (st_random() > 0.5 ? 1 : -1);
+            int64_t node2 = st_randomInt(1, nodeNumber + 1) * (st_random() > 0.5 ? 1 : -1);
+            if (llabs(node1) != llabs(node2)) {
+                addRandomWeight(aL, nL, node1, node2, st_random() * 10 + 0.01);
+                if (st_random() > 0.5) {
+                    refAdjList_addToWeight(dAL, node1, node2, 1.0);
+                }
+            }
+        }
+        reference *ref = reference_construct(nodeNumber);
+        for (int64_t i = 0; i < intervalNumber; i++) {
+            reference_makeNewInterval(ref, -(2 * i + 1), 2 * i + 2);
+        }
+        for (int64_t node = intervalNumber * 2 + 1; node <= nodeNumber; node++) {
+            reference_insertNode(ref, -(2 * st_randomInt(0, intervalNumber) + 1), st_random() > 0.5 ? node : -node);
+        }
+        double initialScore = getReferenceScore(aL, ref);
+
+        uint64_t seed = st_randomInt(0, INT32_MAX);
+        sampledReference *sR = sampledReference_construct(ref, nodeNumber, seed);
+        sampledReference_updateGreedily(sR, aL, nL, 100);
+        reference *sampledRef = sampledReference_getReference(sR);
+        double sampledScore = getReferenceScore(aL, sampledRef);
+        int64_t sampledBadAdjacencies = getBadAdjacencyCount(dAL, sampledRef);
+        CuAssertIntEquals(testCase, nodeNumber, getNodeCount(sampledRef));
+        CuAssertTrue(testCase, sampledScore >= initialScore - 1e-6 * (1.0 + initialScore));
+
+        sampledReference_nudgeGreedily(sR, dAL, aL, nL, 100, 5);
+        reference *nudgedRef = sampledReference_getReference(sR);
+        double nudgedScore = getReferenceScore(aL, nudgedRef);
+        CuAssertIntEquals(testCase, nodeNumber, getNodeCount(nudgedRef));
+        CuAssertTrue(testCase, nudgedScore >= sampledScore - 1e-6 * (1.0 + sampledScore));
+        CuAssertTrue(testCase, getBadAdjacencyCount(dAL, nudgedRef) <= sampledBadAdjacencies);
+
+        sampledReference *sR2 = sampledReference_construct(ref, nodeNumber, seed);
+        sampledReference_updateGreedily(sR2, aL, nL, 100);
+        sampledReference_nudgeGreedily(sR2, dAL, aL, nL, 100, 5);
+        reference *nudgedRef2 = sampledReference_getReference(sR2);
+        CuAssertDblEquals(testCase, nudgedScore, getReferenceScore(aL, nudgedRef2), 0.0);
+
+        reference_destruct(ref);
+        reference_destruct(sampledRef);
+        reference_destruct(nudgedRef);
+        reference_destruct(nudgedRef2);
+        sampledReference_destruct(sR);
+        sampledReference_destruct(sR2);
+        refNeighbours_destruct(nL);
+        refAdjList_destruct(aL);
+        refAdjList_destruct(dAL);
+    }
+}
+
+CuSuite *referenceSamplerTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testReferenceSampler_random);
+    return suite;
+}
@@ -101,6 +101,7 @@ void processSequence(void* destination, const char *fastaHeader, const char *str
     cap1 = cap_construct2(end1, 1, 1, sequence);
     cap2 = cap_construct2(end2, length + 2, 1, sequence);
     cap_makeAdjacent(cap1, cap2);
+    cactusDisk_setSequenceCatalogThreadName(cactusDisk, metaSequence, cap_getName(cap1));
     totalSequenceNumber++;
 }
 
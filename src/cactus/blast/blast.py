@@ -343,7 +343,8 @@ class TrimAndRecurseOnOutgroups(RoundedJob):
         for ingroupSequence, ingroupName in zip(untrimmedSequenceFiles, self.ingroupNames):
             ingroupCoverageFile = fileStore.getLocalTempFile()
             calculateCoverage(sequenceFile=ingroupSequence, cigarFile=outgroupResultsFile,
-                              outputFile=ingroupCoverageFile, depthById=self.blastOptions.trimOutgroupDepth > 1)
+                              outputFile=ingroupCoverageFile, depthById=self.blastOptions.trimOutgroupDepth > 1,
+                              threads=self.cores)
             ingroupCoverageFiles.append(ingroupCoverageFile)
             self.ingroupCoverageIDs.append(fileStore.writeGlobalFile(ingroupCoverageFile))
             fileStore.logToMaster("Cumulative coverage of %d outgroups on ingroup %s: %s" % (self.outgroupNumber, ingroupName, percentCoverage(ingroupSequence, ingroupCoverageFile)))
@@ -541,7 +542,7 @@ def percentCoverage(sequenceFile, coverageFile):
         return 0
     return 100*float(coverage)/sequenceLen
 
-def calculateCoverage(sequenceFile, cigarFile, outputFile, fromGenome=None, depthById=False, work_dir=None):
+def calculateCoverage(sequenceFile, cigarFile, outputFile, fromGenome=None, depthById=False, threads=None, work_dir=None):
     logger.info("Calculating coverage of cigar file %s on %s, writing to %s" % (
         cigarFile, sequenceFile, outputFile))
     args = [sequenceFile, cigarFile]
@@ -552,6 +553,8 @@ def calculateCoverage(sequenceFile, cigarFile, outputFile, fromGenome=None, dept
         args += ["--from", fromGenome]
     if depthById:
         args += ["--depthById"]
+    if threads is not None and int(threads) > 1:
+        args += ["--threads", str(int(threads))]
     cactus_call(outfile=outputFile, work_dir=work_dir,
                 parameters=["cactus_coverage"] + args)
 
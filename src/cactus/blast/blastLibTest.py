@@ -0,0 +1,19 @@
+#!/usr/bin/env python3
+
+#Copyright (C) 2009-2018 by Benedict Paten (benedictpaten@gmail.com)
+#
+#Released under the MIT license, see LICENSE.txt
+import unittest
+
+from sonLib.bioio import getLogLevelString
+
+from cactus.shared.common import cactus_call
+
+class TestCase(unittest.TestCase):
+    def testBlastLibFunctions(self):
+        """Run all the CuTests, fail if any of them fail.
+        """
+        cactus_call(parameters=["blastLibTests", getLogLevelString()])
+
+if __name__ == '__main__':
+    unittest.main()
@@ -154,8 +154,8 @@ class TestCase(unittest.TestCase):
         os.remove(cigarPath)
 
     @TestStatus.shortLength
-    def testCoverageCap(self):
-        """Test if a base covered by >65535 alignments is capped at 65535 depth."""
+    def testDeepCoverage(self):
+        """Test that a base covered by >65535 alignments has its full depth (the cap is now 2^32 - 1)."""
         deepCigarPath = getTempFile()
         with open(deepCigarPath, 'w') as f:
             for _ in range(65537):
@@ -163,9 +163,20 @@ class TestCase(unittest.TestCase):
         bed = cactus_call(parameters=["cactus_coverage", self.simpleFastaPathA, deepCigarPath],
                           check_output=True)
         self.assertEqual(bed, dedent('''\
-        id=0|simpleSeqA1\t9\t10\t\t65535
+        id=0|simpleSeqA1\t9\t10\t\t65537
         '''))
         os.remove(deepCigarPath)
 
+    @TestStatus.shortLength
+    def testThreads(self):
+        """Test that the output is the same, in the same order, with several threads."""
+        for fastaPath in [self.simpleFastaPathA, self.simpleFastaPathB]:
+            for options in [[], ["--depthById"]]:
+                bed = cactus_call(parameters=["cactus_coverage"] + options + [fastaPath, self.simpleCigarPath],
+                                  check_output=True)
+                threadedBed = cactus_call(parameters=["cactus_coverage", "--threads", "4"] + options +
+                                          [fastaPath, self.simpleCigarPath], check_output=True)
+                self.assertEqual(bed, threadedBed)
+
 if __name__ == '__main__':
     unittest.main()
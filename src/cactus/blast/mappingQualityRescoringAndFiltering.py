@@ -22,6 +22,8 @@ filtering the alignments to remove lower probability alignments.
             if they overlap they have the same interval.
         - Calculate mapping qualities for each alignments and optionally filter alignments,
         for example to only keep the primary alignment: C subscript: cactus_calculateMappingQualities
+- The steps are run as stages of a single process, cactus_blast_processAlignments, which passes the alignments
+  between them in memory. The mapping qualities of independent sites are calculated on the job's cores.
 
 """
 from cactus.shared.common import cactus_call
@@ -45,14 +47,14 @@ def mappingQualityRescoring(job, inputAlignmentFileID,
     assert maxAlignmentsPerSite >= 1
     tempAlignmentFiles = [job.fileStore.getLocalTempFile() for i in range(maxAlignmentsPerSite)]
 
-    # Mirror and orient alignments, sort, split overlaps and calculate mapping qualities
-    cactus_call(parameters=[["cat", inputAlignmentFile],
-                            ["cactus_mirrorAndOrientAlignments", logLevel],
-                            ["sort", "-T{}".format(job.fileStore.getLocalTempDir()), "-k6,6", "-k7,7n", "-k8,8n"], # This sorts by coordinate
-                            ["uniq"], # This eliminates any annoying duplicates if lastz reports the alignment in both orientations
-                            ["cactus_splitAlignmentOverlaps", logLevel],
-                            ["cactus_calculateMappingQualities", logLevel, str(maxAlignmentsPerSite),
-                             str(minimumMapQValue), str(alpha)] + tempAlignmentFiles])
+    # Mirror and orient alignments, sort, split overlaps and calculate mapping qualities, in one process
+    cactus_call(parameters=["cactus_blast_processAlignments", "--logLevel", logLevel,
+                            "--input", inputAlignmentFile,
+                            "--maxAlignmentsPerSite", str(maxAlignmentsPerSite),
+                            "--minimumMapQValue", str(minimumMapQValue),
+                            "--alpha", str(alpha),
+                            "--tempDir", job.fileStore.getLocalTempDir(),
+                            "--threads", str(max(1, int(job.cores)))] + tempAlignmentFiles)
 
     # Merge together the output files in order
     secondaryTempAlignmentFile = job.fileStore.getLocalTempFile()
@@ -307,16 +307,54 @@ class TestCase(unittest.TestCase):
         with open(self.simpleInputCigarPath, 'w') as fH:
             fH.write("\n".join(self.sortedNonOverlappingInputCigars) + "\n")
 
-        cactus_call(parameters=[ "cactus_calculateMappingQualities",
-                                 self.logLevelString,
-                                 '1', '0', "1.0",
-                                 self.simpleOutputCigarPath,
-                                 self.simpleInputCigarPath ])
+        # The output must not depend on the number of threads
+        for threads in [ "1", "4" ]:
+            cactus_call(parameters=[ "cactus_calculateMappingQualities",
+                                     "--threads", threads,
+                                     self.logLevelString,
+                                     '1', '0', "1.0",
+                                     self.simpleOutputCigarPath,
+                                     self.simpleInputCigarPath ])
 
-        with open(self.simpleOutputCigarPath, 'r') as fh:
-            outputCigars = [ cigar[:-1] for cigar in fh.readlines() ] # Remove new lines
+            with open(self.simpleOutputCigarPath, 'r') as fh:
+                outputCigars = [ cigar[:-1] for cigar in fh.readlines() ] # Remove new lines
 
-        self.assertEqual(self.filteredSortedNonOverlappingInputCigars, outputCigars)
+            self.assertEqual(self.filteredSortedNonOverlappingInputCigars, outputCigars)
+
+    @TestStatus.shortLength
+    def testProcessAlignments(self):
+        """
+        Tests the fused pipeline, with a memory limit small enough that the sort spills to disk.
+        """
+        for maxMemory in [ "1000000000", "100" ]:
+            cactus_call(parameters=[ "cactus_blast_processAlignments",
+                                     "--logLevel", self.logLevelString,
+                                     "--input", self.simpleInputCigarPath,
+                                     "--maxAlignmentsPerSite", "1",
+                                     "--minimumMapQValue", "0",
+                                     "--alpha", "1.0",
+                                     "--maxMemory", maxMemory,
+                                     "--tempDir", self.tempDir,
+                                     self.simpleOutputCigarPath ])
+
+            with open(self.simpleOutputCigarPath, 'r') as fh:
+                outputCigars = [ cigar[:-1] for cigar in fh.readlines() ] # Remove new lines
+
+            self.assertEqual(self.filteredSortedNonOverlappingInputCigars, outputCigars)
+
+        # Without the other stages the output is that of cactus_mirrorAndOrientAlignments
+        cactus_call(parameters=[ "cactus_blast_processAlignments",
+                                 "--logLevel", self.logLevelString,
+                                 "--input", self.simpleInputCigarPath,
+                                 "--stages", "mirror",
+                                 self.simpleOutputCigarPath ])
+        cactus_call(parameters=[ "cactus_mirrorAndOrientAlignments",
+                                 self.logLevelString,
+                                 self.simpleInputCigarPath,
+                                 self.simpleOutputCigarPath2 ])
+
+        with open(self.simpleOutputCigarPath, 'r') as fh, open(self.simpleOutputCigarPath2, 'r') as fh2:
+            self.assertEqual(fh2.read(), fh.read())
 
     def runToilPipeline(self, alignmentsFile, alpha=0.001):
         # Tests the toil pipeline
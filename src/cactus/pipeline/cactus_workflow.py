@@ -51,6 +51,7 @@ from cactus.shared.common import runCactusReference
 from cactus.shared.common import runCactusAddReferenceCoordinates
 from cactus.shared.common import runCactusCheck
 from cactus.shared.common import runCactusHalGenerator
+from cactus.shared.common import runCactusC2hbToC2h
 from cactus.shared.common import runCactusFlowerStats
 from cactus.shared.common import runCactusSecondaryDatabase
 from cactus.shared.common import runCactusFastaGenerator
@@ -728,7 +729,7 @@ class CactusCafPhase(CactusPhasesJob):
             tempFile = fileStore.getLocalTempFile()
             system("cat %s > %s" % (" ".join(bedFiles), tempFile))
             ingroupCoverageFile = fileStore.getLocalTempFile()
-            runConvertAlignmentsToInternalNames(self.cactusWorkflowArguments.cactusDiskDatabaseString, tempFile, ingroupCoverageFile, self.topFlowerName, isBedFile=True)
+            runConvertAlignmentsToInternalNames(self.cactusWorkflowArguments.cactusDiskDatabaseString, tempFile, ingroupCoverageFile, isBedFile=True)
             self.cactusWorkflowArguments.ingroupCoverageID = fileStore.writeGlobalFile(ingroupCoverageFile)
 
         if (not self.cactusWorkflowArguments.configWrapper.getDoTrimStrategy()) or (self.cactusWorkflowArguments.outgroupEventNames == None):
@@ -748,7 +749,7 @@ class CactusCafPhase(CactusPhasesJob):
         # Primary alignments first
         alignmentsFile = fileStore.readGlobalFile(self.cactusWorkflowArguments.alignmentsID)
         convertedAlignmentsFile = fileStore.getLocalTempFile()
-        runConvertAlignmentsToInternalNames(cactusDiskString=self.cactusWorkflowArguments.cactusDiskDatabaseString, alignmentsFile=alignmentsFile, outputFile=convertedAlignmentsFile, flowerName=self.topFlowerName)
+        runConvertAlignmentsToInternalNames(cactusDiskString=self.cactusWorkflowArguments.cactusDiskDatabaseString, alignmentsFile=alignmentsFile, outputFile=convertedAlignmentsFile)
         fileStore.logToMaster("Converted headers of cigar file %s to internal names, new file %s" % (self.cactusWorkflowArguments.alignmentsID, convertedAlignmentsFile))
         self.cactusWorkflowArguments.alignmentsID = fileStore.writeGlobalFile(convertedAlignmentsFile, cleanup=True)
 
@@ -756,7 +757,7 @@ class CactusCafPhase(CactusPhasesJob):
         if self.cactusWorkflowArguments.secondaryAlignmentsID != None:
             secondaryAlignmentsFile = fileStore.readGlobalFile(self.cactusWorkflowArguments.secondaryAlignmentsID)
             convertedAlignmentsFile = fileStore.getLocalTempFile()
-            runConvertAlignmentsToInternalNames(cactusDiskString=self.cactusWorkflowArguments.cactusDiskDatabaseString, alignmentsFile=secondaryAlignmentsFile, outputFile=convertedAlignmentsFile, flowerName=self.topFlowerName)
+            runConvertAlignmentsToInternalNames(cactusDiskString=self.cactusWorkflowArguments.cactusDiskDatabaseString, alignmentsFile=secondaryAlignmentsFile, outputFile=convertedAlignmentsFile)
             fileStore.logToMaster("Converted headers of secondary cigar file %s to internal names, new file %s" % (self.cactusWorkflowArguments.secondaryAlignmentsID, convertedAlignmentsFile))
             self.cactusWorkflowArguments.secondaryAlignmentsID = fileStore.writeGlobalFile(convertedAlignmentsFile, cleanup=True)
 
@@ -923,7 +924,8 @@ def runBarForJob(self, fileStore=None, features=None, calculateWhichEndsToComput
                  partialOrderAlignmentWindow=self.getOptionalPhaseAttrib("partialOrderAlignmentWindow", int),
                  partialOrderAlignmentMaskFilter=self.getOptionalPhaseAttrib("partialOrderAlignmentMaskFilter", int),
                  partialOrderAlignmentBandConstant=self.getOptionalPhaseAttrib("partialOrderAlignmentBandConstant", int),
-                 partialOrderAlignmentBandFraction=self.getOptionalPhaseAttrib("partialOrderAlignmentBandFraction", float))
+                 partialOrderAlignmentBandFraction=self.getOptionalPhaseAttrib("partialOrderAlignmentBandFraction", float),
+                 threads=self.cores)
 
 class CactusBarWrapper(CactusRecursionJob):
     """Runs the BAR algorithm implementation.
@@ -1221,6 +1223,7 @@ class CactusReferenceWrapper(CactusRecursionJob):
                        flowerNames=self.flowerNames,
                        matchingAlgorithm=self.getOptionalPhaseAttrib("matchingAlgorithm"),
                        permutations=self.getOptionalPhaseAttrib("permutations", int),
+                       samplingChains=self.getOptionalPhaseAttrib("samplingChains", int),
                        referenceEventString=exp.getRootGenome(),
                        useSimulatedAnnealing=self.getOptionalPhaseAttrib("useSimulatedAnnealing", bool),
                        theta=self.getOptionalPhaseAttrib("theta", float),
@@ -1230,7 +1233,8 @@ class CactusReferenceWrapper(CactusRecursionJob):
                        wiggle=self.getOptionalPhaseAttrib("wiggle", float),
                        numberOfNs=self.getOptionalPhaseAttrib("numberOfNs", int),
                        minNumberOfSequencesToSupportAdjacency=self.getOptionalPhaseAttrib("minNumberOfSequencesToSupportAdjacency", int),
-                       makeScaffolds=self.getOptionalPhaseAttrib("makeScaffolds", bool))
+                       makeScaffolds=self.getOptionalPhaseAttrib("makeScaffolds", bool),
+                       threads=self.cores)
 
 class CactusReferenceRecursion2(CactusRecursionJob):
     memoryPoly = [2e+09]
@@ -1426,6 +1430,7 @@ class CactusHalGeneratorUpWrapper(CactusRecursionJob):
     memoryPoly = [4e+09]
 
     def run(self, fileStore):
+        binary = self.getOptionalPhaseAttrib("binary", bool, default=True)
         if self.getOptionalPhaseAttrib("outputFile"):
             tmpHal = fileStore.getLocalTempFile()
         else:
@@ -1439,7 +1444,15 @@ class CactusHalGeneratorUpWrapper(CactusRecursionJob):
                               referenceEventString=self.cactusWorkflowArguments.experimentWrapper.getRootGenome(),
                               outputFile=tmpHal,
                               showOnlySubstitutionsWithRespectToReference=\
-                              self.getOptionalPhaseAttrib("showOnlySubstitutionsWithRespectToReference", bool))
+                              self.getOptionalPhaseAttrib("showOnlySubstitutionsWithRespectToReference", bool),
+                              binary=binary,
+                              threads=self.cores)
+        if tmpHal and binary:
+            # Decode the .c2hb file into the .c2h text that cactus2hal reads
+            tmpC2h = fileStore.getLocalTempFile()
+            runCactusC2hbToC2h(tmpHal, tmpC2h, jobName=self.__class__.__name__,
+                               features=self.featuresFn(), fileStore=fileStore)
+            tmpHal = tmpC2h
         if tmpHal:
             # At top level--have the final .c2h file
             intermediateResultsUrl = getattr(self.cactusWorkflowArguments, 'intermediateResultsUrl', None)
@@ -270,7 +270,7 @@ def runCactusSetup(cactusDiskDatabaseString, seqMap,
     logger.info("Ran cactus setup okay")
     return [ i for i in masterMessages.split("\n") if i != '' ]
 
-def runConvertAlignmentsToInternalNames(cactusDiskString, alignmentsFile, outputFile, flowerName, isBedFile=False):
+def runConvertAlignmentsToInternalNames(cactusDiskString, alignmentsFile, outputFile, isBedFile=False):
     # keep temp files alongside data (ie in job's filestore)
     # (this should happen via cactus overriding TMPDIR in Rounded Job but maybe not always?
     #  https://github.com/ComparativeGenomicsToolkit/cactus/issues/301#issuecomment-738192236)
@@ -280,8 +280,7 @@ def runConvertAlignmentsToInternalNames(cactusDiskString, alignmentsFile, output
             "--workDir", workDir]
     if isBedFile:
         args += ["--bed"]
-    cactus_call(stdin_string=encodeFlowerNames((flowerName,)),
-                parameters=["cactus_convertAlignmentsToInternalNames"] + args)
+    cactus_call(parameters=["cactus_convertAlignmentsToInternalNames"] + args)
 
 def runStripUniqueIDs(cactusDiskString):
     cactus_call(parameters=["cactus_stripUniqueIDs", "--cactusDisk", cactusDiskString])
@@ -509,6 +508,7 @@ def runCactusBar(cactusDiskDatabaseString, flowerNames, logLevel=None,
                  partialOrderAlignmentMaskFilter=None,
                  partialOrderAlignmentBandConstant=None,
                  partialOrderAlignmentBandFraction=None,
+                 threads=None,
                  jobName=None,
                  fileStore=None,
                  features=None):
@@ -573,6 +573,8 @@ def runCactusBar(cactusDiskDatabaseString, flowerNames, logLevel=None,
         args += ["--partialOrderAlignmentBandConstant", str(partialOrderAlignmentBandConstant)]
     if partialOrderAlignmentBandFraction:
         args += ["--partialOrderAlignmentBandFraction", str(partialOrderAlignmentBandFraction)]
+    if threads is not None and int(threads) > 1:
+        args += ["--threads", str(int(threads))]
         
     masterMessages = cactus_call(stdin_string=flowerNames, check_output=True,
                                  parameters=["cactus_bar"] + args,
@@ -590,6 +592,7 @@ def runCactusReference(cactusDiskDatabaseString, flowerNames, logLevel=None,
                        matchingAlgorithm=None,
                        referenceEventString=None,
                        permutations=None,
+                       samplingChains=None,
                        useSimulatedAnnealing=False,
                        theta=None,
                        phi=None,
@@ -598,7 +601,8 @@ def runCactusReference(cactusDiskDatabaseString, flowerNames, logLevel=None,
                        wiggle=None,
                        numberOfNs=None,
                        minNumberOfSequencesToSupportAdjacency=None,
-                       makeScaffolds=False):
+                       makeScaffolds=False,
+                       threads=None):
     """Runs cactus reference."""
     logLevel = getLogLevelString2(logLevel)
     args = ["--logLevel", logLevel, "--cactusDisk", cactusDiskDatabaseString]
@@ -608,6 +612,8 @@ def runCactusReference(cactusDiskDatabaseString, flowerNames, logLevel=None,
         args += ["--referenceEventString", referenceEventString]
     if permutations is not None:
         args += ["--permutations", str(permutations)]
+    if samplingChains is not None:
+        args += ["--samplingChains", str(samplingChains)]
     if useSimulatedAnnealing:
         args += ["--useSimulatedAnnealing"]
     if theta is not None:
@@ -626,6 +632,8 @@ def runCactusReference(cactusDiskDatabaseString, flowerNames, logLevel=None,
         args += ["--minNumberOfSequencesToSupportAdjacency", str(minNumberOfSequencesToSupportAdjacency)]
     if makeScaffolds:
         args += ["--makeScaffolds"]
+    if threads is not None and int(threads) > 1:
+        args += ["--threads", str(int(threads))]
 
     masterMessages = cactus_call(stdin_string=flowerNames, check_output=True,
                                  parameters=["cactus_reference"] + args,
@@ -778,6 +786,8 @@ def runCactusHalGenerator(cactusDiskDatabaseString,
                           referenceEventString,
                           outputFile=None,
                           showOnlySubstitutionsWithRespectToReference=False,
+                          binary=True,
+                          threads=None,
                           logLevel=None,
                           jobName=None,
                           features=None,
@@ -793,10 +803,18 @@ def runCactusHalGenerator(cactusDiskDatabaseString,
         args += ["--outputFile", outputFile]
     if showOnlySubstitutionsWithRespectToReference:
         args += ["--showOnlySubstitutionsWithRespectToReference"]
+    if not binary:
+        args += ["--text"]
+    if threads is not None and int(threads) > 1:
+        args += ["--threads", str(int(threads))]
     cactus_call(stdin_string=flowerNames,
                 parameters=["cactus_halGenerator"] + args,
                 job_name=jobName, features=features, fileStore=fileStore)
 
+def runCactusC2hbToC2h(inputFile, outputFile, jobName=None, features=None, fileStore=None):
+    cactus_call(parameters=["cactus_c2hbToC2h", os.path.basename(inputFile), os.path.basename(outputFile)],
+                job_name=jobName, features=features, fileStore=fileStore)
+
 def runCactusFastaGenerator(cactusDiskDatabaseString,
                             flowerName,
                             outputFile,